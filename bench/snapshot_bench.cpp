@@ -0,0 +1,368 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <filesystem>
+#include <unistd.h>
+#include <sys/utsname.h>
+#include "../include/desktop_snapshot_api.h"
+#include "../src/icon_metadata.h"
+#include "synthetic_home.h"
+
+namespace fs = std::filesystem;
+
+// 打印帮助信息
+void printUsage(const char* progName) {
+    std::cerr << "Usage: " << progName << " [options]" << std::endl;
+    std::cerr << "在临时的合成 HOME 中反复执行 冰冻 -> 修改 -> 恢复 -> 解冻，输出 JSON 格式的结果。" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --profile small|default|large  (合成目录的规模，默认 default)" << std::endl;
+    std::cerr << "  --seed N                       (生成和修改目录树的随机种子，默认 1)" << std::endl;
+    std::cerr << "  --iterations N                 (重复次数，默认 5)" << std::endl;
+    std::cerr << "  --target desktop|home_folders|all  (默认 all)" << std::endl;
+    std::cerr << "  --jobs N                       (并行复制线程数，默认等于 CPU 核心数)" << std::endl;
+    std::cerr << "  --packed[=lz4|zstd|none]       (使用打包存储冰冻)" << std::endl;
+    std::cerr << "  --restore-mode incremental|full|checksum  (默认 incremental)" << std::endl;
+    std::cerr << "  --churn PERCENT                (每轮恢复前修改的小文件比例，默认 5)" << std::endl;
+    std::cerr << "  --dir PATH                     (临时 HOME 的上级目录，默认 $TMPDIR 或 /tmp)" << std::endl;
+    std::cerr << "  --output FILE                  (结果写入文件，默认输出到标准输出)" << std::endl;
+    std::cerr << "  --keep                         (结束后保留临时 HOME)" << std::endl;
+    std::cerr << "  --verbose                      (显示库的进度输出)" << std::endl;
+}
+
+namespace {
+
+// 丢弃库在标准输出上的进度信息，使结果可以直接被解析
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+struct Options {
+    std::string profile = "default";
+    uint64_t seed = 1;
+    int iterations = 5;
+    int jobs = 0;
+    std::vector<std::string> targets = {"desktop", "home_folders"};
+    bool packed = false;
+    int codec = SNAPSHOT_COMPRESS_LZ4;
+    int restoreMode = SNAPSHOT_RESTORE_INCREMENTAL;
+    double churn = 5.0;
+    fs::path dir;
+    std::string output;
+    bool keep = false;
+    bool verbose = false;
+};
+
+// 各目标在 HOME 中对应的目录 (不含 /usr/share/applications 等系统目录，它们只计入耗时)
+std::vector<std::string> targetDirectories(const std::string& target) {
+    if (target == "desktop") {
+        return {"Desktop", ".local/share/Trash", ".local/share/applications", ".config/dde-launcher",
+                ".config/deepin/dde-launcher", ".config/deepin/dde-dock"};
+    }
+    return {"Videos", "Pictures", "Documents", "Music"};
+}
+
+// 一次操作所涉及的数据量
+struct Dataset {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+};
+
+Dataset measureTargets(const fs::path& home, const std::vector<std::string>& targets) {
+    Dataset dataset;
+    for (const auto& target : targets) {
+        for (const auto& dir : targetDirectories(target)) {
+            std::error_code ec;
+            for (auto it = fs::recursive_directory_iterator(home / dir, ec);
+                 !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if (it->is_regular_file(ec) && !it->is_symlink(ec)) {
+                    dataset.files++;
+                    dataset.bytes += it->file_size(ec);
+                }
+            }
+        }
+    }
+    return dataset;
+}
+
+// 一种操作的全部样本
+struct OperationSamples {
+    std::string name;
+    std::vector<double> seconds;
+    uint64_t entriesChanged = 0;   // 只对恢复有意义: 各轮恢复前被修改的条目总数
+};
+
+// 最近秩法求百分位数 (samples 已排序)
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)std::max(1.0, std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+std::string number(double value, int precision) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.*f", precision, value);
+    return buf;
+}
+
+std::string distribution(std::vector<double> samples, int precision) {
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples) sum += s;
+    double mean = samples.empty() ? 0 : sum / samples.size();
+    return "{\"min\": " + number(samples.empty() ? 0 : samples.front(), precision) +
+           ", \"p50\": " + number(percentile(samples, 50), precision) +
+           ", \"p90\": " + number(percentile(samples, 90), precision) +
+           ", \"p99\": " + number(percentile(samples, 99), precision) +
+           ", \"max\": " + number(samples.empty() ? 0 : samples.back(), precision) +
+           ", \"mean\": " + number(mean, precision) + "}";
+}
+
+std::string operationJson(const OperationSamples& op, const Dataset& dataset) {
+    std::vector<double> filesPerSec;
+    std::vector<double> mbPerSec;
+    for (double s : op.seconds) {
+        double t = std::max(s, 1e-9);
+        filesPerSec.push_back(dataset.files / t);
+        mbPerSec.push_back(dataset.bytes / 1e6 / t);
+    }
+    std::string json = "{\"seconds\": " + distribution(op.seconds, 6) +
+                       ", \"files_per_sec\": " + distribution(filesPerSec, 1) +
+                       ", \"mb_per_sec\": " + distribution(mbPerSec, 2);
+    if (op.name == "restore") json += ", \"entries_changed\": " + std::to_string(op.entriesChanged);
+    return json + "}";
+}
+
+const char* restoreModeName(int mode) {
+    switch (mode) {
+        case SNAPSHOT_RESTORE_FULL: return "full";
+        case SNAPSHOT_RESTORE_CHECKSUM: return "checksum";
+        default: return "incremental";
+    }
+}
+
+const char* codecName(int codec) {
+    switch (codec) {
+        case SNAPSHOT_COMPRESS_NONE: return "none";
+        case SNAPSHOT_COMPRESS_ZSTD: return "zstd";
+        default: return "lz4";
+    }
+}
+
+// 解析命令行; 返回 false 时已打印错误
+bool parseOptions(int argc, char* argv[], Options& options) {
+    const char* tmp = std::getenv("TMPDIR");
+    options.dir = (tmp && *tmp) ? tmp : "/tmp";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+        const char* v = nullptr;
+        if (arg == "--profile") {
+            if (!(v = value("--profile"))) return false;
+            options.profile = v;
+        } else if (arg == "--seed") {
+            if (!(v = value("--seed"))) return false;
+            options.seed = std::strtoull(v, nullptr, 10);
+        } else if (arg == "--iterations") {
+            if (!(v = value("--iterations"))) return false;
+            options.iterations = std::max(1, std::atoi(v));
+        } else if (arg == "--jobs") {
+            if (!(v = value("--jobs"))) return false;
+            options.jobs = std::atoi(v);
+        } else if (arg == "--target") {
+            if (!(v = value("--target"))) return false;
+            std::string target = v;
+            if (target == "all") {
+                options.targets = {"desktop", "home_folders"};
+            } else if (target == "desktop" || target == "home_folders") {
+                options.targets = {target};
+            } else {
+                std::cerr << "Unknown target: " << target << std::endl;
+                return false;
+            }
+        } else if (arg == "--packed" || arg == "--packed=lz4") {
+            options.packed = true;
+            options.codec = SNAPSHOT_COMPRESS_LZ4;
+        } else if (arg == "--packed=zstd") {
+            options.packed = true;
+            options.codec = SNAPSHOT_COMPRESS_ZSTD;
+        } else if (arg == "--packed=none") {
+            options.packed = true;
+            options.codec = SNAPSHOT_COMPRESS_NONE;
+        } else if (arg == "--restore-mode") {
+            if (!(v = value("--restore-mode"))) return false;
+            std::string mode = v;
+            if (mode == "full") {
+                options.restoreMode = SNAPSHOT_RESTORE_FULL;
+            } else if (mode == "checksum") {
+                options.restoreMode = SNAPSHOT_RESTORE_CHECKSUM;
+            } else if (mode == "incremental") {
+                options.restoreMode = SNAPSHOT_RESTORE_INCREMENTAL;
+            } else {
+                std::cerr << "Unknown restore mode: " << mode << std::endl;
+                return false;
+            }
+        } else if (arg == "--churn") {
+            if (!(v = value("--churn"))) return false;
+            options.churn = std::max(0.0, std::atof(v));
+        } else if (arg == "--dir") {
+            if (!(v = value("--dir"))) return false;
+            options.dir = v;
+        } else if (arg == "--output") {
+            if (!(v = value("--output"))) return false;
+            options.output = v;
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else if (arg == "--verbose") {
+            options.verbose = true;
+        } else {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+double elapsedSeconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+    SyntheticHomeSpec spec;
+    if (!syntheticHomeProfile(options.profile, spec)) {
+        std::cerr << "Unknown profile: " << options.profile << std::endl;
+        return 1;
+    }
+    spec.seed = options.seed;
+
+    // 没有桌面会话: 图标位置写入内存表，不调用 gvfs，也不触发桌面刷新
+    setIconMetadataStubbed(true);
+
+    std::string pattern = (options.dir / "snapshot_bench.XXXXXX").string();
+    if (!mkdtemp(pattern.data())) {
+        std::cerr << "无法在 " << options.dir.string() << " 中创建临时目录: " << strerror(errno) << std::endl;
+        return 1;
+    }
+    fs::path workDir = pattern;
+    fs::path home = workDir / "home";
+    setenv("HOME", home.c_str(), 1);
+
+    std::cerr << "正在生成合成 HOME (" << options.profile << ", seed " << options.seed << "): " << home.string()
+              << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    SyntheticHomeStats generated;
+    if (generateSyntheticHome(home, spec, generated) != 0) {
+        if (!options.keep) fs::remove_all(workDir);
+        return 1;
+    }
+    double generateSeconds = elapsedSeconds(start);
+    Dataset dataset = measureTargets(home, options.targets);
+
+    SetWorkerCount(options.jobs);
+    SetRestoreMode(options.restoreMode);
+    if (options.packed) {
+        SetStorageMode(SNAPSHOT_STORAGE_PACKED);
+        SetPackCompression(options.codec);
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf* stdoutBuffer = std::cout.rdbuf();
+    if (!options.verbose) std::cout.rdbuf(&nullBuffer);
+
+    OperationSamples freeze{"freeze", {}, 0}, restore{"restore", {}, 0}, unfreeze{"unfreeze", {}, 0};
+    bool failed = false;
+    for (int i = 0; i < options.iterations && !failed; ++i) {
+        start = std::chrono::steady_clock::now();
+        for (const auto& target : options.targets) failed |= TakeSnapshotAndArm(target.c_str()) != 0;
+        freeze.seconds.push_back(elapsedSeconds(start));
+        if (failed) break;
+
+        restore.entriesChanged += mutateSyntheticHome(home, spec, (uint64_t)i, options.churn);
+
+        start = std::chrono::steady_clock::now();
+        for (const auto& target : options.targets) failed |= RestoreSnapshotImmediate(target.c_str()) != 0;
+        restore.seconds.push_back(elapsedSeconds(start));
+        if (failed) break;
+
+        start = std::chrono::steady_clock::now();
+        for (const auto& target : options.targets) RemoveSnapshotAndCancel(target.c_str());
+        unfreeze.seconds.push_back(elapsedSeconds(start));
+        std::cerr << "  第 " << (i + 1) << "/" << options.iterations << " 轮: 冰冻 " << number(freeze.seconds.back(), 3)
+                  << " s, 恢复 " << number(restore.seconds.back(), 3) << " s, 解冻 "
+                  << number(unfreeze.seconds.back(), 3) << " s" << std::endl;
+    }
+    if (failed) {
+        for (const auto& target : options.targets) RemoveSnapshotAndCancel(target.c_str());
+    }
+    std::cout.rdbuf(stdoutBuffer);
+
+    if (options.keep) {
+        std::cerr << "保留临时 HOME: " << home.string() << std::endl;
+    } else {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+    if (failed) {
+        std::cerr << "ERROR: 冰冻或恢复失败，未输出结果。" << std::endl;
+        return 1;
+    }
+
+    struct utsname host;
+    uname(&host);
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"benchmark\": \"snapshot_bench\",\n"
+         << "  \"version\": 1,\n"
+         << "  \"profile\": \"" << options.profile << "\",\n"
+         << "  \"seed\": " << options.seed << ",\n"
+         << "  \"iterations\": " << options.iterations << ",\n"
+         << "  \"jobs\": " << options.jobs << ",\n"
+         << "  \"targets\": [";
+    for (size_t i = 0; i < options.targets.size(); ++i) json << (i ? ", " : "") << "\"" << options.targets[i] << "\"";
+    json << "],\n"
+         << "  \"storage\": \"" << (options.packed ? std::string("packed-") + codecName(options.codec) : "blobs") << "\",\n"
+         << "  \"restore_mode\": \"" << restoreModeName(options.restoreMode) << "\",\n"
+         << "  \"churn_percent\": " << number(options.churn, 2) << ",\n"
+         << "  \"host\": {\"kernel\": \"" << host.release << "\", \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << "},\n"
+         << "  \"generated\": {\"files\": " << generated.files << ", \"bytes\": " << generated.bytes
+         << ", \"directories\": " << generated.directories << ", \"symlinks\": " << generated.symlinks
+         << ", \"icon_positions\": " << generated.iconPositions << ", \"seconds\": " << number(generateSeconds, 3)
+         << "},\n"
+         << "  \"dataset\": {\"files\": " << dataset.files << ", \"bytes\": " << dataset.bytes << "},\n"
+         << "  \"operations\": {\n"
+         << "    \"freeze\": " << operationJson(freeze, dataset) << ",\n"
+         << "    \"restore\": " << operationJson(restore, dataset) << ",\n"
+         << "    \"unfreeze\": " << operationJson(unfreeze, dataset) << "\n"
+         << "  }\n"
+         << "}\n";
+
+    if (options.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(options.output, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "无法写入 " << options.output << std::endl;
+            return 1;
+        }
+        out << json.str();
+    }
+    return 0;
+}
@@ -0,0 +1,392 @@
+#include "synthetic_home.h"
+#include "../src/icon_metadata.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 所有生成条目的 mtime 从这个时间 (2023-11-14) 起逐个递增，使目录树完全确定
+const time_t BASE_MTIME = 1700000000;
+const size_t WRITE_CHUNK = 1 << 20;
+
+// splitmix64: 简单、快速，且在各平台上结果一致
+struct Rng {
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed) {}
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    uint64_t uniform(uint64_t bound) { return bound ? next() % bound : 0; }
+};
+
+// 随机数据 (不可压缩)
+void fillRandom(Rng& rng, char* buffer, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t value = rng.next();
+        memcpy(buffer + i, &value, 8);
+    }
+    for (uint64_t value = rng.next(); i < size; ++i, value >>= 8) buffer[i] = (char)value;
+}
+
+// 重复的文本 (可压缩)，开头带一个随机数使不同文件的内容不同
+void fillText(Rng& rng, char* buffer, size_t size) {
+    static const char WORDS[] = "the quick brown fox jumps over the lazy dog 0123456789\n";
+    uint64_t salt = rng.next();
+    for (size_t i = 0; i < size; ++i) buffer[i] = WORDS[(i + salt) % (sizeof(WORDS) - 1)];
+    if (size >= 8) memcpy(buffer, &salt, 8);
+}
+
+enum class Content { Text, Random, Mixed };
+
+// 写入一个文件; Mixed 时按 1 MiB 交替写入随机数据和可压缩数据
+bool writeFile(const fs::path& path, uint64_t size, Rng& rng, Content content) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "无法创建 " << path.string() << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    std::vector<char> buffer(std::min<uint64_t>(size, WRITE_CHUNK));
+    uint64_t written = 0;
+    for (uint64_t chunk = 0; written < size; ++chunk) {
+        size_t n = (size_t)std::min<uint64_t>(size - written, WRITE_CHUNK);
+        bool random = content == Content::Random || (content == Content::Mixed && chunk % 2 == 0);
+        if (random) {
+            fillRandom(rng, buffer.data(), n);
+        } else {
+            fillText(rng, buffer.data(), n);
+        }
+        if (write(fd, buffer.data(), n) != (ssize_t)n) {
+            std::cerr << "无法写入 " << path.string() << ": " << strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+        written += n;
+    }
+    close(fd);
+    return true;
+}
+
+bool writeText(const fs::path& path, const std::string& text) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "无法创建 " << path.string() << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    bool ok = write(fd, text.data(), text.size()) == (ssize_t)text.size();
+    close(fd);
+    return ok;
+}
+
+void setMtime(const fs::path& path, time_t mtime) {
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = mtime;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    utimensat(AT_FDCWD, path.c_str(), times, AT_SYMLINK_NOFOLLOW);
+}
+
+// Documents 中第 index 个小文件的路径 (每 tinyPerDirectory 个一个目录，每 64 个目录一个上级目录)
+fs::path tinyPath(const fs::path& home, const SyntheticHomeSpec& spec, uint32_t index) {
+    uint32_t dir = index / std::max<uint32_t>(spec.tinyPerDirectory, 1);
+    return home / "Documents" / ("project-" + std::to_string(dir / 64)) / ("dir-" + std::to_string(dir)) /
+           ("file-" + std::to_string(index) + ".txt");
+}
+
+std::string trashInfo(const std::string& name) {
+    return "[Trash Info]\nPath=/home/user/Documents/" + name + "\nDeletionDate=2023-11-14T22:13:20\n";
+}
+
+// 生成过程的状态
+class Generator {
+public:
+    Generator(const fs::path& home, const SyntheticHomeSpec& spec, SyntheticHomeStats& stats)
+        : home_(home), spec_(spec), stats_(stats), rng_(spec.seed) {}
+
+    bool run() {
+        return tinyFiles() && hugeFiles() && mediumFiles() && deepNesting() && desktop() && symlinks() &&
+               trash() && launcher() && finishDirectories();
+    }
+
+private:
+    bool directory(const fs::path& path) {
+        std::error_code ec;
+        if (fs::is_directory(path, ec)) return true;
+        if (!fs::create_directories(path, ec)) {
+            std::cerr << "无法创建目录 " << path.string() << ": " << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool file(const fs::path& path, uint64_t size, Content content) {
+        if (!directory(path.parent_path()) || !writeFile(path, size, rng_, content)) return false;
+        setMtime(path, BASE_MTIME + (time_t)stats_.files);
+        stats_.files++;
+        stats_.bytes += size;
+        return true;
+    }
+
+    bool text(const fs::path& path, const std::string& content) {
+        if (!directory(path.parent_path()) || !writeText(path, content)) return false;
+        setMtime(path, BASE_MTIME + (time_t)stats_.files);
+        stats_.files++;
+        stats_.bytes += content.size();
+        return true;
+    }
+
+    bool link(const fs::path& target, const fs::path& path) {
+        std::error_code ec;
+        fs::create_symlink(target, path, ec);
+        if (ec) {
+            std::cerr << "无法创建符号链接 " << path.string() << ": " << ec.message() << std::endl;
+            return false;
+        }
+        setMtime(path, BASE_MTIME);
+        stats_.symlinks++;
+        return true;
+    }
+
+    bool tinyFiles() {
+        for (uint32_t i = 0; i < spec_.tinyFiles; ++i) {
+            if (!file(tinyPath(home_, spec_, i), rng_.uniform(spec_.tinyMaxBytes + 1ULL), Content::Text)) return false;
+        }
+        return true;
+    }
+
+    bool hugeFiles() {
+        for (uint32_t i = 0; i < spec_.hugeFiles; ++i) {
+            fs::path path = home_ / "Videos" / ("movie-" + std::to_string(i) + ".mkv");
+            if (!file(path, spec_.hugeBytes, Content::Mixed)) return false;
+        }
+        return directory(home_ / "Videos");
+    }
+
+    bool mediumFiles() {
+        for (uint32_t i = 0; i < spec_.mediumFiles; ++i) {
+            fs::path path = home_ / "Music" / ("album-" + std::to_string(i / 12)) / ("track-" + std::to_string(i) + ".flac");
+            if (!file(path, rng_.uniform(spec_.mediumMaxBytes + 1ULL), Content::Random)) return false;
+        }
+        return directory(home_ / "Music");
+    }
+
+    bool deepNesting() {
+        fs::path dir = home_ / "Pictures" / "nested";
+        for (uint32_t level = 0; level < spec_.nestingDepth; ++level) {
+            dir /= "level-" + std::to_string(level);
+            if (!file(dir / "photo.jpg", 8192, Content::Random)) return false;
+        }
+        return directory(home_ / "Pictures");
+    }
+
+    // 桌面上的文件和目录，并为每个顶层条目按网格写入图标位置
+    bool desktop() {
+        fs::path desktop = home_ / "Desktop";
+        if (!directory(desktop)) return false;
+        std::vector<IconPositionUpdate> icons;
+        auto place = [&](const std::string& name) {
+            IconPositionUpdate update;
+            size_t slot = icons.size();
+            update.name = name;
+            update.position = std::to_string(slot / 12 * 100) + "," + std::to_string(slot % 12 * 80);
+            icons.push_back(update);
+        };
+        for (uint32_t i = 0; i < spec_.desktopFiles; ++i) {
+            if (i % 20 == 0) {
+                std::string name = "folder-" + std::to_string(i / 20);
+                for (int j = 0; j < 3; ++j) {
+                    if (!file(desktop / name / ("item-" + std::to_string(j) + ".txt"), 1024, Content::Text)) return false;
+                }
+                place(name);
+            }
+            std::string name = "note-" + std::to_string(i) + ".txt";
+            if (!file(desktop / name, rng_.uniform(16384), Content::Text)) return false;
+            place(name);
+        }
+        text(desktop / "readme.desktop", "[Desktop Entry]\nType=Link\nName=Readme\nURL=file:///usr/share/doc\n");
+        place("readme.desktop");
+        stats_.iconPositions = writeIconPositions(desktop, icons);
+        return true;
+    }
+
+    // 一半在桌面 (指向桌面文件)，一半在 Documents (指向小文件)，每 10 个中有一个悬空
+    bool symlinks() {
+        for (uint32_t i = 0; i < spec_.symlinks; ++i) {
+            bool dangling = i % 10 == 9;
+            if (i % 2 == 0 && spec_.desktopFiles > 0) {
+                fs::path target = dangling ? "missing-note.txt" : "note-" + std::to_string(i % spec_.desktopFiles) + ".txt";
+                if (!link(target, home_ / "Desktop" / ("link-" + std::to_string(i)))) return false;
+            } else if (spec_.tinyFiles > 0) {
+                fs::path links = home_ / "Documents" / "links";
+                fs::path target = dangling ? fs::path("/nonexistent/file")
+                                           : tinyPath(home_, spec_, i % spec_.tinyFiles).lexically_relative(links);
+                if (!directory(links)) return false;
+                if (!link(target, links / ("link-" + std::to_string(i)))) return false;
+            }
+        }
+        return true;
+    }
+
+    bool trash() {
+        fs::path trash = home_ / ".local/share/Trash";
+        if (!directory(trash / "files") || !directory(trash / "info")) return false;
+        for (uint32_t i = 0; i < spec_.trashItems; ++i) {
+            std::string name = "trashed-" + std::to_string(i) + ".dat";
+            if (!file(trash / "files" / name, rng_.uniform(65536), Content::Random)) return false;
+            if (!text(trash / "info" / (name + ".trashinfo"), trashInfo(name))) return false;
+        }
+        return true;
+    }
+
+    bool launcher() {
+        fs::path applications = home_ / ".local/share/applications";
+        for (uint32_t i = 0; i < spec_.applicationEntries; ++i) {
+            std::string id = "app-" + std::to_string(i);
+            if (!text(applications / (id + ".desktop"),
+                      "[Desktop Entry]\nType=Application\nName=App " + std::to_string(i) +
+                          "\nExec=/usr/bin/true\nIcon=" + id + "\nCategories=Utility;\n")) {
+                return false;
+            }
+        }
+        return directory(applications) &&
+               text(home_ / ".config/dde-launcher/launcher.conf", "[General]\nmode=fullscreen\n") &&
+               text(home_ / ".config/deepin/dde-dock/dock.conf", "[General]\nposition=bottom\n");
+    }
+
+    // 目录的 mtime 在所有子条目写完后统一设置
+    bool finishDirectories() {
+        std::error_code ec;
+        std::vector<fs::path> dirs;
+        for (auto it = fs::recursive_directory_iterator(home_, ec); !ec && it != fs::recursive_directory_iterator();
+             it.increment(ec)) {
+            if (it->is_directory(ec) && !it->is_symlink(ec)) dirs.push_back(it->path());
+        }
+        if (ec) {
+            std::cerr << "无法遍历 " << home_.string() << ": " << ec.message() << std::endl;
+            return false;
+        }
+        for (const auto& dir : dirs) setMtime(dir, BASE_MTIME);
+        stats_.directories = dirs.size();
+        return true;
+    }
+
+    fs::path home_;
+    const SyntheticHomeSpec& spec_;
+    SyntheticHomeStats& stats_;
+    Rng rng_;
+};
+
+} // namespace
+
+bool syntheticHomeProfile(const std::string& name, SyntheticHomeSpec& spec) {
+    spec = SyntheticHomeSpec();
+    if (name == "default") return true;
+    if (name == "small") {
+        spec.tinyFiles = 2000;
+        spec.hugeFiles = 2;
+        spec.hugeBytes = 16ULL << 20;
+        spec.mediumFiles = 24;
+        spec.mediumMaxBytes = 256 << 10;
+        spec.nestingDepth = 32;
+        spec.desktopFiles = 40;
+        spec.symlinks = 40;
+        spec.trashItems = 50;
+        spec.applicationEntries = 50;
+        return true;
+    }
+    if (name == "large") {
+        spec.tinyFiles = 200000;
+        spec.hugeFiles = 4;
+        spec.hugeBytes = 1ULL << 30;
+        spec.mediumFiles = 2000;
+        spec.nestingDepth = 128;
+        spec.desktopFiles = 500;
+        spec.symlinks = 2000;
+        spec.trashItems = 5000;
+        spec.applicationEntries = 1000;
+        return true;
+    }
+    return false;
+}
+
+int generateSyntheticHome(const fs::path& home, const SyntheticHomeSpec& spec, SyntheticHomeStats& stats) {
+    stats = SyntheticHomeStats();
+    std::error_code ec;
+    if (fs::exists(home, ec) && !fs::is_empty(home, ec)) {
+        std::cerr << "合成目录必须为空: " << home.string() << std::endl;
+        return -1;
+    }
+    Generator generator(home, spec, stats);
+    return generator.run() ? 0 : -1;
+}
+
+uint64_t mutateSyntheticHome(const fs::path& home, const SyntheticHomeSpec& spec, uint64_t round,
+                             double churnPercent) {
+    Rng rng(spec.seed ^ (0x5851f42d4c957f2dULL * (round + 1)));
+    uint64_t changed = 0;
+    std::error_code ec;
+
+    // 小文件: 依次改写、删除、新增
+    uint64_t count = (uint64_t)(spec.tinyFiles * churnPercent / 100.0);
+    for (uint64_t k = 0; k < count; ++k) {
+        fs::path path = tinyPath(home, spec, (uint32_t)rng.uniform(spec.tinyFiles));
+        switch (k % 3) {
+            case 0:
+                if (fs::exists(path, ec) && writeFile(path, rng.uniform(spec.tinyMaxBytes + 1ULL), rng, Content::Text)) {
+                    changed++;
+                }
+                break;
+            case 1:
+                if (fs::remove(path, ec)) changed++;
+                break;
+            default: {
+                fs::path added = path.parent_path() / ("added-" + std::to_string(round) + "-" + std::to_string(k) + ".txt");
+                if (fs::is_directory(path.parent_path(), ec) && writeFile(added, 512, rng, Content::Text)) changed++;
+                break;
+            }
+        }
+    }
+
+    // 大文件: 原地改写中间的 64 KiB (大小不变，mtime 变化)
+    std::vector<char> patch(64 << 10);
+    for (uint32_t i = 0; i < spec.hugeFiles; ++i) {
+        fs::path path = home / "Videos" / ("movie-" + std::to_string(i) + ".mkv");
+        int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        fillRandom(rng, patch.data(), patch.size());
+        off_t offset = (off_t)(spec.hugeBytes / 2);
+        if (spec.hugeBytes >= patch.size() && pwrite(fd, patch.data(), patch.size(), offset) == (ssize_t)patch.size()) {
+            changed++;
+        }
+        close(fd);
+    }
+
+    // 回收站: 清空一部分，再放入新的条目
+    fs::path trash = home / ".local/share/Trash";
+    uint32_t emptied = (uint32_t)(spec.trashItems * churnPercent / 100.0);
+    for (uint32_t i = 0; i < emptied; ++i) {
+        std::string name = "trashed-" + std::to_string(i) + ".dat";
+        if (fs::remove(trash / "files" / name, ec)) changed++;
+        fs::remove(trash / "info" / (name + ".trashinfo"), ec);
+    }
+    for (uint32_t i = 0; i < emptied; ++i) {
+        std::string name = "new-" + std::to_string(round) + "-" + std::to_string(i) + ".dat";
+        if (writeFile(trash / "files" / name, 4096, rng, Content::Random) &&
+            writeText(trash / "info" / (name + ".trashinfo"), trashInfo(name))) {
+            changed++;
+        }
+    }
+
+    // 桌面: 新建一个文件并删除一个链接
+    if (writeText(home / "Desktop" / ("untitled-" + std::to_string(round) + ".txt"), "draft\n")) changed++;
+    if (fs::remove(home / "Desktop" / "link-0", ec)) changed++;
+    return changed;
+}
@@ -0,0 +1,71 @@
+#ifndef SYNTHETIC_HOME_H
+#define SYNTHETIC_HOME_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+/**
+ * 基准测试用的合成 HOME 目录。相同的规格和种子总是生成完全相同的目录树
+ * (内容、权限和 mtime 均确定)，便于在不同机器和不同版本之间比较结果。
+ *
+ * 生成的内容覆盖冰冻和恢复的各种路径:
+ *  - Documents: 大量小文件，分布在多层子目录中
+ *  - Videos: 少数几个大文件 (一半随机数据、一半可压缩数据)
+ *  - Pictures: 一条很深的嵌套目录链
+ *  - Music: 中等大小的文件
+ *  - Desktop: 普通文件、目录和符号链接 (含悬空链接)，并记录图标位置
+ *  - .local/share/Trash: 带 .trashinfo 的回收站条目
+ *  - .local/share/applications 和 .config/dde-launcher: 启动器条目和配置
+ */
+
+// 合成目录的规格
+struct SyntheticHomeSpec {
+    uint64_t seed = 1;
+    uint32_t tinyFiles = 20000;         // Documents 中的小文件数
+    uint32_t tinyMaxBytes = 4096;       // 小文件的最大字节数
+    uint32_t tinyPerDirectory = 64;     // 每个子目录中的小文件数
+    uint32_t hugeFiles = 3;             // Videos 中的大文件数
+    uint64_t hugeBytes = 256ULL << 20;  // 每个大文件的字节数
+    uint32_t mediumFiles = 200;         // Music 中的中等文件数
+    uint32_t mediumMaxBytes = 1 << 20;
+    uint32_t nestingDepth = 64;         // Pictures 中嵌套目录的层数
+    uint32_t desktopFiles = 200;
+    uint32_t symlinks = 200;            // Desktop 和 Documents 中的符号链接数
+    uint32_t trashItems = 500;
+    uint32_t applicationEntries = 300;  // .local/share/applications 中的 .desktop 条目数
+};
+
+// 生成结果的统计 (只统计普通文件的内容)
+struct SyntheticHomeStats {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    uint64_t directories = 0;
+    uint64_t symlinks = 0;
+    uint64_t iconPositions = 0;
+};
+
+/**
+ * @brief 按名称取得预设规格: "small" (几秒内完成，适合 CI)、"default"、"large"。
+ * @return false 表示名称未知。
+ */
+bool syntheticHomeProfile(const std::string& name, SyntheticHomeSpec& spec);
+
+/**
+ * @brief 在 home (必须为空或不存在) 下生成合成目录树，并为桌面条目写入图标位置。
+ * @return 0 表示成功, -1 表示失败。
+ */
+int generateSyntheticHome(const std::filesystem::path& home, const SyntheticHomeSpec& spec,
+                          SyntheticHomeStats& stats);
+
+/**
+ * @brief 确定性地修改目录树，模拟一次会话中的使用: 改写、删除和新增约 churnPercent% 的小文件，
+ *        改写每个大文件中间的一段数据，清空并重新填入部分回收站条目。
+ * @param round 第几轮修改 (不同轮次修改不同的文件)。
+ * @return 被修改、删除或新增的条目数。
+ */
+uint64_t mutateSyntheticHome(const std::filesystem::path& home, const SyntheticHomeSpec& spec,
+                             uint64_t round, double churnPercent);
+
+#endif // SYNTHETIC_HOME_H
@@ -6,6 +6,95 @@
 extern "C" {
 #endif
 
+// ----- 恢复模式 (用于 SetRestoreMode) -----
+#define SNAPSHOT_RESTORE_FULL        0  // 清空后全量复制 (旧行为)
+#define SNAPSHOT_RESTORE_INCREMENTAL 1  // 只复制变化/缺失的条目，只删除多余条目 (默认)
+#define SNAPSHOT_RESTORE_CHECKSUM    2  // 同上，并在大小和 mtime 一致时额外比较内容哈希
+
+// ----- 物化方式 (用于 SetMaterializeMode) -----
+#define SNAPSHOT_MATERIALIZE_COPY     0  // 从 blob 存储复制文件 (默认)
+#define SNAPSHOT_MATERIALIZE_HARDLINK 1  // 硬链接到 blob (跨文件系统时退回复制)
+
+// ----- 存储方式 (用于 SetStorageMode) -----
+#define SNAPSHOT_STORAGE_BLOBS  0  // 每个文件存为共享 blob 存储中的一个对象 (默认)
+#define SNAPSHOT_STORAGE_PACKED 1  // 目标的全部文件写入快照目录中的少数几个容器文件
+
+// ----- 容器压缩方式 (用于 SetPackCompression) -----
+#define SNAPSHOT_COMPRESS_NONE 0
+#define SNAPSHOT_COMPRESS_LZ4  1  // 默认
+#define SNAPSHOT_COMPRESS_ZSTD 2  // 需在编译时开启 DESKSNAPSHOT_WITH_ZSTD，否则退回 LZ4
+
+// ----- 登录恢复各阶段的状态 (用于 SnapshotRestoreProgress) -----
+#define SNAPSHOT_STAGE_IDLE    0  // 本次无需执行 (未开启恢复，或已在会话结束时完成)
+#define SNAPSHOT_STAGE_PENDING 1  // 等待执行
+#define SNAPSHOT_STAGE_RUNNING 2
+#define SNAPSHOT_STAGE_DONE    3
+#define SNAPSHOT_STAGE_FAILED  4
+
+// ----- 异步操作的状态 (用于 SnapshotOperationProgress) -----
+#define SNAPSHOT_OP_QUEUED    0  // 等待前面提交的操作完成
+#define SNAPSHOT_OP_RUNNING   1
+#define SNAPSHOT_OP_SUCCEEDED 2
+#define SNAPSHOT_OP_FAILED    3
+#define SNAPSHOT_OP_CANCELLED 4  // 已取消 (冰冻取消时保留上一份快照)
+
+// ----- 异步操作的阶段 (用于 SnapshotOperationProgress) -----
+#define SNAPSHOT_PHASE_PREPARING 0  // 读取清单、创建暂存目录
+#define SNAPSHOT_PHASE_SCANNING  1  // 枚举要冰冻的目录
+#define SNAPSHOT_PHASE_COPYING   2  // 写入快照或恢复文件
+#define SNAPSHOT_PHASE_FINISHING 3  // 写入清单、发布快照、恢复图标位置
+
+/**
+ * 登录恢复的进度。桌面 (启动器配置、桌面文件和图标位置) 最先在前台恢复，
+ * 完成后即标记桌面就绪；回收站和用户文件夹随后在后台以空闲 I/O 优先级恢复。
+ */
+typedef struct {
+    int desktop;                      // SNAPSHOT_STAGE_*
+    int trash;
+    int homeFolders;
+    int desktopReady;                 // 1 表示桌面已可使用
+    int finished;                     // 1 表示全部阶段已结束
+    unsigned long long filesCopied;   // 当前阶段已复制的文件数
+    unsigned long long bytesCopied;   // 当前阶段已复制的字节数
+    long long updatedAt;              // 状态最后更新的时间 (Unix 秒)，可用于判断恢复进程是否已退出
+} SnapshotRestoreProgress;
+
+/**
+ * 一个目标的快照状态。条目数、文件数和字节数来自快照清单，库内按清单缓存，
+ * 快照未变化时查询只需几次 stat。
+ */
+typedef struct {
+    int exists;                       // 1 表示存在快照
+    int armed;                        // 1 表示已开启下次登录时恢复
+    int packed;                       // 1 表示快照为打包存储
+    unsigned long long entries;       // 清单中的条目数 (文件、目录和符号链接)
+    unsigned long long files;         // 普通文件数
+    unsigned long long bytes;         // 普通文件的总字节数
+    long long frozenAt;               // 冰冻时间 (Unix 秒)，没有快照时为 0
+} SnapshotInfo;
+
+// 异步操作的句柄 (不透明)
+typedef struct SnapshotOperation SnapshotOperation;
+
+/**
+ * 异步操作的进度。总量随冰冻时逐个目录的枚举而增长，恢复时在处理每个分区前加入该分区的全部文件;
+ * 已处理的文件包括实际写入的文件和确认未变化而跳过的文件。
+ */
+typedef struct {
+    int state;                        // SNAPSHOT_OP_*
+    int phase;                        // SNAPSHOT_PHASE_*
+    unsigned long long filesDone;
+    unsigned long long filesTotal;
+    unsigned long long bytesDone;
+    unsigned long long bytesTotal;
+} SnapshotOperationProgress;
+
+/**
+ * @brief 异步操作的进度回调。在库内部的线程上调用 (不会并发调用)，应尽快返回。
+ *        运行期间最多每 100 毫秒调用一次，阶段变化时和操作结束时 (state 为最终状态) 总会调用。
+ */
+typedef void (*SnapshotProgressCallback)(const SnapshotOperationProgress* progress, void* userData);
+
 /**
  * @brief 为指定目标创建快照，并设置一个标志以便在下次启动时自动恢复。
  * @param target 快照目标, e.g., "desktop" 或 "home_folders".
@@ -14,7 +103,7 @@ extern "C" {
 int TakeSnapshotAndArm(const char* target);
 
 /**
- * @brief 移除指定目标的快照数据，并取消其未来的所有自动恢复。
+ * @brief 移除指定目标的快照数据 (包括全部的代)，并取消其未来的所有自动恢复。
  * @param target 快照目标, e.g., "desktop" 或 "home_folders".
  */
 void RemoveSnapshotAndCancel(const char* target);
@@ -33,12 +122,228 @@ int IsRestoreArmed(const char* target);
  */
 int RestoreSnapshotImmediate(const char* target);
 
+/**
+ * @brief 把指定目标恢复到快照的某一代。该代随即成为当前代，之后的恢复 (包括登录时的自动恢复) 都使用它。
+ * @param target 快照目标, e.g., "desktop" 或 "home_folders".
+ * @param generation 代的名称 (见 ListSnapshotGenerations)，NULL 或空字符串表示当前代 (同 RestoreSnapshotImmediate)。
+ * @return 0 表示成功, -1 表示失败 (包括该代不存在)。
+ */
+int RestoreSnapshotGeneration(const char* target, const char* generation);
+
+/**
+ * @brief 删除指定目标快照中的一代 (当前代只能随 RemoveSnapshotAndCancel 一起删除)。
+ * @return 0 表示成功, -1 表示该代不存在或是当前代。
+ */
+int RemoveSnapshotGeneration(const char* target, const char* generation);
+
+/**
+ * @brief 异步执行 TakeSnapshotAndArm。操作在库内部的线程上按提交顺序逐个执行。
+ * @param target 快照目标, e.g., "desktop" 或 "home_folders".
+ * @param callback 进度回调，可为 NULL。
+ * @param userData 原样传给回调。
+ * @return 操作句柄，必须由 ReleaseSnapshotOperation 释放。
+ */
+SnapshotOperation* TakeSnapshotAndArmAsync(const char* target, SnapshotProgressCallback callback, void* userData);
+
+/**
+ * @brief 异步执行 RestoreSnapshotImmediate，参数和返回值同 TakeSnapshotAndArmAsync。
+ */
+SnapshotOperation* RestoreSnapshotAsync(const char* target, SnapshotProgressCallback callback, void* userData);
+
+/**
+ * @brief 异步执行 RestoreSnapshotGeneration，其余参数和返回值同 TakeSnapshotAndArmAsync。
+ */
+SnapshotOperation* RestoreSnapshotGenerationAsync(const char* target, const char* generation,
+                                                  SnapshotProgressCallback callback, void* userData);
+
+/**
+ * @brief 异步执行 RemoveSnapshotAndCancel，参数和返回值同 TakeSnapshotAndArmAsync。
+ */
+SnapshotOperation* RemoveSnapshotAsync(const char* target, SnapshotProgressCallback callback, void* userData);
+
+/**
+ * @brief 请求取消操作。尚未开始的操作立即结束; 正在执行的冰冻放弃新快照并保留上一份，
+ *        正在执行的恢复停止复制剩余的文件 (全量恢复时目标目录保持原样)。
+ */
+void CancelSnapshotOperation(SnapshotOperation* operation);
+
+/**
+ * @brief 查询操作的当前进度。
+ * @param progress 输出的进度，可为 NULL。
+ * @return 操作的状态 (SNAPSHOT_OP_*)。
+ */
+int PollSnapshotOperation(SnapshotOperation* operation, SnapshotOperationProgress* progress);
+
+/**
+ * @brief 等待操作结束。
+ * @param timeoutMs 最长等待的毫秒数，负数表示一直等待。
+ * @return 等待结束时操作的状态 (超时返回 SNAPSHOT_OP_QUEUED 或 SNAPSHOT_OP_RUNNING)。
+ */
+int WaitSnapshotOperation(SnapshotOperation* operation, int timeoutMs);
+
+/**
+ * @brief 释放操作句柄。操作仍在进行时先取消并等待其结束，返回后不会再调用其进度回调。
+ */
+void ReleaseSnapshotOperation(SnapshotOperation* operation);
+
+/**
+ * @brief 设置后续恢复操作使用的模式。
+ *        增量模式按类型、大小、mtime、权限和链接目标比较实时目录与快照，
+ *        恢复耗时与变化量成正比，而不是与快照大小成正比。
+ * @param mode SNAPSHOT_RESTORE_FULL / SNAPSHOT_RESTORE_INCREMENTAL / SNAPSHOT_RESTORE_CHECKSUM。
+ */
+void SetRestoreMode(int mode);
+
+/**
+ * @brief 设置恢复时从快照存储物化文件的方式。
+ *        硬链接方式几乎不产生写入，但恢复出的文件与存储中的对象共享 inode，
+ *        原地修改会影响快照内容，只适合不会被原地改写的数据。
+ * @param mode SNAPSHOT_MATERIALIZE_COPY / SNAPSHOT_MATERIALIZE_HARDLINK。
+ */
+void SetMaterializeMode(int mode);
+
+/**
+ * @brief 设置恢复前是否先校验快照 (见 VerifySnapshot，同一进程中每份快照只校验一次)。
+ *        开启后快照中有缺失或损坏的内容时不恢复该目标，当前文件保持原样。默认关闭，
+ *        开机服务和登录恢复通过 autostart_helper --verify 开启。
+ * @param enabled 1 表示开启, 0 表示关闭。
+ */
+void SetVerifyBeforeRestore(int enabled);
+
+/**
+ * @brief 设置后续冰冻使用的存储方式。
+ *        打包方式把目标的文件按数据块顺序写入少数几个容器文件 (可并行压缩)，
+ *        冰冻大量小文件时不再受元数据操作限制，删除快照也只需删除几个文件;
+ *        代价是每次冰冻都要重新写入全部内容，且不与其他目标共享相同文件。
+ *        恢复时自动识别快照的存储方式。
+ * @param mode SNAPSHOT_STORAGE_BLOBS / SNAPSHOT_STORAGE_PACKED。
+ */
+void SetStorageMode(int mode);
+
+/**
+ * @brief 设置按块更新大文件的阈值。不小于此大小的文件冰冻时另存一份块校验表 (每 1 MiB 一个哈希，
+ *        存于 blob 存储)，恢复时若目标中已有内容不同的同名文件，只改写与快照不同的块并按需截断或扩展，
+ *        大文件中的小改动只产生与改动量成正比的写入。打包存储和硬链接物化方式不使用按块更新。
+ * @param bytes 阈值 (字节)，0 表示不使用 (默认 64 MiB)。
+ */
+void SetDeltaRestoreThreshold(long long bytes);
+
+/**
+ * @brief 设置打包存储时数据块的压缩方式。
+ * @param codec SNAPSHOT_COMPRESS_NONE / SNAPSHOT_COMPRESS_LZ4 / SNAPSHOT_COMPRESS_ZSTD。
+ */
+void SetPackCompression(int codec);
+
+/**
+ * @brief 设置后续冰冻产生的代的名称。每次冰冻都新增一代 (同名的代被替换)，
+ *        未变化的文件由各代共享，新增一代只需写入变化的内容。
+ * @param name 字母、数字、'.'、'_' 或 '-' 组成的名称 (最长 64 个字符)，NULL 或空字符串表示按冰冻时间命名 (默认)。
+ *             命名的代不受保留策略影响。
+ * @return 0 表示成功, -1 表示名称不合法 (保持当前设置)。
+ */
+int SetGenerationName(const char* name);
+
+/**
+ * @brief 设置按冰冻时间命名的代的保留策略，每次冰冻后清理超出的旧代 (当前代总是保留)。
+ * @param keepCount 最多保留的代数，0 表示不限 (默认 5)。
+ * @param keepSeconds 只保留此时长内冰冻的代，0 表示不限 (默认)。
+ */
+void SetGenerationRetention(int keepCount, long long keepSeconds);
+
+/**
+ * @brief 设置冰冻和恢复时并行复制使用的工作线程数。
+ *        目录枚举、哈希和文件复制由工作窃取线程池并行执行，结果与串行执行完全一致。
+ * @param count 线程数，0 或负数表示使用 CPU 核心数 (默认)，1 表示串行。
+ */
+void SetWorkerCount(int count);
+
+/**
+ * @brief 查询指定目标的快照状态。
+ * @param target 快照目标, e.g., "desktop" 或 "home_folders".
+ * @param info 输出的状态。
+ * @return 0 表示成功, -1 表示目标未知。
+ */
+int GetSnapshotInfo(const char* target, SnapshotInfo* info);
+
+/**
+ * @brief 列出指定目标快照的全部代 (JSON 数组，从新到旧)，每一项形如
+ *        {"name": "20261016-153000", "current": true, "named": false, "created_at": 1792143000}。
+ * @param buffer 输出缓冲区，内容超出时被截断 (总以 '\0' 结尾)，可为 NULL。
+ * @param bufferSize 缓冲区大小。
+ * @return 完整长度 (不含结尾的 '\0')，-1 表示目标未知。
+ */
+int ListSnapshotGenerations(const char* target, char* buffer, int bufferSize);
+
+/**
+ * @brief 校验指定目标的当前快照是否完好: 由多个线程通过内存映射读取每个内容对象 (blob，
+ *        或打包容器中逐块解码的文件)，以 XXH3-64 (按 CPU 自动选用 AVX2 / SSE2 实现) 重新计算哈希，
+ *        与冰冻时记录的比较。相同内容只读取一次，吞吐量通常受限于磁盘带宽。
+ *        缺失或损坏的条目逐个打印到标准输出。
+ * @return 缺失或损坏的条目数 (0 表示完好)，-1 表示目标未知、快照不存在、清单损坏或旧版快照没有记录哈希。
+ */
+int VerifySnapshot(const char* target);
+
+/**
+ * @brief 查询当前用户最近一次登录恢复的进度 (可在其他进程中调用)。
+ * @param progress 输出的进度。
+ * @return 0 表示成功, -1 表示本次开机后尚未执行过登录恢复。
+ */
+int GetRestoreProgress(SnapshotRestoreProgress* progress);
+
+/**
+ * @brief 设置每次运行结束时是否同时导出 Chrome 追踪文件 (~/.snapshot_manager/trace.json)，
+ *        可在 chrome://tracing 或 Perfetto 中查看各阶段的时间线。默认关闭。
+ * @param enabled 1 表示导出, 0 表示不导出。
+ */
+void SetTraceExport(int enabled);
+
+/**
+ * @brief 读取最近一次运行 (冰冻、恢复、登录恢复或会话结束恢复) 的统计 (JSON 文本，
+ *        与 ~/.snapshot_manager/stats.json 相同)，包括各阶段的耗时、复制的文件数和字节数、
+ *        读写类系统调用次数以及差异比较跳过的字节数。
+ * @param buffer 输出缓冲区，内容超出时被截断 (总以 '\0' 结尾)，可为 NULL。
+ * @param bufferSize 缓冲区大小。
+ * @return 统计的完整长度 (不含结尾的 '\0')，-1 表示尚无统计。
+ */
+int GetLastRunStats(char* buffer, int bufferSize);
+
+/**
+ * @brief 以常驻服务的方式运行，直到收到 SIGTERM / SIGINT 或 "shutdown" 请求。
+ *        在 Unix 域套接字上按行接收 JSON 请求 (状态查询、冰冻、恢复、解冻、取消等)，
+ *        冰冻、恢复和解冻按提交顺序逐个执行，执行期间向所有连接推送进度事件。
+ *        协议见 README。
+ * @param socketPath 套接字路径，NULL 表示 /run/user/<uid>/desktop_snapshot/daemon.sock。
+ * @return 0 表示正常退出, -1 表示无法监听 (例如已有服务在运行)。
+ */
+int RunSnapshotDaemon(const char* socketPath);
+
 /**
  * @brief [内部使用] 供自启动程序调用。
- *        依次检查所有受支持的目标，如果存在恢复标志则执行恢复。
+ *        按优先级恢复所有开启了恢复的目标: 先在前台恢复桌面并发出就绪信号
+ *        (/run/user/<uid>/desktop_snapshot/desktop.ready)，再在后台低优先级线程中
+ *        恢复回收站和用户文件夹，全部完成后返回。会话结束时已恢复过的目标只恢复图标位置。
  */
 void ExecuteRestoreOnBoot();
 
+/**
+ * @brief [内部使用] 供会话结束时 (注销或关机) 的 systemd 用户服务调用。
+ *        预先恢复所有已开启恢复的目标的文件内容，成功后写入干净标记；
+ *        下次登录时 ExecuteRestoreOnBoot 见到有效的标记只需恢复图标位置，
+ *        标记缺失 (恢复被中断) 时退回登录时的完整恢复。
+ */
+void ExecuteRestoreOnLogout();
+
+/**
+ * @brief [内部使用] 供开机时的系统服务 (root) 调用。
+ *        为所有开启了恢复且尚未登录的普通用户预先恢复文件内容 (同 ExecuteRestoreOnLogout)，
+ *        每个用户在单独的子进程中以其 HOME 和 uid/gid 恢复，多个用户并行进行;
+ *        同时恢复的用户数与每个用户的工作线程数之积不超过 SetWorkerCount 设置的线程数，
+ *        子进程以最低 CPU 优先级和空闲 I/O 优先级运行。用户登录时只需恢复图标位置。
+ * @param parallel 最多同时恢复的用户数，0 或负数表示工作线程数的一半。
+ * @return 0 表示成功, -1 表示不是 root 或有用户恢复失败。
+ */
+int ExecuteRestoreForAllUsers(int parallel);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,12 @@ BUILD_DIR="build"
 PACKAGE_DIR="package"
 # [新增] 定义外部脚本的路径，方便管理
 STARTUP_SCRIPT_SOURCE="scripts/autostart.sh"
+# [新增] 会话结束时预先恢复的 systemd 用户服务
+LOGOUT_UNIT_SOURCE="scripts/desktop-snapshot-logout.service"
+# [新增] 供前端连接的常驻服务
+DAEMON_UNIT_SOURCE="scripts/desktop-snapshot-daemon.service"
+# [新增] 开机时为所有用户预先恢复的系统服务
+BOOT_UNIT_SOURCE="scripts/desktop-snapshot-boot.service"
 
 # ==============================================================================
 #  步骤 1: 检查构建依赖
@@ -75,6 +81,8 @@ mkdir -p "$PKG_ROOT/usr/bin"
 # mkdir -p "$PKG_ROOT/etc/X11/Xsession.d" 
 mkdir -p "$PKG_ROOT/etc/profile.d"     # <--- 新增: profile.d 目录
 mkdir -p "$PKG_ROOT/usr/include"
+mkdir -p "$PKG_ROOT/usr/lib/systemd/user"
+mkdir -p "$PKG_ROOT/usr/lib/systemd/system"
 mkdir -p "$PKG_ROOT/DEBIAN"
 
 
@@ -108,6 +116,13 @@ fi
 # 复制到 profile.d
 cp "$STARTUP_SCRIPT_SOURCE" "$PKG_ROOT/etc/profile.d/uos-desktop-restore.sh"
 
+# 3.1 [新增] 复制会话结束恢复服务
+cp "$LOGOUT_UNIT_SOURCE" "$PKG_ROOT/usr/lib/systemd/user/desktop-snapshot-logout.service"
+# 3.2 [新增] 复制常驻服务
+cp "$DAEMON_UNIT_SOURCE" "$PKG_ROOT/usr/lib/systemd/user/desktop-snapshot-daemon.service"
+# 3.3 [新增] 复制开机预先恢复服务
+cp "$BOOT_UNIT_SOURCE" "$PKG_ROOT/usr/lib/systemd/system/desktop-snapshot-boot.service"
+
 # 4. 复制 API 头文件 <--- 新增：让其他开发者也能使用我们的库
 cp "include/desktop_snapshot_api.h" "$PKG_ROOT/usr/include/"
 
@@ -145,6 +160,13 @@ chmod 4755 /usr/bin/snapshot_tool
 if [ -f /etc/profile.d/uos-desktop-restore.sh ]; then
     chmod +x /etc/profile.d/uos-desktop-restore.sh
 fi
+
+# [新增] 为所有用户启用会话结束恢复服务 (下次登录后生效)
+if command -v systemctl > /dev/null 2>&1; then
+    systemctl --global enable desktop-snapshot-logout.service || true
+    systemctl --global enable desktop-snapshot-daemon.service || true
+    systemctl enable desktop-snapshot-boot.service || true
+fi
 exit 0
 EOF
 chmod 0755 "$PKG_ROOT/DEBIAN/postinst"
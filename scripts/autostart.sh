@@ -59,7 +59,7 @@ echo "Checking for helper binary at '$HELPER_BIN'..."
 if [ -x "$HELPER_BIN" ]; then
     echo "Executing helper in the background and creating lock file..."
     touch "$LOCK_FILE"
-    "$HELPER_BIN" &
+    "$HELPER_BIN" --verify &
 else
     echo "ERROR: Helper binary not found or is not executable."
 fi
@@ -0,0 +1,238 @@
+#include "async_operation.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <condition_variable>
+
+namespace {
+
+// 进度回调的最小间隔 (阶段变化和操作结束时总会回调)
+const int64_t REPORT_INTERVAL_NS = 100LL * 1000 * 1000;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+// 一个异步操作 (对 C 接口不透明)
+struct SnapshotOperation {
+    std::function<int()> work;
+    SnapshotProgressCallback callback = nullptr;
+    void* userData = nullptr;
+
+    std::atomic<bool> cancel{false};
+    std::atomic<int> phase{SNAPSHOT_PHASE_PREPARING};
+    std::atomic<uint64_t> filesDone{0};
+    std::atomic<uint64_t> filesTotal{0};
+    std::atomic<uint64_t> bytesDone{0};
+    std::atomic<uint64_t> bytesTotal{0};
+
+    std::mutex mutex;                   // 保护 state
+    std::condition_variable finished;
+    int state = SNAPSHOT_OP_QUEUED;
+
+    std::mutex callbackMutex;           // 回调不会并发执行
+    std::atomic<int64_t> lastReportNs{0};
+};
+
+namespace {
+
+// 当前正在执行的异步操作 (工作线程池中的任务也通过它汇报进度)
+std::atomic<SnapshotOperation*> g_current{nullptr};
+
+int readState(SnapshotOperation* op) {
+    std::lock_guard<std::mutex> lock(op->mutex);
+    return op->state;
+}
+
+SnapshotOperationProgress snapshotProgress(SnapshotOperation* op, int state) {
+    SnapshotOperationProgress progress;
+    progress.state = state;
+    progress.phase = op->phase;
+    progress.filesDone = op->filesDone;
+    progress.filesTotal = op->filesTotal;
+    progress.bytesDone = op->bytesDone;
+    progress.bytesTotal = op->bytesTotal;
+    return progress;
+}
+
+// 调用进度回调; 非强制时按间隔节流，且另一线程正在回调时直接跳过
+void report(SnapshotOperation* op, bool force, int state = SNAPSHOT_OP_RUNNING) {
+    if (!op->callback) return;
+    int64_t now = nowNs();
+    if (!force && now - op->lastReportNs < REPORT_INTERVAL_NS) return;
+    std::unique_lock<std::mutex> lock(op->callbackMutex, std::defer_lock);
+    if (force) {
+        lock.lock();
+    } else if (!lock.try_lock()) {
+        return;
+    }
+    op->lastReportNs = now;
+    SnapshotOperationProgress progress = snapshotProgress(op, state);
+    op->callback(&progress, op->userData);
+}
+
+// 结束操作: 先做最后一次回调，再发布最终状态 (之后不再访问 op)
+void finish(SnapshotOperation* op, int state) {
+    report(op, true, state);
+    std::lock_guard<std::mutex> lock(op->mutex);
+    op->state = state;
+    op->finished.notify_all();
+}
+
+/**
+ * 库内部的执行线程，按提交顺序逐个运行操作。线程在第一次提交时启动，
+ * 进程退出时取消尚未完成的操作并等待其结束。
+ */
+class OperationExecutor {
+public:
+    ~OperationExecutor() {
+        std::deque<SnapshotOperation*> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            dropped.swap(queue_);
+            SnapshotOperation* running = g_current;
+            if (running) running->cancel = true;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        for (auto* op : dropped) finish(op, SNAPSHOT_OP_CANCELLED);
+    }
+
+    void submit(SnapshotOperation* op) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(op);
+            if (!thread_.joinable()) thread_ = std::thread([this] { run(); });
+        }
+        wake_.notify_one();
+    }
+
+    // 从队列中移除尚未开始的操作; 返回 false 表示操作已开始或已结束
+    bool dequeue(SnapshotOperation* op) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find(queue_.begin(), queue_.end(), op);
+        if (it == queue_.end()) return false;
+        queue_.erase(it);
+        return true;
+    }
+
+private:
+    void run() {
+        while (true) {
+            SnapshotOperation* op;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (stop_) return;
+                op = queue_.front();
+                queue_.pop_front();
+                {
+                    std::lock_guard<std::mutex> stateLock(op->mutex);
+                    op->state = SNAPSHOT_OP_RUNNING;
+                }
+                g_current = op;
+            }
+            report(op, true);
+
+            int result = -1;
+            try {
+                std::lock_guard<std::mutex> lock(operationMutex());
+                result = op->work();
+            } catch (...) {
+                result = -1;
+            }
+            g_current = nullptr;
+            finish(op, result == 0 ? SNAPSHOT_OP_SUCCEEDED
+                                   : (op->cancel ? SNAPSHOT_OP_CANCELLED : SNAPSHOT_OP_FAILED));
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<SnapshotOperation*> queue_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+OperationExecutor& executor() {
+    static OperationExecutor instance;
+    return instance;
+}
+
+} // namespace
+
+void progressBeginPhase(int phase) {
+    SnapshotOperation* op = g_current;
+    if (!op || op->phase == phase) return;
+    op->phase = phase;
+    report(op, true);
+}
+
+void progressAddTotal(uint64_t files, uint64_t bytes) {
+    SnapshotOperation* op = g_current;
+    if (!op) return;
+    op->filesTotal += files;
+    op->bytesTotal += bytes;
+}
+
+void progressAddDone(uint64_t files, uint64_t bytes) {
+    SnapshotOperation* op = g_current;
+    if (!op) return;
+    op->filesDone += files;
+    op->bytesDone += bytes;
+    report(op, false);
+}
+
+bool operationCancelled() {
+    SnapshotOperation* op = g_current;
+    return op && op->cancel;
+}
+
+std::mutex& operationMutex() {
+    static std::mutex instance;
+    return instance;
+}
+
+SnapshotOperation* submitOperation(std::function<int()> work, SnapshotProgressCallback callback, void* userData) {
+    SnapshotOperation* op = new SnapshotOperation();
+    op->work = std::move(work);
+    op->callback = callback;
+    op->userData = userData;
+    executor().submit(op);
+    return op;
+}
+
+int pollOperation(SnapshotOperation* op, SnapshotOperationProgress* progress) {
+    int state = readState(op);
+    if (progress) *progress = snapshotProgress(op, state);
+    return state;
+}
+
+int waitOperation(SnapshotOperation* op, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(op->mutex);
+    auto done = [op] { return op->state >= SNAPSHOT_OP_SUCCEEDED; };
+    if (timeoutMs < 0) {
+        op->finished.wait(lock, done);
+    } else {
+        op->finished.wait_for(lock, std::chrono::milliseconds(timeoutMs), done);
+    }
+    return op->state;
+}
+
+void cancelOperation(SnapshotOperation* op) {
+    op->cancel = true;
+    if (executor().dequeue(op)) finish(op, SNAPSHOT_OP_CANCELLED);
+}
+
+void releaseOperation(SnapshotOperation* op) {
+    if (!op) return;
+    cancelOperation(op);
+    waitOperation(op, -1);
+    delete op;
+}
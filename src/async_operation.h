@@ -0,0 +1,49 @@
+#ifndef ASYNC_OPERATION_H
+#define ASYNC_OPERATION_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include "../include/desktop_snapshot_api.h"
+
+/**
+ * 异步操作的执行与进度汇报。异步接口提交的操作在库内部的执行线程上按提交顺序逐个运行
+ * (冰冻和恢复共用进程内的全局状态，不能同时进行)，文件处理仍由工作线程池并行完成。
+ * 核心代码通过 progress* 函数报告当前操作的阶段和进度，并通过 operationCancelled() 查询是否已被取消;
+ * 没有正在运行的异步操作时 (同步接口) 这些函数什么也不做。
+ */
+
+// 报告当前操作进入新的阶段 (SNAPSHOT_PHASE_*)
+void progressBeginPhase(int phase);
+
+// 增加当前操作需要处理的普通文件总量
+void progressAddTotal(uint64_t files, uint64_t bytes);
+
+// 增加当前操作已处理 (已写入或确认未变化) 的普通文件数量
+void progressAddDone(uint64_t files, uint64_t bytes);
+
+// 当前操作是否已被请求取消
+bool operationCancelled();
+
+// 串行化冰冻、恢复和移除操作 (异步执行线程与同步接口共用)
+std::mutex& operationMutex();
+
+/**
+ * @brief 提交一个异步操作。work 返回 0 表示成功; 失败时若已请求取消则记为已取消。
+ * @return 操作句柄，由 releaseOperation 释放。
+ */
+SnapshotOperation* submitOperation(std::function<int()> work, SnapshotProgressCallback callback, void* userData);
+
+// 读取操作的当前进度，返回其状态 (SNAPSHOT_OP_*)
+int pollOperation(SnapshotOperation* op, SnapshotOperationProgress* progress);
+
+// 等待操作结束，timeoutMs < 0 表示一直等待; 返回等待结束时的状态
+int waitOperation(SnapshotOperation* op, int timeoutMs);
+
+// 请求取消操作 (尚未开始的操作立即结束)
+void cancelOperation(SnapshotOperation* op);
+
+// 取消并等待操作结束后释放句柄
+void releaseOperation(SnapshotOperation* op);
+
+#endif // ASYNC_OPERATION_H
@@ -1,7 +1,33 @@
 #include "../include/desktop_snapshot_api.h"
+#include <cstring>
+#include <cstdlib>
 
-int main() {
+int main(int argc, char* argv[]) {
+    // DESKSNAPSHOT_TRACE=1: 同时导出 Chrome 追踪文件，便于分析登录恢复的耗时
+    const char* trace = std::getenv("DESKSNAPSHOT_TRACE");
+    if (trace && std::strcmp(trace, "0") != 0 && *trace) SetTraceExport(1);
+
+    // --verify (最后一个参数): 恢复前先校验快照，有缺失或损坏的内容时不恢复该目标
+    if (argc > 1 && std::strcmp(argv[argc - 1], "--verify") == 0) {
+        SetVerifyBeforeRestore(1);
+        argc--;
+    }
+
+    // --logout: 由会话结束时的 systemd 用户服务调用，预先恢复文件
+    if (argc > 1 && std::strcmp(argv[1], "--logout") == 0) {
+        ExecuteRestoreOnLogout();
+        return 0;
+    }
+    // --all-users [--parallel N] [--jobs N]: 由开机时的系统服务以 root 身份调用，为所有用户预先恢复
+    if (argc > 1 && std::strcmp(argv[1], "--all-users") == 0) {
+        int parallel = 0;
+        for (int i = 2; i + 1 < argc; i += 2) {
+            if (std::strcmp(argv[i], "--parallel") == 0) parallel = std::atoi(argv[i + 1]);
+            else if (std::strcmp(argv[i], "--jobs") == 0) SetWorkerCount(std::atoi(argv[i + 1]));
+        }
+        return ExecuteRestoreForAllUsers(parallel) == 0 ? 0 : 1;
+    }
     // 调用库中的函数来执行启动时恢复逻辑
     ExecuteRestoreOnBoot();
     return 0;
-}
\ No newline at end of file
+}
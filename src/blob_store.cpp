@@ -0,0 +1,179 @@
+#include "blob_store.h"
+#include "content_hash.h"
+#include "copy_engine.h"
+#include "block_table.h"
+#include <iostream>
+#include <atomic>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* OBJECTS_DIR = "objects";
+const char* TEMP_DIR = "tmp";
+const char* BLOCKS_DIR = "blocks";
+
+// 临时文件序号，保证并行入库时 (即使内容相同) 临时文件名也不冲突
+std::atomic<uint64_t> g_tempCounter{0};
+
+// 读取文件当前的大小和 mtime，用于检测复制期间文件是否被修改
+bool statSizeMtime(const fs::path& path, uint64_t& size, int64_t& mtimeNs) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = (uint64_t)st.st_size;
+    mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+} // namespace
+
+std::string blobKey(uint64_t hash, uint64_t size) {
+    char sizeHex[17];
+    std::snprintf(sizeHex, sizeof(sizeHex), "%llx", (unsigned long long)size);
+    return hashToHex(hash) + "-" + sizeHex;
+}
+
+fs::path blobPath(const fs::path& storeRoot, uint64_t hash, uint64_t size) {
+    std::string key = blobKey(hash, size);
+    return storeRoot / OBJECTS_DIR / key.substr(0, 2) / key;
+}
+
+fs::path blockTablePath(const fs::path& storeRoot, uint64_t hash, uint64_t size) {
+    std::string key = blobKey(hash, size);
+    return storeRoot / BLOCKS_DIR / key.substr(0, 2) / key;
+}
+
+bool ensureBlockTable(const fs::path& storeRoot, const TreeEntry& entry, uint32_t blockSize) {
+    if (!entry.hasContentHash) return false;
+    fs::path path = blockTablePath(storeRoot, entry.contentHash, entry.size);
+    std::error_code ec;
+    if (fs::exists(path, ec)) return true;
+    BlockTable table;
+    if (!computeBlockTable(entry.sourcePath, blockSize, table) || table.fileSize != entry.size) return false;
+    fs::create_directories(path.parent_path(), ec);
+    return writeBlockTable(path, table);
+}
+
+bool ingestFile(const fs::path& storeRoot, TreeEntry& entry,
+                const std::unordered_map<std::string, TreeEntry>& previous, IngestStats& stats, bool dereference) {
+    // 1. 大小和 mtime 都没变且 blob 仍在：沿用上次的哈希，完全不读文件
+    auto it = previous.find(entry.relPath);
+    if (it != previous.end() && it->second.hasContentHash && it->second.type == EntryType::Regular &&
+        it->second.size == entry.size && it->second.mtimeNs == entry.mtimeNs) {
+        fs::path cached = blobPath(storeRoot, it->second.contentHash, entry.size);
+        if (fs::exists(cached)) {
+            entry.contentHash = it->second.contentHash;
+            entry.hasContentHash = true;
+            entry.sourcePath = cached;
+            stats.hashesReused++;
+            stats.bytesDeduplicated += entry.size;
+            return true;
+        }
+    }
+
+    // 2. 计算内容哈希，已有相同内容的 blob 时直接引用
+    uint64_t hash = 0;
+    if (!hashFile(entry.sourcePath, hash, dereference)) {
+        std::cerr << "  -> 警告: 无法读取 '" << entry.sourcePath.string() << "'" << std::endl;
+        return false;
+    }
+    fs::path target = blobPath(storeRoot, hash, entry.size);
+    if (fs::exists(target)) {
+        entry.contentHash = hash;
+        entry.hasContentHash = true;
+        entry.sourcePath = target;
+        stats.filesDeduplicated++;
+        stats.bytesDeduplicated += entry.size;
+        return true;
+    }
+
+    // 3. 先复制到临时文件，再原子地重命名为最终的 blob
+    try {
+        fs::path tempDir = storeRoot / TEMP_DIR;
+        fs::create_directories(tempDir);
+        fs::path temp = tempDir / (target.filename().string() + "." + std::to_string(getpid()) + "." +
+                                   std::to_string(g_tempCounter++));
+        copyFileOrThrow(entry.sourcePath, temp, 0600);
+
+        // 复制期间源文件被修改：以实际写入的内容重新计算键
+        uint64_t sizeNow = 0;
+        int64_t mtimeNow = 0;
+        if (!statSizeMtime(entry.sourcePath, sizeNow, mtimeNow) || sizeNow != entry.size || mtimeNow != entry.mtimeNs) {
+            if (!hashFile(temp, hash)) {
+                fs::remove(temp);
+                return false;
+            }
+            entry.size = fs::file_size(temp);
+            target = blobPath(storeRoot, hash, entry.size);
+        }
+
+        chmod(temp.c_str(), 0444);
+        fs::create_directories(target.parent_path());
+        fs::rename(temp, target);
+
+        entry.contentHash = hash;
+        entry.hasContentHash = true;
+        entry.sourcePath = target;
+        stats.filesStored++;
+        stats.bytesStored += entry.size;
+        return true;
+    } catch (const fs::filesystem_error& e) {
+        std::cerr << "  -> 警告: 写入 blob 失败 '" << entry.sourcePath.string() << "': " << e.what() << std::endl;
+        return false;
+    }
+}
+
+StoreLock::StoreLock(const fs::path& storeRoot, bool exclusive) {
+    fs::path lockPath = storeRoot.string() + ".lock";
+    std::error_code ec;
+    fs::create_directories(lockPath.parent_path(), ec);
+    fd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ < 0) return;
+    int rc;
+    do {
+        rc = flock(fd_, exclusive ? LOCK_EX : LOCK_SH);
+    } while (rc != 0 && errno == EINTR);
+    locked_ = (rc == 0);
+}
+
+StoreLock::~StoreLock() {
+    unlock();
+}
+
+void StoreLock::unlock() {
+    if (fd_ >= 0) ::close(fd_);   // 关闭即释放 flock
+    fd_ = -1;
+    locked_ = false;
+}
+
+uint64_t collectGarbage(const fs::path& storeRoot, const std::unordered_set<std::string>& referenced) {
+    uint64_t removed = 0;
+    std::error_code ec;
+
+    fs::remove_all(storeRoot / TEMP_DIR, ec);
+
+    // objects/ 和 blocks/ 使用相同的键，未被引用的一并删除 (只统计对象数)
+    for (const char* dirName : {OBJECTS_DIR, BLOCKS_DIR}) {
+        fs::path dir = storeRoot / dirName;
+        if (!fs::exists(dir, ec)) continue;
+        for (const auto& bucket : fs::directory_iterator(dir, ec)) {
+            std::error_code bucketEc;
+            for (const auto& blob : fs::directory_iterator(bucket.path(), bucketEc)) {
+                if (referenced.count(blob.path().filename().string())) continue;
+                std::error_code rmEc;
+                if (fs::remove(blob.path(), rmEc) && dirName == OBJECTS_DIR) removed++;
+            }
+            std::error_code emptyEc;
+            if (fs::is_empty(bucket.path(), emptyEc)) fs::remove(bucket.path(), emptyEc);
+        }
+        if (fs::is_empty(dir, ec)) fs::remove(dir, ec);
+    }
+    fs::remove(storeRoot, ec);   // 存储为空时一并删除 (非空时失败，忽略)
+    return removed;
+}
@@ -0,0 +1,87 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <filesystem>
+#include "tree_sync.h"
+
+/**
+ * 内容寻址的 blob 存储 (位于 ~/.snapshot_manager/store)。
+ * 每个普通文件按 "XXH3-64 哈希 + 大小" 存为 objects/<前两位>/<key>，
+ * 所有目标共享同一个存储，相同内容只保存一份。
+ * 大文件的块校验表 (见 block_table.h) 以同样的键存为 blocks/<前两位>/<key>，随对象一起回收。
+ */
+
+// 一次入库的统计信息
+struct IngestStats {
+    uint64_t filesStored = 0;         // 新写入的 blob 数
+    uint64_t bytesStored = 0;
+    uint64_t filesDeduplicated = 0;   // 已存在相同内容、无需写入的文件数
+    uint64_t bytesDeduplicated = 0;
+    uint64_t hashesReused = 0;        // 大小和 mtime 未变、直接沿用上次哈希的文件数
+};
+
+/**
+ * @brief 根据哈希和大小生成 blob 的键 (形如 "0123456789abcdef-1a2b")。
+ */
+std::string blobKey(uint64_t hash, uint64_t size);
+
+/**
+ * @brief 返回 blob 在存储中的物理路径。
+ */
+std::filesystem::path blobPath(const std::filesystem::path& storeRoot, uint64_t hash, uint64_t size);
+
+/**
+ * @brief 返回 blob 的块校验表在存储中的路径。
+ */
+std::filesystem::path blockTablePath(const std::filesystem::path& storeRoot, uint64_t hash, uint64_t size);
+
+/**
+ * @brief 确保已入库的条目 (sourcePath 指向 blob) 有块校验表，没有时从 blob 读取生成。
+ * @return true 表示块校验表已存在或已生成。
+ */
+bool ensureBlockTable(const std::filesystem::path& storeRoot, const TreeEntry& entry, uint32_t blockSize);
+
+/**
+ * @brief 将一个普通文件条目写入存储，并填好 entry 的 contentHash (可在多个线程上并行调用)。
+ *        previous 中有相同 relPath、大小和 mtime 的条目且 blob 仍在时，直接沿用其哈希而不读取文件。
+ * @param entry 条目 (sourcePath 指向实时文件)，成功后 sourcePath 改为指向 blob。
+ * @param dereference 扫描时是否跟随了符号链接 (为 false 时 sourcePath 被换成符号链接则失败)。
+ * @return true 表示成功, false 表示文件读取或写入失败。
+ */
+bool ingestFile(const std::filesystem::path& storeRoot, TreeEntry& entry,
+                const std::unordered_map<std::string, TreeEntry>& previous, IngestStats& stats, bool dereference);
+
+/**
+ * 存储锁 (对存储旁的 <storeRoot>.lock 加 flock，存储目录被整体回收后仍然有效)。
+ * 冰冻从写入对象到发布清单期间持有共享锁，回收持有独占锁: 多个进程可以同时冰冻不同的目标，
+ * 但回收不会删除另一个进程正在写入的临时文件，或已写入/沿用、但所在清单尚未发布的对象。
+ */
+class StoreLock {
+public:
+    StoreLock(const std::filesystem::path& storeRoot, bool exclusive);
+    ~StoreLock();
+    StoreLock(const StoreLock&) = delete;
+    StoreLock& operator=(const StoreLock&) = delete;
+
+    bool locked() const { return locked_; }
+    void unlock();
+
+private:
+    int fd_ = -1;
+    bool locked_ = false;
+};
+
+/**
+ * @brief 删除存储中不再被任何清单引用的 blob 和块校验表，以及残留的临时文件。
+ *        调用方须持有独占的 StoreLock，并在持锁期间收集 referenced。
+ * @param referenced 所有清单仍引用的 blob 键。
+ * @return 删除的 blob 数量。
+ */
+uint64_t collectGarbage(const std::filesystem::path& storeRoot, const std::unordered_set<std::string>& referenced);
+
+#endif // BLOB_STORE_H
@@ -0,0 +1,193 @@
+#include "block_table.h"
+#include "content_hash.h"
+#include "copy_engine.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char BLOCK_TABLE_MAGIC[8] = {'D', 'S', 'N', 'A', 'P', 'B', 'T', '\0'};
+const uint32_t BLOCK_TABLE_VERSION = 1;
+
+// 块校验表的文件头 (32 字节)，其后是 blockCount 个 uint64 哈希，最后是全部哈希的 XXH3-64
+struct BlockTableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t blockSize;
+    uint64_t fileSize;
+    uint64_t blockCount;
+};
+static_assert(sizeof(BlockTableHeader) == 32, "BlockTableHeader 必须为 32 字节");
+
+uint64_t blockCountFor(uint64_t fileSize, uint32_t blockSize) {
+    return (fileSize + blockSize - 1) / blockSize;
+}
+
+// 读满 length 字节 (遇到文件结尾时提前结束)，返回实际读取的字节数，出错返回 -1
+ssize_t readFully(int fd, char* buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, buffer + done, length - done, (off_t)(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+bool writeFully(int fd, const char* buffer, size_t length, uint64_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, buffer + done, length - done, (off_t)(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+} // namespace
+
+bool computeBlockTable(const fs::path& path, uint32_t blockSize, BlockTable& table) {
+    if (blockSize == 0) return false;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    table.blockSize = blockSize;
+    table.fileSize = (uint64_t)st.st_size;
+    table.hashes.clear();
+    table.hashes.reserve(blockCountFor(table.fileSize, blockSize));
+    std::unique_ptr<char[]> buffer(new char[blockSize]);
+    bool ok = true;
+    for (uint64_t offset = 0; offset < table.fileSize; offset += blockSize) {
+        size_t length = (size_t)std::min<uint64_t>(blockSize, table.fileSize - offset);
+        if (readFully(fd, buffer.get(), length, offset) != (ssize_t)length) {
+            ok = false;
+            break;
+        }
+        table.hashes.push_back(xxh3_64(buffer.get(), length));
+    }
+    close(fd);
+    return ok;
+}
+
+bool writeBlockTable(const fs::path& path, const BlockTable& table) {
+    BlockTableHeader header;
+    std::memcpy(header.magic, BLOCK_TABLE_MAGIC, sizeof(header.magic));
+    header.version = BLOCK_TABLE_VERSION;
+    header.blockSize = table.blockSize;
+    header.fileSize = table.fileSize;
+    header.blockCount = table.hashes.size();
+    uint64_t checksum = xxh3_64(table.hashes.data(), table.hashes.size() * sizeof(uint64_t));
+
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char*>(table.hashes.data()), table.hashes.size() * sizeof(uint64_t));
+    data.append(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    return writeFileAtomically(path, data);
+}
+
+bool readBlockTable(const fs::path& path, BlockTable& table) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    BlockTableHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, BLOCK_TABLE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BLOCK_TABLE_VERSION || header.blockSize == 0 ||
+        header.blockCount != blockCountFor(header.fileSize, header.blockSize)) {
+        return false;
+    }
+    std::vector<uint64_t> hashes(header.blockCount);
+    uint64_t checksum = 0;
+    if (!in.read(reinterpret_cast<char*>(hashes.data()), hashes.size() * sizeof(uint64_t)) ||
+        !in.read(reinterpret_cast<char*>(&checksum), sizeof(checksum)) ||
+        checksum != xxh3_64(hashes.data(), hashes.size() * sizeof(uint64_t))) {
+        return false;
+    }
+    table.blockSize = header.blockSize;
+    table.fileSize = header.fileSize;
+    table.hashes = std::move(hashes);
+    return true;
+}
+
+bool applyBlockDelta(int sourceFd, uint64_t sourceSize, int destFd, const BlockTable* table,
+                     BlockDeltaStats& stats, std::string& error) {
+    if (table && (table->fileSize != sourceSize || table->blockSize == 0)) {
+        error = "block table does not match source size";
+        return false;
+    }
+    uint32_t blockSize = table ? table->blockSize : DEFAULT_DELTA_BLOCK_SIZE;
+    struct stat st;
+    if (fstat(destFd, &st) != 0) {
+        error = std::string("fstat: ") + strerror(errno);
+        return false;
+    }
+    uint64_t destSize = (uint64_t)st.st_size;
+    // 目标较长时先截断; 较短时超出部分的块都会被写入，文件随之扩展
+    if (destSize > sourceSize) {
+        if (ftruncate(destFd, (off_t)sourceSize) != 0) {
+            error = std::string("ftruncate: ") + strerror(errno);
+            return false;
+        }
+        destSize = sourceSize;
+    }
+    posix_fadvise(destFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::unique_ptr<char[]> destBuffer(new char[blockSize]);
+    std::unique_ptr<char[]> sourceBuffer(new char[blockSize]);
+    uint64_t block = 0;
+    for (uint64_t offset = 0; offset < sourceSize; offset += blockSize, ++block) {
+        size_t length = (size_t)std::min<uint64_t>(blockSize, sourceSize - offset);
+        ssize_t destRead = 0;
+        if (offset < destSize) {
+            destRead = readFully(destFd, destBuffer.get(), length, offset);
+            if (destRead < 0) {
+                error = std::string("read dest: ") + strerror(errno);
+                return false;
+            }
+        }
+        // 有块表时先只看目标一侧: 哈希相同的块不必读取源内容
+        bool destComplete = destRead == (ssize_t)length;
+        if (table && destComplete && xxh3_64(destBuffer.get(), length) == table->hashes[block]) {
+            stats.bytesSkipped += length;
+            continue;
+        }
+        if (readFully(sourceFd, sourceBuffer.get(), length, offset) != (ssize_t)length) {
+            error = "short read from source";
+            return false;
+        }
+        if (table) {
+            if (xxh3_64(sourceBuffer.get(), length) != table->hashes[block]) {
+                error = "source content does not match block table";
+                return false;
+            }
+        } else if (destComplete && std::memcmp(destBuffer.get(), sourceBuffer.get(), length) == 0) {
+            stats.bytesSkipped += length;
+            continue;
+        }
+        if (!writeFully(destFd, sourceBuffer.get(), length, offset)) {
+            error = std::string("write dest: ") + strerror(errno);
+            return false;
+        }
+        stats.blocksWritten++;
+        stats.bytesWritten += length;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef BLOCK_TABLE_H
+#define BLOCK_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+/**
+ * 大文件的块校验表: 文件内容按固定大小分块，每块记录一个 XXH3-64 哈希。
+ * 冰冻时为超过阈值的文件生成，恢复时与目标中现有的同名文件逐块比较，
+ * 只改写哈希不同的块，大文件中的小改动只需与改动量成正比的写入。
+ */
+
+// 默认块大小 (1 MiB)
+const uint32_t DEFAULT_DELTA_BLOCK_SIZE = 1u << 20;
+
+struct BlockTable {
+    uint32_t blockSize = 0;
+    uint64_t fileSize = 0;
+    std::vector<uint64_t> hashes;   // 第 i 块 [i * blockSize, min((i + 1) * blockSize, fileSize)) 的哈希
+};
+
+// 一次按块更新的结果
+struct BlockDeltaStats {
+    uint64_t blocksWritten = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t bytesSkipped = 0;   // 与源内容一致、无需改写的字节数
+};
+
+/**
+ * @brief 读取文件 path 的全部内容并生成块校验表。
+ * @return false 表示文件无法读取。
+ */
+bool computeBlockTable(const std::filesystem::path& path, uint32_t blockSize, BlockTable& table);
+
+/**
+ * @brief 以临时文件加重命名的方式原子地写入块校验表。
+ */
+bool writeBlockTable(const std::filesystem::path& path, const BlockTable& table);
+
+/**
+ * @brief 读取块校验表，并检查块数与文件大小是否相符。
+ * @return false 表示文件不存在或已损坏。
+ */
+bool readBlockTable(const std::filesystem::path& path, BlockTable& table);
+
+/**
+ * @brief 把 sourceFd 的内容 (sourceSize 字节) 按块写入已打开 (可读写) 的 destFd:
+ *        逐块读取 dest，与源内容不同的块才改写，最后把 dest 截断或扩展到 sourceSize。
+ * @param table 源内容的块校验表 (可为 nullptr)。有表时只需读取 dest 和需要改写的源块，
+ *              没有表时按默认块大小直接比较两边的数据。
+ * @return false 表示读写失败或源内容与块表不符 (error 给出原因，dest 可能已被部分改写)。
+ */
+bool applyBlockDelta(int sourceFd, uint64_t sourceSize, int destFd, const BlockTable* table,
+                     BlockDeltaStats& stats, std::string& error);
+
+#endif // BLOCK_TABLE_H
@@ -0,0 +1,490 @@
+#include "change_journal.h"
+#include "copy_engine.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const JOURNAL_MAGIC = "desksnapshot-journal 1";
+const char* const JOURNAL_SUFFIX = ".journal";
+const char* const LOCK_SUFFIX = ".lock";
+const char* const COMMAND_SUFFIX = ".cmd";
+
+// 恢复根目录下每个目录上监视的事件 (新建、删除、改名、内容和属性变化)
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+fs::path journalPath(const fs::path& dir, const std::string& target) {
+    return dir / (target + JOURNAL_SUFFIX);
+}
+
+fs::path lockPath(const fs::path& dir, const std::string& target) {
+    return dir / (target + LOCK_SUFFIX);
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// 目标的命令文件名: <目标>.<序号>.cmd
+bool isCommandFile(const std::string& name, const std::string& target) {
+    return name.compare(0, target.size() + 1, target + ".") == 0 && endsWith(name, COMMAND_SUFFIX);
+}
+
+std::string joinPath(const std::string& parent, const std::string& name) {
+    return parent.empty() ? name : parent + "/" + name;
+}
+
+// relPath 的各级父目录，从根目录 ("") 开始
+std::vector<std::string> ancestors(const std::string& relPath) {
+    std::vector<std::string> result;
+    if (relPath.empty()) return result;
+    result.push_back("");
+    for (size_t slash = relPath.find('/'); slash != std::string::npos; slash = relPath.find('/', slash + 1)) {
+        result.push_back(relPath.substr(0, slash));
+    }
+    return result;
+}
+
+// 日志中的一条变化记录: "+ <分区>\t<相对路径>"
+bool parseRecord(const std::string& line, std::string& section, std::string& relPath) {
+    if (line.compare(0, 2, "+ ") != 0) return false;
+    size_t tab = line.find('\t', 2);
+    if (tab == std::string::npos) return false;
+    section = line.substr(2, tab - 2);
+    relPath = line.substr(tab + 1);
+    return true;
+}
+
+// 根目录监视失效的记录: "lost <分区>"
+std::string lostLine(const std::string& section) {
+    return "lost " + section;
+}
+
+bool readLines(const fs::path& path, std::vector<std::string>& lines) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+    std::string line;
+    while (std::getline(in, line)) lines.push_back(line);
+    return true;
+}
+
+// 命令文件和标记使用的唯一序号
+std::string makeToken() {
+    static std::atomic<uint64_t> counter{0};
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::to_string(getpid()) + "-" + std::to_string(++counter) + "-" +
+           std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+// 先写临时文件再改名，监视器只在改名时看到完整的命令
+bool writeCommand(const fs::path& dir, const std::string& target, const std::string& content) {
+    return writeFileAtomically(dir / (target + "." + makeToken() + COMMAND_SUFFIX), content);
+}
+
+} // namespace
+
+// ===== 监视器 =====
+
+std::unique_ptr<ChangeJournal> ChangeJournal::start(const fs::path& journalDir, const std::string& target,
+                                                    const std::vector<JournalRoot>& roots) {
+    std::unique_ptr<ChangeJournal> journal(new ChangeJournal());
+    journal->journalDir_ = journalDir;
+    journal->target_ = target;
+    journal->roots_ = roots;
+
+    std::error_code ec;
+    fs::create_directories(journalDir, ec);
+    journal->lockFd_ = ::open(lockPath(journalDir, target).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (journal->lockFd_ < 0 || flock(journal->lockFd_, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "  -> 警告: 无法锁定 " << target << " 的变更日志 (可能已有其他进程在监视)" << std::endl;
+        return nullptr;
+    }
+    journal->inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (journal->inotifyFd_ < 0) {
+        std::cerr << "  -> 警告: 无法创建 inotify 实例: " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    journal->commandWatch_ = inotify_add_watch(journal->inotifyFd_, journalDir.c_str(), IN_MOVED_TO | IN_ONLYDIR);
+    if (journal->commandWatch_ < 0) {
+        std::cerr << "  -> 警告: 无法监视日志目录 " << journalDir.string() << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    // 没有监视器时留下的命令已经没有意义
+    for (const auto& item : fs::directory_iterator(journalDir, ec)) {
+        std::string name = item.path().filename().string();
+        size_t temp = name.rfind(".tmp.");   // 写了一半的命令 (<命令>.tmp.<pid>.<序号>)
+        if (!endsWith(name, COMMAND_SUFFIX) && temp != std::string::npos) name.resize(temp);
+        if (isCommandFile(name, target)) {
+            std::error_code rmEc;
+            fs::remove(item.path(), rmEc);
+        }
+    }
+
+    // 上次正常关闭的日志接着使用，其他情况 (没有日志、异常退出、格式不对) 从无效状态开始
+    std::vector<std::string> previous;
+    journal->base_ = "-";
+    if (readLines(journalPath(journalDir, target), previous) && previous.size() >= 2 &&
+        previous[0] == JOURNAL_MAGIC && previous[1].compare(0, 5, "base ") == 0 && previous.back() == "closed") {
+        journal->base_ = previous[1].substr(5);
+        for (size_t i = 2; i + 1 < previous.size(); ++i) {
+            if (previous[i] != "opened" && previous[i] != "closed") journal->lines_.push_back(previous[i]);
+        }
+    }
+    journal->lines_.push_back("opened");
+    journal->rebuildRecorded();
+    if (!journal->rewrite()) return nullptr;
+
+    // 监视每个根目录下的全部目录; 不存在的根目录 (以及上次退出时仍未恢复监视的) 等它出现后再监视
+    journal->rootLost_.assign(roots.size(), true);
+    for (size_t i = 0; i < roots.size(); ++i) {
+        if (std::find(journal->lines_.begin(), journal->lines_.end(), lostLine(roots[i].section)) ==
+            journal->lines_.end()) {
+            journal->append(lostLine(roots[i].section));
+        }
+    }
+    for (size_t i = 0; i < roots.size(); ++i) {
+        struct stat st;
+        if (stat(roots[i].path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+        if (!journal->addWatches(i, roots[i].path, "")) return nullptr;
+        journal->rootLost_[i] = false;
+    }
+    // 已监视的根目录: 本次新写的 "lost" 行直接去掉，上次遗留的改为整个分区的变化记录
+    std::vector<std::string> kept;
+    bool opened = false;
+    for (auto& line : journal->lines_) {
+        opened = opened || line == "opened";
+        auto root = std::find_if(roots.begin(), roots.end(),
+                                 [&](const JournalRoot& r) { return line == lostLine(r.section); });
+        if (root != roots.end() && !journal->rootLost_[root - roots.begin()]) {
+            if (opened) continue;
+            line = "+ " + root->section + "\t";
+        }
+        kept.push_back(line);
+    }
+    journal->lines_.swap(kept);
+    journal->rebuildRecorded();
+    if (!journal->rewrite()) return nullptr;
+    return journal;
+}
+
+ChangeJournal::~ChangeJournal() {
+    if (journalFd_ >= 0) {
+        append("closed");
+        close(journalFd_);
+    }
+    if (inotifyFd_ >= 0) close(inotifyFd_);
+    if (lockFd_ >= 0) close(lockFd_);
+}
+
+/**
+ * @brief 监视 dir 及其下的全部子目录 (不跟随符号链接)。无法读取的目录整体记为已变化。
+ * @return false 表示 inotify 监视数量不足，日志无法覆盖整棵树。
+ */
+bool ChangeJournal::addWatches(size_t root, const fs::path& dir, const std::string& relPath) {
+    std::vector<std::pair<fs::path, std::string>> stack{{dir, relPath}};
+    while (!stack.empty()) {
+        auto item = std::move(stack.back());
+        stack.pop_back();
+        // 根目录本身可以是符号链接 (例如指向其他分区的文件夹)
+        uint32_t mask = WATCH_MASK | (item.second.empty() ? 0 : IN_DONT_FOLLOW);
+        int wd = inotify_add_watch(inotifyFd_, item.first.c_str(), mask);
+        if (wd < 0) {
+            if (errno == ENOSPC || errno == ENOMEM) {
+                std::cerr << "  -> 警告: inotify 监视数量已达上限 (fs.inotify.max_user_watches)，"
+                          << target_ << " 的恢复将使用完整扫描" << std::endl;
+                return false;
+            }
+            record(root, item.second);
+            continue;
+        }
+        // 目录改名后同一个 inode 返回相同的 wd，这里同时更新它的路径
+        watches_[wd] = {root, item.second};
+        std::error_code ec;
+        fs::directory_iterator it(item.first, ec);
+        if (ec) {
+            record(root, item.second);
+            continue;
+        }
+        for (; it != fs::directory_iterator(); it.increment(ec)) {
+            std::error_code typeEc;
+            if (it->symlink_status(typeEc).type() == fs::file_type::directory) {
+                stack.emplace_back(it->path(), joinPath(item.second, it->path().filename().string()));
+            }
+        }
+        if (ec) record(root, item.second);
+    }
+    return true;
+}
+
+// 记录一个发生变化的路径 (代表其下的整棵子树); 自身或父目录在本段中已记录时跳过
+void ChangeJournal::record(size_t root, const std::string& relPath) {
+    const std::string& section = roots_[root].section;
+    for (const auto& parent : ancestors(relPath)) {
+        if (recorded_.count(section + "\t" + parent)) return;
+    }
+    std::string key = section + "\t" + relPath;
+    if (recorded_.insert(key).second) append("+ " + key);
+}
+
+// 根据日志行重建最后一个标记之后已记录的路径
+void ChangeJournal::rebuildRecorded() {
+    recorded_.clear();
+    for (const auto& line : lines_) {
+        std::string section, relPath;
+        if (line.compare(0, 5, "sync ") == 0) recorded_.clear();
+        else if (parseRecord(line, section, relPath)) recorded_.insert(section + "\t" + relPath);
+    }
+}
+
+/**
+ * @brief 根目录的监视失效: 根目录被删除、移走或与暂存目录交换后，原有的监视跟随的是旧的那棵树，
+ *        全部移除，并写入 "lost" 行使日志无效，直到 rearmRoots() 重新监视新的根目录。
+ */
+void ChangeJournal::loseRoot(size_t root) {
+    if (rootLost_[root]) return;
+    rootLost_[root] = true;
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        if (it->second.root == root) {
+            inotify_rm_watch(inotifyFd_, it->first);
+            it = watches_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    append(lostLine(roots_[root].section));
+}
+
+/**
+ * @brief 重新监视已失效、现在又存在的根目录。失效期间的变化没有事件，因此把 "lost" 行原地改为
+ *        整个分区的变化记录: 在它之后放置的标记都能看到这条记录，之后的恢复会完整同步该分区一次。
+ */
+void ChangeJournal::rearmRoots() {
+    bool changed = false;
+    for (size_t i = 0; i < roots_.size(); ++i) {
+        if (!rootLost_[i]) continue;
+        struct stat st;
+        if (stat(roots_[i].path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) continue;
+        if (!addWatches(i, roots_[i].path, "")) {
+            append("overflow");
+            continue;
+        }
+        rootLost_[i] = false;
+        std::replace(lines_.begin(), lines_.end(), lostLine(roots_[i].section), "+ " + roots_[i].section + "\t");
+        changed = true;
+    }
+    if (!changed) return;
+    rebuildRecorded();
+    rewrite();
+}
+
+void ChangeJournal::append(const std::string& line) {
+    lines_.push_back(line);
+    std::string text = line + "\n";
+    if (journalFd_ >= 0 && write(journalFd_, text.data(), text.size()) != (ssize_t)text.size()) {
+        std::cerr << "  -> 警告: 写入 " << target_ << " 的变更日志失败: " << strerror(errno) << std::endl;
+    }
+}
+
+void ChangeJournal::processEvents() {
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        ssize_t length = read(inotifyFd_, buffer, sizeof(buffer));
+        if (length <= 0) break;
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // 丢失了事件，下一次覆盖全部分区的基准更新之前日志无效
+                append("overflow");
+                continue;
+            }
+            std::string name = event->len ? event->name : "";
+            if (event->wd == commandWatch_) {
+                if (isCommandFile(name, target_)) handleCommand(journalDir_ / name);
+                continue;
+            }
+            auto it = watches_.find(event->wd);
+            if (it == watches_.end()) continue;
+            Watch watch = it->second;
+            if (watch.relPath.empty() && (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))) {
+                // 根目录被删除、移走或被交换: 之后根目录下的变化不再有事件
+                loseRoot(watch.root);
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                watches_.erase(it);
+                continue;
+            }
+            if (name.empty()) {
+                // 目录自身被删除或移走 (父目录上也会收到事件)
+                if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) record(watch.root, watch.relPath);
+                continue;
+            }
+            std::string relPath = joinPath(watch.relPath, name);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                // 新出现的目录: 监视其下的全部目录。监视建立之前目录中的变化没有事件，
+                // 因此在下一个标记之后再记录一次，保证之后的基准更新不会丢掉它
+                if (!addWatches(watch.root, roots_[watch.root].path / relPath, relPath)) append("overflow");
+                lateDirs_.emplace_back(watch.root, relPath);
+            }
+            record(watch.root, relPath);
+        }
+    }
+    // 全量恢复交换根目录后新的根目录已经就位，立即重新监视
+    if (std::find(rootLost_.begin(), rootLost_.end(), true) != rootLost_.end()) rearmRoots();
+}
+
+void ChangeJournal::handleCommand(const fs::path& path) {
+    std::vector<std::string> lines;
+    bool ok = readLines(path, lines);
+    std::error_code ec;
+    fs::remove(path, ec);
+    if (!ok || lines.empty()) return;
+    if (lines[0].compare(0, 5, "sync ") == 0) {
+        append(lines[0]);
+        recorded_.clear();
+        for (const auto& dir : lateDirs_) record(dir.first, dir.second);
+        lateDirs_.clear();
+    } else if (lines[0].compare(0, 7, "rebase ") == 0 && lines.size() >= 3) {
+        std::vector<std::string> sections;
+        if (lines[2] != "*") sections.assign(lines.begin() + 2, lines.end());
+        rebase(lines[0].substr(7), lines[1], sections);
+    }
+}
+
+/**
+ * @brief 丢弃标记 token 之前 sections 的记录并把基准设为 identity。
+ *        只更新部分分区时要求基准已经是 identity (其他分区的记录仍然相对于它)。
+ */
+void ChangeJournal::rebase(const std::string& token, const std::string& identity,
+                           const std::vector<std::string>& sections) {
+    auto mark = std::find(lines_.begin(), lines_.end(), "sync " + token);
+    if (mark == lines_.end()) return;   // 标记不在本次监视期间 (例如服务重启过)
+    std::unordered_set<std::string> covered(sections.begin(), sections.end());
+    bool all = sections.empty() || std::all_of(roots_.begin(), roots_.end(), [&](const JournalRoot& root) {
+        return covered.count(root.section) > 0;
+    });
+    if (!all && base_ != identity) return;
+
+    std::vector<std::string> kept;
+    for (auto it = lines_.begin(); it != mark; ++it) {
+        std::string section, relPath;
+        if (parseRecord(*it, section, relPath)) {
+            if (!all && !covered.count(section)) kept.push_back(*it);
+        } else if ((*it == "overflow" && !all) || it->compare(0, 5, "lost ") == 0) {
+            // 仍未重新监视的根目录: 基准更新之后的变化同样没有事件，日志继续无效
+            kept.push_back(*it);
+        }
+    }
+    kept.insert(kept.end(), mark + 1, lines_.end());
+    lines_.swap(kept);
+    base_ = identity;
+    rebuildRecorded();
+    rewrite();
+}
+
+// 用内存中的内容重写日志 (先写临时文件再改名)，之后的记录追加到新文件
+bool ChangeJournal::rewrite() {
+    fs::path path = journalPath(journalDir_, target_);
+    std::string content = std::string(JOURNAL_MAGIC) + "\n" + "base " + base_ + "\n";
+    for (const auto& line : lines_) content += line + "\n";
+    std::string error;
+    if (!writeFileAtomically(path, content, &error)) {
+        std::cerr << "  -> 警告: 无法更新变更日志 " << path.string() << ": " << error << std::endl;
+        return false;
+    }
+    if (journalFd_ >= 0) close(journalFd_);
+    journalFd_ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC);
+    return journalFd_ >= 0;
+}
+
+// ===== 恢复端 =====
+
+bool JournalClient::mark(const fs::path& journalDir, const std::string& target) {
+    journalDir_ = journalDir;
+    target_ = target;
+    token_.clear();
+    dirty_.clear();
+    // 监视器持有排他锁; 能拿到共享锁说明没有监视器在运行
+    int fd = ::open(lockPath(journalDir, target).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool watched = flock(fd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+    close(fd);
+    if (!watched) return false;
+    std::string token = makeToken();
+    if (!writeCommand(journalDir, target, "sync " + token + "\n")) return false;
+    token_ = token;
+    return true;
+}
+
+bool JournalClient::load(const std::string& identity, int timeoutMs) {
+    if (token_.empty()) return false;
+    const std::string markLine = "sync " + token_;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::vector<std::string> lines;
+    for (;;) {
+        lines.clear();
+        readLines(journalPath(journalDir_, target_), lines);
+        if (std::find(lines.begin(), lines.end(), markLine) != lines.end()) break;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            std::cerr << "  -> 警告: " << target_ << " 的变更日志没有及时响应，改为完整扫描" << std::endl;
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    if (lines.size() < 2 || lines[0] != JOURNAL_MAGIC || lines[1] != "base " + identity) return false;
+
+    std::unordered_map<std::string, std::unordered_set<std::string>> recorded;
+    for (size_t i = 2; lines[i] != markLine; ++i) {
+        if (lines[i] == "overflow" || lines[i].compare(0, 5, "lost ") == 0) return false;
+        std::string section, relPath;
+        if (parseRecord(lines[i], section, relPath)) recorded[section].insert(relPath);
+    }
+    // 只保留最外层的路径 (父目录已记录时其下的路径不必再单独处理)
+    for (const auto& item : recorded) {
+        std::vector<std::string>& paths = dirty_[item.first];
+        for (const auto& relPath : item.second) {
+            auto parents = ancestors(relPath);
+            if (std::none_of(parents.begin(), parents.end(),
+                             [&](const std::string& parent) { return item.second.count(parent) > 0; })) {
+                paths.push_back(relPath);
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    }
+    return true;
+}
+
+const std::vector<std::string>* JournalClient::dirtyPaths(const std::string& section) const {
+    auto it = dirty_.find(section);
+    return it == dirty_.end() ? nullptr : &it->second;
+}
+
+void JournalClient::rebase(const std::string& identity, const std::vector<std::string>& sections) {
+    if (token_.empty() || identity.empty()) return;
+    std::string content = "rebase " + token_ + "\n" + identity + "\n";
+    if (sections.empty()) content += "*\n";
+    for (const auto& section : sections) content += section + "\n";
+    writeCommand(journalDir_, target_, content);
+}
+
+void removeChangeJournal(const fs::path& journalDir, const std::string& target) {
+    std::error_code ec;
+    fs::remove(journalPath(journalDir, target), ec);
+    fs::remove(lockPath(journalDir, target), ec);
+    if (fs::exists(journalDir, ec) && fs::is_empty(journalDir, ec)) fs::remove(journalDir, ec);
+}
@@ -0,0 +1,131 @@
+#ifndef CHANGE_JOURNAL_H
+#define CHANGE_JOURNAL_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+
+/**
+ * 变更日志: 已冰冻的目标由常驻服务中的监视器用 inotify 监视其恢复根目录，
+ * 把发生变化的路径追加到 ~/.snapshot_manager/journal/<目标>.journal。
+ * 增量恢复在日志有效时只检查日志中记录的子树，不再扫描和比较整棵树。
+ *
+ * 日志只在监视器一直运行时可信: 监视器对 <目标>.lock 持有 flock，恢复端发现没有监视器时退回完整扫描。
+ * 恢复端与监视器之间通过日志目录中的命令文件 (<目标>.<序号>.cmd) 通信; 命令文件的出现本身也是一个
+ * inotify 事件，与其之前的所有文件变化按顺序到达监视器，因此:
+ *   - "sync" 命令在日志中留下标记，监视器写出标记时，标记之前的变化一定已经记录;
+ *   - 冰冻或恢复成功后的 "rebase" 命令丢弃标记之前的记录 (此时这些路径已与快照一致) 并更新日志的基准快照。
+ * 根目录的监视失效 (根目录被删除、移走，或全量恢复时与暂存目录交换) 时写入 "lost <分区>"，
+ * 根目录重新出现并重新监视后，这一行原地改为整个分区的变化记录; 在此之前日志无效。
+ * 事件队列溢出、基准快照不是当前快照时日志无效。服务正常退出时写入 "closed"，下次启动时接着使用
+ * (与干净标记一样，假定会话之间没有其他人修改这些目录); 异常退出后日志从无效状态重新开始。
+ */
+
+// 监视的一个恢复根目录 (对应快照中的一个分区)
+struct JournalRoot {
+    std::string section;
+    std::filesystem::path path;
+};
+
+/**
+ * 一个目标的监视器 (在常驻服务的主循环中使用)。
+ */
+class ChangeJournal {
+public:
+    /**
+     * @brief 开始监视 roots 并打开目标的日志。
+     * @return 失败 (已有其他监视器、inotify 监视数量不足等) 时返回 nullptr，恢复端将退回完整扫描。
+     */
+    static std::unique_ptr<ChangeJournal> start(const std::filesystem::path& journalDir, const std::string& target,
+                                                const std::vector<JournalRoot>& roots);
+    ~ChangeJournal();
+    ChangeJournal(const ChangeJournal&) = delete;
+    ChangeJournal& operator=(const ChangeJournal&) = delete;
+
+    // inotify 描述符，可读时调用 processEvents()
+    int fd() const { return inotifyFd_; }
+    void processEvents();
+
+    // 重新监视监视已失效、现在又存在的根目录 (由服务在空闲时和操作结束后调用)
+    void rearmRoots();
+
+private:
+    ChangeJournal() = default;
+    bool addWatches(size_t root, const std::filesystem::path& dir, const std::string& relPath);
+    void record(size_t root, const std::string& relPath);
+    void loseRoot(size_t root);
+    void rebuildRecorded();
+    void append(const std::string& line);
+    void handleCommand(const std::filesystem::path& path);
+    void rebase(const std::string& token, const std::string& identity, const std::vector<std::string>& sections);
+    bool rewrite();
+
+    struct Watch {
+        size_t root;
+        std::string relPath;
+    };
+
+    std::filesystem::path journalDir_;
+    std::string target_;
+    std::vector<JournalRoot> roots_;
+    int inotifyFd_ = -1;
+    int lockFd_ = -1;
+    int journalFd_ = -1;
+    int commandWatch_ = -1;
+    std::unordered_map<int, Watch> watches_;
+    std::vector<bool> rootLost_;               // 根目录的监视是否已失效 (日志中有对应的 "lost" 行)
+    std::string base_;                         // 日志的基准快照标识 ("-" 表示无效)
+    std::vector<std::string> lines_;           // 基准行之后的全部日志行
+    std::unordered_set<std::string> recorded_; // 最后一个标记之后已记录的路径 (去重)
+    std::vector<std::pair<size_t, std::string>> lateDirs_;   // 事后才建立监视的新目录 (下一个标记后再记录一次)
+};
+
+/**
+ * 恢复端 (任何进程): 在冰冻或恢复开始时放置标记，恢复前读取日志，成功后更新基准。
+ */
+class JournalClient {
+public:
+    /**
+     * @brief 在日志中放置标记 (不等待)。
+     * @return false 表示目标没有正在运行的监视器。
+     */
+    bool mark(const std::filesystem::path& journalDir, const std::string& target);
+
+    /**
+     * @brief 等待标记写入日志后读取标记之前记录的变化。
+     * @return true 表示日志有效 (基准为 identity 且没有溢出)，可以用 dirtyPaths() 限定恢复范围。
+     */
+    bool load(const std::string& identity, int timeoutMs);
+
+    /**
+     * @brief 分区中记录的变化路径 (相对分区根目录、互不嵌套，"" 表示整个分区)。
+     * @return nullptr 表示该分区没有变化。
+     */
+    const std::vector<std::string>* dirtyPaths(const std::string& section) const;
+
+    /**
+     * @brief 操作成功后丢弃标记之前 sections 的记录，并把日志的基准设为 identity。
+     * @param sections 为空表示目标的全部分区 (冰冻)。
+     */
+    void rebase(const std::string& identity, const std::vector<std::string>& sections);
+
+private:
+    std::filesystem::path journalDir_;
+    std::string target_;
+    std::string token_;
+    std::unordered_map<std::string, std::vector<std::string>> dirty_;
+};
+
+// 日志目录和目标的监视根目录 (由 desktop_snapshot_lib.cpp 按目标的定义提供)
+std::filesystem::path changeJournalDir();
+std::vector<JournalRoot> changeJournalRoots(const std::string& target);
+
+/**
+ * @brief 删除目标的日志 (解冻时)，日志目录为空时一并删除。
+ */
+void removeChangeJournal(const std::filesystem::path& journalDir, const std::string& target);
+
+#endif // CHANGE_JOURNAL_H
@@ -0,0 +1,427 @@
+#include "content_hash.h"
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ----- XXH3-64 实现 (参考 xxHash 规范, seed = 0) -----
+namespace {
+
+const uint32_t PRIME32_1 = 0x9E3779B1U;
+const uint32_t PRIME32_2 = 0x85EBCA77U;
+const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+const size_t STRIPE_LEN = 64;
+const size_t SECRET_CONSUME_RATE = 8;
+const size_t ACC_NB = 8;
+const size_t SECRET_SIZE = 192;
+
+alignas(64) const uint8_t kSecret[SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+inline uint32_t readLE32(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+inline uint64_t readLE64(const uint8_t* p) { uint64_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t mul128Fold64(uint64_t a, uint64_t b) {
+    unsigned __int128 product = (unsigned __int128)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+inline uint64_t xxh64Avalanche(uint64_t h) {
+    h ^= h >> 33; h *= PRIME64_2;
+    h ^= h >> 29; h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t xxh3Avalanche(uint64_t h) {
+    h ^= h >> 37; h *= PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= PRIME_MX2;
+    h ^= (h >> 35) + len;
+    h *= PRIME_MX2;
+    return h ^ (h >> 28);
+}
+
+inline uint64_t mix16B(const uint8_t* in, const uint8_t* secret) {
+    return mul128Fold64(readLE64(in) ^ readLE64(secret), readLE64(in + 8) ^ readLE64(secret + 8));
+}
+
+uint64_t hashLen0To16(const uint8_t* in, size_t len) {
+    if (len > 8) {
+        uint64_t lo = readLE64(in) ^ (readLE64(kSecret + 24) ^ readLE64(kSecret + 32));
+        uint64_t hi = readLE64(in + len - 8) ^ (readLE64(kSecret + 40) ^ readLE64(kSecret + 48));
+        uint64_t acc = len + __builtin_bswap64(lo) + hi + mul128Fold64(lo, hi);
+        return xxh3Avalanche(acc);
+    }
+    if (len >= 4) {
+        uint64_t input64 = readLE32(in + len - 4) + ((uint64_t)readLE32(in) << 32);
+        uint64_t keyed = input64 ^ (readLE64(kSecret + 8) ^ readLE64(kSecret + 16));
+        return rrmxmx(keyed, len);
+    }
+    if (len > 0) {
+        uint32_t combined = ((uint32_t)in[0] << 16) | ((uint32_t)in[len >> 1] << 24)
+                          | (uint32_t)in[len - 1] | ((uint32_t)len << 8);
+        uint64_t keyed = (uint64_t)combined ^ (uint64_t)(readLE32(kSecret) ^ readLE32(kSecret + 4));
+        return xxh64Avalanche(keyed);
+    }
+    return xxh64Avalanche(readLE64(kSecret + 56) ^ readLE64(kSecret + 64));
+}
+
+uint64_t hashLen17To128(const uint8_t* in, size_t len) {
+    uint64_t acc = len * PRIME64_1;
+    if (len > 32) {
+        if (len > 64) {
+            if (len > 96) {
+                acc += mix16B(in + 48, kSecret + 96);
+                acc += mix16B(in + len - 64, kSecret + 112);
+            }
+            acc += mix16B(in + 32, kSecret + 64);
+            acc += mix16B(in + len - 48, kSecret + 80);
+        }
+        acc += mix16B(in + 16, kSecret + 32);
+        acc += mix16B(in + len - 32, kSecret + 48);
+    }
+    acc += mix16B(in, kSecret);
+    acc += mix16B(in + len - 16, kSecret + 16);
+    return xxh3Avalanche(acc);
+}
+
+uint64_t hashLen129To240(const uint8_t* in, size_t len) {
+    uint64_t acc = len * PRIME64_1;
+    size_t rounds = len / 16;
+    for (size_t i = 0; i < 8; ++i) acc += mix16B(in + 16 * i, kSecret + 16 * i);
+    acc = xxh3Avalanche(acc);
+    for (size_t i = 8; i < rounds; ++i) acc += mix16B(in + 16 * i, kSecret + 16 * (i - 8) + 3);
+    acc += mix16B(in + len - 16, kSecret + 136 - 17);
+    return xxh3Avalanche(acc);
+}
+
+inline void accumulate512(uint64_t* acc, const uint8_t* in, const uint8_t* secret) {
+    for (size_t i = 0; i < ACC_NB; ++i) {
+        uint64_t dataVal = readLE64(in + 8 * i);
+        uint64_t dataKey = dataVal ^ readLE64(secret + 8 * i);
+        acc[i ^ 1] += dataVal;
+        acc[i] += (uint64_t)(uint32_t)dataKey * (dataKey >> 32);
+    }
+}
+
+// ----- 长输入的累加与扰乱: 标量实现以及 SSE2 / AVX2 实现 (运行时按 CPU 选择，结果完全相同) -----
+
+// 依次累加 nbStripes 个 64 字节的条带，第 s 个条带使用 secret + s * 8
+void accumulateScalar(uint64_t* acc, const uint8_t* in, const uint8_t* secret, size_t nbStripes) {
+    for (size_t s = 0; s < nbStripes; ++s) accumulate512(acc, in + s * STRIPE_LEN, secret + s * SECRET_CONSUME_RATE);
+}
+
+void scrambleScalar(uint64_t* acc, const uint8_t* secret) {
+    for (size_t i = 0; i < ACC_NB; ++i) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= readLE64(secret + 8 * i);
+        a *= PRIME32_1;
+        acc[i] = a;
+    }
+}
+
+#if defined(__x86_64__)
+void accumulateSse2(uint64_t* acc, const uint8_t* in, const uint8_t* secret, size_t nbStripes) {
+    __m128i* xacc = reinterpret_cast<__m128i*>(acc);
+    __m128i a[4] = { _mm_load_si128(xacc), _mm_load_si128(xacc + 1),
+                     _mm_load_si128(xacc + 2), _mm_load_si128(xacc + 3) };
+    for (size_t s = 0; s < nbStripes; ++s) {
+        const uint8_t* stripe = in + s * STRIPE_LEN;
+        const uint8_t* key = secret + s * SECRET_CONSUME_RATE;
+        for (int i = 0; i < 4; ++i) {
+            __m128i dataVec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stripe) + i);
+            __m128i keyVec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key) + i);
+            __m128i dataKey = _mm_xor_si128(dataVec, keyVec);
+            __m128i product = _mm_mul_epu32(dataKey, _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swapped = _mm_shuffle_epi32(dataVec, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+        }
+    }
+    for (int i = 0; i < 4; ++i) _mm_store_si128(xacc + i, a[i]);
+}
+
+void scrambleSse2(uint64_t* acc, const uint8_t* secret) {
+    __m128i* xacc = reinterpret_cast<__m128i*>(acc);
+    const __m128i prime32 = _mm_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 4; ++i) {
+        __m128i a = _mm_load_si128(xacc + i);
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i));
+        __m128i high = _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+        __m128i productLow = _mm_mul_epu32(a, prime32);
+        __m128i productHigh = _mm_mul_epu32(high, prime32);
+        _mm_store_si128(xacc + i, _mm_add_epi64(productLow, _mm_slli_epi64(productHigh, 32)));
+    }
+}
+
+__attribute__((target("avx2")))
+void accumulateAvx2(uint64_t* acc, const uint8_t* in, const uint8_t* secret, size_t nbStripes) {
+    __m256i* xacc = reinterpret_cast<__m256i*>(acc);
+    __m256i a0 = _mm256_load_si256(xacc);
+    __m256i a1 = _mm256_load_si256(xacc + 1);
+    for (size_t s = 0; s < nbStripes; ++s) {
+        const __m256i* stripe = reinterpret_cast<const __m256i*>(in + s * STRIPE_LEN);
+        const __m256i* key = reinterpret_cast<const __m256i*>(secret + s * SECRET_CONSUME_RATE);
+        __m256i data0 = _mm256_loadu_si256(stripe);
+        __m256i data1 = _mm256_loadu_si256(stripe + 1);
+        __m256i dataKey0 = _mm256_xor_si256(data0, _mm256_loadu_si256(key));
+        __m256i dataKey1 = _mm256_xor_si256(data1, _mm256_loadu_si256(key + 1));
+        __m256i product0 = _mm256_mul_epu32(dataKey0, _mm256_srli_epi64(dataKey0, 32));
+        __m256i product1 = _mm256_mul_epu32(dataKey1, _mm256_srli_epi64(dataKey1, 32));
+        a0 = _mm256_add_epi64(a0, _mm256_add_epi64(product0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2))));
+        a1 = _mm256_add_epi64(a1, _mm256_add_epi64(product1, _mm256_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+    _mm256_store_si256(xacc, a0);
+    _mm256_store_si256(xacc + 1, a1);
+}
+
+__attribute__((target("avx2")))
+void scrambleAvx2(uint64_t* acc, const uint8_t* secret) {
+    __m256i* xacc = reinterpret_cast<__m256i*>(acc);
+    const __m256i prime32 = _mm256_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 2; ++i) {
+        __m256i a = _mm256_load_si256(xacc + i);
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i));
+        __m256i high = _mm256_shuffle_epi32(a, _MM_SHUFFLE(0, 3, 0, 1));
+        __m256i productLow = _mm256_mul_epu32(a, prime32);
+        __m256i productHigh = _mm256_mul_epu32(high, prime32);
+        _mm256_store_si256(xacc + i, _mm256_add_epi64(productLow, _mm256_slli_epi64(productHigh, 32)));
+    }
+}
+#endif
+
+struct Xxh3Kernel {
+    void (*accumulate)(uint64_t* acc, const uint8_t* in, const uint8_t* secret, size_t nbStripes);
+    void (*scramble)(uint64_t* acc, const uint8_t* secret);
+    const char* name;
+};
+
+Xxh3Kernel selectKernel() {
+#if defined(__x86_64__)
+    if (const char* forced = std::getenv("DESKSNAPSHOT_XXH3")) {
+        // 仅用于对比测试各实现: scalar / sse2 (avx2 仍需 CPU 支持)
+        if (std::strcmp(forced, "scalar") == 0) return {accumulateScalar, scrambleScalar, "scalar"};
+        if (std::strcmp(forced, "sse2") == 0) return {accumulateSse2, scrambleSse2, "sse2"};
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {accumulateAvx2, scrambleAvx2, "avx2"};
+    return {accumulateSse2, scrambleSse2, "sse2"};   // x86-64 总是支持 SSE2
+#else
+    return {accumulateScalar, scrambleScalar, "scalar"};
+#endif
+}
+
+const Xxh3Kernel& kernel() {
+    static const Xxh3Kernel selected = selectKernel();
+    return selected;
+}
+
+const size_t STRIPES_PER_BLOCK = (SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE;
+const size_t BLOCK_LEN = STRIPE_LEN * STRIPES_PER_BLOCK;
+// 最后一个条带使用的 secret 偏移
+const size_t LAST_STRIPE_SECRET = SECRET_SIZE - STRIPE_LEN - 7;
+
+void initAcc(uint64_t* acc) {
+    const uint64_t init[ACC_NB] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3,
+                                    PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+    std::memcpy(acc, init, sizeof(init));
+}
+
+uint64_t mergeAcc(const uint64_t* acc, uint64_t len) {
+    uint64_t result = len * PRIME64_1;
+    for (size_t i = 0; i < 4; ++i) {
+        const uint8_t* secret = kSecret + 11 + 16 * i;
+        result += mul128Fold64(acc[2 * i] ^ readLE64(secret), acc[2 * i + 1] ^ readLE64(secret + 8));
+    }
+    return xxh3Avalanche(result);
+}
+
+uint64_t hashLong(const uint8_t* in, size_t len) {
+    const Xxh3Kernel& k = kernel();
+    alignas(32) uint64_t acc[ACC_NB];
+    initAcc(acc);
+    const size_t blocks = (len - 1) / BLOCK_LEN;
+    for (size_t b = 0; b < blocks; ++b) {
+        k.accumulate(acc, in + b * BLOCK_LEN, kSecret, STRIPES_PER_BLOCK);
+        k.scramble(acc, kSecret + SECRET_SIZE - STRIPE_LEN);
+    }
+    const size_t stripes = ((len - 1) - BLOCK_LEN * blocks) / STRIPE_LEN;
+    k.accumulate(acc, in + blocks * BLOCK_LEN, kSecret, stripes);
+    k.accumulate(acc, in + len - STRIPE_LEN, kSecret + LAST_STRIPE_SECRET, 1);
+    return mergeAcc(acc, len);
+}
+
+} // namespace
+
+uint64_t xxh3_64(const void* data, size_t len) {
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    if (len <= 16) return hashLen0To16(in, len);
+    if (len <= 128) return hashLen17To128(in, len);
+    if (len <= 240) return hashLen129To240(in, len);
+    return hashLong(in, len);
+}
+
+const char* xxh3Implementation() {
+    return kernel().name;
+}
+
+Xxh3Stream::Xxh3Stream() {
+    initAcc(acc_);
+}
+
+// 累加 count 个完整的条带，每满一个块扰乱一次
+void Xxh3Stream::consume(const uint8_t* stripes, size_t count) {
+    const Xxh3Kernel& k = kernel();
+    while (count > 0) {
+        size_t n = std::min(count, STRIPES_PER_BLOCK - stripesInBlock_);
+        k.accumulate(acc_, stripes, kSecret + stripesInBlock_ * SECRET_CONSUME_RATE, n);
+        stripesInBlock_ += n;
+        if (stripesInBlock_ == STRIPES_PER_BLOCK) {
+            k.scramble(acc_, kSecret + SECRET_SIZE - STRIPE_LEN);
+            stripesInBlock_ = 0;
+        }
+        stripes += n * STRIPE_LEN;
+        count -= n;
+    }
+}
+
+void Xxh3Stream::update(const void* data, size_t len) {
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    if (total_ < sizeof(head_)) {
+        size_t n = std::min<uint64_t>(len, sizeof(head_) - total_);
+        std::memcpy(head_ + total_, in, n);
+    }
+    total_ += len;
+    // 与一次性计算一致: 一个条带只有在其后还有数据时才累加，最后一个条带留到 digest 时处理
+    while (len > 0) {
+        if (pendingSize_ == STRIPE_LEN) {
+            consume(pending_, 1);
+            std::memcpy(previous_, pending_, STRIPE_LEN);
+            pendingSize_ = 0;
+        }
+        if (pendingSize_ == 0 && len > STRIPE_LEN) {
+            size_t count = (len - 1) / STRIPE_LEN;
+            consume(in, count);
+            std::memcpy(previous_, in + (count - 1) * STRIPE_LEN, STRIPE_LEN);
+            in += count * STRIPE_LEN;
+            len -= count * STRIPE_LEN;
+        }
+        size_t n = std::min(len, STRIPE_LEN - pendingSize_);
+        std::memcpy(pending_ + pendingSize_, in, n);
+        pendingSize_ += n;
+        in += n;
+        len -= n;
+    }
+}
+
+uint64_t Xxh3Stream::digest() const {
+    if (total_ <= sizeof(head_)) return xxh3_64(head_, (size_t)total_);
+    alignas(32) uint64_t acc[ACC_NB];
+    std::memcpy(acc, acc_, sizeof(acc));
+    // 最后 64 字节: 上一个条带的末尾加上尚未累加的部分
+    uint8_t last[STRIPE_LEN];
+    std::memcpy(last, previous_ + pendingSize_, STRIPE_LEN - pendingSize_);
+    std::memcpy(last + STRIPE_LEN - pendingSize_, pending_, pendingSize_);
+    kernel().accumulate(acc, last, kSecret + LAST_STRIPE_SECRET, 1);
+    return mergeAcc(acc, total_);
+}
+
+bool hashFile(const std::filesystem::path& path, uint64_t& out, bool followSymlinks) {
+    // O_NONBLOCK: 路径被换成 FIFO 时打开不会阻塞，随后因不是普通文件而失败
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK | (followSymlinks ? 0 : O_NOFOLLOW));
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // 只哈希打开时的长度; 读到文件末尾之前就结束说明文件被截短，结果不可信
+    const size_t WINDOW = 256 * 1024;
+    std::vector<uint8_t> buffer(std::min<uint64_t>((uint64_t)st.st_size, WINDOW));
+    Xxh3Stream stream;
+    uint64_t remaining = (uint64_t)st.st_size;
+    off_t offset = 0;
+    while (remaining > 0) {
+        ssize_t n = pread(fd, buffer.data(), (size_t)std::min<uint64_t>(remaining, buffer.size()), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        stream.update(buffer.data(), (size_t)n);
+        remaining -= (uint64_t)n;
+        offset += n;
+    }
+    close(fd);
+    out = stream.digest();
+    return true;
+}
+
+bool hashStoreObject(const std::filesystem::path& path, uint64_t& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(fd); return false; }
+
+    if (st.st_size == 0) {
+        close(fd);
+        out = xxh3_64(nullptr, 0);
+        return true;
+    }
+
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    out = xxh3_64(map, (size_t)st.st_size);
+    munmap(map, (size_t)st.st_size);
+    return true;
+}
+
+std::string hashToHex(uint64_t hash) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)hash);
+    return std::string(buf);
+}
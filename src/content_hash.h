@@ -0,0 +1,62 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <filesystem>
+
+/**
+ * @brief 计算一段内存的 XXH3-64 哈希值 (seed = 0, 默认 secret)。
+ *        结果与官方 xxhash 库的 XXH3_64bits() 完全一致。
+ */
+uint64_t xxh3_64(const void* data, size_t len);
+
+/**
+ * @brief 当前使用的 XXH3 长输入实现 ("avx2" / "sse2" / "scalar")，首次计算时按 CPU 选定。
+ */
+const char* xxh3Implementation();
+
+/**
+ * XXH3-64 的流式计算，结果与对全部数据一次调用 xxh3_64 相同 (用于分块解码的内容)。
+ */
+class Xxh3Stream {
+public:
+    Xxh3Stream();
+    void update(const void* data, size_t len);
+    uint64_t digest() const;
+
+private:
+    void consume(const uint8_t* stripes, size_t count);
+
+    alignas(32) uint64_t acc_[8];
+    uint8_t head_[240];        // 前 240 字节 (总长度不超过 240 时使用短输入算法)
+    uint8_t pending_[64];      // 尚未累加的条带 (只有确定后面还有数据时才累加)
+    uint8_t previous_[64];     // 最近累加的条带，用于拼出最后 64 字节
+    size_t pendingSize_ = 0;
+    size_t stripesInBlock_ = 0;
+    uint64_t total_ = 0;
+};
+
+/**
+ * @brief 以 pread 分段读取文件并流式计算 XXH3-64 哈希 (用于可能被其他进程同时修改的实时文件)。
+ * @param path 文件路径。
+ * @param out  输出的哈希值。
+ * @param followSymlinks 为 false 时路径本身是符号链接则失败 (O_NOFOLLOW)。
+ * @return true 表示成功, false 表示文件无法打开、不是普通文件，或读取期间被截短。
+ */
+bool hashFile(const std::filesystem::path& path, uint64_t& out, bool followSymlinks = false);
+
+/**
+ * @brief 通过内存映射读取整个文件并计算 XXH3-64 哈希。映射期间文件被截短会触发 SIGBUS，
+ *        因此只用于写入后不再修改的存储对象 (blob)。
+ * @return true 表示成功, false 表示文件无法打开、不是普通文件或无法映射。
+ */
+bool hashStoreObject(const std::filesystem::path& path, uint64_t& out);
+
+/**
+ * @brief 将 64 位哈希值格式化为 16 位小写十六进制字符串。
+ */
+std::string hashToHex(uint64_t hash);
+
+#endif // CONTENT_HASH_H
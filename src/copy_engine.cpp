@@ -0,0 +1,262 @@
+#include "copy_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t BUFFERED_CHUNK = 1 << 20;          // 缓冲复制每次读写 1 MiB
+const size_t KERNEL_CHUNK = (size_t)1 << 30;    // copy_file_range / sendfile 单次最多 1 GiB
+
+std::atomic<uint64_t> g_files[(int)CopyStrategy::Count];
+std::atomic<uint64_t> g_bytes[(int)CopyStrategy::Count];
+std::atomic<uint64_t> g_holeBytes{0};
+// resetCopyRunStats 时的计数，本次运行的统计为累计值减去它 (累计值本身从不清零)
+CopyRunStats g_runBase;
+std::mutex g_runBaseMutex;
+
+// 自动关闭的文件描述符
+struct FdGuard {
+    int fd;
+    explicit FdGuard(int f) : fd(f) {}
+    ~FdGuard() { if (fd >= 0) close(fd); }
+    FdGuard(const FdGuard&) = delete;
+    FdGuard& operator=(const FdGuard&) = delete;
+};
+
+// 这些错误表示当前方式不被支持，应退回下一种方式
+bool isUnsupported(int err) {
+    return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP ||
+           err == ENOTTY || err == EBADF || err == ETXTBSY || err == EPERM;
+}
+
+/**
+ * @brief 复制 [offset, offset + length) 区间，按 copy_file_range -> sendfile -> 缓冲读写 的顺序退化。
+ * @param strategy 输入为当前可用的最佳方式，退化后会被更新，供后续区间直接使用。
+ */
+bool copyRange(int in, int out, off_t offset, uint64_t length, CopyStrategy& strategy, std::string& error) {
+    uint64_t remaining = length;
+
+    while (remaining > 0 && strategy == CopyStrategy::CopyFileRange) {
+        loff_t inOff = offset;
+        loff_t outOff = offset;
+        ssize_t n = copy_file_range(in, &inOff, out, &outOff, std::min<uint64_t>(remaining, KERNEL_CHUNK), 0);
+        if (n > 0) { offset += n; remaining -= (uint64_t)n; continue; }
+        if (n == 0) break;   // 源文件在复制期间被截短
+        if (errno == EINTR) continue;
+        if (!isUnsupported(errno)) { error = std::string("copy_file_range: ") + strerror(errno); return false; }
+        strategy = CopyStrategy::Sendfile;
+    }
+
+    while (remaining > 0 && strategy == CopyStrategy::Sendfile) {
+        if (lseek(out, offset, SEEK_SET) < 0) { strategy = CopyStrategy::Buffered; break; }
+        off_t inOff = offset;
+        ssize_t n = sendfile(out, in, &inOff, std::min<uint64_t>(remaining, KERNEL_CHUNK));
+        if (n > 0) { offset += n; remaining -= (uint64_t)n; continue; }
+        if (n == 0) break;
+        if (errno == EINTR) continue;
+        if (!isUnsupported(errno)) { error = std::string("sendfile: ") + strerror(errno); return false; }
+        strategy = CopyStrategy::Buffered;
+    }
+
+    if (remaining > 0 && strategy == CopyStrategy::Buffered) {
+        std::vector<char> buffer(std::min<uint64_t>(remaining, BUFFERED_CHUNK));
+        while (remaining > 0) {
+            ssize_t n = pread(in, buffer.data(), std::min<uint64_t>(remaining, buffer.size()), offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) { error = std::string("read: ") + strerror(errno); return false; }
+            if (n == 0) break;
+            ssize_t written = 0;
+            while (written < n) {
+                ssize_t w = pwrite(out, buffer.data() + written, n - written, offset + written);
+                if (w < 0 && errno == EINTR) continue;
+                if (w < 0) { error = std::string("write: ") + strerror(errno); return false; }
+                written += w;
+            }
+            offset += n;
+            remaining -= (uint64_t)n;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 非 reflink 路径: 按数据段复制，跳过空洞，最后用 ftruncate 补齐文件长度。
+ */
+bool copyDataSegments(int in, int out, uint64_t size, CopyStrategy& strategy, std::string& error) {
+    uint64_t copied = 0;
+    off_t offset = 0;
+    while ((uint64_t)offset < size) {
+        off_t dataStart = lseek(in, offset, SEEK_DATA);
+        if (dataStart < 0) {
+            if (errno == ENXIO) break;   // 之后全是空洞
+            dataStart = offset;          // 文件系统不支持 SEEK_DATA: 视为整段数据
+        }
+        off_t dataEnd = lseek(in, dataStart, SEEK_HOLE);
+        if (dataEnd < 0 || (uint64_t)dataEnd > size) dataEnd = (off_t)size;
+        if (dataEnd <= dataStart) break;
+
+        if (!copyRange(in, out, dataStart, (uint64_t)(dataEnd - dataStart), strategy, error)) return false;
+        copied += (uint64_t)(dataEnd - dataStart);
+        offset = dataEnd;
+    }
+    if (ftruncate(out, (off_t)size) != 0) {
+        error = std::string("ftruncate: ") + strerror(errno);
+        return false;
+    }
+    g_holeBytes += size - std::min(size, copied);
+    return true;
+}
+
+} // namespace
+
+bool copyFdContents(int inFd, int outFd, CopyStrategy* used, std::string* error) {
+    std::string localError;
+    std::string& err = error ? *error : localError;
+
+    struct stat st;
+    if (fstat(inFd, &st) != 0) { err = std::string("fstat: ") + strerror(errno); return false; }
+
+    uint64_t size = (uint64_t)st.st_size;
+    CopyStrategy strategy = CopyStrategy::Reflink;
+
+    // 1. reflink: 共享数据块，瞬间完成
+    if (size == 0 || ioctl(outFd, FICLONE, inFd) != 0) {
+        strategy = CopyStrategy::CopyFileRange;
+        posix_fadvise(inFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (!copyDataSegments(inFd, outFd, size, strategy, err)) return false;
+    }
+
+    g_files[(int)strategy]++;
+    g_bytes[(int)strategy] += size;
+    if (used) *used = strategy;
+    return true;
+}
+
+bool copyFileContents(const fs::path& source, const fs::path& dest, mode_t mode,
+                      CopyStrategy* used, std::string* error) {
+    FdGuard in(open(source.c_str(), O_RDONLY | O_CLOEXEC));
+    if (in.fd < 0) {
+        if (error) *error = std::string("open source: ") + strerror(errno);
+        return false;
+    }
+    FdGuard out(open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode));
+    if (out.fd < 0) {
+        if (error) *error = std::string("open dest: ") + strerror(errno);
+        return false;
+    }
+    return copyFdContents(in.fd, out.fd, used, error);
+}
+
+void copyFileOrThrow(const fs::path& source, const fs::path& dest, mode_t mode) {
+    std::string error;
+    if (!copyFileContents(source, dest, mode, nullptr, &error)) {
+        throw fs::filesystem_error(error, source, dest, std::make_error_code(std::errc::io_error));
+    }
+}
+
+bool writeFileAtomically(const fs::path& path, const std::string& content, std::string* error) {
+    static std::atomic<uint64_t> counter{0};
+    auto fail = [&](const char* what) {
+        if (error) *error = std::string(what) + ": " + strerror(errno);
+        return false;
+    };
+    fs::path parent = path.parent_path();
+    FdGuard dir(::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir.fd < 0) return fail("open directory");
+    std::string name = path.filename().string();
+    std::string temp = name + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++);
+
+    bool ok = true;
+    {
+        FdGuard out(openat(dir.fd, temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666));
+        if (out.fd < 0) return fail("open temp");
+        const char* data = content.data();
+        size_t left = content.size();
+        while (ok && left > 0) {
+            ssize_t n = ::write(out.fd, data, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ok = fail("write");
+                break;
+            }
+            data += n;
+            left -= (size_t)n;
+        }
+        if (ok && ::close(out.fd) != 0) ok = fail("close");
+        out.fd = -1;
+    }
+    if (ok && renameat(dir.fd, temp.c_str(), dir.fd, name.c_str()) != 0) ok = fail("rename");
+    if (!ok) unlinkat(dir.fd, temp.c_str(), 0);
+    return ok;
+}
+
+void recordCopiedFile(CopyStrategy strategy, uint64_t bytes) {
+    g_files[(int)strategy]++;
+    g_bytes[(int)strategy] += bytes;
+}
+
+void resetCopyRunStats() {
+    std::lock_guard<std::mutex> lock(g_runBaseMutex);
+    g_runBase = getCopyTotals();
+}
+
+CopyRunStats getCopyRunStats() {
+    CopyRunStats stats = getCopyTotals();
+    std::lock_guard<std::mutex> lock(g_runBaseMutex);
+    for (int i = 0; i < (int)CopyStrategy::Count; ++i) {
+        stats.files[i] -= g_runBase.files[i];
+        stats.bytes[i] -= g_runBase.bytes[i];
+    }
+    stats.holeBytes -= g_runBase.holeBytes;
+    return stats;
+}
+
+CopyRunStats getCopyTotals() {
+    CopyRunStats stats;
+    for (int i = 0; i < (int)CopyStrategy::Count; ++i) {
+        stats.files[i] = g_files[i].load();
+        stats.bytes[i] = g_bytes[i].load();
+    }
+    stats.holeBytes = g_holeBytes.load();
+    return stats;
+}
+
+const char* copyStrategyName(CopyStrategy strategy) {
+    switch (strategy) {
+        case CopyStrategy::Reflink: return "reflink";
+        case CopyStrategy::CopyFileRange: return "copy_file_range";
+        case CopyStrategy::Sendfile: return "sendfile";
+        case CopyStrategy::Buffered: return "buffered";
+        case CopyStrategy::IoUring: return "io_uring";
+        case CopyStrategy::Unpack: return "unpack";
+        case CopyStrategy::Delta: return "delta";
+        default: return "unknown";
+    }
+}
+
+std::string formatCopyRunStats(const CopyRunStats& stats) {
+    std::ostringstream out;
+    bool any = false;
+    for (int i = 0; i < (int)CopyStrategy::Count; ++i) {
+        if (stats.files[i] == 0) continue;
+        out << (any ? ", " : "") << copyStrategyName((CopyStrategy)i) << " " << stats.files[i]
+            << " 个文件 (" << stats.bytes[i] << " 字节)";
+        any = true;
+    }
+    if (!any) return "无文件复制";
+    if (stats.holeBytes > 0) out << ", 跳过稀疏空洞 " << stats.holeBytes << " 字节";
+    return out.str();
+}
@@ -0,0 +1,86 @@
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#include <cstdint>
+#include <string>
+#include <filesystem>
+#include <sys/types.h>
+
+/**
+ * 文件内容复制引擎。按以下顺序尝试，尽量把数据搬运交给内核完成:
+ *   1. FICLONE reflink (btrfs/xfs 上瞬间完成，不产生数据写入)
+ *   2. copy_file_range (内核内复制，部分文件系统可在服务端/块层完成)
+ *   3. sendfile
+ *   4. 用户态缓冲读写
+ * 小文件在启用 io_uring 后端时由 uring_copy 批量复制，打包快照的文件由 pack_store 解出，结果同样计入本模块的统计。
+ * 非 reflink 路径通过 SEEK_DATA/SEEK_HOLE 只复制数据段，保留稀疏文件的空洞。
+ */
+
+// 复制策略
+enum class CopyStrategy : int {
+    Reflink = 0,
+    CopyFileRange = 1,
+    Sendfile = 2,
+    Buffered = 3,
+    IoUring = 4,       // uring_copy 批量复制的小文件
+    Unpack = 5,        // 从打包容器中解出的文件
+    Delta = 6,         // 按块原地更新的大文件 (只统计实际写入的字节)
+    Count = 7
+};
+
+// 一次运行 (冰冻或恢复) 中各复制策略的统计
+struct CopyRunStats {
+    uint64_t files[(int)CopyStrategy::Count] = {};
+    uint64_t bytes[(int)CopyStrategy::Count] = {};
+    uint64_t holeBytes = 0;   // 因稀疏空洞而未复制的字节数
+};
+
+/**
+ * @brief 将 source 的内容复制到新文件 dest (已存在则截断覆盖)。
+ * @param mode 新建文件的权限 (调用方可在之后再调整)。
+ * @param used 输出本文件实际使用的复制策略 (可为 nullptr)。
+ * @return true 表示成功; 失败时 error 中给出原因 (可为 nullptr)。
+ */
+bool copyFileContents(const std::filesystem::path& source, const std::filesystem::path& dest,
+                      mode_t mode, CopyStrategy* used = nullptr, std::string* error = nullptr);
+
+/**
+ * @brief 将已打开的 inFd 的全部内容复制到已打开 (且为空) 的 outFd，策略选择与 copyFileContents 相同。
+ *        供按目录 fd 创建目标文件的调用方使用，两个 fd 均由调用方关闭。
+ */
+bool copyFdContents(int inFd, int outFd, CopyStrategy* used = nullptr, std::string* error = nullptr);
+
+/**
+ * @brief 与 copyFileContents 相同，但失败时抛出 std::filesystem::filesystem_error，
+ *        便于替换原有的 fs::copy_file 调用。
+ */
+void copyFileOrThrow(const std::filesystem::path& source, const std::filesystem::path& dest, mode_t mode);
+
+/**
+ * @brief 原子地写入整个文件: 在 path 所在目录中以 O_CREAT|O_EXCL|O_NOFOLLOW 新建唯一命名的临时文件
+ *        (<文件名>.tmp.<pid>.<序号>)，写完后重命名为 path。不会跟随预先放好的符号链接，
+ *        并发的写入者也不会共用同一个临时文件。
+ * @return true 表示成功; 失败时删除临时文件，error 中给出原因 (可为 nullptr)。
+ */
+bool writeFileAtomically(const std::filesystem::path& path, const std::string& content,
+                         std::string* error = nullptr);
+
+// 记录一个由其他后端 (如 io_uring) 复制的文件
+void recordCopiedFile(CopyStrategy strategy, uint64_t bytes);
+
+// 清零本次运行的复制统计
+void resetCopyRunStats();
+
+// 取得本次运行的复制统计 (线程安全)
+CopyRunStats getCopyRunStats();
+
+// 取得进程启动以来累计的复制统计 (不受 resetCopyRunStats 影响，用于计算各阶段的增量)
+CopyRunStats getCopyTotals();
+
+// 返回复制策略的名称
+const char* copyStrategyName(CopyStrategy strategy);
+
+// 将复制统计格式化为一行可读文本
+std::string formatCopyRunStats(const CopyRunStats& stats);
+
+#endif // COPY_ENGINE_H
@@ -1,19 +1,48 @@
 #include "../include/desktop_snapshot_api.h"
+#include "tree_sync.h"
+#include "blob_store.h"
+#include "content_hash.h"
+#include "snapshot_manifest.h"
+#include "copy_engine.h"
+#include "thread_pool.h"
+#include "icon_metadata.h"
+#include "pack_store.h"
+#include "restore_scheduler.h"
+#include "tree_swap.h"
+#include "async_operation.h"
+#include "run_stats.h"
+#include "change_journal.h"
+#include "snapshot_generations.h"
+#include "target_config.h"
+#include "block_table.h"
+#include "relocation.h"
+#include "json_util.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <stdexcept>
 #include <filesystem>
 #include <memory>
-#include <array>
-#include <regex>
+#include <mutex>
+#include <ctime>
+#include <chrono>
 #include <unistd.h> // 必须包含，用于 chown, lchown, getuid, getgid
+#include <fcntl.h>
+#include <sys/file.h>
+#include <grp.h>
 #include <sys/stat.h>
 
 namespace fs = std::filesystem;
 
+// 以下三个列表是默认的冰冻目标，可由配置文件替换 (见 target_config.h)
 // 1. 定义要备份的用户文件夹列表 (已移除 Downloads)
 const std::vector<std::string> HOME_FOLDER_TARGETS = {
     "Videos", "Pictures", "Documents", "Music"
@@ -33,10 +62,50 @@ const std::vector<std::string> SYSTEM_TARGETS = {
 
 // ----- 配置常量 -----
 const std::string BASE_SNAPSHOT_DIR = ".snapshot_manager";
-const std::string ICON_POSITION_KEY = "metadata::dde-file-manager-icon-position";
-const std::string SNAPSHOT_MANIFEST_NAME = "snapshot.manifest";
+const std::string BINARY_MANIFEST_NAME = "manifest.bin";
+const std::string SNAPSHOT_MANIFEST_NAME = "snapshot.manifest";   // 旧版图标清单 (只读)
 const std::string BOOT_TRIGGER_FILENAME = "restore_on_boot.flag";
+const std::string CLEAN_MARKER_FILENAME = "restored_clean.marker";   // 会话结束时已完成恢复
+const std::string CONTENT_MANIFEST_NAME = "content.manifest";     // 旧版文本内容清单 (只读)
+const std::string BLOB_STORE_DIR = "store";
+const std::string JOURNAL_DIR = "journal";   // 变更日志 (常驻服务监视已冰冻的目标时写入)
+const int JOURNAL_SYNC_TIMEOUT_MS = 2000;     // 等待监视器确认标记的最长时间，超时退回完整扫描
+const std::string GENERATIONS_DIR = "generations";   // 各目标快照的历代 (见 snapshot_generations.h)
+const std::string GENERATION_FILENAME = "generation"; // 当前代的名称 (在目标快照目录中)
 const std::vector<std::string> SUPPORTED_TARGETS = {"desktop", "home_folders"};
+const std::string SYSTEM_TARGET_CONFIG = "/etc/desktop-snapshot/targets.conf";   // 系统配置 (属于 root)
+const std::string USER_TARGET_CONFIG = ".config/desktop-snapshot/targets.conf";  // 用户配置 (相对于 HOME)
+
+// ----- 运行时选项 -----
+// 恢复模式，默认只恢复发生变化的条目
+int g_restoreMode = SNAPSHOT_RESTORE_INCREMENTAL;
+// 从 blob 存储物化文件的方式，默认复制
+int g_materializeMode = SNAPSHOT_MATERIALIZE_COPY;
+// 冰冻的存储方式和打包时的压缩方式
+int g_storageMode = SNAPSHOT_STORAGE_BLOBS;
+int g_packCompression = SNAPSHOT_COMPRESS_LZ4;
+// 不小于此大小的文件冰冻时记录块校验表，恢复时按块更新 (0 表示不使用)
+uint64_t g_deltaThreshold = 64ULL << 20;
+// 恢复前是否先校验快照，以及本进程中已校验通过的快照 (目标名 + 清单标识)
+bool g_verifyBeforeRestore = false;
+std::mutex g_verifiedMutex;
+std::unordered_set<std::string> g_verifiedSnapshots;
+// 冰冻产生的代的名称 (空表示按冰冻时间命名) 和按时间命名的代的保留策略
+std::string g_generationName;
+int g_keepGenerations = 5;
+int64_t g_keepGenerationSeconds = 0;
+// 为所有用户恢复时，子进程负责的用户 (恢复出的用户文件归其所有)
+bool g_sessionOverride = false;
+uid_t g_sessionUid = 0;
+gid_t g_sessionGid = 0;
+
+// do_restore 要执行的部分
+const int RESTORE_PART_FILES = 1;   // 主要文件 (desktop: 主目录中的启动器配置和桌面文件; home_folders: 用户文件夹)
+const int RESTORE_PART_ICONS = 2;   // 桌面图标位置和桌面刷新 (需要用户会话中的 gvfs 元数据服务)
+const int RESTORE_PART_TRASH = 4;   // 回收站 (desktop 目标)
+const int RESTORE_PART_SYSTEM = 8;  // 系统目录中的启动器配置 (desktop 目标，如 /usr/share/applications，需要 root 权限)
+const int RESTORE_PART_CONTENT = RESTORE_PART_FILES | RESTORE_PART_TRASH | RESTORE_PART_SYSTEM;
+const int RESTORE_PART_ALL = RESTORE_PART_CONTENT | RESTORE_PART_ICONS;
 
 // ----- 内部辅助函数 -----
 // 获取用户主目录
@@ -50,6 +119,22 @@ fs::path getUserHome() {
     return fs::path(homeDir);
 }
 	 
+// 恢复出的用户文件的拥有者: 通常是调用者 (SUID 运行时 getuid 仍是普通用户)，
+// 为所有用户恢复时是子进程负责的用户
+uid_t sessionUid() {
+    return g_sessionOverride ? g_sessionUid : getuid();
+}
+
+gid_t sessionGid() {
+    return g_sessionOverride ? g_sessionGid : getgid();
+}
+
+// 是否正以 root 身份代替会话用户运行 (为所有用户恢复时的系统目录部分)。
+// 此时用户主目录中的路径都可能被用户换成符号链接，不向其中写入任何状态文件
+bool actingForSessionUser() {
+    return g_sessionOverride && geteuid() != g_sessionUid;
+}
+
 // 获取快照目录路径
 fs::path getBaseSnapshotPath() {
     return getUserHome() / BASE_SNAPSHOT_DIR;
@@ -65,222 +150,843 @@ fs::path getTriggerFilePath(const std::string& target) {
     return getSnapshotPathForTarget(target) / BOOT_TRIGGER_FILENAME;
 }
 
+// 获取 "会话结束时已恢复" 标记文件路径
+fs::path getCleanMarkerPath(const std::string& target) {
+    return getSnapshotPathForTarget(target) / CLEAN_MARKER_FILENAME;
+}
+
+// [新增] 回收站路径的辅助函数
+fs::path getTrashPath() {
+    return getUserHome() / ".local/share/Trash";
+}
+
+// 当前是否使用增量恢复
+bool isIncrementalRestore() {
+    return g_restoreMode != SNAPSHOT_RESTORE_FULL;
+}
+
+// 根据当前恢复模式构造增量同步选项
+SyncOptions makeRestoreOptions(uid_t owner_uid, gid_t owner_gid) {
+    SyncOptions options;
+    options.compareContent = (g_restoreMode == SNAPSHOT_RESTORE_CHECKSUM);
+    options.deleteExtra = true;
+    options.ownerUid = owner_uid;
+    options.ownerGid = owner_gid;
+    options.hardlinkSources = (g_materializeMode == SNAPSHOT_MATERIALIZE_HARDLINK);
+    return options;
+}
+
+// 打印恢复的统计信息
+void printSyncSummary(const SyncStats& stats) {
+    std::cout << "  -> 恢复统计: 复制 " << stats.filesCopied << " 个文件 (" << stats.bytesCopied
+              << " 字节), 删除 " << stats.entriesRemoved << " 个多余条目, 修正 " << stats.metadataFixed
+              << " 个条目的属性, " << stats.entriesUnchanged << " 个条目未变化 (跳过 "
+              << stats.bytesSkipped << " 字节)";
+    if (stats.filesPatched > 0) std::cout << ", 其中 " << stats.filesPatched << " 个大文件按块更新";
+    if (stats.filesMoved > 0) {
+        std::cout << ", " << stats.filesMoved << " 个被移动的文件直接移回 (" << stats.bytesMoved << " 字节)";
+    }
+    std::cout << std::endl;
+}
+
+// [新增] blob 存储路径 (所有目标共享)
+fs::path getBlobStorePath() {
+    return getBaseSnapshotPath() / BLOB_STORE_DIR;
+}
+
+// 目标快照的历代所在目录
+fs::path getGenerationsPath(const std::string& target) {
+    return getBaseSnapshotPath() / GENERATIONS_DIR / target;
+}
+
+// 快照目录中记录的当前代名称 (升级前的快照没有记录，返回空)
+std::string currentGenerationName(const fs::path& snapshotPath) {
+    std::ifstream in(snapshotPath / GENERATION_FILENAME);
+    std::string name;
+    if (in.is_open()) std::getline(in, name);
+    return isValidGenerationName(name) ? name : "";
+}
+
+bool writeGenerationName(const fs::path& snapshotPath, const std::string& name) {
+    std::ofstream out(snapshotPath / GENERATION_FILENAME, std::ios::trunc);
+    if (!out.is_open()) return false;
+    out << name << std::endl;
+    return out.good();
+}
+
 /**
- * @brief 递归修改文件或目录的所有者 (chown)
- * @param path 目标路径
- * @param owner_uid 目标用户 ID
- * @param owner_gid 目标组 ID
+ * @brief 把快照目录中的清单和容器文件硬链接为目标的一代 (同名的代被原子替换)。
+ *        恢复标志、干净标记等状态文件不属于快照内容，不进入代。
  */
-void chownRecursive(const fs::path& path, uid_t owner_uid, gid_t owner_gid) {
-    try {
-        // 1. 修改当前路径本身的权限 (lchown 不会跟随符号链接，修改链接本身)
-        if (lchown(path.c_str(), owner_uid, owner_gid) != 0) {
-            // 忽略错误，或者打印调试信息
+bool archiveGeneration(const std::string& target, const fs::path& snapshotPath, const std::string& name) {
+    fs::path generationPath = getGenerationsPath(target) / name;
+    fs::path stagingPath;
+    fs::create_directories(generationPath.parent_path());
+    if (!createStagingDir(generationPath, stagingPath)) return false;
+    if (!linkSnapshotFiles(snapshotPath, stagingPath, {BOOT_TRIGGER_FILENAME, CLEAN_MARKER_FILENAME, GENERATION_FILENAME})) {
+        discardStagedTree(generationPath, stagingPath);
+        return false;
+    }
+    return swapInStagedTree(generationPath, stagingPath);
+}
+
+/**
+ * @brief 升级前的快照 (或保存失败的当前代) 在被替换前先保存为一代，以冰冻时间命名。
+ *        只有二进制清单格式的快照可以保存，更早的格式在下次冰冻时被替换。
+ */
+void ensureCurrentArchived(const std::string& target) {
+    fs::path snapshotPath = getSnapshotPathForTarget(target);
+    struct stat st;
+    if (stat((snapshotPath / BINARY_MANIFEST_NAME).c_str(), &st) != 0) return;
+    fs::path generationsPath = getGenerationsPath(target);
+    std::string name = currentGenerationName(snapshotPath);
+    std::error_code ec;
+    if (!name.empty() && fs::exists(generationsPath / name / BINARY_MANIFEST_NAME, ec)) return;
+    if (name.empty()) name = timestampGenerationName((std::time_t)st.st_mtim.tv_sec, generationsPath);
+    if (!archiveGeneration(target, snapshotPath, name) || !writeGenerationName(snapshotPath, name)) {
+        std::cerr << "  -> 警告: 无法把现有快照保存为一代，它将被新快照替换。" << std::endl;
+        return;
+    }
+    std::cout << "  -> 已把现有快照保存为第 '" << name << "' 代" << std::endl;
+}
+
+// 按保留策略删除按时间命名的旧代 (当前代总是保留)
+void pruneGenerations(const std::string& target, const std::string& current) {
+    fs::path generationsPath = getGenerationsPath(target);
+    std::vector<std::string> expired =
+        expiredGenerations(listGenerations(generationsPath, BINARY_MANIFEST_NAME), current, g_keepGenerations,
+                           g_keepGenerationSeconds, (int64_t)std::time(nullptr));
+    for (const auto& name : expired) {
+        std::error_code ec;
+        fs::remove_all(generationsPath / name, ec);
+        if (ec) std::cerr << "  -> 警告: 无法删除过期的代 '" << name << "': " << ec.message() << std::endl;
+    }
+    if (!expired.empty()) std::cout << "  -> 已清理 " << expired.size() << " 个过期的代" << std::endl;
+}
+
+// IconConfigs 下对应启动器/系统目录的分区名
+std::string iconConfigSection(const std::string& folderName) {
+    if (!folderName.empty() && folderName[0] == '/') return "IconConfigs/" + folderName.substr(1);
+    return "IconConfigs/" + folderName;
+}
+
+// 配置文件的标识 (inode、大小和 mtime)，用于判断是否需要重新读取
+std::string configFileKey(const fs::path& path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) return path.string() + ":-";
+    return path.string() + ":" + std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" +
+           std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+}
+
+/**
+ * @brief 当前生效的目标配置 (默认列表叠加系统配置和用户配置)。
+ *        规则只在配置文件 (或 HOME、会话用户) 变化后重新读取和编译，常驻服务中也不会每次操作都解析一遍。
+ */
+std::shared_ptr<const TargetConfig> currentTargetConfig() {
+    static std::mutex cacheMutex;
+    static std::shared_ptr<const TargetConfig> cached;
+    static std::string cachedKey;
+    fs::path userFile = getUserHome() / USER_TARGET_CONFIG;
+    std::string key = configFileKey(SYSTEM_TARGET_CONFIG) + "|" + configFileKey(userFile) + "|" +
+                      std::to_string(sessionUid());
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (cached && key == cachedKey) return cached;
+
+    TargetConfig defaults;
+    defaults.homeFolders = HOME_FOLDER_TARGETS;
+    defaults.launcherFolders = LAUNCHER_TARGETS;
+    defaults.systemFolders = SYSTEM_TARGETS;
+    auto config = std::make_shared<TargetConfig>(
+        loadTargetConfig(defaults, SUPPORTED_TARGETS, SYSTEM_TARGET_CONFIG, userFile, sessionUid()));
+    // 快照自身的存储目录不能作为冰冻目标
+    for (auto* folders : {&config->homeFolders, &config->launcherFolders}) {
+        folders->erase(std::remove_if(folders->begin(), folders->end(),
+                                      [](const std::string& folder) {
+                                          std::string first = folder.substr(0, folder.find('/'));
+                                          return first == BASE_SNAPSHOT_DIR || folder == ".";
+                                      }),
+                       folders->end());
+    }
+    cached = config;
+    cachedKey = key;
+    return cached;
+}
+
+// desktop 目标的启动器配置目录和系统目录
+std::vector<std::string> iconConfigFolders(const TargetConfig& config) {
+    std::vector<std::string> folders = config.launcherFolders;
+    folders.insert(folders.end(), config.systemFolders.begin(), config.systemFolders.end());
+    return folders;
+}
+
+// 变更日志目录 (所有目标共享)
+fs::path changeJournalDir() {
+    return getBaseSnapshotPath() / JOURNAL_DIR;
+}
+
+// 目标恢复时同步的全部根目录及其分区 (与 restoreTarget 中的恢复位置一致)
+std::vector<JournalRoot> changeJournalRoots(const std::string& target) {
+    std::vector<JournalRoot> roots;
+    std::shared_ptr<const TargetConfig> config = currentTargetConfig();
+    if (target == "desktop") {
+        for (const auto& folderName : iconConfigFolders(*config)) {
+            fs::path path = !folderName.empty() && folderName[0] == '/' ? fs::path(folderName) : getUserHome() / folderName;
+            roots.push_back({iconConfigSection(folderName), path});
         }
+        roots.push_back({"DesktopFiles", getUserHome() / "Desktop"});
+        roots.push_back({"TrashBackup/files", getTrashPath() / "files"});
+        roots.push_back({"TrashBackup/info", getTrashPath() / "info"});
+    } else if (target == "home_folders") {
+        for (const auto& folderName : config->homeFolders) {
+            roots.push_back({folderName, getUserHome() / folderName});
+        }
+    }
+    return roots;
+}
 
-        // 2. 如果是目录且不是符号链接，则递归修改其内容
-        if (fs::is_directory(path) && !fs::is_symlink(path)) {
-            for (const auto& entry : fs::recursive_directory_iterator(path)) {
-                // 对每一个子文件/子目录执行 lchown
-                lchown(entry.path().c_str(), owner_uid, owner_gid);
-            }
+/**
+ * @brief 将一个实时目录记录到快照中: 扫描目录树，把普通文件写入 blob 存储 (packer 不为空时写入打包容器)，
+ *        条目的 relPath 以 section 为前缀追加到 out 中 (section 本身也作为目录条目记录)。
+ * @param filter 目标的排除规则 (可为 nullptr)，被排除的子树在扫描时整体跳过。
+ */
+bool captureSection(const fs::path& sourceDir, const std::string& section, bool dereference,
+                    const std::unordered_map<std::string, TreeEntry>& previous, PackWriter* packer,
+                    std::vector<TreeEntry>& out, IngestStats& stats, const PathFilter* filter) {
+    PhaseScope phase("capture " + section);
+    IngestStats before = stats;
+    struct stat st;
+    if (stat(sourceDir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        std::cerr << "  -> 警告: 无法读取目录 " << sourceDir.string() << std::endl;
+        return false;
+    }
+    TreeEntry root;
+    root.relPath = section;
+    root.type = EntryType::Directory;
+    root.mode = st.st_mode & 07777;
+    root.uid = st.st_uid;
+    root.gid = st.st_gid;
+    root.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    out.push_back(root);
+
+    // 目录由线程池并行枚举，普通文件并行哈希并写入存储
+    fs::path storePath = getBlobStorePath();
+    progressBeginPhase(SNAPSHOT_PHASE_SCANNING);
+    std::vector<TreeEntry> entries = scanTree(sourceDir, dereference, filter);
+    std::vector<char> stored(entries.size(), 1);
+    uint64_t totalFiles = 0, totalBytes = 0;
+    for (auto& entry : entries) {
+        entry.relPath = section + "/" + entry.relPath;
+        if (entry.type != EntryType::Regular) continue;
+        totalFiles++;
+        totalBytes += entry.size;
+    }
+    progressAddTotal(totalFiles, totalBytes);
+    progressBeginPhase(SNAPSHOT_PHASE_COPYING);
+    if (packer) {
+        // 打包模式: 整个分区的文件交给容器写入器，由其成批并行读取和压缩
+        std::vector<TreeEntry*> files;
+        std::vector<size_t> fileIndex;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].type != EntryType::Regular) continue;
+            files.push_back(&entries[i]);
+            fileIndex.push_back(i);
         }
-    } catch (const std::exception& e) {
-        std::cerr << "权限修复警告: " << path.string() << " -> " << e.what() << std::endl;
+        std::vector<char> packed;
+        packer->addFiles(files, packed);
+        for (size_t k = 0; k < files.size(); ++k) stored[fileIndex[k]] = packed[k];
+    } else {
+        std::mutex statsMutex;
+        parallelFor(entries.size(), [&](size_t i) {
+            TreeEntry& entry = entries[i];
+            if (entry.type != EntryType::Regular) return;
+            if (operationCancelled()) {
+                stored[i] = 0;
+                return;
+            }
+            IngestStats local;
+            stored[i] = ingestFile(storePath, entry, previous, local, dereference) ? 1 : 0;
+            // 大文件另存块校验表 (内容未变时表已存在，不再读取)
+            if (stored[i] && g_deltaThreshold > 0 && entry.size >= g_deltaThreshold &&
+                !ensureBlockTable(storePath, entry, DEFAULT_DELTA_BLOCK_SIZE)) {
+                std::cerr << "  -> 警告: 无法为 '" << entry.relPath << "' 生成块校验表" << std::endl;
+            }
+            progressAddDone(1, entry.size);
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.filesStored += local.filesStored;
+            stats.bytesStored += local.bytesStored;
+            stats.filesDeduplicated += local.filesDeduplicated;
+            stats.bytesDeduplicated += local.bytesDeduplicated;
+            stats.hashesReused += local.hashesReused;
+        });
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        // 无法读取的文件不记录，恢复时会被当作多余条目处理
+        if (stored[i]) out.push_back(std::move(entries[i]));
     }
+    phase.addCounter("entries_scanned", entries.size());
+    phase.addCounter("files_stored", stats.filesStored - before.filesStored);
+    phase.addCounter("bytes_stored", stats.bytesStored - before.bytesStored);
+    phase.addCounter("files_deduplicated", stats.filesDeduplicated - before.filesDeduplicated);
+    phase.addCounter("bytes_deduplicated", stats.bytesDeduplicated - before.bytesDeduplicated);
+    phase.addCounter("hashes_reused", stats.hashesReused - before.hashesReused);
+    return true;
 }
+
+// 快照是否带有内容清单 (二进制清单或旧版文本清单)
+bool hasContentManifest(const fs::path& snapshotPath) {
+    return fs::exists(snapshotPath / BINARY_MANIFEST_NAME) || fs::exists(snapshotPath / CONTENT_MANIFEST_NAME);
+}
+
 /**
- * @brief 智能地复制一个目录的内容到另一个目录，能正确处理子目录、文件和符号链接。并自动修复所有权。
- * @param sourceDir 源目录。
- * @param destDir 目标目录。
- * @param dereference 如果为 true，遇到符号链接时，会复制其指向的真实文件（变成普通文件）。
- *                    如果为 false，则保留符号链接的属性（依然是链接）。
- * @param target_uid 目标文件的拥有者 UID (-1 表示不修改)
- * @param target_gid 目标文件的拥有者 GID (-1 表示不修改)
+ * @brief 读取快照清单中的全部条目 (优先二进制清单，其次旧版 content.manifest)。
+ * @return true 表示成功, false 表示没有清单或清单已损坏。
  */
-bool performIntelligentCopy(const fs::path& sourceDir, const fs::path& destDir, 
-				bool dereference, uid_t target_uid, gid_t target_gid) {
-    try {
-        // 1. 确保目标目录存在
-        if (!fs::exists(destDir)) {
-            fs::create_directories(destDir);
-            // 如果创建了新目录，立即修复其权限
-            if (target_uid != (uid_t)-1) {
-                lchown(destDir.c_str(), target_uid, target_gid);
-            }
-        }
-
-        for (const auto& entry : fs::directory_iterator(sourceDir)) {
-            const auto& sourcePath = entry.path();
-            const auto& filename = sourcePath.filename();
-            fs::path destinationPath = destDir / filename;
-
-            try {
-                // [逻辑升级]
-                // 如果是符号链接，且开启了 dereference (解引用) 模式
-                if (fs::is_symlink(sourcePath) && dereference) {
-                    // 使用 fs::copy 会自动跟随链接，复制真实内容
-                    // 使用 overwrite_existing 以防目标已存在
-                    fs::copy(sourcePath, destinationPath, fs::copy_options::overwrite_existing | fs::copy_options::recursive);
-                }
-                // 如果是符号链接，且没有开启解引用 (保持原样)
-                else if (fs::is_symlink(sourcePath)) {
-                    fs::copy_symlink(sourcePath, destinationPath);
-                }
-                // 如果是目录
-                else if (fs::is_directory(sourcePath)) {
-                    fs::copy(sourcePath, destinationPath, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
-                } 
-                // 普通文件
-                else {
-                    fs::copy(sourcePath, destinationPath, fs::copy_options::overwrite_existing);
-                }
-                // --- 权限修复逻辑 (核心修改) ---
-                if (target_uid != (uid_t)-1) {
-                    chownRecursive(destinationPath, target_uid, target_gid);
-                }
-            } catch (const fs::filesystem_error& e) {
-                // 忽略一些特殊文件的复制错误 (如 socket 或 pipe)
-                std::cerr << "  -> 警告: 复制 '" << sourcePath.string() << "' 失败" << std::endl;
-                continue;
+bool readSnapshotEntries(const fs::path& snapshotPath, std::vector<TreeEntry>& entries) {
+    entries.clear();
+    MappedManifest manifest;
+    if (manifest.open(snapshotPath / BINARY_MANIFEST_NAME)) {
+        entries.reserve(manifest.size());
+        for (size_t i = 0; i < manifest.size(); ++i) entries.push_back(manifest.entry(i));
+        return true;
+    }
+    if (fs::exists(snapshotPath / BINARY_MANIFEST_NAME)) return false;
+    return readContentManifest(snapshotPath / CONTENT_MANIFEST_NAME, entries);
+}
+
+/**
+ * @brief 回收 blob 存储中不再被任何目标清单引用的对象。
+ *        任一清单无法解析时放弃回收，避免误删仍在使用的数据。
+ *        收集引用和删除都在独占的存储锁内进行，等待其他进程中正在进行的冰冻发布清单。
+ */
+void garbageCollectStore() {
+    StoreLock lock(getBlobStorePath(), true);
+    if (!lock.locked()) {
+        std::cerr << "  -> 警告: 无法锁定 blob 存储，跳过存储回收。" << std::endl;
+        return;
+    }
+    std::unordered_set<std::string> referenced;
+    for (const auto& target : SUPPORTED_TARGETS) {
+        // 当前快照和历代快照 (各代共享未变化文件的 blob)
+        std::vector<fs::path> snapshotPaths = {getSnapshotPathForTarget(target)};
+        fs::path generationsPath = getGenerationsPath(target);
+        for (const auto& generation : listGenerations(generationsPath, BINARY_MANIFEST_NAME)) {
+            snapshotPaths.push_back(generationsPath / generation.name);
+        }
+        for (const auto& snapshotPath : snapshotPaths) {
+            // 打包快照的内容在自己的容器中，不引用 blob
+            if (!hasContentManifest(snapshotPath) || isPackedSnapshot(snapshotPath)) continue;
+            std::vector<TreeEntry> entries;
+            if (!readSnapshotEntries(snapshotPath, entries)) {
+                std::cerr << "  -> 警告: " << snapshotPath.string() << " 的清单无法解析，跳过存储回收。" << std::endl;
+                return;
+            }
+            for (const auto& e : entries) {
+                if (e.hasContentHash) referenced.insert(blobKey(e.contentHash, e.size));
             }
         }
+    }
+    uint64_t removed = collectGarbage(getBlobStorePath(), referenced);
+    if (removed > 0) {
+        std::cout << "  -> 已回收 " << removed << " 个不再使用的存储对象。" << std::endl;
+    }
+}
+
+// 快照内容: 新版快照来自映射的二进制清单 (文件在 blob 存储或快照自己的打包容器中)，
+// 较早的版本来自文本清单 (文件均在 blob 存储中)，最早的旧版快照是物理镜像目录
+struct SnapshotContents {
+    fs::path snapshotPath;
+    bool fromManifest = false;
+    MappedManifest mapped;            // 二进制清单 (打开时优先使用)
+    std::unique_ptr<PackReader> pack; // 打包快照的容器 (为空表示文件在 blob 存储中)
+    std::vector<TreeEntry> entries;   // 旧版文本清单，按 relPath 排序，sourcePath 指向 blob
+};
+
+bool loadSnapshotContents(const fs::path& snapshotPath, SnapshotContents& contents) {
+    contents.snapshotPath = snapshotPath;
+    if (fs::exists(snapshotPath / BINARY_MANIFEST_NAME)) {
+        contents.fromManifest = contents.mapped.open(snapshotPath / BINARY_MANIFEST_NAME);
+        if (contents.fromManifest && isPackedSnapshot(snapshotPath)) {
+            contents.pack = std::make_unique<PackReader>();
+            if (!contents.pack->open(snapshotPath)) return false;
+        }
+        return contents.fromManifest;
+    }
+    fs::path manifestPath = snapshotPath / CONTENT_MANIFEST_NAME;
+    if (!fs::exists(manifestPath)) {
+        contents.fromManifest = false;   // 旧版快照，恢复时直接扫描镜像目录
         return true;
-    } catch (const std::exception& e) {
-        std::cerr << "  -> 错误: 智能复制失败 " << sourceDir.string() << ": " << e.what() << std::endl;
-        return false;
     }
+    if (!readContentManifest(manifestPath, contents.entries)) return false;
+    contents.fromManifest = true;
+    fs::path storePath = getBlobStorePath();
+    for (auto& e : contents.entries) {
+        if (e.hasContentHash) e.sourcePath = blobPath(storePath, e.contentHash, e.size);
+    }
+    return true;
+}
+
+// 快照中是否包含指定分区
+bool sectionExists(const SnapshotContents& contents, const std::string& section) {
+    if (!contents.fromManifest) return fs::exists(contents.snapshotPath / section);
+    if (contents.mapped.isOpen()) {
+        size_t i = contents.mapped.lowerBound(section);
+        return i < contents.mapped.size() && contents.mapped.relPath(i) == section;
+    }
+    auto it = std::lower_bound(contents.entries.begin(), contents.entries.end(), section,
+                               [](const TreeEntry& e, const std::string& key) { return e.relPath < key; });
+    return it != contents.entries.end() && it->relPath == section;
 }
 
-// 为了简洁，这里不再重复粘贴，请将上一个回答中的这三个函数复制到此处。
-std::string exec(const char* cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd, "r"), pclose);
-    if (!pipe) { throw std::runtime_error("popen() failed!"); }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) { result += buffer.data(); }
+// 取出分区内的条目，relPath 改为相对于分区根目录
+std::vector<TreeEntry> sectionEntries(const SnapshotContents& contents, const std::string& section) {
+    if (!contents.fromManifest) {
+        fs::path dir = contents.snapshotPath / section;
+        return fs::exists(dir) ? scanTree(dir, false) : std::vector<TreeEntry>();
+    }
+    std::vector<TreeEntry> result;
+    std::string prefix = section + "/";
+    if (contents.mapped.isOpen()) {
+        // 只解码分区范围内的记录
+        const MappedManifest& mapped = contents.mapped;
+        fs::path storePath = getBlobStorePath();
+        for (size_t i = mapped.lowerBound(prefix);
+             i < mapped.size() && mapped.relPath(i).compare(0, prefix.size(), prefix) == 0; ++i) {
+            TreeEntry e = mapped.entry(i);
+            e.relPath = e.relPath.substr(prefix.size());
+            if (e.hasContentHash && !contents.pack) e.sourcePath = blobPath(storePath, e.contentHash, e.size);
+            result.push_back(std::move(e));
+        }
+        return result;
+    }
+    auto it = std::lower_bound(contents.entries.begin(), contents.entries.end(), prefix,
+                               [](const TreeEntry& e, const std::string& key) { return e.relPath < key; });
+    for (; it != contents.entries.end() && it->relPath.compare(0, prefix.size(), prefix) == 0; ++it) {
+        TreeEntry e = *it;
+        e.relPath = e.relPath.substr(prefix.size());
+        result.push_back(std::move(e));
+    }
     return result;
 }
-std::string getIconPosition(const fs::path& filePath) {
-    std::string command = "gvfs-info -a " + ICON_POSITION_KEY + " \"" + filePath.string() + "\"";
-    try {
-        std::string output = exec(command.c_str());
-        std::regex re(ICON_POSITION_KEY + ": (\\d+,\\d+)");
-        std::smatch match;
-        if (std::regex_search(output, match, re) && match.size() > 1) { return match.str(1); }
-    } catch (const std::exception& e) {
-        std::cerr << "获取位置时出错 '" << filePath.string() << "': " << e.what() << std::endl;
+
+// 取出分区内 dirty (变更日志记录的路径，为空表示整个分区) 范围内的条目
+std::vector<TreeEntry> sectionEntriesInScope(const SnapshotContents& contents, const std::string& section,
+                                             const std::vector<std::string>* dirty) {
+    std::vector<TreeEntry> entries = sectionEntries(contents, section);
+    if (dirty) {
+        SyncScope scope(*dirty);
+        entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                     [&](const TreeEntry& e) { return !scope.contains(e.relPath); }),
+                      entries.end());
+    }
+    return entries;
+}
+
+// 取出快照中记录的桌面图标位置 (二进制清单中 DesktopFiles 下的顶层条目，或旧版 snapshot.manifest)
+std::vector<IconPositionUpdate> desktopIconUpdates(const SnapshotContents& contents) {
+    std::vector<IconPositionUpdate> updates;
+    if (contents.mapped.isOpen()) {
+        const MappedManifest& mapped = contents.mapped;
+        const std::string prefix = "DesktopFiles/";
+        for (size_t i = mapped.lowerBound(prefix);
+             i < mapped.size() && mapped.relPath(i).compare(0, prefix.size(), prefix) == 0; ++i) {
+            std::string_view name = mapped.relPath(i).substr(prefix.size());
+            IconPositionUpdate update;
+            if (name.find('/') != std::string_view::npos || !mapped.iconPosition(i, update.position)) continue;
+            update.name = std::string(name);
+            updates.push_back(std::move(update));
+        }
+        return updates;
+    }
+    std::unordered_map<std::string, std::string> positions;
+    readIconManifest(contents.snapshotPath / SNAPSHOT_MANIFEST_NAME, positions);
+    for (auto& item : positions) {
+        IconPositionUpdate update;
+        update.name = item.first;
+        update.position = std::move(item.second);
+        updates.push_back(std::move(update));
     }
-    return "";
+    std::sort(updates.begin(), updates.end(),
+              [](const IconPositionUpdate& a, const IconPositionUpdate& b) { return a.name < b.name; });
+    return updates;
 }
-void setIconPosition(const fs::path& filePath, const std::string& position) {
-    std::string command = "gvfs-set-attribute -t string \"" + filePath.string() + "\" " + ICON_POSITION_KEY + " '" + position + "'";
-    system(command.c_str());
+
+/**
+ * @brief 将快照中的一个分区恢复到目标目录。
+ *        增量模式只在原地同步差异；全量模式在同级暂存目录中完整物化后与目标目录原子交换，
+ *        旧树由后台删除。无法暂存时 (挂载点、空间不足等) 退回先清空目标目录内容再物化。
+ * @param journal 有效的变更日志 (可为 nullptr)。增量模式下只同步日志中记录的路径，
+ *                没有记录的分区既不读取清单也不扫描目录。
+ * @param filter 目标的排除规则 (可为 nullptr)。被排除的条目保持原样: 全量模式此时改为原地逐个校验内容，
+ *               不再整体替换目录。
+ * @param current 移动检测时已扫描的目标现状 (可为 nullptr)，原地同步时不再重新扫描。
+ */
+void restoreSection(const SnapshotContents& contents, const std::string& section, const fs::path& destDir,
+                    uid_t owner_uid, gid_t owner_gid, SyncStats& stats, const JournalClient* journal,
+                    const PathFilter* filter, const std::vector<TreeEntry>* current = nullptr) {
+    if (operationCancelled()) return;
+    PhaseScope phase("restore " + section);
+    const std::vector<std::string>* dirty = nullptr;
+    if (journal && isIncrementalRestore()) {
+        dirty = journal->dirtyPaths(section);
+        phase.addCounter("journal_paths", dirty ? dirty->size() : 0);
+        if (!dirty) {
+            std::cout << "      变更日志中没有 '" << destDir.string() << "' 的变化，跳过。" << std::endl;
+            return;
+        }
+        if (dirty->size() == 1 && dirty->front().empty()) dirty = nullptr;   // 整个分区都已变化
+    }
+    std::vector<TreeEntry> entries = sectionEntriesInScope(contents, section, dirty);
+    uint64_t requiredFiles = 0, requiredBytes = 0;
+    for (const auto& entry : entries) {
+        if (entry.type != EntryType::Regular) continue;
+        requiredFiles++;
+        requiredBytes += entry.size;
+    }
+    progressAddTotal(requiredFiles, requiredBytes);
+    progressBeginPhase(SNAPSHOT_PHASE_COPYING);
+
+    fs::path syncDir = destDir;
+    fs::path stagingDir;
+    bool staged = false;
+    if (!isIncrementalRestore() && !filter && fs::exists(destDir)) {
+        staged = prepareStagingDir(destDir, requiredBytes, stagingDir);
+        if (staged) {
+            syncDir = stagingDir;
+        } else {
+            for (const auto& entry : fs::directory_iterator(destDir)) {
+                fs::remove_all(entry.path());
+            }
+        }
+    }
+    SyncOptions options = makeRestoreOptions(owner_uid, owner_gid);
+    options.filter = filter;
+    if (!isIncrementalRestore() && filter) options.compareContent = true;
+    if (dirty) {
+        options.scoped = true;
+        options.scopePaths = *dirty;
+    }
+    if (isIncrementalRestore() || filter) options.destEntries = current;
+    if (contents.pack) {
+        // 打包快照: 文件内容直接从容器解出到新建的目标文件
+        const PackReader* pack = contents.pack.get();
+        options.contentSource = [pack](const TreeEntry& entry, int outFd, std::string& error) {
+            if (!entry.hasContentHash) {
+                error = "missing content hash";
+                return false;
+            }
+            if (!pack->extract(entry.contentHash, entry.size, outFd, error)) return false;
+            recordCopiedFile(CopyStrategy::Unpack, entry.size);
+            return true;
+        };
+    } else {
+        // 大文件按块原地更新: 有冰冻时记录的块校验表时只需读取目标文件和需要改写的块
+        options.deltaMinSize = g_deltaThreshold;
+        fs::path storePath = getBlobStorePath();
+        options.blockTable = [storePath](const TreeEntry& entry, BlockTable& table) {
+            return entry.hasContentHash &&
+                   readBlockTable(blockTablePath(storePath, entry.contentHash, entry.size), table);
+        };
+    }
+    SyncStats before = stats;
+    bool synced = syncEntries(entries, syncDir, options, &stats);
+    if (!synced && !operationCancelled()) stats.entriesFailed++;
+    phase.addCounter("staged", staged ? 1 : 0);
+    phase.addCounter("entries_unchanged", stats.entriesUnchanged - before.entriesUnchanged);
+    phase.addCounter("entries_removed", stats.entriesRemoved - before.entriesRemoved);
+    phase.addCounter("metadata_fixed", stats.metadataFixed - before.metadataFixed);
+    phase.addCounter("bytes_skipped", stats.bytesSkipped - before.bytesSkipped);
+    phase.addCounter("files_patched", stats.filesPatched - before.filesPatched);
+    if (!staged) return;
+    if (!synced) {
+        // 新树不完整 (构建失败或已取消): 保留原目录不动
+        if (!operationCancelled()) {
+            std::cerr << "  -> 警告: 暂存目录构建失败，'" << destDir.string() << "' 保持不变。" << std::endl;
+        }
+        discardStagedTree(destDir, stagingDir);
+        return;
+    }
+    if (!swapInStagedTree(destDir, stagingDir)) {
+        // 交换失败 (例如目标是同一文件系统上的绑定挂载点): 退回原地同步
+        options.destEntries = nullptr;
+        syncEntries(entries, destDir, options, &stats);
+    }
 }
-// [新增] 回收站路径的辅助函数
-fs::path getTrashPath() {
-    return getUserHome() / ".local/share/Trash";
+
+/**
+ * @brief 原地恢复前，在本次恢复的各分区之间查找被移动的文件并重命名回原处 (见 relocation.h)，
+ *        例如从桌面拖进回收站的文件不再复制一份、再删除回收站中的那份。
+ * @param sections 分区名 -> 目标目录 (只应包含属于会话用户的目录)。
+ * @param scanned  [输出] 没有文件移入或移出的分区的目标现状，恢复该分区时直接使用，不再重新扫描。
+ */
+void relocateSections(const SnapshotContents& contents, const std::vector<std::pair<std::string, fs::path>>& sections,
+                      const JournalClient* journal, const PathFilter* filter, SyncStats& stats,
+                      std::map<std::string, std::vector<TreeEntry>>& scanned) {
+    if (operationCancelled()) return;
+    PhaseScope phase("relocate");
+    std::vector<std::string> names;
+    std::vector<std::vector<TreeEntry>> wanted, current;
+    std::vector<RelocationSection> relocation;
+    for (const auto& item : sections) {
+        if (!sectionExists(contents, item.first)) continue;
+        const std::vector<std::string>* dirty = nullptr;
+        if (journal && isIncrementalRestore()) {
+            dirty = journal->dirtyPaths(item.first);
+            if (!dirty) continue;
+            if (dirty->size() == 1 && dirty->front().empty()) dirty = nullptr;
+        }
+        // 与 restoreSection 中的同步使用相同的范围和排除规则，扫描结果才能直接复用
+        SyncOptions options;
+        options.filter = filter;
+        if (dirty) {
+            options.scoped = true;
+            options.scopePaths = *dirty;
+        }
+        names.push_back(item.first);
+        wanted.push_back(selectSyncEntries(sectionEntriesInScope(contents, item.first, dirty), options));
+        current.push_back(scanDestination(item.second, options));
+        RelocationSection section;
+        section.destRoot = item.second;
+        relocation.push_back(section);
+    }
+    for (size_t i = 0; i < relocation.size(); ++i) {
+        relocation[i].wanted = &wanted[i];
+        relocation[i].current = &current[i];
+    }
+    uint64_t bytesBefore = stats.bytesMoved;
+    size_t moved = relocateMovedFiles(relocation, g_restoreMode == SNAPSHOT_RESTORE_CHECKSUM,
+                                      g_materializeMode == SNAPSHOT_MATERIALIZE_HARDLINK, stats);
+    phase.addCounter("files_moved", moved);
+    phase.addCounter("bytes_moved", stats.bytesMoved - bytesBefore);
+    for (size_t i = 0; i < relocation.size(); ++i) {
+        if (!relocation[i].changed) scanned[names[i]] = std::move(current[i]);
+    }
+    if (moved > 0) std::cout << "  -> 已将 " << moved << " 个被移动的文件移回原处" << std::endl;
 }
 
+// 本次恢复中属于会话用户的分区及其目标目录 (系统目录不参与移动检测，避免把用户的文件移入其中)
+std::vector<std::pair<std::string, fs::path>> userRestoreSections(const std::string& target, int parts,
+                                                                  const TargetConfig& config) {
+    std::vector<std::pair<std::string, fs::path>> sections;
+    fs::path home = getUserHome();
+    if (target == "desktop") {
+        if (parts & RESTORE_PART_FILES) {
+            for (const auto& folderName : iconConfigFolders(config)) {
+                if (!folderName.empty() && folderName[0] != '/') {
+                    sections.emplace_back(iconConfigSection(folderName), home / folderName);
+                }
+            }
+            sections.emplace_back("DesktopFiles", home / "Desktop");
+        }
+        if (parts & RESTORE_PART_TRASH) {
+            sections.emplace_back("TrashBackup/files", getTrashPath() / "files");
+            sections.emplace_back("TrashBackup/info", getTrashPath() / "info");
+        }
+    } else if (target == "home_folders" && (parts & RESTORE_PART_FILES)) {
+        for (const auto& folderName : config.homeFolders) sections.emplace_back(folderName, home / folderName);
+    }
+    return sections;
+}
+
+// 批量恢复桌面图标位置 (在本进程内一次完成，不再生成临时脚本)，然后触发桌面刷新
+void restoreDesktopIcons(const SnapshotContents& contents, const fs::path& desktopPath) {
+    PhaseScope phase("icon_positions");
+    std::cout << "  -> 正在批量恢复图标位置..." << std::endl;
+    std::vector<IconPositionUpdate> iconUpdates = desktopIconUpdates(contents);
+    // 注意：因为我们是 SUID Root 运行，gvfs 需要连接用户的 Session Bus
+    // 之前的环境通常已经设置好了 DBUS_SESSION_BUS_ADDRESS，所以直接写入通常可行
+    size_t applied = writeIconPositions(desktopPath, iconUpdates);
+    for (const auto& update : iconUpdates) {
+        if (!update.applied) std::cerr << "      图标位置未恢复: " << update.name << std::endl;
+    }
+    std::cout << "      已恢复 " << applied << "/" << iconUpdates.size() << " 个图标位置。" << std::endl;
+    phase.addCounter("icons_total", iconUpdates.size());
+    phase.addCounter("icons_applied", applied);
+    if (iconMetadataStubbed()) return;   // 没有桌面会话 (如基准测试)，无需刷新
+
+    // [修改 2] 异步刷新桌面环境
+    // 移除了 "killall -9 dde-desktop"，保留 dock 和 launcher 的重启
+    // 这样任务栏会刷新（因为配置变了），但壁纸不会消失
+    std::cout << "  -> 触发后台刷新..." << std::endl;
+    std::string refreshCmd = 
+        "nohup sh -c '"
+        "update-desktop-database /usr/share/applications > /dev/null 2>&1; "
+        //"killall -9 dde-dock > /dev/null 2>&1; "
+        //"killall -9 dde-launcher > /dev/null 2>&1; "
+        // 注意：这里删除了 killall dde-desktop
+        // 让 DDE 自动监测文件变化并更新，而不是强制重启
+        "xrefresh > /dev/null 2>&1"
+        "' > /dev/null 2>&1 &";
+
+    PhaseScope refresh("launch_desktop_refresh");
+    system(refreshCmd.c_str());
+}
+
+// 快照的标识 (清单文件的 inode、大小和 mtime)，用于确认干净标记对应的就是当前这份快照
+std::string snapshotIdentity(const fs::path& snapshotPath) {
+    for (const std::string& name : {BINARY_MANIFEST_NAME, CONTENT_MANIFEST_NAME, SNAPSHOT_MANIFEST_NAME}) {
+        struct stat st;
+        if (stat((snapshotPath / name).c_str(), &st) != 0) continue;
+        return name + " " + std::to_string(st.st_ino) + " " + std::to_string(st.st_size) + " " +
+               std::to_string((int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec);
+    }
+    return "";   // 没有清单的旧版镜像快照不使用干净标记
+}
+
+// 会话结束时的恢复成功后写入干净标记 (先写临时文件再重命名)
+bool writeCleanMarker(const std::string& target) {
+    std::string identity = snapshotIdentity(getSnapshotPathForTarget(target));
+    if (identity.empty()) return false;
+    return writeFileAtomically(getCleanMarkerPath(target), identity + "\n");
+}
+
+/**
+ * @brief 取走干净标记 (无论是否有效都删除，标记只能使用一次)。
+ * @return true 表示标记存在且对应当前快照，登录时无需再恢复文件。
+ */
+bool consumeCleanMarker(const std::string& target) {
+    fs::path marker = getCleanMarkerPath(target);
+    std::string recorded;
+    {
+        std::ifstream in(marker);
+        if (!in.is_open()) return false;
+        std::getline(in, recorded);
+    }
+    std::error_code ec;
+    fs::remove(marker, ec);
+    std::string identity = snapshotIdentity(getSnapshotPathForTarget(target));
+    return !identity.empty() && recorded == identity;
+}
+
+// 恢复互斥锁: 会话结束时的恢复和下次登录时的检查不能同时进行 (对快照基础目录加 flock)
+class RestoreLock {
+public:
+    RestoreLock() {
+        fd_ = ::open(getBaseSnapshotPath().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd_ >= 0) flock(fd_, LOCK_EX);
+    }
+    ~RestoreLock() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+    RestoreLock(const RestoreLock&) = delete;
+    RestoreLock& operator=(const RestoreLock&) = delete;
+
+private:
+    int fd_ = -1;
+};
+
 // 快照和恢复核心逻辑 (内部实现)
-int do_snapshot(const std::string& target) {
+// 新快照先写入同级的暂存目录，完整写好后与旧快照原子交换; 旧快照由后台删除，失败时旧快照保持不变
+// 发布后新快照同时保存为一代，按保留策略清理旧代后再回收不再被任何一代引用的 blob
+int snapshotTarget(const std::string& target) {
+    fs::path snapshotPath = getSnapshotPathForTarget(target);
+    fs::path stagingPath;
     try {
+        if (target != "desktop" && target != "home_folders") {
+            return -1; // 不支持的目标
+        }
+
         // 1. 确保基础目录存在
         // 在使用子目录之前，先确保基础目录存在
         fs::path baseSnapshotPath = getBaseSnapshotPath();
         fs::create_directories(baseSnapshotPath); // create_directories 会在不存在时创建，存在时什么也不做
+        ensureCurrentArchived(target);
 
-        fs::path snapshotPath = getSnapshotPathForTarget(target);
         fs::path trashPath = getTrashPath(); // 获取回收站路径
+        progressBeginPhase(SNAPSHOT_PHASE_PREPARING);
+        std::shared_ptr<const TargetConfig> config = currentTargetConfig();
+        const PathFilter* filter = config->filterFor(target);
 
-        // 2. 清理旧快照
-        if (fs::exists(snapshotPath)) {
-            std::cout << "  -> 正在删除旧快照..." << std::endl;
-            fs::remove_all(snapshotPath);
+        // 2. 读取旧清单 (用于沿用未变化文件的哈希)，然后在暂存目录中构建新快照
+        //    旧快照在新快照发布前保持可用，旧 blob 由发布后的垃圾回收统一处理
+        std::unordered_map<std::string, TreeEntry> previous;
+        {
+            PhaseScope phase("read_previous_manifest");
+            std::vector<TreeEntry> previousEntries;
+            if (readSnapshotEntries(snapshotPath, previousEntries)) {
+                for (auto& e : previousEntries) previous.emplace(e.relPath, std::move(e));
+            }
+            phase.addCounter("entries", previous.size());
+        }
+        if (!createStagingDir(snapshotPath, stagingPath)) {
+            std::cerr << "快照出错: 无法创建暂存目录。" << std::endl;
+            return -1;
         }
-        fs::create_directory(snapshotPath);
+
+        // 打包模式下文件内容写入快照目录中的容器，而不是共享的 blob 存储
+        std::unique_ptr<PackWriter> packer;
+        if (g_storageMode == SNAPSHOT_STORAGE_PACKED) {
+            packer = std::make_unique<PackWriter>();
+            if (!packer->open(stagingPath, (PackCodec)g_packCompression)) {
+                std::cerr << "快照出错: 无法创建容器文件。" << std::endl;
+                discardStagedTree(snapshotPath, stagingPath);
+                return -1;
+            }
+        }
+
+        // 从写入对象到发布清单期间持有共享的存储锁，其他进程的存储回收等待本次发布后再收集引用
+        StoreLock storeLock(getBlobStorePath(), false);
+        std::vector<TreeEntry> contents;
+        std::unordered_map<std::string, std::string> manifestIcons;   // relPath -> 图标位置
+        IngestStats ingestStats;
+        resetCopyRunStats();
 
         // ====================================================================
         //  TARGET: DESKTOP (桌面文件 + 图标布局 + 系统应用图标)
         // ====================================================================
         if (target == "desktop") {
-            // [新增] 定义子目录路径
-            fs::path desktopFilesDir = snapshotPath / "DesktopFiles";
-            fs::path iconConfigsDir = snapshotPath / "IconConfigs";
-            // [新增] 创建子目录
-            fs::create_directories(desktopFilesDir);
-            fs::create_directories(iconConfigsDir);
-
             // --- 桌面快照逻辑 (处理图标位置) ---
             fs::path desktopPath = getUserHome() / "Desktop";
-            std::ofstream manifestFile(snapshotPath / SNAPSHOT_MANIFEST_NAME);// 清单文件依然放在根目录
-            if (!manifestFile.is_open()) return -1;
-            
             std::cout << "  -> 正在备份桌面..." << std::endl;
 
+            // 一次性读取整个桌面的图标位置，不再为每个图标启动 gvfs-info 进程
+            std::unordered_map<std::string, std::string> iconPositions;
+            readIconPositions(desktopPath, iconPositions);
+
         // [核心修改] 遍历桌面并根据文件类型进行处理
         for (const auto& entry : fs::directory_iterator(desktopPath)) {
             const auto& path = entry.path();
             std::string filename = path.filename().string();
-            fs::path destination = desktopFilesDir / filename;
-
-            try {
-                // [新增] 判断文件类型
-                if (fs::is_symlink(path)) {
-                    // 1. 如果是符号链接，只复制链接本身
-                    std::cout << "      备份 (符号链接): " << filename << std::endl;
-                    // 使用 copy_symlink 来精确处理
-                    fs::copy_symlink(path, destination);
-
-                } else if (fs::is_directory(path)) {
-                    // 2. 如果是目录，递归复制
-                    std::cout << "      备份 (目录): " << filename << std::endl;
-                    fs::copy(path, destination, fs::copy_options::recursive);
-
-                } else {
-                    // 3. 其他情况（如普通文件），直接复制
-                    std::cout << "      备份 (文件): " << filename << std::endl;
-                    fs::copy(path, destination);
-                }
-            } catch (const fs::filesystem_error& e) {
-                // 如果复制单个文件失败，打印错误并继续处理下一个
-                std::cerr << "无法复制 '" << path.string() << "': " << e.what() << std::endl;
+            struct stat entryStat;
+            if (filter && lstat(path.c_str(), &entryStat) == 0 &&
+                filter->excludes(filename, S_ISDIR(entryStat.st_mode),
+                                 S_ISREG(entryStat.st_mode) ? (uint64_t)entryStat.st_size : 0)) {
                 continue;
             }
 
-            // 获取并记录图标位置的逻辑保持不变
-            std::string position = getIconPosition(path);
-            manifestFile << filename << "|" << position << std::endl;
+            // [新增] 判断文件类型 (仅用于输出，实际内容由 captureSection 统一写入 blob 存储)
+            if (fs::is_symlink(path)) {
+                std::cout << "      备份 (符号链接): " << filename << std::endl;
+            } else if (fs::is_directory(path)) {
+                std::cout << "      备份 (目录): " << filename << std::endl;
+            } else {
+                std::cout << "      备份 (文件): " << filename << std::endl;
+            }
+
+            // 图标位置随条目一起写入清单
+            auto position = iconPositions.find(filename);
+            if (position != iconPositions.end()) manifestIcons["DesktopFiles/" + filename] = position->second;
         }
+        captureSection(desktopPath, "DesktopFiles", false, previous, packer.get(), contents, ingestStats, filter);
         // --- 2. [新增] 备份回收站 ---
         std::cout << "  -> 正在备份回收站..." << std::endl;
         if (fs::exists(trashPath)) {
-            try {
-                // 将整个 Trash 目录复制到快照目录下一个名为 'TrashBackup' 的子目录中
-                fs::copy(trashPath, snapshotPath / "TrashBackup", fs::copy_options::recursive);
+            // 回收站内容记录在 'TrashBackup' 分区下
+            if (captureSection(trashPath, "TrashBackup", false, previous, packer.get(), contents, ingestStats, filter)) {
                 std::cout << "      回收站备份成功。" << std::endl;
-            } catch (const fs::filesystem_error& e) {
-                std::cerr << "警告: 备份回收站时出错: " << e.what() << std::endl;
             }
         } else {
             std::cout << "      未找到回收站目录，跳过备份。" << std::endl;
         }
-        manifestFile.close();
             // --- B. [新增] 备份启动器配置和系统图标 (从 home_folders 移过来的逻辑) ---
             std::cout << "  -> 正在备份启动器配置及系统图标..." << std::endl;
             
-            std::vector<std::string> extraTargets = LAUNCHER_TARGETS;
-            extraTargets.insert(extraTargets.end(), SYSTEM_TARGETS.begin(), SYSTEM_TARGETS.end());
-
-            for (const auto& folderName : extraTargets) {
+            for (const auto& folderName : iconConfigFolders(*config)) {
                 fs::path sourcePath;
-                fs::path destPath;
                 bool shouldDereference = false;
 
                 // 判断路径类型 (系统绝对路径 vs 用户相对路径)
                 if (!folderName.empty() && folderName[0] == '/') {
                     sourcePath = folderName;
-                    destPath = iconConfigsDir / folderName.substr(1);
                     // 对于 /usr/share/applications，开启解引用，备份真实文件
                     if (folderName.find("/usr/share/applications") != std::string::npos ||
                         folderName.find("dde-launcher") != std::string::npos) {
@@ -289,63 +995,286 @@ int do_snapshot(const std::string& target) {
                 } else {
                     // 相对路径
                     sourcePath = getUserHome() / folderName;
-                    // [修改] 目标路径基于 iconConfigsDir
-                    destPath = iconConfigsDir / folderName;
                 }
 
                 if (fs::exists(sourcePath)) {
                     std::cout << "      备份配置: " << sourcePath.string() << std::endl;
-                    if (destPath.has_parent_path()) {
-                        fs::create_directories(destPath.parent_path());
-                    }
-                    performIntelligentCopy(sourcePath, destPath, shouldDereference,-1,-1);
+                    captureSection(sourcePath, iconConfigSection(folderName), shouldDereference,
+                                   previous, packer.get(), contents, ingestStats, filter);
                 }
             }
        } else if (target == "home_folders") {
             // --- 用户文件夹快照逻辑 (只复制目录) ---
-            std::vector<fs::path> homeFolderPaths = {
-                getUserHome() / "Videos",
-                getUserHome() / "Pictures",
-                getUserHome() / "Documents",
-                getUserHome() / "Music"
-            };
-            
             std::cout << "  -> 正在备份用户文件夹..." << std::endl;
-            for (const auto& path : homeFolderPaths) {
-	         fs::path sourcePath = getUserHome() / path.filename().string();
-	         fs::path destPath = snapshotPath / path.filename().string();
-                if (fs::exists(path)) {
-                    std::cout << "      备份: " << path.filename().string() << std::endl;
-            		// [核心修改] 使用新的智能复制函数
-            		performIntelligentCopy(sourcePath, destPath, false,-1,-1); // 数据文件通常不解引用
+            for (const auto& folderName : config->homeFolders) {
+                fs::path sourcePath = getUserHome() / folderName;
+                if (fs::exists(sourcePath)) {
+                    std::cout << "      备份: " << folderName << std::endl;
+                    captureSection(sourcePath, folderName, false, previous, packer.get(), contents, ingestStats,
+                                   filter); // 数据文件通常不解引用
                 }
             }
+        }
+
+        // 3. 写完容器索引后写入二进制清单，发布新快照，再回收不再被引用的 blob
+        if (operationCancelled()) {
+            std::cerr << "快照已取消，上一份快照保持不变。" << std::endl;
+            discardStagedTree(snapshotPath, stagingPath);
+            return -1;
+        }
+        progressBeginPhase(SNAPSHOT_PHASE_FINISHING);
+        std::string generation = g_generationName.empty()
+                                     ? timestampGenerationName(std::time(nullptr), getGenerationsPath(target))
+                                     : g_generationName;
+        {
+            PhaseScope phase("write_manifest");
+            if (packer && !packer->finish()) {
+                std::cerr << "快照出错: 无法写入容器文件。" << std::endl;
+                discardStagedTree(snapshotPath, stagingPath);
+                return -1;
+            }
+            if (!writeBinaryManifest(stagingPath / BINARY_MANIFEST_NAME, contents, manifestIcons)) {
+                std::cerr << "快照出错: 无法写入内容清单。" << std::endl;
+                discardStagedTree(snapshotPath, stagingPath);
+                return -1;
+            }
+            if (!writeGenerationName(stagingPath, generation)) {
+                std::cerr << "快照出错: 无法写入代的名称。" << std::endl;
+                discardStagedTree(snapshotPath, stagingPath);
+                return -1;
+            }
+            phase.addCounter("entries", contents.size());
+            if (packer) {
+                phase.addCounter("pack_files", packer->stats().packFiles);
+                phase.addCounter("pack_bytes_stored", packer->stats().bytesStored);
+                phase.addCounter("pack_bytes_deduplicated", packer->stats().bytesDeduplicated);
+            }
+        }
+        bool published;
+        {
+            PhaseScope phase("publish");
+            published = swapInStagedTree(snapshotPath, stagingPath);
+        }
+        stagingPath.clear();   // 暂存目录已发布或已交给后台回收
+        storeLock.unlock();
+        if (!published) {
+            std::cerr << "快照出错: 无法发布新快照，旧快照保持不变。" << std::endl;
+            return -1;
+        }
+        if (packer) {
+            const PackStats& packStats = packer->stats();
+            std::cout << "  -> 打包统计: 写入 " << packStats.filesPacked << " 个文件 (" << packStats.bytesPacked
+                      << " 字节) 到 " << packStats.packFiles << " 个容器文件 (" << packCodecName(packer->codec())
+                      << " 压缩后 " << packStats.bytesStored << " 字节), 去重 " << packStats.filesDeduplicated
+                      << " 个文件 (" << packStats.bytesDeduplicated << " 字节)" << std::endl;
         } else {
-            return -1; // 不支持的目标
+            std::cout << "  -> 存储统计: 新写入 " << ingestStats.filesStored << " 个对象 (" << ingestStats.bytesStored
+                      << " 字节), 去重 " << ingestStats.filesDeduplicated + ingestStats.hashesReused << " 个文件 ("
+                      << ingestStats.bytesDeduplicated << " 字节)" << std::endl;
+            std::cout << "  -> 复制方式: " << formatCopyRunStats(getCopyRunStats()) << std::endl;
+        }
+        {
+            PhaseScope phase("archive_generation");
+            if (archiveGeneration(target, snapshotPath, generation)) {
+                std::cout << "  -> 已保存为第 '" << generation << "' 代" << std::endl;
+            } else {
+                std::cerr << "  -> 警告: 无法把新快照保存为一代，下次冰冻前会重试。" << std::endl;
+            }
+            pruneGenerations(target, generation);
         }
+        PhaseScope phase("garbage_collect");
+        garbageCollectStore();
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "快照出错: " << e.what() << std::endl;
+        if (!stagingPath.empty()) discardStagedTree(snapshotPath, stagingPath);
         return -1;
     }
 }
 
-int do_restore(const std::string& target) {
+// 冰冻一个目标，并记录运行统计
+int do_snapshot(const std::string& target) {
+    RunScope run("freeze", target, getBaseSnapshotPath());
+    // 冰冻期间的变化保留在日志中 (快照可能记录了变化之前的内容)，之前的记录随新快照作废
+    JournalClient journal;
+    bool watched = journal.mark(changeJournalDir(), target);
+    int result = snapshotTarget(target);
+    if (result == 0 && watched) journal.rebase(snapshotIdentity(getSnapshotPathForTarget(target)), {});
+    run.setResult(result);
+    return result;
+}
+
+// 校验时的一个内容对象 (相同内容的文件只读取一次)
+struct VerifyObject {
+    uint64_t hash = 0;
+    uint64_t size = 0;
+    bool hasHash = false;
+    std::vector<std::string> paths;   // 引用该对象的条目
+    enum class Status { Ok, Missing, Corrupt } status = Status::Ok;
+};
+
+/**
+ * @brief 重新计算快照中每个内容对象的哈希并与清单中记录的比较，缺失或损坏的条目逐个打印。
+ *        对象按大小从大到小分给线程池并行校验，blob 通过内存映射读取，打包快照逐块解码。
+ * @return 缺失或损坏的条目数，-1 表示旧版镜像快照没有记录哈希、无法校验。
+ */
+int verifyContents(const std::string& target, const SnapshotContents& contents) {
+    if (!contents.fromManifest) {
+        std::cout << "  -> 旧版快照没有记录内容哈希，无法校验。" << std::endl;
+        return -1;
+    }
+    PhaseScope phase("verify");
+    auto started = std::chrono::steady_clock::now();
+
+    // 1. 按 (哈希, 大小) 合并引用相同内容的条目
+    std::vector<VerifyObject> objects;
+    std::unordered_map<std::string, size_t> byKey;
+    auto addEntry = [&](const TreeEntry& e) {
+        if (e.type != EntryType::Regular) return;
+        std::string key = e.hasContentHash ? blobKey(e.contentHash, e.size) : "?" + e.relPath;
+        auto inserted = byKey.emplace(key, objects.size());
+        if (inserted.second) {
+            VerifyObject object;
+            object.hash = e.contentHash;
+            object.size = e.size;
+            object.hasHash = e.hasContentHash;
+            objects.push_back(std::move(object));
+        }
+        objects[inserted.first->second].paths.push_back(e.relPath);
+    };
+    if (contents.mapped.isOpen()) {
+        for (size_t i = 0; i < contents.mapped.size(); ++i) addEntry(contents.mapped.entry(i));
+    } else {
+        for (const auto& e : contents.entries) addEntry(e);
+    }
+    uint64_t totalBytes = 0;
+    std::vector<size_t> order(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        order[i] = i;
+        totalBytes += objects[i].size;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return objects[a].size > objects[b].size; });
+    std::cout << "  -> 正在校验 " << target << " 的快照: " << objects.size() << " 个内容对象 (" << totalBytes
+              << " 字节，XXH3 " << xxh3Implementation() << ")..." << std::endl;
+
+    // 2. 并行重新计算哈希
+    fs::path storePath = getBlobStorePath();
+    const PackReader* pack = contents.pack.get();
+    parallelFor(order.size(), [&](size_t i) {
+        VerifyObject& object = objects[order[i]];
+        if (!object.hasHash) {
+            object.status = VerifyObject::Status::Missing;   // 冰冻时未能入库
+            return;
+        }
+        uint64_t actual = 0;
+        if (pack) {
+            std::string error;
+            if (!pack->contains(object.hash, object.size)) {
+                object.status = VerifyObject::Status::Missing;
+                return;
+            }
+            if (!pack->hashContent(object.hash, object.size, actual, error)) {
+                object.status = VerifyObject::Status::Corrupt;
+                return;
+            }
+        } else {
+            fs::path path = blobPath(storePath, object.hash, object.size);
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+                object.status = VerifyObject::Status::Missing;
+                return;
+            }
+            if (!S_ISREG(st.st_mode) || (uint64_t)st.st_size != object.size || !hashStoreObject(path, actual)) {
+                object.status = VerifyObject::Status::Corrupt;
+                return;
+            }
+        }
+        if (actual != object.hash) object.status = VerifyObject::Status::Corrupt;
+    });
+
+    // 3. 报告
+    std::vector<std::pair<std::string, const char*>> problems;
+    uint64_t missing = 0, corrupt = 0, files = 0;
+    for (const auto& object : objects) {
+        files += object.paths.size();
+        if (object.status == VerifyObject::Status::Ok) continue;
+        bool isMissing = object.status == VerifyObject::Status::Missing;
+        (isMissing ? missing : corrupt) += object.paths.size();
+        for (const auto& path : object.paths) problems.emplace_back(path, isMissing ? "缺失" : "损坏");
+    }
+    std::sort(problems.begin(), problems.end());
+    for (const auto& problem : problems) std::cout << "      " << problem.second << ": " << problem.first << std::endl;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "  -> 校验完成: " << files << " 个文件 (" << totalBytes << " 字节)，用时 " << seconds
+              << " 秒 (" << (seconds > 0 ? (uint64_t)(totalBytes / seconds / (1 << 20)) : 0) << " MiB/s)，缺失 "
+              << missing << " 个，损坏 " << corrupt << " 个。" << std::endl;
+    phase.addCounter("objects", objects.size());
+    phase.addCounter("bytes", totalBytes);
+    phase.addCounter("missing", missing);
+    phase.addCounter("corrupt", corrupt);
+    return (int)(missing + corrupt);
+}
+
+// 校验目标的当前快照，返回缺失或损坏的条目数，-1 表示无法校验
+int verifyTarget(const std::string& target) {
+    if (std::find(SUPPORTED_TARGETS.begin(), SUPPORTED_TARGETS.end(), target) == SUPPORTED_TARGETS.end()) return -1;
+    fs::path snapshotPath = getSnapshotPathForTarget(target);
+    if (!fs::exists(snapshotPath)) {
+        std::cerr << "错误：未找到 " << target << " 的快照。" << std::endl;
+        return -1;
+    }
+    SnapshotContents contents;
+    if (!loadSnapshotContents(snapshotPath, contents)) {
+        std::cerr << "错误：快照内容清单已损坏。" << std::endl;
+        return -1;
+    }
+    return verifyContents(target, contents);
+}
+
+// 恢复前校验快照 (同一进程中每份快照只校验一次)，返回 false 表示有缺失或损坏的内容
+bool verifyBeforeRestore(const std::string& target, const SnapshotContents& contents) {
+    std::string key = target + " " + snapshotIdentity(contents.snapshotPath);
+    {
+        std::lock_guard<std::mutex> lock(g_verifiedMutex);
+        if (g_verifiedSnapshots.count(key)) return true;
+    }
+    int problems = verifyContents(target, contents);
+    if (problems > 0) return false;
+    std::lock_guard<std::mutex> lock(g_verifiedMutex);
+    g_verifiedSnapshots.insert(key);   // 旧版快照无法校验，也不再重复尝试
+    return true;
+}
+
+/**
+ * @brief 从快照恢复目标。
+ * @param parts RESTORE_PART_* 的组合: 会话结束时只恢复文件，登录时按优先级分阶段恢复。
+ */
+int restoreTarget(const std::string& target, int parts) {
     try {
         fs::path snapshotPath = getSnapshotPathForTarget(target);
         fs::path trashPath = getTrashPath(); // 获取回收站路径
 
         // 获取当前实际登录用户的 ID (即使程序以 Root 运行，getuid 也会返回普通用户 ID)
-        uid_t user_uid = getuid();
-        gid_t user_gid = getgid();
+        uid_t user_uid = sessionUid();
+        gid_t user_gid = sessionGid();
         
         // 定义 Root 的 ID
         uid_t root_uid = 0;
         gid_t root_gid = 0;
 
+        // 恢复时使用当前的配置: 被排除的条目不受快照管理，保持原样
+        std::shared_ptr<const TargetConfig> config = currentTargetConfig();
+        const PathFilter* filter = config->filterFor(target);
+
+        // 本次恢复累计的统计信息
+        SyncStats syncStats;
+        resetCopyRunStats();
+        progressBeginPhase(SNAPSHOT_PHASE_PREPARING);
+
         // ===== [核心修正] 分离不同目标的有效性检查 =====
         if (target == "desktop") {
-            if (!fs::exists(snapshotPath) || !fs::exists(snapshotPath / SNAPSHOT_MANIFEST_NAME)) {
+            if (!fs::exists(snapshotPath) || (!fs::exists(snapshotPath / BINARY_MANIFEST_NAME) &&
+                                              !fs::exists(snapshotPath / SNAPSHOT_MANIFEST_NAME))) {
                 std::cerr << "错误：未找到桌面快照或其清单文件。" << std::endl;
                 return -1;
             }
@@ -359,194 +1288,158 @@ int do_restore(const std::string& target) {
             return -1;
         }
 
+        SnapshotContents contents;
+        {
+            PhaseScope phase("load_manifest");
+            if (!loadSnapshotContents(snapshotPath, contents)) {
+                std::cerr << "错误：快照内容清单已损坏。" << std::endl;
+                return -1;
+            }
+        }
+        // 开启了恢复前校验时，快照中有缺失或损坏的内容就不恢复该目标，当前文件保持原样
+        if (g_verifyBeforeRestore && (parts & RESTORE_PART_CONTENT) &&
+            !verifyBeforeRestore(target, contents)) {
+            std::cerr << "错误：" << target << " 的快照校验未通过，已跳过恢复，当前文件保持不变。" << std::endl;
+            return -1;
+        }
+
+        // 变更日志: 先放置标记 (恢复自身的写入都在标记之后)，增量恢复且日志有效时只同步日志中记录的路径
+        JournalClient journal;
+        std::string identity = snapshotIdentity(snapshotPath);
+        bool watched = !identity.empty() && (parts & RESTORE_PART_CONTENT) && !actingForSessionUser() &&
+                       journal.mark(changeJournalDir(), target);
+        const JournalClient* dirtyJournal = nullptr;
+        if (watched && isIncrementalRestore()) {
+            PhaseScope phase("load_journal");
+            if (journal.load(identity, JOURNAL_SYNC_TIMEOUT_MS)) {
+                dirtyJournal = &journal;
+                std::cout << "  -> 使用变更日志，只检查冰冻后发生过变化的路径" << std::endl;
+            }
+            phase.addCounter("valid", dirtyJournal ? 1 : 0);
+        }
+        // 原地恢复: 先把被移动 (例如拖进回收站) 的文件移回原处，各分区随后的同步沿用这里的扫描结果
+        std::map<std::string, std::vector<TreeEntry>> scannedSections;
+        if ((isIncrementalRestore() || filter) && (parts & (RESTORE_PART_FILES | RESTORE_PART_TRASH))) {
+            relocateSections(contents, userRestoreSections(target, parts, *config), dirtyJournal, filter, syncStats,
+                             scannedSections);
+        }
+        auto scannedFor = [&](const std::string& section) -> const std::vector<TreeEntry>* {
+            auto it = scannedSections.find(section);
+            return it == scannedSections.end() ? nullptr : &it->second;
+        };
+        std::vector<std::string> restoredSections;   // 本次已与快照一致的分区，成功后更新日志的基准
+        bool sectionsComplete = true;
+
         // ====================================================================
         //  TARGET: DESKTOP (恢复桌面 + 回收站 + 启动器 + 系统图标)
         // ====================================================================
      if (target == "desktop") {
-            // 3. 恢复启动器配置和系统图标 -> 【混合权限】
-            // 这里需要根据路径判断是系统文件还是用户配置
-            std::cout << "  -> 正在恢复启动器及系统配置..." << std::endl;
-            // [关键修改] 指定子目录
-            fs::path iconConfigsBackupDir = snapshotPath / "IconConfigs";
-
-            std::vector<std::string> extraTargets = LAUNCHER_TARGETS;
-            extraTargets.insert(extraTargets.end(), SYSTEM_TARGETS.begin(), SYSTEM_TARGETS.end());
-
-            for (const auto& folderName : extraTargets) {
-                fs::path backupPath;
-                fs::path restorePath;
-                // 决定使用什么权限
-                uid_t target_owner_uid = user_uid;
-                gid_t target_owner_gid = user_gid;
+          if (parts & (RESTORE_PART_FILES | RESTORE_PART_SYSTEM)) {
+                // 3. 恢复启动器配置和系统图标 -> 【混合权限】
+                // 这里需要根据路径判断是系统文件还是用户配置
+                std::cout << "  -> 正在恢复启动器及系统配置..." << std::endl;
 
-                if (!folderName.empty() && folderName[0] == '/') {
-                    // 绝对路径 (如 /usr/share/applications) -> 使用 Root 权限
-                    backupPath = iconConfigsBackupDir / folderName.substr(1);
-                    restorePath = folderName;
-                    target_owner_uid = root_uid;
-                    target_owner_gid = root_gid;
-                } else {
-                    // 相对路径 (如 .config/dde-launcher) -> 使用用户权限
-                    backupPath = iconConfigsBackupDir / folderName;
-                    restorePath = getUserHome() / folderName;
-                    // 保持默认 user_uid
-                }
+                for (const auto& folderName : iconConfigFolders(*config)) {
+                    bool systemFolder = !folderName.empty() && folderName[0] == '/';
+                    if (!(parts & (systemFolder ? RESTORE_PART_SYSTEM : RESTORE_PART_FILES))) continue;
+                    fs::path restorePath;
+                    // 决定使用什么权限
+                    uid_t target_owner_uid = user_uid;
+                    gid_t target_owner_gid = user_gid;
 
-                if (fs::exists(backupPath)) {
-                    std::cout << "      恢复配置: " << restorePath.string() 
-                              << (target_owner_uid == 0 ? " [Root]" : " [User]") << std::endl;
-
-                    // 如果是系统目录，我们只清空内容，不删除文件夹本身，以保留文件夹权限
-                    if (fs::exists(restorePath)) {
-                        // 如果是系统目录，只清空内容；如果是用户目录，可以删除重建
-                        if (target_owner_uid == 0) {
-                             for (const auto& e : fs::directory_iterator(restorePath)) fs::remove_all(e.path());
-                        } else {
-                             fs::remove_all(restorePath);
-                             if (restorePath.has_parent_path()) fs::create_directories(restorePath.parent_path());
-                             // 记得修复重建目录的权限
-                             lchown(restorePath.c_str(), user_uid, user_gid);
-                        }
+                    if (systemFolder) {
+                        // 绝对路径 (如 /usr/share/applications) -> 使用 Root 权限
+                        restorePath = folderName;
+                        target_owner_uid = root_uid;
+                        target_owner_gid = root_gid;
                     } else {
-                        if (restorePath.has_parent_path()) fs::create_directories(restorePath.parent_path());
+                        // 相对路径 (如 .config/dde-launcher) -> 使用用户权限
+                        restorePath = getUserHome() / folderName;
+                        // 保持默认 user_uid
                     }
-                    
-                    // [修改] 传入这一轮循环决定的正确 UID/GID
-                    performIntelligentCopy(backupPath, restorePath, false, target_owner_uid, target_owner_gid);
-                }
-            }
-//===================================================================
-        // --- 桌面恢复逻辑 (处理图标位置) ---
-        fs::path desktopPath = getUserHome() / "Desktop";
 
-        // --- 2. 恢复桌面 (逻辑和之前一样) ---
-        std::cout << "  -> 正在恢复桌面..." << std::endl;
-	 // 清空桌面
-        for (const auto& entry : fs::directory_iterator(desktopPath)) {
-            fs::remove_all(entry.path());
-        }
-        // [关键修改] 直接遍历 DesktopFiles 子目录，无需任何过滤逻辑！
-        fs::path desktopFilesBackupDir = snapshotPath / "DesktopFiles";
-        if (fs::exists(desktopFilesBackupDir)) {
-            // [修改] 直接调用一次即可，performIntelligentCopy 会遍历目录
-            // 注意：这里 dest 是 desktopPath 本身，我们需要把备份目录里的东西拷进去
-            performIntelligentCopy(desktopFilesBackupDir, desktopPath, false, user_uid, user_gid);
-        }
-//===================================================================
-            // 4. [性能优化] 批量恢复图标位置 (不再使用循环调用 system)
-            std::cout << "  -> 正在批量恢复图标位置..." << std::endl;
-            
-            // 创建一个临时 shell 脚本
-            std::string batchScriptPath = "/tmp/restore_icons_" + std::to_string(getpid()) + ".sh";
-            std::ofstream scriptFile(batchScriptPath);
-            
-            if (scriptFile.is_open()) {
-                scriptFile << "#!/bin/sh\n";
-                
-                std::ifstream manifestFile(snapshotPath / SNAPSHOT_MANIFEST_NAME);
-                std::string line;
-                while (std::getline(manifestFile, line)) {
-                    size_t delimiterPos = line.find('|');
-                    if (delimiterPos != std::string::npos) {
-                        std::string filename = line.substr(0, delimiterPos);
-                        std::string position = line.substr(delimiterPos + 1);
-                        
-                        if (!position.empty()) {
-                            // 构造目标文件的完整路径
-                            fs::path targetFile = desktopPath / filename;
-                            // 将 gvfs 命令写入脚本，而不是立即执行
-                            // 注意：我们需要转义文件名中的潜在特殊字符，这里简单处理加引号
-                            scriptFile << "gvfs-set-attribute -t string \"" << targetFile.string() << "\" " 
-                                       << ICON_POSITION_KEY << " '" << position << "'\n";
-                        }
+                    std::string section = iconConfigSection(folderName);
+                    restoredSections.push_back(section);
+                    if (sectionExists(contents, section)) {
+                        std::cout << "      恢复配置: " << restorePath.string() 
+                                  << (target_owner_uid == 0 ? " [Root]" : " [User]") << std::endl;
+
+                        // 目录本身保持不动 (保留系统目录的权限)，只同步其内容
+                        if (restorePath.has_parent_path()) fs::create_directories(restorePath.parent_path());
+                        restoreSection(contents, section, restorePath, target_owner_uid, target_owner_gid, syncStats,
+                                       dirtyJournal, filter, scannedFor(section));
                     }
                 }
-                scriptFile.close();
-                
-                // 赋予脚本执行权限
-                chmod(batchScriptPath.c_str(), 0755);
-                
-                // 一次性执行脚本
-                // 注意：因为我们是 SUID Root 运行，gvfs 需要连接用户的 Session Bus
-                // 之前的环境通常已经设置好了 DBUS_SESSION_BUS_ADDRESS，所以直接运行通常可行
-                // 如果有问题，可能需要用 `su -c ...` 切换回用户执行，但在 autostart 环境下通常不需要
-                std::string runCmd = "sh " + batchScriptPath + " > /dev/null 2>&1";
-                system(runCmd.c_str());
-                
-                // 清理临时脚本
-                fs::remove(batchScriptPath);
-            }
-
-            // 5. [修改 2] 异步刷新桌面环境
-            // 移除了 "killall -9 dde-desktop"，保留 dock 和 launcher 的重启
-            // 这样任务栏会刷新（因为配置变了），但壁纸不会消失
-            std::cout << "  -> 触发后台刷新..." << std::endl;
-            std::string refreshCmd = 
-                "nohup sh -c '"
-                "update-desktop-database /usr/share/applications > /dev/null 2>&1; "
-                //"killall -9 dde-dock > /dev/null 2>&1; "
-                //"killall -9 dde-launcher > /dev/null 2>&1; "
-                // 注意：这里删除了 killall dde-desktop
-                // 让 DDE 自动监测文件变化并更新，而不是强制重启
-                "xrefresh > /dev/null 2>&1"
-                "' > /dev/null 2>&1 &";
-            
-            system(refreshCmd.c_str());
-//===================================================================
-        std::cout << "  -> 正在恢复回收站..." << std::endl;
-        fs::path trashBackupPath = snapshotPath / "TrashBackup";
-        if (fs::exists(trashBackupPath)) {
-            try {
-                // a. 确保当前回收站的子目录存在
-                fs::create_directories(trashPath / "files");
-                fs::create_directories(trashPath / "info");
-
-                // b. 清空当前回收站的子目录内容，而不是删除 Trash 根目录
-                for (const auto& entry : fs::directory_iterator(trashPath / "files")) {
-                    fs::remove_all(entry.path());
-                }
-                for (const auto& entry : fs::directory_iterator(trashPath / "info")) {
-                    fs::remove_all(entry.path());
-                }
-                std::cout << "      当前回收站已清空。" << std::endl;
+    //===================================================================
+            // --- 桌面恢复逻辑 (处理图标位置) ---
+            fs::path desktopPath = getUserHome() / "Desktop";
 
-                // c. 将备份的内容复制到对应的子目录中
-                fs::path trashBackupFiles = trashBackupPath / "files";
-                fs::path trashBackupInfo = trashBackupPath / "info";
+            // --- 2. 恢复桌面 (逻辑和之前一样) ---
+            if (parts & RESTORE_PART_FILES) {
+                std::cout << "  -> 正在恢复桌面..." << std::endl;
+                restoreSection(contents, "DesktopFiles", desktopPath, user_uid, user_gid, syncStats, dirtyJournal,
+                               filter, scannedFor("DesktopFiles"));
+                restoredSections.push_back("DesktopFiles");
+            }
+          }
+    //===================================================================
+          if (parts & RESTORE_PART_TRASH) {
+            std::cout << "  -> 正在恢复回收站..." << std::endl;
+            if (sectionExists(contents, "TrashBackup")) {
+                try {
+                    // a. 确保当前回收站的子目录存在
+                    fs::create_directories(trashPath / "files");
+                    fs::create_directories(trashPath / "info");
 
-                if (fs::exists(trashBackupFiles)) {
-                    // [修改] 传入 user_uid
-                    performIntelligentCopy(trashBackupFiles, trashPath / "files", false, user_uid, user_gid);
-                }
-                if (fs::exists(trashBackupInfo)) {
-                    // [修改] 传入 user_uid
-                    performIntelligentCopy(trashBackupInfo, trashPath / "info", false, user_uid, user_gid);
-                }
-                std::cout << "      回收站已从快照恢复。" << std::endl;
+                    // b. 只同步 files 与 info 的内容，而不是替换 Trash 根目录
+                    //    备份中缺失的子目录视为空目录
+                    restoreSection(contents, "TrashBackup/files", trashPath / "files", user_uid, user_gid, syncStats,
+                                   dirtyJournal, filter, scannedFor("TrashBackup/files"));
+                    restoreSection(contents, "TrashBackup/info", trashPath / "info", user_uid, user_gid, syncStats,
+                                   dirtyJournal, filter, scannedFor("TrashBackup/info"));
+                    std::cout << "      回收站已从快照恢复。" << std::endl;
 
-            } catch (const fs::filesystem_error& e) {
-                // 如果恢复回收站失败，只打印警告，不中断后续的桌面恢复
-                std::cerr << "警告: 恢复回收站时发生错误: " << e.what() << std::endl;
+                } catch (const fs::filesystem_error& e) {
+                    // 如果恢复回收站失败，只打印警告，不中断后续的桌面恢复
+                    std::cerr << "警告: 恢复回收站时发生错误: " << e.what() << std::endl;
+                    sectionsComplete = false;
+                }
+            } else {
+                std::cout << "      快照中未找到回收站备份，跳过恢复。" << std::endl;
             }
-        } else {
-            std::cout << "      快照中未找到回收站备份，跳过恢复。" << std::endl;
-        }
+            restoredSections.push_back("TrashBackup/files");
+            restoredSections.push_back("TrashBackup/info");
+          }
+          // 4. [性能优化] 批量恢复图标位置并刷新桌面
+          if ((parts & RESTORE_PART_ICONS) && !operationCancelled()) {
+              progressBeginPhase(SNAPSHOT_PHASE_FINISHING);
+              restoreDesktopIcons(contents, getUserHome() / "Desktop");
+          }
         } 
-	  else if (target == "home_folders") {
+	  else if (target == "home_folders" && (parts & RESTORE_PART_FILES)) {
             std::cout << "  -> 正在恢复用户文件夹..." << std::endl;
             // 恢复用户数据 -> 必须是【普通用户权限】
-            for (const auto& folderName : HOME_FOLDER_TARGETS) {
-                fs::path backupPath = snapshotPath / folderName;
+            for (const auto& folderName : config->homeFolders) {
                 fs::path restorePath = getUserHome() / folderName;
-                if (fs::exists(backupPath)) {
+                if (sectionExists(contents, folderName)) {
                     std::cout << "      恢复: " << folderName << std::endl;
-                    if (fs::exists(restorePath)) fs::remove_all(restorePath);
-                    // [修改] 传入 user_uid
-                    performIntelligentCopy(backupPath, restorePath, false, user_uid, user_gid);
+                    restoreSection(contents, folderName, restorePath, user_uid, user_gid, syncStats, dirtyJournal,
+                                   filter, scannedFor(folderName));
                 }
+                restoredSections.push_back(folderName);
             }
-        } else {
-            return -1; // 不支持的目标
+        }
+        if (operationCancelled()) {
+            std::cerr << "恢复已取消。" << std::endl;
+            return -1;
+        }
+        if (parts & RESTORE_PART_CONTENT) {
+            printSyncSummary(syncStats);
+            std::cout << "  -> 复制方式: " << formatCopyRunStats(getCopyRunStats()) << std::endl;
+        }
+        // 有条目恢复失败时保留日志中的记录，下次恢复时重试
+        if (watched && sectionsComplete && syncStats.entriesFailed == 0 && !restoredSections.empty()) {
+            journal.rebase(identity, restoredSections);
         }
         return 0;
     }catch (const std::exception& e) {
@@ -557,12 +1450,87 @@ int do_restore(const std::string& target) {
 
 // ----- API 实现 -----
 
-extern "C" {
+// 恢复一个目标，并记录运行统计 (在登录恢复等外层运行中作为一个阶段记录; 代替会话用户运行时不写出)
+int do_restore(const std::string& target, int parts = RESTORE_PART_ALL) {
+    RunScope run("restore", target, actingForSessionUser() ? fs::path() : getBaseSnapshotPath());
+    int result = restoreTarget(target, parts);
+    run.setResult(result);
+    return result;
+}
 
-int TakeSnapshotAndArm(const char* target_c) {
-    std::string target(target_c);
+/**
+ * @brief 把目标快照切换到指定的一代: 在暂存目录中链接该代的文件后与当前快照交换。
+ *        当前快照先保存为一代 (如果还没有)，恢复标志保持不变。
+ */
+int switchGeneration(const std::string& target, const std::string& generation) {
+    PhaseScope phase("switch_generation");
+    fs::path snapshotPath = getSnapshotPathForTarget(target);
+    fs::path generationPath = getGenerationsPath(target) / generation;
+    ensureCurrentArchived(target);
+    std::cout << "  -> 正在切换到第 '" << generation << "' 代..." << std::endl;
+    fs::path stagingPath;
+    if (!createStagingDir(snapshotPath, stagingPath)) {
+        std::cerr << "错误：无法创建暂存目录。" << std::endl;
+        return -1;
+    }
+    bool armed = fs::exists(getTriggerFilePath(target));
+    bool ready = linkSnapshotFiles(generationPath, stagingPath, {}) && writeGenerationName(stagingPath, generation);
+    if (ready && armed) ready = std::ofstream(stagingPath / BOOT_TRIGGER_FILENAME).is_open();
+    if (!ready || !swapInStagedTree(snapshotPath, stagingPath)) {
+        if (!ready) discardStagedTree(snapshotPath, stagingPath);
+        std::cerr << "错误：无法切换到第 '" << generation << "' 代，当前快照保持不变。" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// 恢复到指定的一代 (空表示当前代)，该代成为当前代
+int restoreGeneration(const std::string& target, const std::string& generation) {
+    if (generation.empty()) return do_restore(target);
+    if (std::find(SUPPORTED_TARGETS.begin(), SUPPORTED_TARGETS.end(), target) == SUPPORTED_TARGETS.end()) return -1;
+    if (!isValidGenerationName(generation) ||
+        !fs::exists(getGenerationsPath(target) / generation / BINARY_MANIFEST_NAME)) {
+        std::cerr << "错误：未找到 " << target << " 的第 '" << generation << "' 代快照。" << std::endl;
+        return -1;
+    }
+    // 切换和恢复记为同一次运行 (do_restore 的记录嵌套在其中)
+    RunScope run("restore", target, getBaseSnapshotPath());
+    int result = 0;
+    if (currentGenerationName(getSnapshotPathForTarget(target)) != generation) {
+        result = switchGeneration(target, generation);
+    }
+    if (result == 0) result = do_restore(target);
+    run.setResult(result);
+    return result;
+}
+
+// 删除一代 (当前代除外)，并回收只被该代引用的 blob
+int removeGeneration(const std::string& target, const std::string& generation) {
+    if (std::find(SUPPORTED_TARGETS.begin(), SUPPORTED_TARGETS.end(), target) == SUPPORTED_TARGETS.end()) return -1;
+    fs::path generationPath = getGenerationsPath(target) / generation;
+    std::error_code ec;
+    if (!isValidGenerationName(generation) || !fs::exists(generationPath, ec)) {
+        std::cerr << "未找到 " << target << " 的第 '" << generation << "' 代快照。" << std::endl;
+        return -1;
+    }
+    if (currentGenerationName(getSnapshotPathForTarget(target)) == generation) {
+        std::cerr << "错误：第 '" << generation << "' 代是当前快照，不能单独删除。" << std::endl;
+        return -1;
+    }
+    std::cout << "正在删除 " << target << " 的第 '" << generation << "' 代快照..." << std::endl;
+    fs::remove_all(generationPath, ec);
+    if (ec) {
+        std::cerr << "错误：删除 " << generationPath.string() << " 失败: " << ec.message() << std::endl;
+        return -1;
+    }
+    garbageCollectStore();
+    return 0;
+}
+
+// 冰冻并设置恢复标志 (同步和异步接口共用)
+int freezeAndArm(const std::string& target) {
     if (do_snapshot(target) == 0) {
-        // [修正] 补上创建标志文件的关键一步
+        // [修正] 补上创建标志文件的关键一步 (新快照发布之后才设置，失败时旧快照保持原来的状态)
         std::ofstream triggerFile(getTriggerFilePath(target));
         if (triggerFile.is_open()) {
             triggerFile.close();
@@ -572,15 +1540,26 @@ int TakeSnapshotAndArm(const char* target_c) {
     return -1; // 失败
 }
 
-void RemoveSnapshotAndCancel(const char* target_c) {
-    std::string target(target_c);
+// 移除快照并取消恢复 (同步和异步接口共用)
+int removeSnapshot(const std::string& target) {
     fs::path snapshotPath = getSnapshotPathForTarget(target);
 
     if (fs::exists(snapshotPath)) {
         std::cout << "正在为 '" << target << "' 移除快照..." << std::endl;
         fs::remove_all(snapshotPath);
+        removeChangeJournal(changeJournalDir(), target);
+        // 历代快照一并删除，没有其他目标的代时删除代目录
+        fs::path generationsRoot = getGenerationsPath(target).parent_path();
+        fs::remove_all(getGenerationsPath(target));
+        std::error_code ec;
+        if (fs::is_empty(generationsRoot, ec)) fs::remove(generationsRoot, ec);
+
+        // [新增] 回收只被该快照引用的 blob (其他目标仍在使用的内容会保留)
+        garbageCollectStore();
         
         // [新增] 在移除子目录后，检查基础目录是否已空，如果空了就一并删除
+        //        (先等后台删完以前换下来的旧快照)
+        waitForReaper();
         fs::path basePath = getBaseSnapshotPath();
         if (fs::exists(basePath) && fs::is_empty(basePath)) {
             std::cout << "所有快照均已移除，正在清理基础目录..." << std::endl;
@@ -590,31 +1569,424 @@ void RemoveSnapshotAndCancel(const char* target_c) {
         // [修改] 让输出更清晰
         std::cout << "未找到 '" << target << "' 的快照，无需移除。" << std::endl;
     }
+    return 0;
+}
+
+// 快照清单的统计 (条目数、文件数和字节数需要读取整个清单)，按清单标识缓存
+struct ManifestSummary {
+    std::string identity;
+    unsigned long long entries = 0;
+    unsigned long long files = 0;
+    unsigned long long bytes = 0;
+    bool valid = false;
+};
+
+std::mutex g_summaryMutex;
+std::unordered_map<std::string, ManifestSummary> g_summaryCache;
+
+ManifestSummary summarizeSnapshot(const std::string& target, const fs::path& snapshotPath) {
+    std::string identity = snapshotIdentity(snapshotPath);
+    {
+        std::lock_guard<std::mutex> lock(g_summaryMutex);
+        auto it = g_summaryCache.find(target);
+        if (it != g_summaryCache.end() && it->second.identity == identity) return it->second;
+    }
+    ManifestSummary summary;
+    summary.identity = identity;
+    std::vector<TreeEntry> entries;
+    if (!identity.empty() && readSnapshotEntries(snapshotPath, entries)) {
+        summary.valid = true;
+        summary.entries = entries.size();
+        for (const auto& e : entries) {
+            if (e.type != EntryType::Regular) continue;
+            summary.files++;
+            summary.bytes += e.size;
+        }
+    }
+    std::lock_guard<std::mutex> lock(g_summaryMutex);
+    g_summaryCache[target] = summary;
+    return summary;
+}
+
+extern "C" {
+
+int TakeSnapshotAndArm(const char* target_c) {
+    std::lock_guard<std::mutex> lock(operationMutex());
+    return freezeAndArm(std::string(target_c));
+}
+
+void RemoveSnapshotAndCancel(const char* target_c) {
+    std::lock_guard<std::mutex> lock(operationMutex());
+    removeSnapshot(std::string(target_c));
 }
 
 int RestoreSnapshotImmediate(const char* target_c) {
+    std::lock_guard<std::mutex> lock(operationMutex());
     return do_restore(std::string(target_c));
 }
 
+int RestoreSnapshotGeneration(const char* target_c, const char* generation_c) {
+    std::lock_guard<std::mutex> lock(operationMutex());
+    return restoreGeneration(std::string(target_c), generation_c ? std::string(generation_c) : "");
+}
+
+int RemoveSnapshotGeneration(const char* target_c, const char* generation_c) {
+    if (target_c == nullptr || generation_c == nullptr) return -1;
+    std::lock_guard<std::mutex> lock(operationMutex());
+    return removeGeneration(std::string(target_c), std::string(generation_c));
+}
+
+SnapshotOperation* TakeSnapshotAndArmAsync(const char* target_c, SnapshotProgressCallback callback, void* userData) {
+    std::string target(target_c);
+    return submitOperation([target] { return freezeAndArm(target); }, callback, userData);
+}
+
+SnapshotOperation* RestoreSnapshotAsync(const char* target_c, SnapshotProgressCallback callback, void* userData) {
+    std::string target(target_c);
+    return submitOperation([target] { return do_restore(target); }, callback, userData);
+}
+
+SnapshotOperation* RestoreSnapshotGenerationAsync(const char* target_c, const char* generation_c,
+                                                  SnapshotProgressCallback callback, void* userData) {
+    std::string target(target_c);
+    std::string generation = generation_c ? generation_c : "";
+    return submitOperation([target, generation] { return restoreGeneration(target, generation); }, callback,
+                           userData);
+}
+
+SnapshotOperation* RemoveSnapshotAsync(const char* target_c, SnapshotProgressCallback callback, void* userData) {
+    std::string target(target_c);
+    return submitOperation([target] { return removeSnapshot(target); }, callback, userData);
+}
+
+void CancelSnapshotOperation(SnapshotOperation* operation) {
+    if (operation) cancelOperation(operation);
+}
+
+int PollSnapshotOperation(SnapshotOperation* operation, SnapshotOperationProgress* progress) {
+    if (!operation) return SNAPSHOT_OP_FAILED;
+    return pollOperation(operation, progress);
+}
+
+int WaitSnapshotOperation(SnapshotOperation* operation, int timeoutMs) {
+    if (!operation) return SNAPSHOT_OP_FAILED;
+    return waitOperation(operation, timeoutMs);
+}
+
+void ReleaseSnapshotOperation(SnapshotOperation* operation) {
+    releaseOperation(operation);
+}
+
+void SetMaterializeMode(int mode) {
+    if (mode != SNAPSHOT_MATERIALIZE_COPY && mode != SNAPSHOT_MATERIALIZE_HARDLINK) {
+        std::cerr << "未知的物化方式: " << mode << "，保持当前设置。" << std::endl;
+        return;
+    }
+    g_materializeMode = mode;
+}
+
+void SetStorageMode(int mode) {
+    if (mode != SNAPSHOT_STORAGE_BLOBS && mode != SNAPSHOT_STORAGE_PACKED) {
+        std::cerr << "未知的存储方式: " << mode << "，保持当前设置。" << std::endl;
+        return;
+    }
+    g_storageMode = mode;
+}
+
+void SetDeltaRestoreThreshold(long long bytes) {
+    if (bytes < 0) {
+        std::cerr << "无效的按块更新阈值: " << bytes << "，保持当前设置。" << std::endl;
+        return;
+    }
+    g_deltaThreshold = (uint64_t)bytes;
+}
+
+void SetVerifyBeforeRestore(int enabled) {
+    g_verifyBeforeRestore = enabled != 0;
+}
+
+void SetPackCompression(int codec) {
+    if (codec < SNAPSHOT_COMPRESS_NONE || codec > SNAPSHOT_COMPRESS_ZSTD) {
+        std::cerr << "未知的压缩方式: " << codec << "，保持当前设置。" << std::endl;
+        return;
+    }
+    if (!packCodecAvailable((PackCodec)codec)) {
+        std::cerr << "  -> 警告: 未编译 " << packCodecName((PackCodec)codec) << " 支持，改用 LZ4 压缩。" << std::endl;
+        codec = SNAPSHOT_COMPRESS_LZ4;
+    }
+    g_packCompression = codec;
+}
+
+int SetGenerationName(const char* name) {
+    std::string value = name ? name : "";
+    if (!value.empty() && !isValidGenerationName(value)) {
+        std::cerr << "无效的代名称: " << value << "，保持当前设置。" << std::endl;
+        return -1;
+    }
+    g_generationName = value;
+    return 0;
+}
+
+void SetGenerationRetention(int keepCount, long long keepSeconds) {
+    if (keepCount < 0 || keepSeconds < 0) {
+        std::cerr << "无效的保留策略: " << keepCount << " 代 / " << keepSeconds << " 秒，保持当前设置。" << std::endl;
+        return;
+    }
+    g_keepGenerations = keepCount;
+    g_keepGenerationSeconds = keepSeconds;
+}
+
+void SetWorkerCount(int count) {
+    setWorkerCount(count > 0 ? (size_t)count : 0);
+}
+
+void SetRestoreMode(int mode) {
+    if (mode < SNAPSHOT_RESTORE_FULL || mode > SNAPSHOT_RESTORE_CHECKSUM) {
+        std::cerr << "未知的恢复模式: " << mode << "，保持当前设置。" << std::endl;
+        return;
+    }
+    g_restoreMode = mode;
+}
+
 int IsRestoreArmed(const char* target_c) {
     // [修正] 调用新的 getTriggerFilePath 函数来获取正确的路径
     fs::path triggerFile = getTriggerFilePath(std::string(target_c));
     return fs::exists(triggerFile) ? 1 : 0;
 }
 
-// [修改] 自启动执行器
+int GetSnapshotInfo(const char* target_c, SnapshotInfo* info) {
+    if (target_c == nullptr || info == nullptr) return -1;
+    std::string target(target_c);
+    if (std::find(SUPPORTED_TARGETS.begin(), SUPPORTED_TARGETS.end(), target) == SUPPORTED_TARGETS.end()) return -1;
+    *info = SnapshotInfo();
+    fs::path snapshotPath = getSnapshotPathForTarget(target);
+    std::error_code ec;
+    info->armed = fs::exists(getTriggerFilePath(target), ec) ? 1 : 0;
+    if (!fs::is_directory(snapshotPath, ec)) return 0;
+    info->exists = 1;
+    info->packed = isPackedSnapshot(snapshotPath) ? 1 : 0;
+
+    ManifestSummary summary = summarizeSnapshot(target, snapshotPath);
+    if (summary.valid) {
+        info->entries = summary.entries;
+        info->files = summary.files;
+        info->bytes = summary.bytes;
+    }
+    for (const std::string& name : {BINARY_MANIFEST_NAME, CONTENT_MANIFEST_NAME, SNAPSHOT_MANIFEST_NAME}) {
+        struct stat st;
+        if (stat((snapshotPath / name).c_str(), &st) != 0) continue;
+        info->frozenAt = (long long)st.st_mtim.tv_sec;
+        break;
+    }
+    return 0;
+}
+
+int VerifySnapshot(const char* target_c) {
+    if (target_c == nullptr) return -1;
+    return verifyTarget(target_c);
+}
+
+int ListSnapshotGenerations(const char* target_c, char* buffer, int bufferSize) {
+    if (target_c == nullptr) return -1;
+    std::string target(target_c);
+    if (std::find(SUPPORTED_TARGETS.begin(), SUPPORTED_TARGETS.end(), target) == SUPPORTED_TARGETS.end()) return -1;
+    std::string current = currentGenerationName(getSnapshotPathForTarget(target));
+    std::string json = "[";
+    for (const auto& generation : listGenerations(getGenerationsPath(target), BINARY_MANIFEST_NAME)) {
+        if (json.size() > 1) json += ", ";
+        json += "{\"name\": " + jsonString(generation.name) + ", \"current\": " +
+                (generation.name == current ? "true" : "false") + ", \"named\": " +
+                (generation.named ? "true" : "false") + ", \"created_at\": " + std::to_string(generation.createdAt) +
+                "}";
+    }
+    json += "]";
+    if (buffer && bufferSize > 0) {
+        size_t n = std::min(json.size(), (size_t)bufferSize - 1);
+        memcpy(buffer, json.data(), n);
+        buffer[n] = '\0';
+    }
+    return (int)json.size();
+}
+
+int GetRestoreProgress(SnapshotRestoreProgress* progress) {
+    if (progress == nullptr) return -1;
+    return readRestoreProgress(*progress) ? 0 : -1;
+}
+
+void SetTraceExport(int enabled) {
+    setTraceExport(enabled != 0);
+}
+
+int GetLastRunStats(char* buffer, int bufferSize) {
+    std::string json;
+    if (!readRunStats(getBaseSnapshotPath(), json)) return -1;
+    if (buffer && bufferSize > 0) {
+        size_t n = std::min(json.size(), (size_t)bufferSize - 1);
+        memcpy(buffer, json.data(), n);
+        buffer[n] = '\0';
+    }
+    return (int)json.size();
+}
+
+// 执行登录恢复的一个阶段并记录其状态
+int runRestoreStage(RestoreProgressReporter& reporter, RestoreStage stage, const std::string& target, int parts) {
+    reporter.setStage(stage, SNAPSHOT_STAGE_RUNNING);
+    int result = do_restore(target, parts);
+    reporter.setStage(stage, result == 0 ? SNAPSHOT_STAGE_DONE : SNAPSHOT_STAGE_FAILED);
+    if (result != 0) std::cerr << "恢复 " << target << " 时失败。" << std::endl;
+    return result;
+}
+
+// [修改] 自启动执行器: 按优先级分阶段恢复
 void ExecuteRestoreOnBoot() {
-    // 依次检查所有支持的目标
-    for (const auto& target : SUPPORTED_TARGETS) {
-        if (IsRestoreArmed(target.c_str()) == 1) {
-            std::cout << "检测到 " << target << " 的恢复标志，正在执行恢复..." << std::endl;
-            if (do_restore(target) == 0) {
-                std::cout << target << " 已根据快照恢复。" << std::endl;
-            } else {
-                std::cerr << "恢复 " << target << " 时失败。" << std::endl;
+    // 等待可能仍在进行的会话结束恢复
+    RestoreLock lock;
+    RestoreProgressReporter reporter;
+    RunScope run("login_restore", "all", getBaseSnapshotPath());
+    int result = 0;
+
+    // 上次会话结束时已完成恢复的目标只需恢复图标位置 (干净标记只能使用一次)
+    bool desktopArmed = IsRestoreArmed("desktop") == 1;
+    bool homeArmed = IsRestoreArmed("home_folders") == 1;
+    bool desktopClean = desktopArmed && consumeCleanMarker("desktop");
+    bool homeClean = homeArmed && consumeCleanMarker("home_folders");
+    bool trashPending = desktopArmed && !desktopClean;
+    bool homePending = homeArmed && !homeClean;
+    reporter.setStage(RestoreStage::Desktop, desktopArmed ? SNAPSHOT_STAGE_PENDING : SNAPSHOT_STAGE_IDLE);
+    reporter.setStage(RestoreStage::Trash, trashPending ? SNAPSHOT_STAGE_PENDING : SNAPSHOT_STAGE_IDLE);
+    reporter.setStage(RestoreStage::HomeFolders, homePending ? SNAPSHOT_STAGE_PENDING : SNAPSHOT_STAGE_IDLE);
+
+    // 1. 前台: 启动器配置、桌面文件和图标位置，完成后立即发出桌面就绪信号
+    if (desktopArmed) {
+        if (desktopClean) {
+            std::cout << "desktop 已在上次会话结束时恢复，只恢复图标位置..." << std::endl;
+            result |= runRestoreStage(reporter, RestoreStage::Desktop, "desktop", RESTORE_PART_ICONS);
+        } else {
+            std::cout << "检测到 desktop 的恢复标志，正在优先恢复桌面..." << std::endl;
+            result |= runRestoreStage(reporter, RestoreStage::Desktop, "desktop",
+                                      RESTORE_PART_FILES | RESTORE_PART_SYSTEM | RESTORE_PART_ICONS);
+        }
+    }
+    reporter.markDesktopReady();
+    std::cout << "桌面已就绪。" << std::endl;
+
+    // 2. 后台: 回收站和用户文件夹以最低 CPU 优先级和空闲 I/O 优先级恢复，不与会话启动争抢磁盘
+    if (trashPending || homePending) {
+        runWithBackgroundPriority([&] {
+            if (trashPending) {
+                std::cout << "正在后台恢复回收站..." << std::endl;
+                result |= runRestoreStage(reporter, RestoreStage::Trash, "desktop", RESTORE_PART_TRASH);
+            }
+            if (homePending) {
+                std::cout << "检测到 home_folders 的恢复标志，正在后台恢复..." << std::endl;
+                result |= runRestoreStage(reporter, RestoreStage::HomeFolders, "home_folders", RESTORE_PART_FILES);
             }
+        });
+        std::cout << "后台恢复已完成。" << std::endl;
+    }
+    run.setResult(result);
+}
+
+// 预先恢复所有已开启恢复的目标的文件内容，成功后写入干净标记，登录时只需恢复图标位置
+// parts 不含 RESTORE_PART_SYSTEM 时，调用方须已恢复系统目录中的启动器配置
+int prerestoreArmedTargets(const std::string& runName, const std::string& reason, int parts) {
+    RestoreLock lock;
+    RunScope run(runName, "all", getBaseSnapshotPath());
+    int result = 0;
+    for (const auto& target : SUPPORTED_TARGETS) {
+        if (IsRestoreArmed(target.c_str()) != 1) continue;
+        // 先作废旧标记: 本次恢复被中断 (断电、超时被杀) 时，下次登录会退回完整恢复
+        std::error_code ec;
+        fs::remove(getCleanMarkerPath(target), ec);
+        std::cout << reason << "正在为 " << target << " 预先恢复文件..." << std::endl;
+        if (do_restore(target, parts) == 0 && writeCleanMarker(target)) {
+            std::cout << target << " 已恢复，下次登录只需恢复图标位置。" << std::endl;
+        } else {
+            std::cerr << "恢复 " << target << " 时失败，下次登录时将重新恢复。" << std::endl;
+            result = -1;
+        }
+    }
+    run.setResult(result);
+    return result;
+}
+
+void ExecuteRestoreOnLogout() {
+    prerestoreArmedTargets("logout_restore", "会话结束，", RESTORE_PART_CONTENT);
+}
+
+// 用户是否有开启了恢复的目标 (不依赖 HOME)
+bool userHasArmedTarget(const UserAccount& user) {
+    for (const auto& target : SUPPORTED_TARGETS) {
+        std::error_code ec;
+        if (fs::exists(user.home / BASE_SNAPSHOT_DIR / target / BOOT_TRIGGER_FILENAME, ec)) return true;
+    }
+    return false;
+}
+
+// 在用户的子进程中运行: 切换 HOME 和文件拥有者后，先以 root 身份恢复系统目录中的启动器配置，
+// 再降为该用户恢复主目录中的其余部分。清单由用户写入，不能以 root 身份按其中的路径创建和删除主目录中的文件
+int prerestoreForUser(const UserAccount& user, size_t workers) {
+    setenv("HOME", user.home.c_str(), 1);
+    g_sessionOverride = true;
+    g_sessionUid = user.uid;
+    g_sessionGid = user.gid;
+    setWorkerCount(workers);
+
+    // 1. 系统目录 (不写干净标记、运行统计和变更日志命令; 失败时不预先恢复，登录时完整恢复)
+    if (IsRestoreArmed("desktop") == 1) {
+        RestoreLock lock;
+        std::cout << "[" << user.name << "] 正在恢复系统目录中的启动器配置..." << std::endl;
+        if (do_restore("desktop", RESTORE_PART_SYSTEM) != 0) {
+            std::cerr << "[" << user.name << "] 恢复系统目录失败，登录时将重新恢复。" << std::endl;
+            waitForReaper();
+            return -1;
+        }
+    }
+    waitForReaper();   // 后台删除线程在降低权限之前结束
+
+    // 2. 主目录中的部分以该用户的身份恢复
+    if (initgroups(user.name.c_str(), user.gid) != 0 || setresgid(user.gid, user.gid, user.gid) != 0 ||
+        setresuid(user.uid, user.uid, user.uid) != 0) {
+        std::cerr << "错误：无法切换到用户 " << user.name << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+    int result = prerestoreArmedTargets("boot_restore", "[" + user.name + "] ",
+                                        RESTORE_PART_FILES | RESTORE_PART_TRASH);
+    waitForReaper();
+    return result;
+}
+
+int ExecuteRestoreForAllUsers(int parallel) {
+    if (getuid() != 0) {
+        std::cerr << "错误：为所有用户恢复需要以 root 身份运行。" << std::endl;
+        return -1;
+    }
+    std::vector<UserAccount> users;
+    for (auto& user : listLoginUsers()) {
+        if (!userHasArmedTarget(user)) continue;
+        // 已经开始会话的用户由其登录脚本和会话结束服务负责
+        std::error_code ec;
+        if (fs::exists(fs::path("/run/user") / std::to_string(user.uid), ec)) {
+            std::cout << "用户 " << user.name << " 已登录，跳过。" << std::endl;
+            continue;
         }
+        users.push_back(std::move(user));
     }
+    if (users.empty()) {
+        std::cout << "没有需要预先恢复的用户。" << std::endl;
+        return 0;
+    }
+    // 全局预算: 同时恢复的用户数 x 每个用户的工作线程数不超过总的工作线程数 (--jobs，默认 CPU 核心数)
+    size_t budget = getWorkerCount();
+    size_t concurrent = parallel > 0 ? (size_t)parallel : std::max<size_t>(1, budget / 2);
+    concurrent = std::min(concurrent, users.size());
+    size_t workers = std::max<size_t>(1, budget / concurrent);
+    std::cout << "正在为 " << users.size() << " 个用户预先恢复 (同时 " << concurrent << " 个，每个 " << workers
+              << " 个工作线程)..." << std::endl;
+    int result = runForEachUser(users, concurrent,
+                                [workers](const UserAccount& user) { return prerestoreForUser(user, workers); });
+    std::cout << "所有用户的预先恢复已" << (result == 0 ? "完成。" : "结束，部分用户失败。") << std::endl;
+    return result;
 }
 
 } // extern "C"
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "icon_metadata.h"
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace fs = std::filesystem;
+
+const char* const ICON_POSITION_ATTRIBUTE = "metadata::dde-file-manager-icon-position";
+
+namespace {
+
+// gvfs-info 命令行一次传入的最多文件数，避免超出参数长度限制
+const size_t CLI_BATCH_FILES = 256;
+
+// ---------------------------------------------------------------------------
+//  内存中的替身 (无桌面会话时使用)
+// ---------------------------------------------------------------------------
+
+std::atomic<bool> g_stubbed{false};
+std::mutex g_stubMutex;
+std::unordered_map<std::string, std::string> g_stubPositions;   // 完整路径 -> "x,y"
+
+bool readWithStub(const fs::path& dir, std::unordered_map<std::string, std::string>& positions) {
+    std::lock_guard<std::mutex> lock(g_stubMutex);
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        auto it = g_stubPositions.find(entry.path().string());
+        if (it != g_stubPositions.end()) positions[entry.path().filename().string()] = it->second;
+    }
+    return true;
+}
+
+void writeWithStub(const fs::path& dir, std::vector<IconPositionUpdate>& updates) {
+    std::lock_guard<std::mutex> lock(g_stubMutex);
+    for (auto& update : updates) {
+        fs::path path = dir / update.name;
+        std::error_code ec;
+        update.applied = fs::symlink_status(path, ec).type() != fs::file_type::not_found;
+        if (update.applied) g_stubPositions[path.string()] = update.position;
+    }
+}
+
+// ---------------------------------------------------------------------------
+//  GIO (运行时加载)
+// ---------------------------------------------------------------------------
+
+// 与 GLib 的 GError 布局一致
+struct GErrorStub {
+    uint32_t domain;
+    int code;
+    char* message;
+};
+
+struct GioApi {
+    void* (*fileNewForPath)(const char*) = nullptr;
+    void* (*fileEnumerateChildren)(void*, const char*, int, void*, GErrorStub**) = nullptr;
+    void* (*enumeratorNextFile)(void*, void*, GErrorStub**) = nullptr;
+    int (*enumeratorClose)(void*, void*, GErrorStub**) = nullptr;
+    const char* (*fileInfoGetName)(void*) = nullptr;
+    const char* (*fileInfoGetAttributeString)(void*, const char*) = nullptr;
+    void (*objectUnref)(void*) = nullptr;
+    void (*errorFree)(GErrorStub*) = nullptr;
+    int (*fileSetAttributeString)(void*, const char*, const char*, int, void*, GErrorStub**) = nullptr;
+    bool loaded = false;
+};
+
+template <typename Fn>
+bool loadSymbol(void* handle, const char* name, Fn& fn) {
+    fn = reinterpret_cast<Fn>(dlsym(handle, name));
+    return fn != nullptr;
+}
+
+// 加载 libgio-2.0 (只尝试一次; 句柄在进程结束前不释放)。
+// SUID 运行时 (有效 uid/gid 与实际的不同) 不在进程内使用 GIO: 它会按调用者的环境变量 (GIO_EXTRA_MODULES、
+// GIO_MODULE_DIR、DBUS_SESSION_BUS_ADDRESS、XDG_* 等) 加载模块和连接总线，此时改用以实际用户身份运行的命令行工具
+const GioApi& gio() {
+    static const GioApi unavailable;
+    if (geteuid() != getuid() || getegid() != getgid()) return unavailable;
+    static GioApi api;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        void* handle = dlopen("libgio-2.0.so.0", RTLD_NOW | RTLD_LOCAL);
+        if (!handle) return;
+        api.loaded = loadSymbol(handle, "g_file_new_for_path", api.fileNewForPath) &&
+                     loadSymbol(handle, "g_file_enumerate_children", api.fileEnumerateChildren) &&
+                     loadSymbol(handle, "g_file_enumerator_next_file", api.enumeratorNextFile) &&
+                     loadSymbol(handle, "g_file_enumerator_close", api.enumeratorClose) &&
+                     loadSymbol(handle, "g_file_info_get_name", api.fileInfoGetName) &&
+                     loadSymbol(handle, "g_file_info_get_attribute_string", api.fileInfoGetAttributeString) &&
+                     loadSymbol(handle, "g_object_unref", api.objectUnref) &&
+                     loadSymbol(handle, "g_error_free", api.errorFree) &&
+                     loadSymbol(handle, "g_file_set_attribute_string", api.fileSetAttributeString);
+    });
+    return api;
+}
+
+// 通过 GIO 枚举目录，一次取得所有子项的图标位置
+bool readWithGio(const fs::path& dir, std::unordered_map<std::string, std::string>& positions) {
+    const GioApi& api = gio();
+    if (!api.loaded) return false;
+
+    void* file = api.fileNewForPath(dir.c_str());
+    if (!file) return false;
+    std::string attributes = std::string("standard::name,") + ICON_POSITION_ATTRIBUTE;
+    GErrorStub* error = nullptr;
+    void* enumerator = api.fileEnumerateChildren(file, attributes.c_str(), 0, nullptr, &error);
+    api.objectUnref(file);
+    if (!enumerator) {
+        if (error) {
+            std::cerr << "  -> 警告: GIO 无法枚举 " << dir.string() << ": "
+                      << (error->message ? error->message : "") << std::endl;
+            api.errorFree(error);
+        }
+        return false;
+    }
+
+    while (void* info = api.enumeratorNextFile(enumerator, nullptr, &error)) {
+        const char* name = api.fileInfoGetName(info);
+        const char* position = api.fileInfoGetAttributeString(info, ICON_POSITION_ATTRIBUTE);
+        if (name && position && *position) positions[name] = position;
+        api.objectUnref(info);
+    }
+    bool ok = (error == nullptr);
+    if (error) api.errorFree(error);
+    api.enumeratorClose(enumerator, nullptr, nullptr);
+    api.objectUnref(enumerator);
+    return ok;
+}
+
+// 通过 GIO 逐条写入 (元数据写入经由同一个 gvfsd-metadata 连接，不启动新进程)
+bool writeWithGio(const fs::path& dir, std::vector<IconPositionUpdate>& updates) {
+    const GioApi& api = gio();
+    if (!api.loaded) return false;
+
+    for (auto& update : updates) {
+        fs::path path = dir / update.name;
+        void* file = api.fileNewForPath(path.c_str());
+        if (!file) continue;
+        GErrorStub* error = nullptr;
+        update.applied = api.fileSetAttributeString(file, ICON_POSITION_ATTRIBUTE, update.position.c_str(),
+                                                    0, nullptr, &error) != 0;
+        if (error) {
+            std::cerr << "  -> 警告: 无法设置 '" << path.string() << "' 的图标位置: "
+                      << (error->message ? error->message : "") << std::endl;
+            api.errorFree(error);
+        }
+        api.objectUnref(file);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+//  命令行工具 (不经过 shell)
+// ---------------------------------------------------------------------------
+
+// 命令行工具所在目录 (以绝对路径执行，不按调用者的 PATH 查找)
+const char* const CLI_TOOL_DIR = "/usr/bin/";
+
+// 传给命令行工具的环境变量 (其余一律丢弃): 连接会话总线和定位用户目录所需的变量
+const char* const CLI_ENVIRONMENT[] = {
+    "HOME", "USER", "LOGNAME", "LANG", "LC_ALL", "XDG_RUNTIME_DIR", "DBUS_SESSION_BUS_ADDRESS",
+};
+
+/**
+ * @brief 直接执行 CLI_TOOL_DIR 中的程序 (不经过 shell，参数无需转义)。stdoutFd 为 -1 时输出丢弃到 /dev/null。
+ *        本库运行在 SUID 的 snapshot_tool / autostart_helper 中: 子进程先降回调用者的真实 uid/gid，
+ *        只继承 CLI_ENVIRONMENT 中的环境变量，再以 execve 执行。
+ * @return 子进程 pid, 无法启动时返回 -1。
+ */
+pid_t spawnProgram(const std::vector<std::string>& args, int stdoutFd) {
+    // fork 之后子进程只能调用异步信号安全的函数，参数和环境在此之前准备好
+    std::string program = CLI_TOOL_DIR + args[0];
+    std::vector<char*> argv;
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    std::vector<std::string> envStrings = {"PATH=/usr/bin:/bin"};
+    for (const char* name : CLI_ENVIRONMENT) {
+        const char* value = getenv(name);
+        if (value) envStrings.push_back(std::string(name) + "=" + value);
+    }
+    std::vector<char*> envp;
+    for (auto& item : envStrings) envp.push_back(const_cast<char*>(item.c_str()));
+    envp.push_back(nullptr);
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+
+    pid_t pid = fork();
+    if (pid != 0) return pid;   // 父进程 (fork 失败时为 -1)
+
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devNull < 0 || dup2(stdoutFd >= 0 ? stdoutFd : devNull, STDOUT_FILENO) < 0 ||
+        dup2(devNull, STDERR_FILENO) < 0) {
+        _exit(126);
+    }
+    if (setresgid(gid, gid, gid) != 0 || setresuid(uid, uid, uid) != 0) _exit(126);
+    execve(program.c_str(), argv.data(), envp.data());
+    _exit(127);
+}
+
+// 等待子进程结束; 退出码 127 表示子进程中 exec 失败 (命令不存在)，126 表示无法降低权限
+bool waitProgram(pid_t pid, int& exitCode) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return exitCode != 127 && exitCode != 126;
+}
+
+// 执行程序并等待其结束
+bool runAndWait(const std::vector<std::string>& args, int& exitCode) {
+    pid_t pid = spawnProgram(args, -1);
+    return pid > 0 && waitProgram(pid, exitCode);
+}
+
+// 执行程序并读取其标准输出
+bool runAndCapture(const std::vector<std::string>& args, std::string& output) {
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) != 0) return false;
+    pid_t pid = spawnProgram(args, pipeFds[1]);
+    close(pipeFds[1]);
+    if (pid <= 0) {
+        close(pipeFds[0]);
+        return false;
+    }
+
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(pipeFds[0], buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        output.append(buffer, (size_t)n);
+    }
+    close(pipeFds[0]);
+
+    int exitCode = 0;
+    return waitProgram(pid, exitCode);
+}
+
+// 解码 file:// URI 中的 %XX 转义
+std::string decodeFileUri(const std::string& uri) {
+    const std::string prefix = "file://";
+    if (uri.compare(0, prefix.size(), prefix) != 0) return "";
+    std::string path;
+    for (size_t i = prefix.size(); i < uri.size(); ++i) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            path += (char)std::stoi(uri.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        } else {
+            path += uri[i];
+        }
+    }
+    return path;
+}
+
+// 位置必须形如 "x,y" (均为数字)
+bool isValidPosition(const std::string& value) {
+    size_t comma = value.find(',');
+    if (comma == std::string::npos || comma == 0 || comma + 1 == value.size()) return false;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (i != comma && (value[i] < '0' || value[i] > '9')) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 解析 "gvfs-info -a KEY file1 file2 ..." 的输出。每个文件一段，以 "uri:" 开头，
+ *        随后可能有 "local path:"，属性行形如 "  KEY: x,y"。
+ */
+void parseInfoOutput(const std::string& output, std::unordered_map<std::string, std::string>& positions) {
+    const std::string attributePrefix = std::string(ICON_POSITION_ATTRIBUTE) + ": ";
+    std::string currentPath;
+    size_t start = 0;
+    while (start < output.size()) {
+        size_t end = output.find('\n', start);
+        if (end == std::string::npos) end = output.size();
+        std::string line = output.substr(start, end - start);
+        start = end + 1;
+
+        if (line.compare(0, 5, "uri: ") == 0) {
+            currentPath = decodeFileUri(line.substr(5));
+        } else if (line.compare(0, 12, "local path: ") == 0) {
+            currentPath = line.substr(12);
+        } else {
+            size_t pos = line.find(attributePrefix);
+            if (pos == std::string::npos || currentPath.empty()) continue;
+            std::string value = line.substr(pos + attributePrefix.size());
+            if (isValidPosition(value)) positions[fs::path(currentPath).filename().string()] = value;
+        }
+    }
+}
+
+// 以尽量少的进程读取所有条目的位置 (每 CLI_BATCH_FILES 个文件一个进程)
+bool readWithCli(const fs::path& dir, std::unordered_map<std::string, std::string>& positions) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) files.push_back(entry.path().string());
+    if (files.empty()) return true;
+
+    // 优先使用原有的 gvfs-info，新系统上退回 "gio info"
+    const std::vector<std::vector<std::string>> tools = {
+        {"gvfs-info", "-a", ICON_POSITION_ATTRIBUTE},
+        {"gio", "info", "-a", ICON_POSITION_ATTRIBUTE},
+    };
+    for (const auto& tool : tools) {
+        bool started = true;
+        std::unordered_map<std::string, std::string> found;
+        for (size_t begin = 0; begin < files.size() && started; begin += CLI_BATCH_FILES) {
+            std::vector<std::string> args = tool;
+            size_t end = std::min(files.size(), begin + CLI_BATCH_FILES);
+            args.insert(args.end(), files.begin() + begin, files.begin() + end);
+            std::string output;
+            started = runAndCapture(args, output);
+            parseInfoOutput(output, found);
+        }
+        if (!started) continue;
+        for (auto& item : found) positions.emplace(item.first, std::move(item.second));
+        return true;
+    }
+    return false;
+}
+
+// 没有 GIO 时逐条执行 gvfs-set-attribute (或 "gio set")，参数直接传递，无需 shell 转义
+bool writeWithCli(const fs::path& dir, std::vector<IconPositionUpdate>& updates) {
+    const std::vector<std::vector<std::string>> tools = {
+        {"gvfs-set-attribute", "-t", "string"},
+        {"gio", "set", "-t", "string"},
+    };
+    for (const auto& tool : tools) {
+        bool started = true;
+        for (auto& update : updates) {
+            std::vector<std::string> args = tool;
+            args.push_back((dir / update.name).string());
+            args.push_back(ICON_POSITION_ATTRIBUTE);
+            args.push_back(update.position);
+            int exitCode = -1;
+            if (!runAndWait(args, exitCode)) {
+                started = false;
+                break;
+            }
+            update.applied = (exitCode == 0);
+        }
+        if (started) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+bool readIconPositions(const fs::path& dir, std::unordered_map<std::string, std::string>& positions) {
+    if (g_stubbed) return readWithStub(dir, positions);
+    if (readWithGio(dir, positions)) return true;
+    if (readWithCli(dir, positions)) return true;
+    std::cerr << "  -> 警告: 无法读取图标位置 (GIO 与 gvfs-info 均不可用)" << std::endl;
+    return false;
+}
+
+size_t writeIconPositions(const fs::path& dir, std::vector<IconPositionUpdate>& updates) {
+    // 位置格式不正确的条目不写入 (applied 保持 false)
+    std::vector<IconPositionUpdate> valid;
+    std::vector<size_t> validIndex;
+    for (size_t i = 0; i < updates.size(); ++i) {
+        updates[i].applied = false;
+        if (!isValidPosition(updates[i].position)) continue;
+        valid.push_back(updates[i]);
+        validIndex.push_back(i);
+    }
+    if (valid.empty()) return 0;
+
+    if (g_stubbed) {
+        writeWithStub(dir, valid);
+    } else if (!writeWithGio(dir, valid) && !writeWithCli(dir, valid)) {
+        std::cerr << "  -> 警告: 无法写入图标位置 (GIO 与 gvfs-set-attribute 均不可用)" << std::endl;
+        return 0;
+    }
+    size_t applied = 0;
+    for (size_t i = 0; i < valid.size(); ++i) {
+        updates[validIndex[i]].applied = valid[i].applied;
+        applied += valid[i].applied ? 1 : 0;
+    }
+    return applied;
+}
+
+void setIconMetadataStubbed(bool stubbed) {
+    std::lock_guard<std::mutex> lock(g_stubMutex);
+    g_stubPositions.clear();
+    g_stubbed = stubbed;
+}
+
+bool iconMetadataStubbed() {
+    return g_stubbed;
+}
@@ -0,0 +1,51 @@
+#ifndef ICON_METADATA_H
+#define ICON_METADATA_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+/**
+ * 桌面图标位置 (gvfs 元数据 metadata::dde-file-manager-icon-position) 的批量读写。
+ * 优先在进程内通过 GIO (运行时 dlopen libgio-2.0，不产生编译依赖) 访问元数据，
+ * GIO 不可用时读取退回为对整个目录只启动一次 gvfs-info / gio 进程，写入退回为逐条直接执行命令。
+ */
+
+// dde-file-manager 记录桌面图标位置的元数据键
+extern const char* const ICON_POSITION_ATTRIBUTE;
+
+/**
+ * @brief 一次性读取目录下所有条目的图标位置。
+ * @param dir 目录 (通常为 ~/Desktop)。
+ * @param positions 输出: 文件名 -> "x,y"，没有记录位置的条目不出现在结果中。
+ * @return true 表示读取成功 (即使没有任何位置记录); false 表示没有可用的读取方式。
+ */
+bool readIconPositions(const std::filesystem::path& dir, std::unordered_map<std::string, std::string>& positions);
+
+// 一条待写入的图标位置
+struct IconPositionUpdate {
+    std::string name;       // 目录中的文件名
+    std::string position;   // "x,y"
+    bool applied = false;   // 输出: 是否写入成功
+};
+
+/**
+ * @brief 批量写入目录下各条目的图标位置。
+ *        GIO 可用时全部在本进程内经同一个元数据服务连接完成; 否则逐条直接执行
+ *        gvfs-set-attribute / gio set (不经过 shell，不生成临时脚本)。
+ * @param updates 待写入的条目，每条的 applied 给出结果。
+ * @return 成功写入的条目数。
+ */
+size_t writeIconPositions(const std::filesystem::path& dir, std::vector<IconPositionUpdate>& updates);
+
+/**
+ * @brief 以进程内的内存表代替 gvfs 元数据 (不再调用 GIO 或 gvfs 命令)，同时不再触发桌面刷新。
+ *        供没有桌面会话的场景 (如基准测试) 使用; 切换时清空内存表。
+ */
+void setIconMetadataStubbed(bool stubbed);
+
+// 是否正在使用内存中的元数据替身
+bool iconMetadataStubbed();
+
+#endif // ICON_METADATA_H
@@ -0,0 +1,171 @@
+#include "json_util.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+// 递归下降解析器的状态
+struct Parser {
+    const std::string& text;
+    size_t pos = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n')) {
+            ++pos;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (pos >= text.size() || text[pos] != c) return false;
+        ++pos;
+        return true;
+    }
+
+    bool literal(const char* word) {
+        size_t n = std::char_traits<char>::length(word);
+        if (text.compare(pos, n, word) != 0) return false;
+        pos += n;
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xc0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += (char)(0xe0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        } else {
+            out += (char)(0xf0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3f));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool hex4(unsigned& code) {
+        if (pos + 4 > text.size()) return false;
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text[pos++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= (unsigned)(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= (unsigned)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= (unsigned)(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    bool string(std::string& out) {
+        if (!consume('"')) return false;
+        out.clear();
+        while (pos < text.size()) {
+            char c = text[pos++];
+            if (c == '"') return true;
+            if ((unsigned char)c < 0x20) return false;
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos >= text.size()) return false;
+            char escape = text[pos++];
+            switch (escape) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned code;
+                    if (!hex4(code)) return false;
+                    // 代理对
+                    if (code >= 0xd800 && code < 0xdc00 && literal("\\u")) {
+                        unsigned low;
+                        if (!hex4(low) || low < 0xdc00 || low >= 0xe000) return false;
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    bool scalar(JsonScalar& value) {
+        skipSpace();
+        if (pos >= text.size()) return false;
+        char c = text[pos];
+        if (c == '"') {
+            value.type = JsonScalar::Type::String;
+            return string(value.text);
+        }
+        if (literal("true") || literal("false")) {
+            value.type = JsonScalar::Type::Bool;
+            value.boolean = text[pos - 4] == 't';
+            return true;
+        }
+        if (literal("null")) {
+            value.type = JsonScalar::Type::Null;
+            return true;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            const char* begin = text.c_str() + pos;
+            char* end = nullptr;
+            value.number = std::strtod(begin, &end);
+            if (end == begin) return false;
+            value.type = JsonScalar::Type::Number;
+            value.text.assign(begin, (size_t)(end - begin));
+            pos += (size_t)(end - begin);
+            return true;
+        }
+        return false;   // 嵌套的对象或数组不支持
+    }
+};
+
+} // namespace
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char ch : text) {
+        unsigned char c = (unsigned char)ch;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += ch;
+        } else if (c < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += ch;
+        }
+    }
+    return out + "\"";
+}
+
+bool parseJsonObject(const std::string& text, std::unordered_map<std::string, JsonScalar>& members) {
+    members.clear();
+    Parser parser{text};
+    if (!parser.consume('{')) return false;
+    if (!parser.consume('}')) {
+        do {
+            std::string key;
+            JsonScalar value;
+            parser.skipSpace();
+            if (!parser.string(key) || !parser.consume(':') || !parser.scalar(value)) return false;
+            members[key] = std::move(value);
+        } while (parser.consume(','));
+        if (!parser.consume('}')) return false;
+    }
+    parser.skipSpace();
+    return parser.pos == text.size();
+}
@@ -0,0 +1,30 @@
+#ifndef JSON_UTIL_H
+#define JSON_UTIL_H
+
+#include <string>
+#include <unordered_map>
+
+/**
+ * 运行统计和常驻服务协议用到的最小 JSON 支持: 字符串转义，以及解析只含标量成员的单层对象
+ * (服务的请求都是这种形式)。
+ */
+
+// 转义并加上引号
+std::string jsonString(const std::string& text);
+
+// 单层对象中的一个成员值
+struct JsonScalar {
+    enum class Type { String, Number, Bool, Null };
+    Type type = Type::Null;
+    std::string text;      // 字符串的内容，或数字的原始文本
+    double number = 0;
+    bool boolean = false;
+};
+
+/**
+ * @brief 解析形如 {"键": 标量, ...} 的单层对象 (值为字符串、数字、true/false 或 null)。
+ * @return false 表示格式错误或含有嵌套的对象/数组。
+ */
+bool parseJsonObject(const std::string& text, std::unordered_map<std::string, JsonScalar>& members);
+
+#endif // JSON_UTIL_H
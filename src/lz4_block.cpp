@@ -0,0 +1,150 @@
+#include "lz4_block.h"
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;     // 块的最后 5 个字节必须是字面量
+const size_t MF_LIMIT = 12;         // 最后一个匹配必须在块结束前 12 字节之前开始
+const size_t MAX_DISTANCE = 65535;
+const int HASH_LOG = 16;
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// 写入长度的扩展字节 (每个 255 表示继续)
+uint8_t* writeLength(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// 写入一个序列: 字面量 + (可选) 匹配
+uint8_t* writeSequence(uint8_t* op, const uint8_t* literals, size_t literalLength,
+                       size_t offset, size_t matchLength) {
+    uint8_t* token = op++;
+    *token = (uint8_t)((literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15) op = writeLength(op, literalLength - 15);
+    std::memcpy(op, literals, literalLength);
+    op += literalLength;
+    if (matchLength == 0) return op;   // 最后一个序列只有字面量
+
+    *op++ = (uint8_t)(offset & 0xff);
+    *op++ = (uint8_t)(offset >> 8);
+    size_t code = matchLength - MIN_MATCH;
+    *token |= (uint8_t)(code >= 15 ? 15 : code);
+    if (code >= 15) op = writeLength(op, code - 15);
+    return op;
+}
+
+// 读取长度的扩展字节
+bool readLength(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+    uint8_t byte;
+    do {
+        if (ip >= end) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+size_t lz4CompressBound(size_t inputSize) {
+    return inputSize + inputSize / 255 + 16;
+}
+
+size_t lz4Compress(const void* source, size_t size, void* dest, size_t capacity) {
+    if (capacity < lz4CompressBound(size)) return 0;
+    const uint8_t* src = static_cast<const uint8_t*>(source);
+    uint8_t* op = static_cast<uint8_t*>(dest);
+
+    size_t anchor = 0;
+    if (size > MF_LIMIT) {
+        // 表中存放 "位置 + 1"，0 表示空槽
+        std::vector<uint32_t> table((size_t)1 << HASH_LOG, 0);
+        const size_t matchLimit = size - LAST_LITERALS;
+        const size_t lastMatchStart = size - MF_LIMIT;
+        size_t ip = 0;
+        unsigned misses = 0;
+
+        while (ip < lastMatchStart) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = hashSequence(sequence);
+            size_t candidate = table[h];
+            table[h] = (uint32_t)(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > MAX_DISTANCE || read32(src + candidate - 1) != sequence) {
+                // 连续未命中时逐渐加大步长，快速跳过不可压缩的数据
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            size_t ref = candidate - 1;
+
+            // 向前扩展匹配
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                --ip;
+                --ref;
+            }
+            size_t length = MIN_MATCH;
+            while (ip + length < matchLimit && src[ref + length] == src[ip + length]) ++length;
+
+            op = writeSequence(op, src + anchor, ip - anchor, ip - ref, length);
+            ip += length;
+            anchor = ip;
+            if (ip >= 2 && ip - 2 < lastMatchStart) table[hashSequence(read32(src + ip - 2))] = (uint32_t)(ip - 1);
+        }
+    }
+
+    op = writeSequence(op, src + anchor, size - anchor, 0, 0);
+    return (size_t)(op - static_cast<uint8_t*>(dest));
+}
+
+bool lz4Decompress(const void* source, size_t size, void* dest, size_t rawSize) {
+    const uint8_t* ip = static_cast<const uint8_t*>(source);
+    const uint8_t* end = ip + size;
+    uint8_t* out = static_cast<uint8_t*>(dest);
+    size_t pos = 0;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(ip, end, literalLength)) return false;
+        if (literalLength > (size_t)(end - ip) || literalLength > rawSize - pos) return false;
+        std::memcpy(out + pos, ip, literalLength);
+        ip += literalLength;
+        pos += literalLength;
+        if (ip == end) break;   // 最后一个序列
+
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > pos) return false;
+        size_t matchLength = (token & 15);
+        if (matchLength == 15 && !readLength(ip, end, matchLength)) return false;
+        matchLength += MIN_MATCH;
+        if (matchLength > rawSize - pos) return false;
+
+        // 匹配可能与输出重叠 (offset < matchLength)，逐字节复制
+        const uint8_t* match = out + pos - offset;
+        if (offset >= matchLength) {
+            std::memcpy(out + pos, match, matchLength);
+        } else {
+            for (size_t i = 0; i < matchLength; ++i) out[pos + i] = match[i];
+        }
+        pos += matchLength;
+    }
+    return pos == rawSize;
+}
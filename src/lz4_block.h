@@ -0,0 +1,30 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * 内置的 LZ4 块格式 (block format) 编解码器，不依赖 liblz4。
+ * 输出与官方 LZ4_compress_default() 的格式兼容，可互相解压。
+ */
+
+/**
+ * @brief 压缩输出缓冲区所需的最大长度。
+ */
+size_t lz4CompressBound(size_t inputSize);
+
+/**
+ * @brief 压缩一个块。
+ * @param capacity dst 的容量，至少为 lz4CompressBound(size)。
+ * @return 压缩后的长度; 容量不足时返回 0。
+ */
+size_t lz4Compress(const void* src, size_t size, void* dst, size_t capacity);
+
+/**
+ * @brief 解压一个块，解压结果必须恰好为 rawSize 字节。
+ * @return true 表示成功, false 表示数据损坏。
+ */
+bool lz4Decompress(const void* src, size_t size, void* dst, size_t rawSize);
+
+#endif // LZ4_BLOCK_H
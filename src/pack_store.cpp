@@ -0,0 +1,631 @@
+#include "pack_store.h"
+#include "lz4_block.h"
+#include "content_hash.h"
+#include "copy_engine.h"
+#include "thread_pool.h"
+#include "async_operation.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef SNAPSHOT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+const char* const PACK_INDEX_NAME = "pack.index";
+
+namespace {
+
+const char PACK_INDEX_MAGIC[8] = {'D', 'S', 'N', 'A', 'P', 'P', 'K', '\0'};
+const uint32_t PACK_INDEX_VERSION = 1;
+
+const size_t CHUNK_SIZE = 1 << 20;                // 数据块大小
+const uint64_t PACK_SIZE_LIMIT = 1ULL << 30;      // 单个容器文件的大小上限
+const uint64_t LARGE_FILE_SIZE = 8 << 20;         // 超过此大小的文件单独读取，按数据块并行压缩
+const size_t BATCH_BYTES = 64 << 20;              // 一批小文件的总大小上限
+const size_t BATCH_FILES = 4096;
+const size_t WINDOW_CHUNKS = 64;                  // 大文件每次并行压缩的数据块数
+const size_t WRITE_BUFFER_SIZE = 4 << 20;
+#ifdef SNAPSHOT_HAVE_ZSTD
+const int ZSTD_LEVEL = 3;
+#endif
+
+// 索引文件头 (64 字节)
+struct PackIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t packCount;
+    uint64_t fileCount;
+    uint64_t chunkCount;
+    uint32_t fileRecordSize;
+    uint32_t chunkRecordSize;
+    uint64_t bodyHash;       // 文件头之后全部内容的 XXH3-64
+    uint8_t reserved[16];
+};
+static_assert(sizeof(PackIndexHeader) == 64, "PackIndexHeader 必须为 64 字节");
+
+fs::path packFilePath(const fs::path& dir, unsigned index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "pack-%03u.dat", index);
+    return dir / name;
+}
+
+bool isZeroBlock(const uint8_t* data, size_t size) {
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word != 0) return false;
+    }
+    for (; i < size; ++i) {
+        if (data[i] != 0) return false;
+    }
+    return true;
+}
+
+// 编码一个数据块，返回实际使用的编码 (压缩后不变小时原样存放)
+PackCodec encodeChunk(const uint8_t* data, size_t size, PackCodec codec, std::vector<uint8_t>& out) {
+    out.clear();
+    if (isZeroBlock(data, size)) return PackCodec::Zero;
+    size_t stored = 0;
+    if (codec == PackCodec::Lz4) {
+        out.resize(lz4CompressBound(size));
+        stored = lz4Compress(data, size, out.data(), out.size());
+    }
+#ifdef SNAPSHOT_HAVE_ZSTD
+    else if (codec == PackCodec::Zstd) {
+        out.resize(ZSTD_compressBound(size));
+        size_t result = ZSTD_compress(out.data(), out.size(), data, size, ZSTD_LEVEL);
+        stored = ZSTD_isError(result) ? 0 : result;
+    }
+#endif
+    if (stored == 0 || stored >= size) {
+        out.assign(data, data + size);
+        return PackCodec::None;
+    }
+    out.resize(stored);
+    return codec;
+}
+
+bool decodeChunk(const uint8_t* src, size_t storedSize, PackCodec codec, uint8_t* dst, size_t rawSize) {
+    switch (codec) {
+        case PackCodec::None:
+            if (storedSize != rawSize) return false;
+            std::memcpy(dst, src, rawSize);
+            return true;
+        case PackCodec::Lz4:
+            return lz4Decompress(src, storedSize, dst, rawSize);
+#ifdef SNAPSHOT_HAVE_ZSTD
+        case PackCodec::Zstd:
+            return ZSTD_decompress(dst, rawSize, src, storedSize) == rawSize;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool writeFull(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+bool preadFull(int fd, uint8_t* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = pread(fd, data, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+bool pwriteFull(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = pwrite(fd, data, size, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return true;
+}
+
+// 读取整个文件 (以打开时的大小为准)
+bool readWholeFile(const fs::path& path, std::vector<uint8_t>& data) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    data.resize((size_t)st.st_size);
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = read(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) break;   // 文件在读取期间变短
+        done += (size_t)n;
+    }
+    ::close(fd);
+    data.resize(done);
+    return true;
+}
+
+} // namespace
+
+// 一个已编码、等待追加的数据块
+struct PackWriter::Chunk {
+    std::vector<uint8_t> data;
+    uint32_t rawSize = 0;
+    PackCodec codec = PackCodec::None;
+};
+
+bool packCodecAvailable(PackCodec codec) {
+    switch (codec) {
+        case PackCodec::None:
+        case PackCodec::Lz4:
+            return true;
+        case PackCodec::Zstd:
+#ifdef SNAPSHOT_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* packCodecName(PackCodec codec) {
+    switch (codec) {
+        case PackCodec::None: return "none";
+        case PackCodec::Lz4: return "lz4";
+        case PackCodec::Zstd: return "zstd";
+        case PackCodec::Zero: return "zero";
+    }
+    return "unknown";
+}
+
+bool isPackedSnapshot(const fs::path& snapshotDir) {
+    return fs::exists(snapshotDir / PACK_INDEX_NAME);
+}
+
+// ----- PackWriter -----
+
+PackWriter::~PackWriter() {
+    if (packFd_ >= 0) ::close(packFd_);
+}
+
+bool PackWriter::open(const fs::path& dir, PackCodec codec) {
+    dir_ = dir;
+    codec_ = (codec == PackCodec::Zero || !packCodecAvailable(codec)) ? PackCodec::Lz4 : codec;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, 5, "pack-") == 0 || name.compare(0, 10, PACK_INDEX_NAME) == 0) fs::remove(entry.path(), ec);
+    }
+    packIndex_ = 0;
+    packOffset_ = 0;
+    packFd_ = ::open(packFilePath(dir_, 0).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (packFd_ < 0) return false;
+    stats_.packFiles = 1;
+    buffer_.reserve(WRITE_BUFFER_SIZE);
+    return true;
+}
+
+bool PackWriter::flushBuffer() {
+    if (!failed_ && !buffer_.empty() && !writeFull(packFd_, buffer_.data(), buffer_.size())) {
+        std::cerr << "  -> 警告: 写入容器文件失败: " << strerror(errno) << std::endl;
+        failed_ = true;
+    }
+    buffer_.clear();
+    return !failed_;
+}
+
+bool PackWriter::openNextPack() {
+    flushBuffer();
+    if (::close(packFd_) != 0) failed_ = true;
+    packFd_ = ::open(packFilePath(dir_, ++packIndex_).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (packFd_ < 0) failed_ = true;
+    packOffset_ = 0;
+    stats_.packFiles++;
+    return !failed_;
+}
+
+void PackWriter::appendChunk(const Chunk& chunk) {
+    PackChunkRecord record;
+    std::memset(&record, 0, sizeof(record));
+    record.rawSize = chunk.rawSize;
+    record.codec = (uint8_t)chunk.codec;
+    if (chunk.codec != PackCodec::Zero) {
+        if (packOffset_ > 0 && packOffset_ + chunk.data.size() > PACK_SIZE_LIMIT) openNextPack();
+        record.offset = packOffset_;
+        record.storedSize = (uint32_t)chunk.data.size();
+        buffer_.insert(buffer_.end(), chunk.data.begin(), chunk.data.end());
+        packOffset_ += chunk.data.size();
+        stats_.bytesStored += chunk.data.size();
+        if (buffer_.size() >= WRITE_BUFFER_SIZE) flushBuffer();
+    }
+    record.pack = packIndex_;
+    chunkRecords_.push_back(record);
+    stats_.chunks++;
+}
+
+void PackWriter::addFiles(const std::vector<TreeEntry*>& files, std::vector<char>& stored) {
+    stored.assign(files.size(), 0);
+    std::vector<size_t> batch;
+    size_t batchBytes = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        // 取消后不再写入 (调用方会放弃整个容器)
+        if (operationCancelled()) return;
+        if (files[i]->size > LARGE_FILE_SIZE) {
+            stored[i] = addLargeFile(*files[i]) ? 1 : 0;
+            progressAddDone(1, files[i]->size);
+            continue;
+        }
+        batch.push_back(i);
+        batchBytes += files[i]->size;
+        if (batchBytes >= BATCH_BYTES || batch.size() >= BATCH_FILES) {
+            addSmallBatch(files, batch, stored);
+            progressAddDone(batch.size(), batchBytes);
+            batch.clear();
+            batchBytes = 0;
+        }
+    }
+    if (!batch.empty()) {
+        addSmallBatch(files, batch, stored);
+        progressAddDone(batch.size(), batchBytes);
+    }
+}
+
+bool PackWriter::addSmallBatch(const std::vector<TreeEntry*>& files, const std::vector<size_t>& batch,
+                               std::vector<char>& stored) {
+    // 读取、哈希和压缩并行完成，追加到容器则按原顺序串行进行
+    struct Pending {
+        bool ok = false;
+        uint64_t hash = 0;
+        uint64_t size = 0;
+        std::vector<Chunk> chunks;
+    };
+    std::vector<Pending> pending(batch.size());
+    parallelFor(batch.size(), [&](size_t k) {
+        std::vector<uint8_t> data;
+        if (!readWholeFile(files[batch[k]]->sourcePath, data)) return;
+        Pending& p = pending[k];
+        p.size = data.size();
+        p.hash = xxh3_64(data.data(), data.size());
+        for (size_t offset = 0; offset < data.size(); offset += CHUNK_SIZE) {
+            Chunk chunk;
+            chunk.rawSize = (uint32_t)std::min(CHUNK_SIZE, data.size() - offset);
+            chunk.codec = encodeChunk(data.data() + offset, chunk.rawSize, codec_, chunk.data);
+            p.chunks.push_back(std::move(chunk));
+        }
+        p.ok = true;
+    });
+
+    for (size_t k = 0; k < batch.size(); ++k) {
+        Pending& p = pending[k];
+        TreeEntry& entry = *files[batch[k]];
+        if (!p.ok) {
+            std::cerr << "  -> 警告: 无法读取文件 " << entry.sourcePath.string() << std::endl;
+            continue;
+        }
+        entry.size = p.size;
+        entry.contentHash = p.hash;
+        entry.hasContentHash = true;
+        stored[batch[k]] = 1;
+
+        auto key = std::make_pair(p.hash, p.size);
+        if (files_.count(key)) {
+            stats_.filesDeduplicated++;
+            stats_.bytesDeduplicated += p.size;
+            continue;
+        }
+        uint64_t first = chunkRecords_.size();
+        for (const auto& chunk : p.chunks) appendChunk(chunk);
+        files_[key] = std::make_pair(first, (uint64_t)p.chunks.size());
+        stats_.filesPacked++;
+        stats_.bytesPacked += p.size;
+    }
+    return !failed_;
+}
+
+bool PackWriter::addLargeFile(TreeEntry& entry) {
+    // 源文件是实时文件，不做内存映射 (被截短时会触发 SIGBUS)，全部以 pread 读取
+    int fd = ::open(entry.sourcePath.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) ::close(fd);
+        std::cerr << "  -> 警告: 无法读取文件 " << entry.sourcePath.string() << std::endl;
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    size_t size = (size_t)st.st_size;
+    size_t count = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+    // 第一遍: 顺序计算哈希，用于去重
+    Xxh3Stream first;
+    bool ok = true;
+    {
+        std::vector<uint8_t> buffer(std::min(CHUNK_SIZE, size));
+        for (size_t offset = 0; ok && offset < size; offset += CHUNK_SIZE) {
+            size_t length = std::min(CHUNK_SIZE, size - offset);
+            ok = preadFull(fd, buffer.data(), length, offset);
+            if (ok) first.update(buffer.data(), length);
+        }
+    }
+    if (!ok) {
+        ::close(fd);
+        std::cerr << "  -> 警告: 文件在读取期间变短 " << entry.sourcePath.string() << std::endl;
+        return false;
+    }
+    uint64_t hash = first.digest();
+    auto key = std::make_pair(hash, (uint64_t)size);
+    if (files_.count(key)) {
+        ::close(fd);
+        entry.size = size;
+        entry.contentHash = hash;
+        entry.hasContentHash = true;
+        stats_.filesDeduplicated++;
+        stats_.bytesDeduplicated += size;
+        return true;
+    }
+
+    // 第二遍: 按窗口并行读取和压缩数据块 (每个任务使用自己的缓冲区)，窗口内按顺序追加。
+    // 读到的内容同时重新计算哈希，与第一遍不一致说明文件被修改，放弃该条目
+    // (已追加的数据块不被任何文件记录引用，只占用空间)
+    uint64_t firstChunk = chunkRecords_.size();
+    Xxh3Stream second;
+    for (size_t window = 0; ok && window < count; window += WINDOW_CHUNKS) {
+        size_t n = std::min(WINDOW_CHUNKS, count - window);
+        std::vector<Chunk> chunks(n);
+        std::vector<std::vector<uint8_t>> raw(n);
+        std::vector<char> read(n, 0);
+        parallelFor(n, [&](size_t j) {
+            size_t offset = (window + j) * CHUNK_SIZE;
+            raw[j].resize(std::min(CHUNK_SIZE, size - offset));
+            if (!preadFull(fd, raw[j].data(), raw[j].size(), offset)) return;
+            read[j] = 1;
+            chunks[j].rawSize = (uint32_t)raw[j].size();
+            chunks[j].codec = encodeChunk(raw[j].data(), raw[j].size(), codec_, chunks[j].data);
+        });
+        for (size_t j = 0; ok && j < n; ++j) {
+            ok = read[j] != 0;
+            if (ok) second.update(raw[j].data(), raw[j].size());
+        }
+        if (!ok) break;
+        for (const auto& chunk : chunks) appendChunk(chunk);
+    }
+    ::close(fd);
+    if (!ok || second.digest() != hash) {
+        std::cerr << "  -> 警告: 文件在读取期间被修改 " << entry.sourcePath.string() << std::endl;
+        return false;
+    }
+
+    entry.size = size;
+    entry.contentHash = hash;
+    entry.hasContentHash = true;
+    files_[key] = std::make_pair(firstChunk, (uint64_t)count);
+    stats_.filesPacked++;
+    stats_.bytesPacked += size;
+    return true;
+}
+
+bool PackWriter::finish() {
+    flushBuffer();
+    if (packFd_ >= 0 && ::close(packFd_) != 0) failed_ = true;
+    packFd_ = -1;
+    if (failed_) return false;
+
+    // 文件记录按 (哈希, 大小) 有序 (来自 std::map)，之后紧跟数据块记录
+    std::string body;
+    body.reserve(files_.size() * sizeof(PackFileRecord) + chunkRecords_.size() * sizeof(PackChunkRecord));
+    for (const auto& item : files_) {
+        PackFileRecord record = {item.first.first, item.first.second, item.second.first, item.second.second};
+        body.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    body.append(reinterpret_cast<const char*>(chunkRecords_.data()), chunkRecords_.size() * sizeof(PackChunkRecord));
+
+    PackIndexHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, PACK_INDEX_MAGIC, sizeof(header.magic));
+    header.version = PACK_INDEX_VERSION;
+    header.packCount = (uint32_t)packIndex_ + 1;
+    header.fileCount = files_.size();
+    header.chunkCount = chunkRecords_.size();
+    header.fileRecordSize = sizeof(PackFileRecord);
+    header.chunkRecordSize = sizeof(PackChunkRecord);
+    header.bodyHash = xxh3_64(body.data(), body.size());
+
+    body.insert(0, reinterpret_cast<const char*>(&header), sizeof(header));
+    return writeFileAtomically(dir_ / PACK_INDEX_NAME, body);
+}
+
+// ----- PackReader -----
+
+PackReader::~PackReader() {
+    close();
+}
+
+void PackReader::close() {
+    for (int fd : packFds_) ::close(fd);
+    packFds_.clear();
+    fileRecords_.clear();
+    chunkRecords_.clear();
+    opened_ = false;
+}
+
+bool PackReader::open(const fs::path& dir) {
+    close();
+    fs::path path = dir / PACK_INDEX_NAME;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // 校验文件头、记录数量、内容哈希以及每条记录的范围，任何不一致都视为损坏
+    PackIndexHeader header;
+    bool valid = data.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, data.data(), sizeof(header));
+        const char* body = data.data() + sizeof(header);
+        size_t bodySize = data.size() - sizeof(header);
+        valid = std::memcmp(header.magic, PACK_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == PACK_INDEX_VERSION &&
+                header.fileRecordSize == sizeof(PackFileRecord) &&
+                header.chunkRecordSize == sizeof(PackChunkRecord) &&
+                header.fileCount <= bodySize / sizeof(PackFileRecord) &&
+                header.chunkCount <= bodySize / sizeof(PackChunkRecord) &&
+                header.fileCount * sizeof(PackFileRecord) + header.chunkCount * sizeof(PackChunkRecord) == bodySize &&
+                xxh3_64(body, bodySize) == header.bodyHash;
+        if (valid) {
+            fileRecords_.resize((size_t)header.fileCount);
+            chunkRecords_.resize((size_t)header.chunkCount);
+            std::memcpy(fileRecords_.data(), body, fileRecords_.size() * sizeof(PackFileRecord));
+            std::memcpy(chunkRecords_.data(), body + fileRecords_.size() * sizeof(PackFileRecord),
+                        chunkRecords_.size() * sizeof(PackChunkRecord));
+        }
+    }
+    for (size_t i = 0; valid && i < fileRecords_.size(); ++i) {
+        const PackFileRecord& f = fileRecords_[i];
+        valid = f.firstChunk <= chunkRecords_.size() && f.chunkCount <= chunkRecords_.size() - f.firstChunk;
+    }
+    for (size_t i = 0; valid && i < chunkRecords_.size(); ++i) {
+        const PackChunkRecord& c = chunkRecords_[i];
+        valid = c.pack < header.packCount && c.codec <= (uint8_t)PackCodec::Zero && c.rawSize <= CHUNK_SIZE;
+    }
+    if (!valid) {
+        close();
+        std::cerr << "  -> 错误: 打包索引已损坏或版本不受支持 " << path.string() << std::endl;
+        return false;
+    }
+
+    for (unsigned i = 0; i < header.packCount; ++i) {
+        int fd = ::open(packFilePath(dir, i).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << "  -> 错误: 无法打开容器文件 " << packFilePath(dir, i).string() << std::endl;
+            close();
+            return false;
+        }
+        packFds_.push_back(fd);
+    }
+    opened_ = true;
+    return true;
+}
+
+const PackFileRecord* PackReader::findFile(uint64_t hash, uint64_t size) const {
+    auto it = std::lower_bound(fileRecords_.begin(), fileRecords_.end(), std::make_pair(hash, size),
+                               [](const PackFileRecord& r, const std::pair<uint64_t, uint64_t>& key) {
+                                   return std::make_pair(r.hash, r.size) < key;
+                               });
+    if (it == fileRecords_.end() || it->hash != hash || it->size != size) return nullptr;
+    return &*it;
+}
+
+bool PackReader::contains(uint64_t hash, uint64_t size) const {
+    return findFile(hash, size) != nullptr;
+}
+
+bool PackReader::decodeFile(uint64_t hash, uint64_t size, const ChunkVisitor& visit, std::string& error) const {
+    const PackFileRecord* it = findFile(hash, size);
+    if (!it) {
+        error = "content not found in pack";
+        return false;
+    }
+
+    // 每个线程复用自己的缓冲区
+    thread_local std::vector<uint8_t> storedBuffer;
+    thread_local std::vector<uint8_t> rawBuffer;
+    uint64_t position = 0;
+    for (uint64_t i = it->firstChunk; i < it->firstChunk + it->chunkCount; ++i) {
+        const PackChunkRecord& chunk = chunkRecords_[i];
+        PackCodec codec = (PackCodec)chunk.codec;
+        if (position + chunk.rawSize > size) break;
+        const uint8_t* raw = nullptr;
+        if (codec != PackCodec::Zero) {
+            storedBuffer.resize(chunk.storedSize);
+            if (!preadFull(packFds_[chunk.pack], storedBuffer.data(), chunk.storedSize, chunk.offset)) {
+                error = "pack read failed";
+                return false;
+            }
+            raw = storedBuffer.data();
+            if (codec != PackCodec::None) {
+                rawBuffer.resize(chunk.rawSize);
+                if (!decodeChunk(storedBuffer.data(), chunk.storedSize, codec, rawBuffer.data(), chunk.rawSize)) {
+                    error = std::string("corrupt ") + packCodecName(codec) + " chunk";
+                    return false;
+                }
+                raw = rawBuffer.data();
+            } else if (chunk.storedSize != chunk.rawSize) {
+                error = "corrupt chunk";
+                return false;
+            }
+        }
+        if (!visit(raw, chunk.rawSize, position, error)) return false;
+        position += chunk.rawSize;
+    }
+    if (position != size) {
+        error = "chunk sizes do not match file size";
+        return false;
+    }
+    return true;
+}
+
+bool PackReader::extract(uint64_t hash, uint64_t size, int outFd, std::string& error) const {
+    bool decoded = decodeFile(hash, size, [outFd](const uint8_t* raw, uint32_t length, uint64_t position,
+                                                  std::string& error) {
+        if (!raw) return true;   // 全零块: 跳过，保留为空洞
+        if (!pwriteFull(outFd, raw, length, position)) {
+            error = std::string("write: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }, error);
+    if (!decoded) return false;
+    // 末尾的全零块只需扩展文件长度，保留为空洞
+    if (ftruncate(outFd, (off_t)size) != 0) {
+        error = std::string("ftruncate: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool PackReader::hashContent(uint64_t hash, uint64_t size, uint64_t& out, std::string& error) const {
+    Xxh3Stream stream;
+    std::vector<uint8_t> zeros;
+    bool decoded = decodeFile(hash, size, [&](const uint8_t* raw, uint32_t length, uint64_t, std::string&) {
+        if (!raw) {
+            zeros.resize(length);
+            raw = zeros.data();
+        }
+        stream.update(raw, length);
+        return true;
+    }, error);
+    if (!decoded) return false;
+    out = stream.digest();
+    return true;
+}
@@ -0,0 +1,184 @@
+#ifndef PACK_STORE_H
+#define PACK_STORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <functional>
+#include <filesystem>
+#include "tree_sync.h"
+
+/**
+ * 打包快照容器。打包模式下目标的全部文件内容顺序写入快照目录中的少数几个容器文件，
+ * 不再为每个文件在 blob 存储中创建一个对象:
+ *
+ *   pack-000.dat, pack-001.dat ...  数据块依次追加，单个容器超过 1 GiB 时换下一个
+ *   pack.index                      [文件头 64 字节][文件记录 32 字节 x N][数据块记录 24 字节 x M]
+ *
+ * 文件按 1 MiB 切成数据块，每块独立压缩 (LZ4，编译时开启可用 zstd)，压缩后不变小的块原样存放，
+ * 全零的块不占空间 (恢复时还原为空洞)。文件记录按 (哈希, 大小) 排序，可单独定位并解出任意一个文件，
+ * 相同内容的文件只存一份。文件头中的 bodyHash 是记录部分的 XXH3-64，打开时校验。
+ * 删除打包快照只需删除这几个文件。
+ */
+
+// 数据块的编码方式
+enum class PackCodec : uint8_t {
+    None = 0,     // 原样存放
+    Lz4 = 1,
+    Zstd = 2,
+    Zero = 3      // 全零块，不占容器空间
+};
+
+// 打包索引文件名
+extern const char* const PACK_INDEX_NAME;
+
+// 一次打包的统计信息
+struct PackStats {
+    uint64_t filesPacked = 0;         // 写入容器的文件数
+    uint64_t bytesPacked = 0;         // 这些文件的原始字节数
+    uint64_t filesDeduplicated = 0;   // 与已写入文件内容相同、只记录引用的文件数
+    uint64_t bytesDeduplicated = 0;
+    uint64_t bytesStored = 0;         // 实际写入容器的字节数 (压缩后)
+    uint64_t chunks = 0;
+    uint32_t packFiles = 0;
+};
+
+/**
+ * @brief 编译时是否支持指定的编码 (None / Lz4 总是可用)。
+ */
+bool packCodecAvailable(PackCodec codec);
+
+// 返回编码的名称
+const char* packCodecName(PackCodec codec);
+
+/**
+ * @brief 快照目录是否为打包格式 (存在 pack.index)。
+ */
+bool isPackedSnapshot(const std::filesystem::path& snapshotDir);
+
+// 索引中的一条文件记录 (32 字节)
+struct PackFileRecord {
+    uint64_t hash;
+    uint64_t size;
+    uint64_t firstChunk;     // 在数据块记录表中的下标
+    uint64_t chunkCount;
+};
+static_assert(sizeof(PackFileRecord) == 32, "PackFileRecord 必须为 32 字节");
+
+// 索引中的一条数据块记录 (24 字节)
+struct PackChunkRecord {
+    uint64_t offset;         // 在容器文件中的偏移
+    uint32_t storedSize;     // 容器中占用的字节数 (全零块为 0)
+    uint32_t rawSize;        // 解码后的字节数
+    uint16_t pack;           // 容器文件编号
+    uint8_t codec;           // PackCodec
+    uint8_t reserved[5];
+};
+static_assert(sizeof(PackChunkRecord) == 24, "PackChunkRecord 必须为 24 字节");
+
+/**
+ * 容器写入器。小文件成批并行读取、哈希和压缩后按顺序追加; 大文件内存映射后按窗口并行压缩数据块。
+ * addFiles 可多次调用 (每个分区一次)，最后由 finish() 写出索引。
+ */
+class PackWriter {
+public:
+    PackWriter() = default;
+    ~PackWriter();
+    PackWriter(const PackWriter&) = delete;
+    PackWriter& operator=(const PackWriter&) = delete;
+
+    /**
+     * @brief 在 dir 中开始写入新的容器 (dir 中已有的容器文件会被覆盖)。
+     * @param codec 数据块的编码方式，编译时不支持的编码退回 LZ4。
+     * @return true 表示成功。
+     */
+    bool open(const std::filesystem::path& dir, PackCodec codec);
+
+    /**
+     * @brief 将一组普通文件写入容器，并填好各条目的 contentHash 和 size (以实际读到的内容为准)。
+     * @param files 待写入的条目 (sourcePath 指向实时文件)。
+     * @param stored 输出: 与 files 一一对应，1 表示已写入, 0 表示文件无法读取。
+     */
+    void addFiles(const std::vector<TreeEntry*>& files, std::vector<char>& stored);
+
+    /**
+     * @brief 写出剩余数据和索引 (索引先写临时文件再重命名)。
+     * @return true 表示成功; 任何一次容器写入失败都会使其返回 false。
+     */
+    bool finish();
+
+    const PackStats& stats() const { return stats_; }
+    PackCodec codec() const { return codec_; }
+
+private:
+    struct Chunk;
+
+    bool addSmallBatch(const std::vector<TreeEntry*>& files, const std::vector<size_t>& batch,
+                       std::vector<char>& stored);
+    bool addLargeFile(TreeEntry& entry);
+    void appendChunk(const Chunk& chunk);
+    bool flushBuffer();
+    bool openNextPack();
+
+    std::filesystem::path dir_;
+    PackCodec codec_ = PackCodec::Lz4;
+    int packFd_ = -1;
+    uint16_t packIndex_ = 0;
+    uint64_t packOffset_ = 0;         // 当前容器的逻辑长度 (包括缓冲区中尚未写出的部分)
+    std::vector<uint8_t> buffer_;     // 合并小块写入
+    bool failed_ = false;
+    std::vector<PackChunkRecord> chunkRecords_;
+    std::map<std::pair<uint64_t, uint64_t>, std::pair<uint64_t, uint64_t>> files_;   // (哈希, 大小) -> (首块, 块数)
+    PackStats stats_;
+};
+
+/**
+ * 容器读取器。打开后可在多个线程上并行解出文件。
+ */
+class PackReader {
+public:
+    PackReader() = default;
+    ~PackReader();
+    PackReader(const PackReader&) = delete;
+    PackReader& operator=(const PackReader&) = delete;
+
+    /**
+     * @brief 读取并校验 dir 中的 pack.index，打开全部容器文件。
+     * @return true 表示成功, false 表示索引缺失、损坏或容器文件无法打开。
+     */
+    bool open(const std::filesystem::path& dir);
+
+    bool isOpen() const { return opened_; }
+
+    // 容器中是否有哈希和大小对应的文件
+    bool contains(uint64_t hash, uint64_t size) const;
+
+    /**
+     * @brief 将哈希和大小对应的文件内容写入已打开的空文件 outFd (全零块保留为空洞)。
+     * @return true 表示成功; 失败时 error 中给出原因。
+     */
+    bool extract(uint64_t hash, uint64_t size, int outFd, std::string& error) const;
+
+    /**
+     * @brief 解码哈希和大小对应的文件内容并重新计算其 XXH3-64 (不写出任何文件)，用于校验快照。
+     * @return true 表示全部数据块都能读取和解码，out 为解出内容的哈希; 失败时 error 中给出原因。
+     */
+    bool hashContent(uint64_t hash, uint64_t size, uint64_t& out, std::string& error) const;
+
+private:
+    // 依次处理解码后的数据块 (raw 为 nullptr 表示全零块)，返回 false 时停止
+    using ChunkVisitor = std::function<bool(const uint8_t* raw, uint32_t length, uint64_t position,
+                                            std::string& error)>;
+    const PackFileRecord* findFile(uint64_t hash, uint64_t size) const;
+    bool decodeFile(uint64_t hash, uint64_t size, const ChunkVisitor& visit, std::string& error) const;
+    void close();
+
+    bool opened_ = false;
+    std::vector<PackFileRecord> fileRecords_;     // 按 (哈希, 大小) 排序
+    std::vector<PackChunkRecord> chunkRecords_;
+    std::vector<int> packFds_;
+};
+
+#endif // PACK_STORE_H
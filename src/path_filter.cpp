@@ -0,0 +1,170 @@
+#include "path_filter.h"
+#include <cctype>
+#include <fnmatch.h>
+
+namespace {
+
+bool hasWildcard(const std::string& text) {
+    return text.find_first_of("*?[\\") != std::string::npos;
+}
+
+std::vector<std::string> splitPath(const std::string& path) {
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= path.size()) {
+        size_t slash = path.find('/', begin);
+        if (slash == std::string::npos) slash = path.size();
+        if (slash > begin) parts.push_back(path.substr(begin, slash - begin));
+        begin = slash + 1;
+    }
+    return parts;
+}
+
+// 单个路径分量与模式分量是否匹配
+bool segmentMatches(const std::string& pattern, bool literal, const std::string& name) {
+    return literal ? pattern == name : fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+}
+
+} // namespace
+
+bool PathFilter::addRule(const std::string& rawPattern, bool include) {
+    Rule rule;
+    rule.include = include;
+    std::string pattern = rawPattern;
+    while (!pattern.empty() && pattern.back() == '/') {
+        rule.directoryOnly = true;
+        pattern.pop_back();
+    }
+    if (!pattern.empty() && pattern[0] == '/') {
+        rule.anchored = true;
+        pattern.erase(0, pattern.find_first_not_of('/'));
+    }
+    // "**/名称" 与不含 '/' 的 "名称" 等价，按条目名匹配才能进入哈希表
+    std::string rest = pattern;
+    while (rest.compare(0, 3, "**/") == 0) rest.erase(0, 3);
+    if (rest.find('/') == std::string::npos && rest != "**") {
+        if (rest.size() != pattern.size()) rule.anchored = false;
+        pattern = rest;
+    } else {
+        rule.anchored = true;
+    }
+
+    for (auto& part : splitPath(pattern)) {
+        if (part == "." || part == "..") return false;
+        Segment segment;
+        segment.kind = part == "**" ? Segment::AnyDepth : hasWildcard(part) ? Segment::Glob : Segment::Literal;
+        segment.text = std::move(part);
+        rule.segments.push_back(std::move(segment));
+    }
+    if (rule.segments.empty()) return false;
+
+    int index = (int)rules_.size();
+    const Segment& first = rule.segments.front();
+    if (!rule.anchored && first.kind == Segment::Literal) {
+        byName_[first.text].push_back(index);
+    } else if (!rule.anchored && first.kind == Segment::Glob && first.text.size() > 1 && first.text[0] == '*' &&
+               !hasWildcard(first.text.substr(1))) {
+        std::string suffix = first.text.substr(1);
+        if (bySuffix_.find(suffix) == bySuffix_.end()) {
+            bool known = false;
+            for (size_t length : suffixLengths_) known = known || length == suffix.size();
+            if (!known) suffixLengths_.push_back(suffix.size());
+        }
+        bySuffix_[suffix].push_back(index);
+    } else {
+        generic_.push_back(index);
+    }
+    rules_.push_back(std::move(rule));
+    return true;
+}
+
+bool PathFilter::matchSegments(const std::vector<Segment>& segments, size_t si,
+                               const std::vector<std::string>& parts, size_t pi) {
+    if (si == segments.size()) return pi == parts.size();
+    const Segment& segment = segments[si];
+    if (segment.kind == Segment::AnyDepth) {
+        // 结尾的 "**" 只匹配其下的条目，不匹配目录本身
+        if (si + 1 == segments.size()) return pi < parts.size();
+        for (size_t k = pi; k <= parts.size(); ++k) {
+            if (matchSegments(segments, si + 1, parts, k)) return true;
+        }
+        return false;
+    }
+    return pi < parts.size() && segmentMatches(segment.text, segment.kind == Segment::Literal, parts[pi]) &&
+           matchSegments(segments, si + 1, parts, pi + 1);
+}
+
+bool PathFilter::matches(const Rule& rule, const std::string& relPath, size_t nameBegin) const {
+    if (!rule.anchored) {
+        const Segment& segment = rule.segments.front();
+        return segment.kind == Segment::AnyDepth ||
+               segmentMatches(segment.text, segment.kind == Segment::Literal, relPath.substr(nameBegin));
+    }
+    return matchSegments(rule.segments, 0, splitPath(relPath), 0);
+}
+
+void PathFilter::lookup(const std::unordered_map<std::string, std::vector<int>>& index, const std::string& key,
+                        bool directory, int& best) const {
+    auto it = index.find(key);
+    if (it == index.end()) return;
+    for (auto rule = it->second.rbegin(); rule != it->second.rend() && *rule > best; ++rule) {
+        if (rules_[*rule].directoryOnly && !directory) continue;
+        best = *rule;
+        return;
+    }
+}
+
+bool PathFilter::excludes(const std::string& relPath, bool directory, uint64_t size) const {
+    if (!directory && maxFileSize_ != 0 && size > maxFileSize_) return true;
+    if (rules_.empty()) return false;
+
+    size_t slash = relPath.rfind('/');
+    size_t nameBegin = slash == std::string::npos ? 0 : slash + 1;
+    std::string name = relPath.substr(nameBegin);
+    // 最后一条匹配的规则生效: 先查哈希表，其余规则只需检查序号更大的
+    int best = -1;
+    lookup(byName_, name, directory, best);
+    for (size_t length : suffixLengths_) {
+        if (name.size() >= length) lookup(bySuffix_, name.substr(name.size() - length), directory, best);
+    }
+    for (auto it = generic_.rbegin(); it != generic_.rend() && *it > best; ++it) {
+        const Rule& rule = rules_[*it];
+        if (rule.directoryOnly && !directory) continue;
+        if (matches(rule, relPath, nameBegin)) {
+            best = *it;
+            break;
+        }
+    }
+    return best >= 0 && !rules_[best].include;
+}
+
+bool PathFilter::excludesPath(const std::string& relPath, bool directory, uint64_t size) const {
+    if (rules_.empty()) return excludes(relPath, directory, size);
+    for (size_t slash = relPath.find('/'); slash != std::string::npos; slash = relPath.find('/', slash + 1)) {
+        if (excludes(relPath.substr(0, slash), true, 0)) return true;
+    }
+    return excludes(relPath, directory, size);
+}
+
+bool parseByteSize(const std::string& text, uint64_t& bytes) {
+    size_t i = 0;
+    uint64_t value = 0;
+    while (i < text.size() && std::isdigit((unsigned char)text[i])) {
+        uint64_t next = value * 10 + (uint64_t)(text[i] - '0');
+        if (next / 10 != value) return false;
+        value = next;
+        ++i;
+    }
+    if (i == 0) return false;
+    std::string unit;
+    for (; i < text.size(); ++i) unit += (char)std::toupper((unsigned char)text[i]);
+    int shift = 0;
+    if (!unit.empty() && unit.find_first_of("KMGT") == 0) {
+        shift = unit[0] == 'K' ? 10 : unit[0] == 'M' ? 20 : unit[0] == 'G' ? 30 : 40;
+        unit.erase(0, 1);
+    }
+    if (!unit.empty() && unit != "B" && !(shift != 0 && unit == "IB")) return false;
+    if (shift != 0 && value > (UINT64_MAX >> shift)) return false;
+    bytes = value << shift;
+    return true;
+}
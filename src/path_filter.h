@@ -0,0 +1,80 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * 目录树的包含/排除规则，语义与 .gitignore 相同:
+ *   - 规则按添加顺序匹配，最后一条匹配的规则生效 (include 可以重新包含被前面规则排除的条目);
+ *   - 不含 '/' 的模式匹配任意层级的条目名 (如 "node_modules"、"*.tmp");
+ *     含 '/' 或以 '/' 开头的模式相对于扫描根目录匹配整条路径 (如 "/build"、"docs/drafts");
+ *   - '*'、'?'、'[...]' 不跨越 '/'，"**" 匹配任意层级 (包括零层); 以 '/' 结尾的模式只匹配目录;
+ *   - 被排除的目录整棵子树都不再枚举，其下的条目无法被重新包含。
+ * 另外可以设置普通文件的大小上限，超过上限的文件总被排除。
+ *
+ * 规则在添加时编译: 名称字面量和 "*.扩展名" 形式的模式放入哈希表，一次查找即可完成匹配，
+ * 只有其余的通配模式需要逐条比较。
+ */
+class PathFilter {
+public:
+    /**
+     * @brief 追加一条规则。
+     * @param include true 为包含规则，false 为排除规则。
+     * @return false 表示模式为空或不合法 (规则未添加)。
+     */
+    bool addRule(const std::string& pattern, bool include);
+
+    // 普通文件的大小上限 (字节)，0 表示不限
+    void setMaxFileSize(uint64_t bytes) { maxFileSize_ = bytes; }
+    uint64_t maxFileSize() const { return maxFileSize_; }
+
+    // 是否没有任何规则和大小上限
+    bool empty() const { return rules_.empty() && maxFileSize_ == 0; }
+
+    /**
+     * @brief 单个条目是否被排除 (不检查父目录，用于枚举时剪枝: 调用方只对未被排除的目录继续向下枚举)。
+     * @param relPath 相对于扫描根目录、以 '/' 分隔的路径。
+     * @param size 普通文件的大小 (目录和其他类型的条目传 0)。
+     */
+    bool excludes(const std::string& relPath, bool directory, uint64_t size) const;
+
+    // 与 excludes 相同，但同时检查 relPath 的各级父目录 (用于不是逐层枚举得到的路径)
+    bool excludesPath(const std::string& relPath, bool directory, uint64_t size) const;
+
+private:
+    struct Segment {
+        enum Kind : uint8_t { Literal, Glob, AnyDepth } kind;
+        std::string text;
+    };
+    struct Rule {
+        bool include = false;
+        bool directoryOnly = false;
+        bool anchored = false;              // 匹配整条路径，否则只匹配条目名
+        std::vector<Segment> segments;
+    };
+
+    // 从第 si 个模式分量和第 pi 个路径分量开始匹配，"**" 可以吞掉任意个路径分量
+    static bool matchSegments(const std::vector<Segment>& segments, size_t si,
+                              const std::vector<std::string>& parts, size_t pi);
+    bool matches(const Rule& rule, const std::string& relPath, size_t nameBegin) const;
+    void lookup(const std::unordered_map<std::string, std::vector<int>>& index, const std::string& key,
+                bool directory, int& best) const;
+
+    std::vector<Rule> rules_;
+    std::unordered_map<std::string, std::vector<int>> byName_;     // 条目名字面量 -> 规则序号 (升序)
+    std::unordered_map<std::string, std::vector<int>> bySuffix_;   // "*后缀" 的后缀 -> 规则序号 (升序)
+    std::vector<size_t> suffixLengths_;                             // bySuffix_ 中出现过的后缀长度
+    std::vector<int> generic_;                                      // 其余规则的序号 (升序)
+    uint64_t maxFileSize_ = 0;
+};
+
+/**
+ * @brief 解析带单位的大小 ("512"、"64K"、"10M"、"2G"，单位不区分大小写，可带 "B"/"iB" 后缀)。
+ * @return false 表示格式不合法。
+ */
+bool parseByteSize(const std::string& text, uint64_t& bytes);
+
+#endif // PATH_FILTER_H
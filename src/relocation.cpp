@@ -0,0 +1,163 @@
+#include "relocation.h"
+#include "content_hash.h"
+#include "thread_pool.h"
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 目标中多出来、可以移回别处的普通文件
+struct Candidate {
+    size_t section;
+    const TreeEntry* entry;
+    bool used = false;
+    bool hashed = false;   // hash 是否有效
+    uint64_t hash = 0;
+};
+
+// 目标中缺失的快照文件
+struct Need {
+    size_t section;
+    const TreeEntry* entry;
+};
+
+int64_t toNanoseconds(const struct timespec& ts) {
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 把候选文件 from 重命名为 to，并把 mtime 设为快照中的值。
+ *        移动前重新检查候选文件: 仍是扫描时的那个 inode，大小和 mtime 都没有变化，目标位置仍不存在。
+ */
+bool moveInto(const fs::path& from, const TreeEntry& candidate, const fs::path& to, const TreeEntry& wanted,
+              bool allowSharedInodes) {
+    struct stat st;
+    if (lstat(from.c_str(), &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_dev != candidate.device ||
+        (uint64_t)st.st_ino != candidate.inode || (uint64_t)st.st_size != wanted.size ||
+        toNanoseconds(st.st_mtim) != candidate.mtimeNs || (st.st_nlink != 1 && !allowSharedInodes)) {
+        return false;
+    }
+    std::error_code ec;
+    fs::create_directories(to.parent_path(), ec);
+    struct stat existing;
+    if (ec || lstat(to.c_str(), &existing) == 0 || errno != ENOENT) return false;
+    if (::rename(from.c_str(), to.c_str()) != 0) return false;   // 跨文件系统 (EXDEV) 等: 留给同步复制
+    if (candidate.mtimeNs != wanted.mtimeNs) {
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = wanted.mtimeNs / 1000000000LL;
+        times[1].tv_nsec = wanted.mtimeNs % 1000000000LL;
+        utimensat(AT_FDCWD, to.c_str(), times, AT_SYMLINK_NOFOLLOW);
+    }
+    return true;
+}
+
+} // namespace
+
+size_t relocateMovedFiles(std::vector<RelocationSection>& sections, bool verifyContent, bool allowSharedInodes,
+                          SyncStats& stats) {
+    // 1. 收集各目录中缺失的快照文件和多余的普通文件
+    std::vector<Need> needs;
+    std::vector<Candidate> candidates;
+    std::vector<uint64_t> rootDevices(sections.size(), 0);
+    for (size_t i = 0; i < sections.size(); ++i) {
+        const RelocationSection& section = sections[i];
+        struct stat st;
+        if (stat(section.destRoot.c_str(), &st) == 0) rootDevices[i] = (uint64_t)st.st_dev;
+        std::unordered_map<std::string, const TreeEntry*> wanted;
+        wanted.reserve(section.wanted->size());
+        for (const auto& e : *section.wanted) wanted.emplace(e.relPath, &e);
+        std::unordered_map<std::string, const TreeEntry*> current;
+        current.reserve(section.current->size());
+        for (const auto& e : *section.current) {
+            current.emplace(e.relPath, &e);
+            if (e.type != EntryType::Regular || e.size == 0) continue;
+            auto it = wanted.find(e.relPath);
+            if (it == wanted.end() || it->second->type != EntryType::Regular) candidates.push_back({i, &e});
+        }
+        if (rootDevices[i] == 0) continue;
+        for (const auto& e : *section.wanted) {
+            if (e.type == EntryType::Regular && e.size > 0 && !current.count(e.relPath)) needs.push_back({i, &e});
+        }
+    }
+    if (needs.empty() || candidates.empty()) return 0;
+
+    size_t moved = 0;
+    auto tryMove = [&](const Need& need, Candidate& candidate) {
+        const RelocationSection& from = sections[candidate.section];
+        RelocationSection& to = sections[need.section];
+        to.changed = true;   // 即使移动失败，也可能已经创建了父目录
+        if (!moveInto(from.destRoot / candidate.entry->relPath, *candidate.entry, to.destRoot / need.entry->relPath,
+                      *need.entry, allowSharedInodes)) {
+            return false;
+        }
+        candidate.used = true;
+        sections[candidate.section].changed = true;
+        stats.filesMoved++;
+        stats.bytesMoved += need.entry->size;
+        moved++;
+        return true;
+    };
+
+    // 2. 冰冻时的 inode 仍在且未被修改: 不读内容直接移回
+    std::vector<const Need*> remaining;
+    if (!verifyContent) {
+        std::map<std::pair<uint64_t, uint64_t>, size_t> byIdentity;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            byIdentity.emplace(std::make_pair(candidates[i].entry->device, candidates[i].entry->inode), i);
+        }
+        for (const auto& need : needs) {
+            const TreeEntry& e = *need.entry;
+            auto it = e.inode != 0 ? byIdentity.find(std::make_pair(e.device, e.inode)) : byIdentity.end();
+            if (it != byIdentity.end()) {
+                Candidate& candidate = candidates[it->second];
+                if (!candidate.used && candidate.entry->size == e.size && candidate.entry->mtimeNs == e.mtimeNs &&
+                    tryMove(need, candidate)) {
+                    continue;
+                }
+            }
+            remaining.push_back(&need);
+        }
+    } else {
+        for (const auto& need : needs) remaining.push_back(&need);
+    }
+
+    // 3. 其余的按内容哈希匹配: 只计算与某个缺失文件大小相同、且在同一文件系统上的候选文件
+    std::set<std::pair<uint64_t, uint64_t>> sizes;   // (设备号, 大小)
+    for (const Need* need : remaining) {
+        if (need->entry->hasContentHash) sizes.emplace(rootDevices[need->section], need->entry->size);
+    }
+    std::vector<size_t> toHash;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const Candidate& c = candidates[i];
+        if (!c.used && sizes.count(std::make_pair(c.entry->device, c.entry->size))) toHash.push_back(i);
+    }
+    if (toHash.empty()) return moved;
+    parallelFor(toHash.size(), [&](size_t i) {
+        Candidate& c = candidates[toHash[i]];
+        c.hashed = hashFile(sections[c.section].destRoot / c.entry->relPath, c.hash);
+    });
+    std::multimap<std::pair<uint64_t, uint64_t>, size_t> byContent;   // (大小, 哈希) -> 候选
+    for (size_t i : toHash) {
+        if (candidates[i].hashed) byContent.emplace(std::make_pair(candidates[i].entry->size, candidates[i].hash), i);
+    }
+    for (const Need* need : remaining) {
+        const TreeEntry& e = *need->entry;
+        if (!e.hasContentHash) continue;
+        auto range = byContent.equal_range(std::make_pair(e.size, e.contentHash));
+        for (auto it = range.first; it != range.second; ++it) {
+            Candidate& candidate = candidates[it->second];
+            if (candidate.used || candidate.entry->device != rootDevices[need->section]) continue;
+            if (tryMove(*need, candidate)) break;
+        }
+    }
+    return moved;
+}
@@ -0,0 +1,36 @@
+#ifndef RELOCATION_H
+#define RELOCATION_H
+
+#include <vector>
+#include <filesystem>
+#include "tree_sync.h"
+
+/**
+ * 恢复前的移动检测: 快照中的文件在目标中已不存在，而同一次恢复的某个目录里多出了内容相同的文件
+ * (例如桌面上的文件被拖进回收站或其他文件夹) 时，把它重命名回原处，既不复制内容，也不删除多余文件。
+ *
+ * 匹配方式:
+ *   1. 设备号和 inode 与冰冻时记录的相同，且大小和 mtime 未变 (与增量恢复判断文件未变化的依据相同);
+ *   2. 大小相同的多余文件逐个计算内容哈希，与快照记录的哈希相同。
+ * 校验模式下只使用第 2 种方式。只在同一文件系统内重命名，其余情况仍由后续的同步复制和删除。
+ */
+
+// 参与移动检测的一个目录
+struct RelocationSection {
+    const std::vector<TreeEntry>* wanted = nullptr;    // 快照条目 (已按同步范围和排除规则筛选)
+    std::filesystem::path destRoot;
+    const std::vector<TreeEntry>* current = nullptr;   // 目标现状 (scanDestination 的结果)
+    bool changed = false;   // [输出] 是否有文件移入或移出 (此时 current 已过时)
+};
+
+/**
+ * @brief 在 sections 之间查找并移回被移动的文件。目标中缺失的快照文件可以从任一 section 的多余文件中取回，
+ *        移回后 mtime 设为快照中的值，权限和拥有者留给后续同步修正。
+ * @param verifyContent 为 true 时只按内容哈希匹配 (校验模式)。
+ * @param allowSharedInodes 为 true 时也移动有多个硬链接的文件 (硬链接物化方式下目标文件与 blob 共享 inode)。
+ * @return 移回的文件数 (同时累计到 stats.filesMoved / bytesMoved)。
+ */
+size_t relocateMovedFiles(std::vector<RelocationSection>& sections, bool verifyContent, bool allowSharedInodes,
+                          SyncStats& stats);
+
+#endif // RELOCATION_H
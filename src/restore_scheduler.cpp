@@ -0,0 +1,251 @@
+#include "restore_scheduler.h"
+#include "copy_engine.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <map>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* PROGRESS_FILENAME = "restore_progress";
+const char* DESKTOP_READY_FILENAME = "desktop.ready";
+const auto REPORT_INTERVAL = std::chrono::milliseconds(500);
+
+// ioprio_set 的参数 (glibc 未提供包装函数)
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_IDLE = 3;
+const int IOPRIO_CLASS_SHIFT = 13;
+const int BACKGROUND_NICE = 19;
+
+const char* LOGIN_DEFS_PATH = "/etc/login.defs";
+const uid_t DEFAULT_UID_MIN = 1000;
+const uid_t NOBODY_UID = 65534;
+
+// /etc/login.defs 中普通用户的最小 uid
+uid_t loginUidMin() {
+    std::ifstream in(LOGIN_DEFS_PATH);
+    std::string key;
+    while (in >> key) {
+        if (key == "UID_MIN") {
+            unsigned long value = 0;
+            if (in >> value) return (uid_t)value;
+            break;
+        }
+        std::string rest;
+        std::getline(in, rest);
+    }
+    return DEFAULT_UID_MIN;
+}
+
+} // namespace
+
+fs::path restoreRuntimeDir() {
+    return fs::path("/run/user") / std::to_string(getuid()) / "desktop_snapshot";
+}
+
+RestoreProgressReporter::RestoreProgressReporter() {
+    progress_ = SnapshotRestoreProgress();
+    std::error_code ec;
+    fs::create_directories(restoreRuntimeDir(), ec);
+    fs::remove(restoreRuntimeDir() / DESKTOP_READY_FILENAME, ec);
+    write();
+    reporter_ = std::thread([this] { reportLoop(); });
+}
+
+RestoreProgressReporter::~RestoreProgressReporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        progress_.finished = 1;
+    }
+    wake_.notify_all();
+    reporter_.join();
+    write();
+}
+
+void RestoreProgressReporter::setStage(RestoreStage stage, int state) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        switch (stage) {
+            case RestoreStage::Desktop: progress_.desktop = state; break;
+            case RestoreStage::Trash: progress_.trash = state; break;
+            case RestoreStage::HomeFolders: progress_.homeFolders = state; break;
+        }
+    }
+    write();
+}
+
+void RestoreProgressReporter::markDesktopReady() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        progress_.desktopReady = 1;
+    }
+    std::ofstream ready(restoreRuntimeDir() / DESKTOP_READY_FILENAME, std::ios::trunc);
+    write();
+}
+
+// 复制进度取自复制引擎的运行统计 (每个目标恢复开始时清零，因此是当前阶段的进度)
+void RestoreProgressReporter::write() {
+    std::lock_guard<std::mutex> fileLock(fileMutex_);
+    SnapshotRestoreProgress snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        CopyRunStats stats = getCopyRunStats();
+        progress_.filesCopied = 0;
+        progress_.bytesCopied = 0;
+        for (int i = 0; i < (int)CopyStrategy::Count; ++i) {
+            progress_.filesCopied += stats.files[i];
+            progress_.bytesCopied += stats.bytes[i];
+        }
+        progress_.updatedAt = (long long)std::time(nullptr);
+        snapshot = progress_;
+    }
+
+    // 先写临时文件再重命名，读取方不会看到写了一半的状态
+    std::ostringstream out;
+    out << "desktop=" << snapshot.desktop << "\n"
+        << "trash=" << snapshot.trash << "\n"
+        << "home_folders=" << snapshot.homeFolders << "\n"
+        << "desktop_ready=" << snapshot.desktopReady << "\n"
+        << "finished=" << snapshot.finished << "\n"
+        << "files_copied=" << snapshot.filesCopied << "\n"
+        << "bytes_copied=" << snapshot.bytesCopied << "\n"
+        << "updated_at=" << snapshot.updatedAt << "\n";
+    writeFileAtomically(restoreRuntimeDir() / PROGRESS_FILENAME, out.str());
+}
+
+void RestoreProgressReporter::reportLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        wake_.wait_for(lock, REPORT_INTERVAL, [this] { return stop_; });
+        if (stop_) break;
+        lock.unlock();
+        write();
+        lock.lock();
+    }
+}
+
+bool readRestoreProgress(SnapshotRestoreProgress& progress) {
+    std::ifstream in(restoreRuntimeDir() / PROGRESS_FILENAME);
+    if (!in.is_open()) return false;
+    progress = SnapshotRestoreProgress();
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq);
+        long long value = std::strtoll(line.c_str() + eq + 1, nullptr, 10);
+        if (key == "desktop") progress.desktop = (int)value;
+        else if (key == "trash") progress.trash = (int)value;
+        else if (key == "home_folders") progress.homeFolders = (int)value;
+        else if (key == "desktop_ready") progress.desktopReady = (int)value;
+        else if (key == "finished") progress.finished = (int)value;
+        else if (key == "files_copied") progress.filesCopied = (unsigned long long)value;
+        else if (key == "bytes_copied") progress.bytesCopied = (unsigned long long)value;
+        else if (key == "updated_at") progress.updatedAt = value;
+    }
+    return true;
+}
+
+void applyBackgroundPriority() {
+    // Linux 上 nice 和 I/O 优先级都是线程属性，只影响本线程及其后创建的线程
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    if (setpriority(PRIO_PROCESS, (id_t)tid, BACKGROUND_NICE) != 0) {
+        std::cerr << "  -> 警告: 无法降低后台线程的 CPU 优先级。" << std::endl;
+    }
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+        std::cerr << "  -> 警告: 无法设置后台线程的空闲 I/O 优先级。" << std::endl;
+    }
+}
+
+void runWithBackgroundPriority(const std::function<void()>& fn) {
+    std::thread worker([&fn] {
+        applyBackgroundPriority();
+        // 工作线程在本线程上重建，继承低优先级
+        restartWorkers();
+        try {
+            fn();
+        } catch (const std::exception& e) {
+            std::cerr << "  -> 警告: 后台恢复失败: " << e.what() << std::endl;
+        }
+        restartWorkers();
+    });
+    worker.join();
+}
+
+std::vector<UserAccount> listLoginUsers() {
+    std::vector<UserAccount> users;
+    uid_t uidMin = loginUidMin();
+    setpwent();
+    while (struct passwd* pw = getpwent()) {
+        if (pw->pw_uid < uidMin || pw->pw_uid == NOBODY_UID || pw->pw_dir == nullptr) continue;
+        UserAccount user;
+        user.name = pw->pw_name;
+        user.uid = pw->pw_uid;
+        user.gid = pw->pw_gid;
+        user.home = pw->pw_dir;
+        std::error_code ec;
+        if (user.home.is_absolute() && fs::is_directory(user.home, ec)) users.push_back(std::move(user));
+    }
+    endpwent();
+    return users;
+}
+
+int runForEachUser(const std::vector<UserAccount>& users, size_t parallel,
+                   const std::function<int(const UserAccount&)>& fn) {
+    if (parallel == 0) parallel = 1;
+    std::map<pid_t, std::string> running;   // 子进程 -> 用户名
+    int result = 0;
+    auto reapOne = [&] {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) return false;
+        auto it = running.find(pid);
+        if (it == running.end()) return true;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::cerr << "  -> 警告: 用户 " << it->second << " 的恢复失败。" << std::endl;
+            result = -1;
+        }
+        running.erase(it);
+        return true;
+    };
+    for (const auto& user : users) {
+        while (running.size() >= parallel && reapOne()) {}
+        std::cout.flush();
+        std::cerr.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "  -> 警告: 无法为用户 " << user.name << " 创建恢复进程。" << std::endl;
+            result = -1;
+            continue;
+        }
+        if (pid == 0) {
+            applyBackgroundPriority();
+            int code = 1;
+            try {
+                code = fn(user) == 0 ? 0 : 1;
+            } catch (const std::exception& e) {
+                std::cerr << "  -> 警告: 用户 " << user.name << " 的恢复失败: " << e.what() << std::endl;
+            }
+            std::cout.flush();
+            std::cerr.flush();
+            // 由 exit 执行库的析构 (等待后台回收线程等)
+            std::exit(code);
+        }
+        running[pid] = user.name;
+    }
+    while (!running.empty() && reapOne()) {}
+    return result;
+}
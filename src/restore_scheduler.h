@@ -0,0 +1,102 @@
+#ifndef RESTORE_SCHEDULER_H
+#define RESTORE_SCHEDULER_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "../include/desktop_snapshot_api.h"
+
+/**
+ * 登录恢复的优先级调度支持: 进度状态、桌面就绪信号和后台低优先级执行。
+ * 进度写入 /run/user/<uid>/desktop_snapshot/restore_progress (每行 "键=值")，
+ * 其他进程通过 readRestoreProgress() 查询; 桌面恢复完成后创建同目录下的 desktop.ready。
+ */
+
+// 登录恢复的阶段
+enum class RestoreStage {
+    Desktop = 0,
+    Trash = 1,
+    HomeFolders = 2
+};
+
+/**
+ * @brief 当前用户的运行时状态目录 (/run/user/<uid>/desktop_snapshot)。
+ */
+std::filesystem::path restoreRuntimeDir();
+
+/**
+ * 一次登录恢复的进度记录器。构造时清除上一次的就绪信号，
+ * 运行期间由后台线程定期把复制进度写入状态文件，析构时写入最终状态。
+ */
+class RestoreProgressReporter {
+public:
+    RestoreProgressReporter();
+    ~RestoreProgressReporter();
+    RestoreProgressReporter(const RestoreProgressReporter&) = delete;
+    RestoreProgressReporter& operator=(const RestoreProgressReporter&) = delete;
+
+    // 设置阶段状态 (SNAPSHOT_STAGE_*)，并立即写入状态文件
+    void setStage(RestoreStage stage, int state);
+
+    // 标记桌面就绪: 创建 desktop.ready 并写入状态文件
+    void markDesktopReady();
+
+private:
+    void write();
+    void reportLoop();
+
+    std::mutex mutex_;
+    std::mutex fileMutex_;             // 串行化状态文件的写入
+    SnapshotRestoreProgress progress_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread reporter_;
+};
+
+/**
+ * @brief 读取状态文件中的进度。
+ * @return true 表示成功, false 表示没有状态文件。
+ */
+bool readRestoreProgress(SnapshotRestoreProgress& progress);
+
+/**
+ * @brief 将调用线程降为最低 CPU 优先级 (nice 19) 和空闲 I/O 优先级，失败时只打印警告。
+ *        之后由该线程创建的线程继承同样的优先级。
+ */
+void applyBackgroundPriority();
+
+/**
+ * @brief 在一个以最低 CPU 优先级 (nice 19) 和空闲 I/O 优先级运行的线程上执行 fn，完成后返回。
+ *        执行期间工作线程池在该线程上重建，并行任务同样以低优先级运行。
+ */
+void runWithBackgroundPriority(const std::function<void()>& fn);
+
+// 一个可登录的本地用户
+struct UserAccount {
+    std::string name;
+    uid_t uid = 0;
+    gid_t gid = 0;
+    std::filesystem::path home;
+};
+
+/**
+ * @brief 列出普通用户 (uid 不小于 /etc/login.defs 中的 UID_MIN，默认 1000，且主目录存在)。
+ */
+std::vector<UserAccount> listLoginUsers();
+
+/**
+ * @brief 为每个用户在单独的子进程中执行 fn (子进程的退出码为 fn 的返回值)，最多 parallel 个同时进行。
+ *        子进程以最低 CPU 优先级和空闲 I/O 优先级运行; 库的全局状态 (运行统计、线程池、HOME 等)
+ *        在各子进程中互不影响。调用时本进程不能有其他线程。
+ * @return 0 表示全部成功, -1 表示有用户失败。
+ */
+int runForEachUser(const std::vector<UserAccount>& users, size_t parallel,
+                   const std::function<int(const UserAccount&)>& fn);
+
+#endif // RESTORE_SCHEDULER_H
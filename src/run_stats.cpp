@@ -0,0 +1,303 @@
+#include "run_stats.h"
+#include "copy_engine.h"
+#include "thread_pool.h"
+#include "json_util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace fs = std::filesystem;
+
+const char* const RUN_STATS_FILENAME = "stats.json";
+const char* const RUN_TRACE_FILENAME = "trace.json";
+
+namespace {
+
+// 进程内累计的计数，阶段的计数为结束时与开始时之差
+struct Counters {
+    uint64_t filesCopied = 0;
+    uint64_t bytesCopied = 0;
+    uint64_t holeBytes = 0;
+    uint64_t readSyscalls = 0;
+    uint64_t writeSyscalls = 0;
+    uint64_t storageReadBytes = 0;
+    uint64_t storageWriteBytes = 0;
+};
+
+Counters operator-(const Counters& a, const Counters& b) {
+    Counters d;
+    d.filesCopied = a.filesCopied - b.filesCopied;
+    d.bytesCopied = a.bytesCopied - b.bytesCopied;
+    d.holeBytes = a.holeBytes - b.holeBytes;
+    d.readSyscalls = a.readSyscalls - b.readSyscalls;
+    d.writeSyscalls = a.writeSyscalls - b.writeSyscalls;
+    d.storageReadBytes = a.storageReadBytes - b.storageReadBytes;
+    d.storageWriteBytes = a.storageWriteBytes - b.storageWriteBytes;
+    return d;
+}
+
+Counters sampleCounters() {
+    Counters c;
+    CopyRunStats copy = getCopyTotals();
+    for (int i = 0; i < (int)CopyStrategy::Count; ++i) {
+        c.filesCopied += copy.files[i];
+        c.bytesCopied += copy.bytes[i];
+    }
+    c.holeBytes = copy.holeBytes;
+
+    // 整个进程 (包括工作线程) 的读写类系统调用次数和块设备读写字节数; 不可读时记为 0
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value;
+    while (io >> key >> value) {
+        if (key == "syscr:") c.readSyscalls = value;
+        else if (key == "syscw:") c.writeSyscalls = value;
+        else if (key == "read_bytes:") c.storageReadBytes = value;
+        else if (key == "write_bytes:") c.storageWriteBytes = value;
+    }
+    return c;
+}
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct PhaseRecord {
+    std::string name;
+    int depth = 0;
+    long tid = 0;
+    int64_t startNs = 0;
+    int64_t endNs = 0;
+    Counters start;
+    Counters delta;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+};
+
+// 当前运行的记录 (同一时刻只有一次运行)
+struct Recorder {
+    std::mutex mutex;
+    bool active = false;
+    std::string operation;
+    std::string target;
+    fs::path outputDir;
+    long long startedAt = 0;
+    int64_t startNs = 0;
+    Counters start;
+    CopyRunStats startCopy;
+    long tid = 0;
+    int depth = 0;
+    std::vector<PhaseRecord> phases;
+};
+
+Recorder g_recorder;
+std::atomic<bool> g_traceExport{false};
+
+long currentTid() {
+    return (long)syscall(SYS_gettid);
+}
+
+// 在持有 g_recorder.mutex 时调用
+size_t openPhase(const std::string& name) {
+    PhaseRecord record;
+    record.name = name;
+    record.depth = g_recorder.depth++;
+    record.tid = currentTid();
+    record.startNs = nowNs();
+    record.start = sampleCounters();
+    g_recorder.phases.push_back(std::move(record));
+    return g_recorder.phases.size() - 1;
+}
+
+void closePhase(size_t index, const std::vector<std::pair<std::string, uint64_t>>& counters) {
+    if (index >= g_recorder.phases.size()) return;
+    PhaseRecord& record = g_recorder.phases[index];
+    record.endNs = nowNs();
+    record.delta = sampleCounters() - record.start;
+    record.counters = counters;
+    g_recorder.depth--;
+}
+
+std::string milliseconds(int64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", ns / 1e6);
+    return buf;
+}
+
+std::string microseconds(int64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", ns / 1e3);
+    return buf;
+}
+
+void writeCounters(std::ostream& out, const Counters& c) {
+    out << "\"files_copied\": " << c.filesCopied << ", \"bytes_copied\": " << c.bytesCopied
+        << ", \"hole_bytes\": " << c.holeBytes << ", \"read_syscalls\": " << c.readSyscalls
+        << ", \"write_syscalls\": " << c.writeSyscalls << ", \"storage_read_bytes\": " << c.storageReadBytes
+        << ", \"storage_write_bytes\": " << c.storageWriteBytes;
+}
+
+void writeExtraCounters(std::ostream& out, const std::vector<std::pair<std::string, uint64_t>>& counters) {
+    out << "{";
+    for (size_t i = 0; i < counters.size(); ++i) {
+        out << (i ? ", " : "") << jsonString(counters[i].first) << ": " << counters[i].second;
+    }
+    out << "}";
+}
+
+std::string statsJson(const Recorder& r, int result, int64_t endNs, const Counters& totals,
+                      const CopyRunStats& copy) {
+    std::ostringstream out;
+    out << "{\n"
+        << "  \"version\": 1,\n"
+        << "  \"operation\": " << jsonString(r.operation) << ",\n"
+        << "  \"target\": " << jsonString(r.target) << ",\n"
+        << "  \"result\": " << result << ",\n"
+        << "  \"started_at\": " << r.startedAt << ",\n"
+        << "  \"wall_ms\": " << milliseconds(endNs - r.startNs) << ",\n"
+        << "  \"workers\": " << getWorkerCount() << ",\n"
+        << "  \"totals\": {";
+    writeCounters(out, totals);
+    out << "},\n  \"copy_strategies\": {";
+    bool any = false;
+    for (int i = 0; i < (int)CopyStrategy::Count; ++i) {
+        uint64_t files = copy.files[i] - r.startCopy.files[i];
+        if (files == 0) continue;
+        out << (any ? ", " : "") << jsonString(copyStrategyName((CopyStrategy)i)) << ": {\"files\": " << files
+            << ", \"bytes\": " << copy.bytes[i] - r.startCopy.bytes[i] << "}";
+        any = true;
+    }
+    out << "},\n  \"phases\": [";
+    for (size_t i = 0; i < r.phases.size(); ++i) {
+        const PhaseRecord& p = r.phases[i];
+        int64_t end = p.endNs ? p.endNs : endNs;
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(p.name) << ", \"depth\": " << p.depth
+            << ", \"thread\": " << p.tid << ", \"start_ms\": " << milliseconds(p.startNs - r.startNs)
+            << ", \"wall_ms\": " << milliseconds(end - p.startNs) << ", ";
+        writeCounters(out, p.delta);
+        out << ", \"counters\": ";
+        writeExtraCounters(out, p.counters);
+        out << "}";
+    }
+    out << (r.phases.empty() ? "]\n" : "\n  ]\n") << "}\n";
+    return out.str();
+}
+
+// Chrome trace_event 格式: 每个阶段是一个完整事件 ("ph": "X")，时间以运行开始为零点，单位微秒
+std::string traceJson(const Recorder& r, int result, int64_t endNs, const Counters& totals) {
+    std::ostringstream out;
+    long pid = (long)getpid();
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "  {\"name\": " << jsonString(r.operation + " " + r.target) << ", \"cat\": \"run\", \"ph\": \"X\", "
+        << "\"ts\": 0, \"dur\": " << microseconds(endNs - r.startNs) << ", \"pid\": " << pid
+        << ", \"tid\": " << r.tid << ", \"args\": {\"result\": " << result
+        << ", ";
+    writeCounters(out, totals);
+    out << "}}";
+    for (const auto& p : r.phases) {
+        int64_t end = p.endNs ? p.endNs : endNs;
+        out << ",\n  {\"name\": " << jsonString(p.name) << ", \"cat\": \"phase\", \"ph\": \"X\", \"ts\": "
+            << microseconds(p.startNs - r.startNs) << ", \"dur\": " << microseconds(end - p.startNs)
+            << ", \"pid\": " << pid << ", \"tid\": " << p.tid << ", \"args\": {";
+        writeCounters(out, p.delta);
+        for (const auto& counter : p.counters) out << ", " << jsonString(counter.first) << ": " << counter.second;
+        out << "}}";
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+// 先写临时文件再重命名
+void writeStatsFile(const fs::path& path, const std::string& content) {
+    std::string error;
+    if (!writeFileAtomically(path, content, &error)) {
+        std::cerr << "  -> 警告: 无法写入运行统计 " << path.string() << " (" << error << ")" << std::endl;
+    }
+}
+
+} // namespace
+
+void setTraceExport(bool enabled) {
+    g_traceExport = enabled;
+}
+
+RunScope::RunScope(const std::string& operation, const std::string& target, const fs::path& outputDir) {
+    std::lock_guard<std::mutex> lock(g_recorder.mutex);
+    if (g_recorder.active) {
+        phase_ = openPhase(operation + " " + target);
+        return;
+    }
+    outermost_ = true;
+    g_recorder.active = true;
+    g_recorder.operation = operation;
+    g_recorder.target = target;
+    g_recorder.outputDir = outputDir;
+    g_recorder.startedAt = (long long)std::time(nullptr);
+    g_recorder.tid = currentTid();
+    g_recorder.depth = 0;
+    g_recorder.phases.clear();
+    g_recorder.startCopy = getCopyTotals();
+    g_recorder.start = sampleCounters();
+    g_recorder.startNs = nowNs();
+}
+
+RunScope::~RunScope() {
+    std::lock_guard<std::mutex> lock(g_recorder.mutex);
+    if (!outermost_) {
+        closePhase(phase_, {{"failed", (uint64_t)(result_ == 0 ? 0 : 1)}});
+        return;
+    }
+    int64_t endNs = nowNs();
+    Counters totals = sampleCounters() - g_recorder.start;
+    CopyRunStats copy = getCopyTotals();
+    g_recorder.active = false;
+
+    std::error_code ec;
+    // 不写出统计，或输出目录已不存在 (例如解冻后快照目录已被删除)
+    if (g_recorder.outputDir.empty() || !fs::is_directory(g_recorder.outputDir, ec)) return;
+    writeStatsFile(g_recorder.outputDir / RUN_STATS_FILENAME,
+                        statsJson(g_recorder, result_, endNs, totals, copy));
+    if (g_traceExport) {
+        writeStatsFile(g_recorder.outputDir / RUN_TRACE_FILENAME, traceJson(g_recorder, result_, endNs, totals));
+    }
+}
+
+void RunScope::setResult(int result) {
+    result_ = result;
+}
+
+PhaseScope::PhaseScope(const std::string& name) {
+    std::lock_guard<std::mutex> lock(g_recorder.mutex);
+    if (g_recorder.active) index_ = openPhase(name);
+}
+
+PhaseScope::~PhaseScope() {
+    std::lock_guard<std::mutex> lock(g_recorder.mutex);
+    if (g_recorder.active) closePhase(index_, counters_);
+}
+
+void PhaseScope::addCounter(const char* name, uint64_t value) {
+    for (auto& counter : counters_) {
+        if (counter.first == name) {
+            counter.second += value;
+            return;
+        }
+    }
+    counters_.emplace_back(name, value);
+}
+
+bool readRunStats(const fs::path& dir, std::string& json) {
+    std::ifstream in(dir / RUN_STATS_FILENAME);
+    if (!in.is_open()) return false;
+    std::ostringstream content;
+    content << in.rdbuf();
+    json = content.str();
+    return true;
+}
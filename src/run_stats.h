@@ -0,0 +1,71 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <filesystem>
+
+/**
+ * 冰冻和恢复的运行统计。每次对外操作 (冰冻、立即恢复、登录恢复、会话结束恢复) 记为一次运行，
+ * 运行中的各阶段记录墙钟时间、复制的文件数和字节数、读写类系统调用次数 (取自 /proc/self/io 的
+ * syscr/syscw，包括 copy_file_range 和 sendfile)、块设备读写字节数，以及差异比较跳过的字节数等阶段计数。
+ *
+ * 运行结束时写入 <输出目录>/stats.json (只保留最近一次运行); 开启追踪导出时另写 trace.json，
+ * 为 Chrome trace_event 格式，可在 chrome://tracing 或 Perfetto 中打开。
+ */
+
+// 运行统计文件名
+extern const char* const RUN_STATS_FILENAME;
+// 追踪文件名
+extern const char* const RUN_TRACE_FILENAME;
+
+// 设置运行结束时是否同时导出 Chrome 追踪文件
+void setTraceExport(bool enabled);
+
+/**
+ * 一次运行。构造时开始计时，析构时写出统计文件 (outputDir 为空时不写出)。
+ * 已有运行在进行时 (例如登录恢复中逐个恢复目标)，嵌套的运行作为外层运行的一个阶段记录。
+ */
+class RunScope {
+public:
+    RunScope(const std::string& operation, const std::string& target, const std::filesystem::path& outputDir);
+    ~RunScope();
+    RunScope(const RunScope&) = delete;
+    RunScope& operator=(const RunScope&) = delete;
+
+    // 记录运行结果 (0 表示成功)，未调用时记为失败
+    void setResult(int result);
+
+private:
+    bool outermost_ = false;
+    int result_ = -1;
+    size_t phase_ = 0;
+};
+
+/**
+ * 运行中的一个计时阶段，可以嵌套。没有运行在进行时什么也不做。
+ */
+class PhaseScope {
+public:
+    explicit PhaseScope(const std::string& name);
+    ~PhaseScope();
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+
+    // 附加一个阶段计数 (如跳过的字节数)，同名计数累加
+    void addCounter(const char* name, uint64_t value);
+
+private:
+    size_t index_ = (size_t)-1;
+    std::vector<std::pair<std::string, uint64_t>> counters_;
+};
+
+/**
+ * @brief 读取 dir 中最近一次运行的统计 (JSON 文本)。
+ * @return true 表示成功, false 表示没有统计文件。
+ */
+bool readRunStats(const std::filesystem::path& dir, std::string& json);
+
+#endif // RUN_STATS_H
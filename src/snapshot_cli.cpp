@@ -2,20 +2,61 @@
 #include <string>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
 #include "../include/desktop_snapshot_api.h"
 
 // 打印帮助信息
 void printUsage(const char* progName) {
-    std::cout << "Usage: " << progName << " <command> [target]" << std::endl;
+    std::cout << "Usage: " << progName << " [--jobs N] [--trace] <command> [target]" << std::endl;
     std::cout << "Commands:" << std::endl;
-    std::cout << "  freeze <target>   (创建冰点，并设置自动恢复)" << std::endl;
-    std::cout << "  unfreeze <target> (移除冰点，并移除自动恢复)" << std::endl;
-    std::cout << "  restore <target>  (不重启，立即恢复)" << std::endl;
+    std::cout << "  freeze <target> [--packed[=lz4|zstd|none]] [--generation NAME] [--keep N] [--keep-days D]" << std::endl;
+    std::cout << "                    (创建冰点，并设置自动恢复；--packed 将文件写入少数几个压缩容器文件；" << std::endl;
+    std::cout << "                     每次冰冻新增一代，默认按时间命名并保留最近 5 代，--keep 0 表示不限；" << std::endl;
+    std::cout << "                     --generation 命名的代不会被自动清理)" << std::endl;
+    std::cout << "  unfreeze <target> [--generation NAME]" << std::endl;
+    std::cout << "                    (移除冰点及其全部的代，并移除自动恢复；--generation 只删除一代)" << std::endl;
+    std::cout << "  restore <target> [--full|--checksum] [--generation NAME]" << std::endl;
+    std::cout << "                    (不重启，立即恢复；默认只恢复变化的条目，" << std::endl;
+    std::cout << "                     --full 清空后全量复制，--checksum 额外比较内容哈希；" << std::endl;
+    std::cout << "                     --generation 恢复到指定的代，该代成为当前代)" << std::endl;
+    std::cout << "  verify <target>   (重新计算快照中每个文件的哈希，报告缺失或损坏的条目；" << std::endl;
+    std::cout << "                     完好时返回 0，有问题时返回 2)" << std::endl;
+    std::cout << "  generations <target>" << std::endl;
+    std::cout << "                    (列出快照的全部代，JSON 格式)" << std::endl;
     std::cout << "  status            (检查冰点状态)" << std::endl;
+    std::cout << "  progress          (查询登录恢复各阶段的进度)" << std::endl;
+    std::cout << "  stats             (输出最近一次冰冻/恢复各阶段的耗时和计数，JSON 格式)" << std::endl;
+    std::cout << "  daemon [--socket PATH]" << std::endl;
+    std::cout << "                    (常驻服务，在 Unix 套接字上处理 JSON 请求，默认" << std::endl;
+    std::cout << "                     /run/user/<uid>/desktop_snapshot/daemon.sock)" << std::endl;
     std::cout << "Targets: desktop, home_folders" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --jobs N          (并行复制线程数，默认等于 CPU 核心数，1 表示串行)" << std::endl;
+    std::cout << "  --delta-mb N      (不小于 N MiB 的文件按块更新，默认 64，0 表示整体复制)" << std::endl;
+    std::cout << "  --trace           (同时导出 Chrome 追踪文件 ~/.snapshot_manager/trace.json)" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
+    // [新增] 解析全局选项 (--jobs N, --delta-mb N, --trace)，并从参数列表中移除
+    std::vector<char*> args;
+    for (int i = 0; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            SetWorkerCount(std::atoi(argv[++i]));
+            continue;
+        }
+        if (std::strcmp(argv[i], "--delta-mb") == 0 && i + 1 < argc) {
+            SetDeltaRestoreThreshold(std::atoll(argv[++i]) * 1024 * 1024);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--trace") == 0) {
+            SetTraceExport(1);
+            continue;
+        }
+        args.push_back(argv[i]);
+    }
+    argc = (int)args.size();
+    argv = args.data();
+
     if (argc < 2) {
         printUsage(argv[0]);
         return 1;
@@ -27,6 +68,33 @@ int main(int argc, char* argv[]) {
     if (command == "freeze") {
         if (argc < 3) { std::cerr << "Missing target" << std::endl; return 1; }
         std::string target = argv[2];
+
+        // [新增] 可选的打包存储、代的名称和保留策略参数
+        int keepCount = 5;
+        long long keepDays = 0;
+        for (int i = 3; i < argc; ++i) {
+            std::string option = argv[i];
+            if (option == "--packed" || option == "--packed=lz4") {
+                SetPackCompression(SNAPSHOT_COMPRESS_LZ4);
+                SetStorageMode(SNAPSHOT_STORAGE_PACKED);
+            } else if (option == "--packed=zstd") {
+                SetPackCompression(SNAPSHOT_COMPRESS_ZSTD);
+                SetStorageMode(SNAPSHOT_STORAGE_PACKED);
+            } else if (option == "--packed=none") {
+                SetPackCompression(SNAPSHOT_COMPRESS_NONE);
+                SetStorageMode(SNAPSHOT_STORAGE_PACKED);
+            } else if (option == "--generation" && i + 1 < argc) {
+                if (SetGenerationName(argv[++i]) != 0) return 1;
+            } else if (option == "--keep" && i + 1 < argc) {
+                keepCount = std::atoi(argv[++i]);
+            } else if (option == "--keep-days" && i + 1 < argc) {
+                keepDays = std::atoll(argv[++i]);
+            } else {
+                std::cerr << "Unknown freeze option: " << option << std::endl;
+                return 1;
+            }
+        }
+        SetGenerationRetention(keepCount, keepDays * 24 * 3600);
         
         // 调用库函数
         if (TakeSnapshotAndArm(target.c_str()) == 0) {
@@ -42,6 +110,19 @@ int main(int argc, char* argv[]) {
     else if (command == "unfreeze") {
         if (argc < 3) { std::cerr << "Missing target" << std::endl; return 1; }
         std::string target = argv[2];
+
+        // [新增] 只删除一代
+        if (argc >= 5 && std::string(argv[3]) == "--generation") {
+            if (RemoveSnapshotGeneration(target.c_str(), argv[4]) != 0) {
+                std::cerr << "ERROR: Failed to remove generation " << argv[4] << " of " << target << std::endl;
+                return 1;
+            }
+            std::cout << "成功删除 '" << target << "' 的第 '" << argv[4] << "' 代快照..." << std::endl;
+            return 0;
+        } else if (argc >= 4) {
+            std::cerr << "Unknown unfreeze option: " << argv[3] << std::endl;
+            return 1;
+        }
         
         RemoveSnapshotAndCancel(target.c_str());
         std::cout << "成功为 '" << target << "' 移除冰冻并关闭恢复..." << std::endl;
@@ -52,8 +133,24 @@ int main(int argc, char* argv[]) {
     else if (command == "restore") {
         if (argc < 3) { std::cerr << "Missing target" << std::endl; return 1; }
         std::string target = argv[2];
+
+        // [新增] 可选的恢复模式和代参数
+        const char* generation = nullptr;
+        for (int i = 3; i < argc; ++i) {
+            std::string mode = argv[i];
+            if (mode == "--full") {
+                SetRestoreMode(SNAPSHOT_RESTORE_FULL);
+            } else if (mode == "--checksum") {
+                SetRestoreMode(SNAPSHOT_RESTORE_CHECKSUM);
+            } else if (mode == "--generation" && i + 1 < argc) {
+                generation = argv[++i];
+            } else {
+                std::cerr << "Unknown restore option: " << mode << std::endl;
+                return 1;
+            }
+        }
         
-        if (RestoreSnapshotImmediate(target.c_str()) == 0) {
+        if (RestoreSnapshotGeneration(target.c_str(), generation) == 0) {
             std::cout << "成功为 '" << target << "' 执行立即恢复..." << std::endl;
             return 0;
         } else {
@@ -62,20 +159,102 @@ int main(int argc, char* argv[]) {
         }
     }
     
-    // 4. 状态查询 (输出 JSON 格式方便 Electron 解析)
+    // 4. 状态查询 (标准输出只有一个 JSON 对象，方便 Electron 解析; 字段与常驻服务的 status 相同)
     else if (command == "status") {
-        std::cout << "--- 快照恢复状态检查 ---" << std::endl;
-        bool desktop = IsRestoreArmed("desktop");
-        bool home = IsRestoreArmed("home_folders");
-        
-        // 手动拼接 JSON 字符串
-        std::cout << "{" 
-                  << "\"桌面 (desktop)\": " << (desktop ? "已开启" : "已关闭") << ", "
-                  << "\"用户文件夹 (home_folders)\": " << (home ? "已开启" : "已关闭")
-                  << "}" << std::endl;
+        const char* targets[] = {"desktop", "home_folders"};
+        std::cout << "{";
+        for (int i = 0; i < 2; ++i) {
+            SnapshotInfo info;
+            GetSnapshotInfo(targets[i], &info);
+            std::cout << (i ? ", " : "") << "\"" << targets[i] << "\": {"
+                      << "\"armed\": " << (info.armed ? "true" : "false") << ", "
+                      << "\"snapshot\": " << (info.exists ? "true" : "false") << ", "
+                      << "\"packed\": " << (info.packed ? "true" : "false") << ", "
+                      << "\"entries\": " << info.entries << ", "
+                      << "\"files\": " << info.files << ", "
+                      << "\"bytes\": " << info.bytes << ", "
+                      << "\"frozen_at\": " << info.frozenAt << "}";
+        }
+        std::cout << "}" << std::endl;
+        return 0;
+    }
+
+    // 3.1 校验快照
+    else if (command == "verify") {
+        if (argc < 3) { std::cerr << "Missing target" << std::endl; return 1; }
+        int problems = VerifySnapshot(argv[2]);
+        if (problems < 0) {
+            std::cerr << "ERROR: Failed to verify " << argv[2] << std::endl;
+            return 1;
+        }
+        if (problems > 0) {
+            std::cerr << "'" << argv[2] << "' 的快照有 " << problems << " 个条目缺失或损坏。" << std::endl;
+            return 2;
+        }
+        std::cout << "'" << argv[2] << "' 的快照完好。" << std::endl;
+        return 0;
+    }
+
+    // 4.1 列出快照的代
+    else if (command == "generations") {
+        if (argc < 3) { std::cerr << "Missing target" << std::endl; return 1; }
+        int length = ListSnapshotGenerations(argv[2], nullptr, 0);
+        if (length < 0) {
+            std::cerr << "Unknown target: " << argv[2] << std::endl;
+            return 1;
+        }
+        std::vector<char> buffer(length + 1);
+        ListSnapshotGenerations(argv[2], buffer.data(), (int)buffer.size());
+        std::cout << buffer.data() << std::endl;
+        return 0;
+    }
+
+    // 5. 登录恢复进度查询
+    else if (command == "progress") {
+        SnapshotRestoreProgress progress;
+        if (GetRestoreProgress(&progress) != 0) {
+            std::cout << "本次会话尚未执行登录恢复。" << std::endl;
+            return 1;
+        }
+        auto stageName = [](int stage) {
+            switch (stage) {
+                case SNAPSHOT_STAGE_PENDING: return "等待中";
+                case SNAPSHOT_STAGE_RUNNING: return "进行中";
+                case SNAPSHOT_STAGE_DONE: return "已完成";
+                case SNAPSHOT_STAGE_FAILED: return "失败";
+                default: return "无需恢复";
+            }
+        };
+        std::cout << "桌面 (desktop): " << stageName(progress.desktop) << std::endl;
+        std::cout << "回收站 (trash): " << stageName(progress.trash) << std::endl;
+        std::cout << "用户文件夹 (home_folders): " << stageName(progress.homeFolders) << std::endl;
+        std::cout << "桌面就绪: " << (progress.desktopReady ? "是" : "否")
+                  << ", 全部完成: " << (progress.finished ? "是" : "否") << std::endl;
+        std::cout << "当前阶段已复制: " << progress.filesCopied << " 个文件, "
+                  << progress.bytesCopied << " 字节" << std::endl;
+        return 0;
+    }
+
+    // 6. 最近一次运行的统计
+    else if (command == "stats") {
+        int length = GetLastRunStats(nullptr, 0);
+        if (length < 0) {
+            std::cout << "尚无运行统计。" << std::endl;
+            return 1;
+        }
+        std::vector<char> buffer(length + 1);
+        GetLastRunStats(buffer.data(), (int)buffer.size());
+        std::cout << buffer.data();
         return 0;
     }
 
+    // 7. 常驻服务
+    else if (command == "daemon") {
+        const char* socketPath = nullptr;
+        if (argc >= 4 && std::string(argv[2]) == "--socket") socketPath = argv[3];
+        return RunSnapshotDaemon(socketPath) == 0 ? 0 : 1;
+    }
+
     else {
         printUsage(argv[0]);
         return 1;
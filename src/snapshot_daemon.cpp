@@ -0,0 +1,655 @@
+#include "../include/desktop_snapshot_api.h"
+#include "json_util.h"
+#include "restore_scheduler.h"
+#include "change_journal.h"
+#include "snapshot_generations.h"
+#include <iostream>
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace fs = std::filesystem;
+
+/**
+ * 常驻服务: 在 Unix 域套接字上按行 (每行一个 JSON 对象) 处理请求，
+ * 省去前端每次操作都启动 snapshot_tool、加载动态库并重新读取文件系统状态的开销。
+ *
+ * 请求:  {"id": 1, "method": "status"}
+ * 应答:  {"id": 1, "ok": true, "result": {...}} 或 {"id": 1, "ok": false, "error": "..."}
+ * 事件:  {"event": "operation", "operation": 3, "method": "freeze", "target": "desktop", "state": "running", ...}
+ *
+ * 冰冻、恢复和解冻在服务内排队，每次只交给库执行一个 (各自的存储方式和恢复模式在开始执行时才设置);
+ * 与队列中尚未开始的操作完全相同的请求合并为同一个操作。进度事件推送给所有连接。
+ * 状态查询只读取库内按清单缓存的快照信息，不加载清单。
+ * 服务同时为已冰冻的目标运行变更日志监视器 (见 change_journal.h)，增量恢复只需检查会话中变化过的路径。
+ */
+
+namespace {
+
+const char* const DAEMON_SOCKET_NAME = "daemon.sock";
+const size_t MAX_REQUEST_BYTES = 64 * 1024;   // 超过此长度仍无换行的连接被断开
+const std::vector<std::string> DAEMON_TARGETS = {"desktop", "home_folders"};
+const int WATCH_CHECK_INTERVAL_MS = 5000;    // 定期检查其他进程对冰冻状态的修改，启停监视器
+
+const char* operationStateName(int state) {
+    switch (state) {
+        case SNAPSHOT_OP_QUEUED: return "queued";
+        case SNAPSHOT_OP_RUNNING: return "running";
+        case SNAPSHOT_OP_SUCCEEDED: return "succeeded";
+        case SNAPSHOT_OP_CANCELLED: return "cancelled";
+        default: return "failed";
+    }
+}
+
+const char* phaseName(int phase) {
+    switch (phase) {
+        case SNAPSHOT_PHASE_SCANNING: return "scanning";
+        case SNAPSHOT_PHASE_COPYING: return "copying";
+        case SNAPSHOT_PHASE_FINISHING: return "finishing";
+        default: return "preparing";
+    }
+}
+
+const char* stageName(int stage) {
+    switch (stage) {
+        case SNAPSHOT_STAGE_PENDING: return "pending";
+        case SNAPSHOT_STAGE_RUNNING: return "running";
+        case SNAPSHOT_STAGE_DONE: return "done";
+        case SNAPSHOT_STAGE_FAILED: return "failed";
+        default: return "idle";
+    }
+}
+
+const char* boolean(bool value) {
+    return value ? "true" : "false";
+}
+
+// 服务排队的一个操作
+struct DaemonOperation {
+    uint64_t id = 0;
+    std::string method;               // "freeze" / "restore" / "unfreeze"
+    std::string target;
+    int storageMode = SNAPSHOT_STORAGE_BLOBS;
+    int codec = SNAPSHOT_COMPRESS_LZ4;
+    int restoreMode = SNAPSHOT_RESTORE_INCREMENTAL;
+    std::string generation;           // 冰冻产生或恢复到的代 (空表示按时间命名 / 当前代)
+    SnapshotOperation* handle = nullptr;
+    SnapshotOperationProgress progress = SnapshotOperationProgress();
+
+    bool sameRequest(const DaemonOperation& other) const {
+        return method == other.method && target == other.target && storageMode == other.storageMode &&
+               codec == other.codec && restoreMode == other.restoreMode && generation == other.generation;
+    }
+
+    std::string json() const {
+        std::string out = "{\"operation\": " + std::to_string(id) + ", \"method\": " + jsonString(method) +
+                          ", \"target\": " + jsonString(target) + ", \"state\": \"" +
+                          operationStateName(progress.state) + "\"";
+        if (progress.state != SNAPSHOT_OP_QUEUED) {
+            out += std::string(", \"phase\": \"") + phaseName(progress.phase) + "\"" +
+                   ", \"files_done\": " + std::to_string(progress.filesDone) +
+                   ", \"files_total\": " + std::to_string(progress.filesTotal) +
+                   ", \"bytes_done\": " + std::to_string(progress.bytesDone) +
+                   ", \"bytes_total\": " + std::to_string(progress.bytesTotal);
+        }
+        return out + "}";
+    }
+};
+
+// 一个客户端连接
+struct Client {
+    int fd = -1;
+    std::string input;
+    std::string output;
+    bool closing = false;             // 输出写完后关闭
+};
+
+} // namespace
+
+// 服务的全部状态 (只在主循环线程上访问，进度回调经 eventfd 转交)
+struct Daemon {
+    int run(const fs::path& socketPath);
+
+    // 进度回调 (库的执行线程上调用)
+    static void onProgress(const SnapshotOperationProgress* progress, void* userData);
+
+private:
+    bool listenOn(const fs::path& socketPath);
+    void acceptClients();
+    void readClient(Client& client);
+    void writeClient(Client& client);
+    void handleLine(Client& client, const std::string& line);
+    std::string handleRequest(const std::unordered_map<std::string, JsonScalar>& request, std::string& error);
+    std::string enqueue(const std::unordered_map<std::string, JsonScalar>& request, const std::string& method,
+                        std::string& error);
+    std::string cancel(const std::unordered_map<std::string, JsonScalar>& request, std::string& error);
+    std::string generationsJson(const std::unordered_map<std::string, JsonScalar>& request, std::string& error);
+    std::string statusJson();
+    std::string restoreProgressJson();
+    void startNext();
+    void drainProgress();
+    void broadcast(const std::string& line);
+    void shutdownOperations();
+    void updateWatchers();
+
+    int listenFd_ = -1;
+    int eventFd_ = -1;
+    int signalFd_ = -1;
+    fs::path socketPath_;
+    bool stop_ = false;
+    uint64_t nextId_ = 1;
+    std::list<Client> clients_;
+    std::deque<std::unique_ptr<DaemonOperation>> pending_;
+    std::unique_ptr<DaemonOperation> running_;
+    std::map<std::string, std::unique_ptr<ChangeJournal>> watchers_;
+    std::vector<std::string> watchFailed_;    // 监视器启动失败的目标 (解冻前不再重试)
+
+    std::mutex progressMutex_;        // 保护 progressUpdates_
+    std::vector<SnapshotOperationProgress> progressUpdates_;
+};
+
+void Daemon::onProgress(const SnapshotOperationProgress* progress, void* userData) {
+    Daemon* daemon = static_cast<Daemon*>(userData);
+    {
+        std::lock_guard<std::mutex> lock(daemon->progressMutex_);
+        daemon->progressUpdates_.push_back(*progress);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(daemon->eventFd_, &one, sizeof(one));
+    (void)ignored;
+}
+
+bool Daemon::listenOn(const fs::path& socketPath) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.string().size() >= sizeof(addr.sun_path)) {
+        std::cerr << "套接字路径过长: " << socketPath.string() << std::endl;
+        return false;
+    }
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    std::error_code ec;
+    fs::create_directories(socketPath.parent_path(), ec);
+    // 已有服务在监听时不抢占; 残留的套接字文件直接删除
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        close(probe);
+        std::cerr << "已有服务在 " << socketPath.string() << " 上运行。" << std::endl;
+        return false;
+    }
+    if (probe >= 0) close(probe);
+    unlink(socketPath.c_str());
+
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listenFd_ < 0 || bind(listenFd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd_, 16) != 0) {
+        std::cerr << "无法监听 " << socketPath.string() << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    // 以 SUID 运行时套接字归调用的用户所有，其他用户无权连接
+    chmod(socketPath.c_str(), 0600);
+    if (chown(socketPath.c_str(), getuid(), getgid()) != 0 && geteuid() == 0) {
+        std::cerr << "  -> 警告: 无法设置套接字的所有者: " << strerror(errno) << std::endl;
+    }
+    socketPath_ = socketPath;
+    return true;
+}
+
+void Daemon::acceptClients() {
+    while (true) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0) return;
+        // 只接受同一用户 (或 root) 的连接
+        ucred cred;
+        socklen_t length = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0 ||
+            (cred.uid != getuid() && cred.uid != 0)) {
+            close(fd);
+            continue;
+        }
+        Client client;
+        client.fd = fd;
+        clients_.push_back(std::move(client));
+    }
+}
+
+void Daemon::readClient(Client& client) {
+    char buffer[4096];
+    while (true) {
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            client.input.append(buffer, (size_t)n);
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+            client.closing = true;
+            client.output.clear();
+            return;
+        }
+        if (errno == EAGAIN) break;
+    }
+    size_t start = 0;
+    size_t newline;
+    while ((newline = client.input.find('\n', start)) != std::string::npos) {
+        std::string line = client.input.substr(start, newline - start);
+        start = newline + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) handleLine(client, line);
+    }
+    client.input.erase(0, start);
+    if (client.input.size() > MAX_REQUEST_BYTES) {
+        client.output += "{\"id\": null, \"ok\": false, \"error\": \"request too long\"}\n";
+        client.input.clear();
+        client.closing = true;
+    }
+}
+
+void Daemon::writeClient(Client& client) {
+    while (!client.output.empty()) {
+        ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            client.output.erase(0, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return;
+        client.output.clear();   // 对端已关闭
+        client.closing = true;
+        return;
+    }
+}
+
+void Daemon::handleLine(Client& client, const std::string& line) {
+    std::unordered_map<std::string, JsonScalar> request;
+    std::string id = "null";
+    std::string error;
+    std::string result;
+    if (!parseJsonObject(line, request)) {
+        error = "invalid request";
+    } else {
+        auto it = request.find("id");
+        if (it != request.end()) {
+            id = it->second.type == JsonScalar::Type::String ? jsonString(it->second.text)
+               : it->second.type == JsonScalar::Type::Number ? it->second.text : "null";
+        }
+        result = handleRequest(request, error);
+    }
+    if (error.empty()) {
+        client.output += "{\"id\": " + id + ", \"ok\": true, \"result\": " + result + "}\n";
+    } else {
+        client.output += "{\"id\": " + id + ", \"ok\": false, \"error\": " + jsonString(error) + "}\n";
+    }
+}
+
+std::string Daemon::handleRequest(const std::unordered_map<std::string, JsonScalar>& request, std::string& error) {
+    auto it = request.find("method");
+    if (it == request.end() || it->second.type != JsonScalar::Type::String) {
+        error = "missing method";
+        return "";
+    }
+    const std::string& method = it->second.text;
+    if (method == "ping") return "{\"pid\": " + std::to_string(getpid()) + "}";
+    if (method == "status") return statusJson();
+    if (method == "freeze" || method == "restore" || method == "unfreeze") return enqueue(request, method, error);
+    if (method == "cancel") return cancel(request, error);
+    if (method == "generations") return generationsJson(request, error);
+    if (method == "progress") return restoreProgressJson();
+    if (method == "stats") {
+        int length = GetLastRunStats(nullptr, 0);
+        if (length < 0) return "null";
+        std::string json((size_t)length + 1, '\0');
+        GetLastRunStats(&json[0], length + 1);
+        json.resize((size_t)length);
+        while (!json.empty() && (json.back() == '\n' || json.back() == ' ')) json.pop_back();
+        std::replace(json.begin(), json.end(), '\n', ' ');   // 协议每行一条消息 (JSON 字符串中不会有裸换行)
+        return json;
+    }
+    if (method == "shutdown") {
+        stop_ = true;
+        return "{}";
+    }
+    error = "unknown method: " + method;
+    return "";
+}
+
+std::string Daemon::enqueue(const std::unordered_map<std::string, JsonScalar>& request, const std::string& method,
+                            std::string& error) {
+    auto option = [&](const char* key) -> std::string {
+        auto it = request.find(key);
+        return it != request.end() && it->second.type == JsonScalar::Type::String ? it->second.text : "";
+    };
+    auto op = std::make_unique<DaemonOperation>();
+    op->method = method;
+    op->target = option("target");
+    op->progress.state = SNAPSHOT_OP_QUEUED;
+    if (std::find(DAEMON_TARGETS.begin(), DAEMON_TARGETS.end(), op->target) == DAEMON_TARGETS.end()) {
+        error = "unknown target: " + op->target;
+        return "";
+    }
+    if (method == "unfreeze" && request.count("generation")) {
+        error = "removing a single generation is not supported by the daemon";
+        return "";
+    }
+    if (method == "freeze") {
+        op->generation = option("generation");
+        auto packed = request.find("packed");
+        std::string codec = option("packed");
+        bool usePacked = packed != request.end() &&
+                         (packed->second.type == JsonScalar::Type::String || packed->second.boolean);
+        if (usePacked) {
+            op->storageMode = SNAPSHOT_STORAGE_PACKED;
+            if (codec == "zstd") op->codec = SNAPSHOT_COMPRESS_ZSTD;
+            else if (codec == "none") op->codec = SNAPSHOT_COMPRESS_NONE;
+            else if (!codec.empty() && codec != "lz4") {
+                error = "unknown compression: " + codec;
+                return "";
+            }
+        }
+    } else if (method == "restore") {
+        op->generation = option("generation");
+        std::string mode = option("mode");
+        if (mode == "full") op->restoreMode = SNAPSHOT_RESTORE_FULL;
+        else if (mode == "checksum") op->restoreMode = SNAPSHOT_RESTORE_CHECKSUM;
+        else if (!mode.empty() && mode != "incremental") {
+            error = "unknown restore mode: " + mode;
+            return "";
+        }
+    }
+    if (!op->generation.empty() && !isValidGenerationName(op->generation)) {
+        error = "invalid generation name: " + op->generation;
+        return "";
+    }
+
+    // 与尚未开始的相同请求合并
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        if (pending_[i]->sameRequest(*op)) {
+            return "{\"operation\": " + std::to_string(pending_[i]->id) + ", \"position\": " +
+                   std::to_string(i + (running_ ? 1 : 0)) + ", \"coalesced\": true}";
+        }
+    }
+    op->id = nextId_++;
+    uint64_t id = op->id;
+    size_t position = pending_.size() + (running_ ? 1 : 0);
+    broadcast("{\"event\": \"operation\", " + op->json().substr(1) + "\n");
+    pending_.push_back(std::move(op));
+    startNext();
+    return "{\"operation\": " + std::to_string(id) + ", \"position\": " + std::to_string(position) +
+           ", \"coalesced\": false}";
+}
+
+std::string Daemon::cancel(const std::unordered_map<std::string, JsonScalar>& request, std::string& error) {
+    auto it = request.find("operation");
+    if (it == request.end() || it->second.type != JsonScalar::Type::Number) {
+        error = "missing operation";
+        return "";
+    }
+    uint64_t id = (uint64_t)it->second.number;
+    if (running_ && running_->id == id) {
+        CancelSnapshotOperation(running_->handle);
+        return "{\"cancelled\": true}";
+    }
+    for (auto op = pending_.begin(); op != pending_.end(); ++op) {
+        if ((*op)->id != id) continue;
+        (*op)->progress.state = SNAPSHOT_OP_CANCELLED;
+        broadcast("{\"event\": \"operation\", " + (*op)->json().substr(1) + "\n");
+        pending_.erase(op);
+        return "{\"cancelled\": true}";
+    }
+    return "{\"cancelled\": false}";   // 已结束或不存在
+}
+
+std::string Daemon::generationsJson(const std::unordered_map<std::string, JsonScalar>& request,
+                                    std::string& error) {
+    auto it = request.find("target");
+    std::string target = it != request.end() && it->second.type == JsonScalar::Type::String ? it->second.text : "";
+    int length = ListSnapshotGenerations(target.c_str(), nullptr, 0);
+    if (length < 0) {
+        error = "unknown target: " + target;
+        return "";
+    }
+    std::string json((size_t)length + 1, '\0');
+    ListSnapshotGenerations(target.c_str(), &json[0], length + 1);
+    json.resize((size_t)length);
+    return json;
+}
+
+std::string Daemon::statusJson() {
+    std::string out = "{\"targets\": {";
+    for (size_t i = 0; i < DAEMON_TARGETS.size(); ++i) {
+        SnapshotInfo info;
+        GetSnapshotInfo(DAEMON_TARGETS[i].c_str(), &info);
+        out += (i ? ", " : "") + jsonString(DAEMON_TARGETS[i]) + ": {\"armed\": " + boolean(info.armed) +
+               ", \"snapshot\": " + boolean(info.exists) + ", \"packed\": " + boolean(info.packed) +
+               ", \"entries\": " + std::to_string(info.entries) + ", \"files\": " + std::to_string(info.files) +
+               ", \"bytes\": " + std::to_string(info.bytes) + ", \"frozen_at\": " + std::to_string(info.frozenAt) +
+               "}";
+    }
+    out += "}, \"running\": " + (running_ ? running_->json() : std::string("null")) + ", \"queued\": [";
+    for (size_t i = 0; i < pending_.size(); ++i) out += (i ? ", " : "") + pending_[i]->json();
+    return out + "]}";
+}
+
+std::string Daemon::restoreProgressJson() {
+    SnapshotRestoreProgress progress;
+    if (GetRestoreProgress(&progress) != 0) return "null";
+    return std::string("{\"desktop\": \"") + stageName(progress.desktop) + "\", \"trash\": \"" +
+           stageName(progress.trash) + "\", \"home_folders\": \"" + stageName(progress.homeFolders) +
+           "\", \"desktop_ready\": " + boolean(progress.desktopReady) + ", \"finished\": " +
+           boolean(progress.finished) + ", \"files_copied\": " + std::to_string(progress.filesCopied) +
+           ", \"bytes_copied\": " + std::to_string(progress.bytesCopied) + ", \"updated_at\": " +
+           std::to_string(progress.updatedAt) + "}";
+}
+
+// 库中没有正在执行的操作时开始下一个; 全局的存储方式和恢复模式在此时才设置
+void Daemon::startNext() {
+    if (running_ || pending_.empty()) return;
+    running_ = std::move(pending_.front());
+    pending_.pop_front();
+    DaemonOperation& op = *running_;
+    op.progress.state = SNAPSHOT_OP_RUNNING;
+    if (op.method == "freeze") {
+        // 冰冻开始前启动监视器，新快照发布后日志立即有效
+        updateWatchers();
+        SetStorageMode(op.storageMode);
+        if (op.storageMode == SNAPSHOT_STORAGE_PACKED) SetPackCompression(op.codec);
+        SetGenerationName(op.generation.c_str());
+        op.handle = TakeSnapshotAndArmAsync(op.target.c_str(), &Daemon::onProgress, this);
+    } else if (op.method == "restore") {
+        SetRestoreMode(op.restoreMode);
+        op.handle = RestoreSnapshotGenerationAsync(op.target.c_str(), op.generation.c_str(), &Daemon::onProgress,
+                                                   this);
+    } else {
+        op.handle = RemoveSnapshotAsync(op.target.c_str(), &Daemon::onProgress, this);
+    }
+}
+
+void Daemon::drainProgress() {
+    uint64_t counter;
+    ssize_t ignored = read(eventFd_, &counter, sizeof(counter));
+    (void)ignored;
+    std::vector<SnapshotOperationProgress> updates;
+    {
+        std::lock_guard<std::mutex> lock(progressMutex_);
+        updates.swap(progressUpdates_);
+    }
+    for (const auto& progress : updates) {
+        if (!running_) break;
+        running_->progress = progress;
+        broadcast("{\"event\": \"operation\", " + running_->json().substr(1) + "\n");
+        if (progress.state >= SNAPSHOT_OP_SUCCEEDED) {
+            // 最后一次回调之后不再有回调，释放句柄只需等待状态发布
+            ReleaseSnapshotOperation(running_->handle);
+            running_.reset();
+            updateWatchers();
+            startNext();
+        }
+    }
+}
+
+void Daemon::broadcast(const std::string& line) {
+    for (auto& client : clients_) {
+        if (!client.closing) client.output += line;
+    }
+}
+
+void Daemon::shutdownOperations() {
+    for (auto& op : pending_) {
+        op->progress.state = SNAPSHOT_OP_CANCELLED;
+        broadcast("{\"event\": \"operation\", " + op->json().substr(1) + "\n");
+    }
+    pending_.clear();
+    if (running_) {
+        // 取消后等待结束 (冰冻保留上一份快照，全量恢复保持目标目录原样)
+        ReleaseSnapshotOperation(running_->handle);
+        running_->progress.state = SNAPSHOT_OP_CANCELLED;
+        broadcast("{\"event\": \"operation\", " + running_->json().substr(1) + "\n");
+        running_.reset();
+    }
+    std::lock_guard<std::mutex> lock(progressMutex_);
+    progressUpdates_.clear();
+}
+
+// 为已冰冻 (或正在冰冻) 的目标维持变更日志监视器 (并重新监视重新出现的根目录)，解冻后停止
+void Daemon::updateWatchers() {
+    for (const auto& target : DAEMON_TARGETS) {
+        bool wanted = IsRestoreArmed(target.c_str()) == 1 ||
+                      (running_ && running_->method == "freeze" && running_->target == target);
+        auto failed = std::find(watchFailed_.begin(), watchFailed_.end(), target);
+        if (!wanted) {
+            watchers_.erase(target);
+            if (failed != watchFailed_.end()) watchFailed_.erase(failed);
+            continue;
+        }
+        auto watcher = watchers_.find(target);
+        if (watcher != watchers_.end()) {
+            watcher->second->rearmRoots();   // 被删除后重新创建的根目录
+            continue;
+        }
+        if (failed != watchFailed_.end()) continue;
+        std::unique_ptr<ChangeJournal> journal;
+        try {
+            journal = ChangeJournal::start(changeJournalDir(), target, changeJournalRoots(target));
+        } catch (const std::exception& e) {
+            std::cerr << "  -> 警告: 无法监视 " << target << ": " << e.what() << std::endl;
+        }
+        if (!journal) {
+            watchFailed_.push_back(target);
+            continue;
+        }
+        std::cout << "  -> 正在监视 " << target << " 的变化" << std::endl;
+        watchers_[target] = std::move(journal);
+    }
+}
+
+int Daemon::run(const fs::path& socketPath) {
+    // SIGTERM / SIGINT 通过 signalfd 在主循环中处理 (执行线程在此之后创建，继承同样的信号屏蔽)
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigset_t previous;
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    signalFd_ = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+    eventFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (signalFd_ < 0 || eventFd_ < 0 || !listenOn(socketPath)) {
+        if (listenFd_ >= 0) close(listenFd_);
+        if (signalFd_ >= 0) close(signalFd_);
+        if (eventFd_ >= 0) close(eventFd_);
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        return -1;
+    }
+    std::cout << "快照服务已启动: " << socketPath.string() << std::endl;
+    updateWatchers();
+
+    std::vector<pollfd> fds;
+    std::vector<ChangeJournal*> watched;
+    while (!stop_) {
+        fds.clear();
+        fds.push_back({listenFd_, POLLIN, 0});
+        fds.push_back({eventFd_, POLLIN, 0});
+        fds.push_back({signalFd_, POLLIN, 0});
+        watched.clear();
+        for (const auto& watcher : watchers_) {
+            fds.push_back({watcher.second->fd(), POLLIN, 0});
+            watched.push_back(watcher.second.get());
+        }
+        for (const auto& client : clients_) {
+            short events = client.closing ? 0 : POLLIN;
+            if (!client.output.empty()) events |= POLLOUT;
+            fds.push_back({client.fd, events, 0});
+        }
+        int ready = poll(fds.data(), fds.size(), WATCH_CHECK_INTERVAL_MS);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "poll 失败: " << strerror(errno) << std::endl;
+            break;
+        }
+        // 先处理文件变化 (监视器可能在下面的操作完成时被停止)
+        for (size_t i = 0; i < watched.size(); ++i) {
+            if (fds[3 + i].revents & POLLIN) watched[i]->processEvents();
+        }
+        if (ready == 0) updateWatchers();
+        if (fds[2].revents & POLLIN) {
+            signalfd_siginfo info;   // 读出信号，恢复信号屏蔽时不会再次投递
+            ssize_t ignored = read(signalFd_, &info, sizeof(info));
+            (void)ignored;
+            std::cout << "收到退出信号，正在停止快照服务..." << std::endl;
+            stop_ = true;
+        }
+        if (fds[1].revents & POLLIN) drainProgress();
+        if (fds[0].revents & POLLIN) acceptClients();
+
+        size_t index = 3 + watched.size();
+        for (auto it = clients_.begin(); it != clients_.end(); ++index) {
+            Client& client = *it;
+            // 本轮新接受的连接不在 fds 中
+            short revents = index < fds.size() && fds[index].fd == client.fd ? fds[index].revents : 0;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) readClient(client);
+            writeClient(client);
+            if (client.closing && client.output.empty()) {
+                close(client.fd);
+                it = clients_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    shutdownOperations();
+    watchers_.clear();   // 日志写入 "closed"，下次启动时接着使用
+    for (auto& client : clients_) {
+        writeClient(client);   // 尽量送出最后的应答和事件
+        close(client.fd);
+    }
+    clients_.clear();
+    close(listenFd_);
+    unlink(socketPath_.c_str());
+    close(signalFd_);
+    close(eventFd_);
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    std::cout << "快照服务已停止。" << std::endl;
+    return 0;
+}
+
+extern "C" int RunSnapshotDaemon(const char* socketPath) {
+    fs::path path = socketPath && *socketPath ? fs::path(socketPath) : restoreRuntimeDir() / DAEMON_SOCKET_NAME;
+    Daemon daemon;
+    return daemon.run(path);
+}
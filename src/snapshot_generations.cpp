@@ -0,0 +1,133 @@
+#include "snapshot_generations.h"
+#include "copy_engine.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t MAX_GENERATION_NAME = 64;
+
+bool isDigits(const std::string& text, size_t begin, size_t end) {
+    if (begin >= end || end > text.size()) return false;
+    for (size_t i = begin; i < end; ++i) {
+        if (text[i] < '0' || text[i] > '9') return false;
+    }
+    return true;
+}
+
+// 以时间命名的代: YYYYMMDD-HHMMSS，可带 "-N" 后缀
+bool isTimestampName(const std::string& name) {
+    if (name.size() < 15 || !isDigits(name, 0, 8) || name[8] != '-' || !isDigits(name, 9, 15)) return false;
+    return name.size() == 15 || (name[15] == '-' && isDigits(name, 16, name.size()));
+}
+
+// 不能硬链接时复制文件内容并保留权限
+bool copyFile(const fs::path& from, const fs::path& to) {
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    struct stat st;
+    fstat(in, &st);
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0) {
+        close(in);
+        return false;
+    }
+    std::string error;
+    bool ok = copyFdContents(in, out, nullptr, &error);
+    close(in);
+    if (close(out) != 0) ok = false;
+    if (!ok) std::cerr << "  -> 警告: 复制 " << from.string() << " 失败: " << error << std::endl;
+    return ok;
+}
+
+} // namespace
+
+bool isValidGenerationName(const std::string& name) {
+    if (name.empty() || name.size() > MAX_GENERATION_NAME || name[0] == '.') return false;
+    return std::all_of(name.begin(), name.end(), [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_' ||
+               c == '-';
+    });
+}
+
+std::string timestampGenerationName(std::time_t when, const fs::path& generationsDir) {
+    struct tm local;
+    localtime_r(&when, &local);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y%m%d-%H%M%S", &local);
+    std::string name = buffer;
+    std::error_code ec;
+    for (int suffix = 2; fs::exists(generationsDir / name, ec); ++suffix) {
+        name = std::string(buffer) + "-" + std::to_string(suffix);
+    }
+    return name;
+}
+
+bool linkSnapshotFiles(const fs::path& from, const fs::path& to, const std::vector<std::string>& skipNames) {
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(from, ec)) {
+        std::string name = item.path().filename().string();
+        std::error_code typeEc;
+        if (!item.is_regular_file(typeEc) || name[0] == '.' ||
+            std::find(skipNames.begin(), skipNames.end(), name) != skipNames.end()) {
+            continue;
+        }
+        fs::path dest = to / name;
+        if (link(item.path().c_str(), dest.c_str()) == 0) continue;
+        if (errno != EXDEV && errno != EPERM && errno != EMLINK) {
+            std::cerr << "  -> 警告: 无法链接 " << item.path().string() << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        if (!copyFile(item.path(), dest)) return false;
+    }
+    return !ec;
+}
+
+std::vector<GenerationInfo> listGenerations(const fs::path& generationsDir, const std::string& manifestName) {
+    std::vector<GenerationInfo> generations;
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(generationsDir, ec)) {
+        GenerationInfo info;
+        info.name = item.path().filename().string();
+        // 暂存目录和等待回收的旧目录以 '.' 开头; 没有清单的目录不是完整的代
+        if (!isValidGenerationName(info.name)) continue;
+        struct stat st;
+        if (stat((item.path() / manifestName).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        info.createdAt = (int64_t)st.st_mtim.tv_sec;
+        info.named = !isTimestampName(info.name);
+        generations.push_back(std::move(info));
+    }
+    std::sort(generations.begin(), generations.end(), [](const GenerationInfo& a, const GenerationInfo& b) {
+        return a.createdAt != b.createdAt ? a.createdAt > b.createdAt : a.name > b.name;
+    });
+    return generations;
+}
+
+std::vector<std::string> expiredGenerations(const std::vector<GenerationInfo>& generations,
+                                            const std::string& current, int keepCount, int64_t keepSeconds,
+                                            int64_t now) {
+    std::vector<std::string> expired;
+    int kept = 0;
+    for (const auto& generation : generations) {
+        if (generation.named) continue;
+        bool keep = generation.name == current;
+        if (!keep) {
+            bool withinCount = keepCount <= 0 || kept < keepCount;
+            bool withinAge = keepSeconds <= 0 || now - generation.createdAt <= keepSeconds;
+            keep = withinCount && withinAge;
+        }
+        if (keep) {
+            kept++;
+        } else {
+            expired.push_back(generation.name);
+        }
+    }
+    return expired;
+}
@@ -0,0 +1,59 @@
+#ifndef SNAPSHOT_GENERATIONS_H
+#define SNAPSHOT_GENERATIONS_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+/**
+ * 快照的代。每次冰冻得到的快照在 ~/.snapshot_manager/generations/<目标>/<名称>/ 中保留一份
+ * (快照目录中清单和打包容器的硬链接，不额外占用空间)，文件内容在 blob 存储中由各代共享，
+ * 新增一代只需写入变化的文件。目标目录 (<目标>/) 总是当前代，其名称记录在目录中的 generation 文件里。
+ *
+ * 代以冰冻时间命名 (如 20261016-153000，同一秒内重复时加 "-2" 等后缀)，也可以由调用方命名;
+ * 保留策略只清理以时间命名的代，命名的代 (例如 "干净镜像") 需要显式删除。
+ */
+
+// 一个代
+struct GenerationInfo {
+    std::string name;
+    int64_t createdAt = 0;   // 创建时间 (Unix 秒)
+    bool named = false;      // 由调用方命名 (不受保留策略影响)
+};
+
+/**
+ * @brief 名称是否合法: 字母、数字、'.'、'_'、'-'，不以 '.' 开头，最长 64 个字符。
+ */
+bool isValidGenerationName(const std::string& name);
+
+/**
+ * @brief 以时间 when 生成 generationsDir 中尚未使用的名称。
+ */
+std::string timestampGenerationName(std::time_t when, const std::filesystem::path& generationsDir);
+
+/**
+ * @brief 把 from 中的普通文件 (skipNames 中的除外) 硬链接到已存在的空目录 to 中，
+ *        不在同一文件系统时退回复制。
+ * @return true 表示成功。
+ */
+bool linkSnapshotFiles(const std::filesystem::path& from, const std::filesystem::path& to,
+                       const std::vector<std::string>& skipNames);
+
+/**
+ * @brief 列出 generationsDir 中的全部代，按创建时间 (代中清单 manifestName 的 mtime) 从新到旧排序。
+ */
+std::vector<GenerationInfo> listGenerations(const std::filesystem::path& generationsDir,
+                                            const std::string& manifestName);
+
+/**
+ * @brief 按保留策略选出应删除的代 (只考虑以时间命名的代，current 总是保留)。
+ * @param keepCount 最多保留的以时间命名的代数 (包括当前代)，<= 0 表示不限。
+ * @param keepSeconds 只保留此时长内创建的代，<= 0 表示不限。
+ */
+std::vector<std::string> expiredGenerations(const std::vector<GenerationInfo>& generations,
+                                            const std::string& current, int keepCount, int64_t keepSeconds,
+                                            int64_t now);
+
+#endif // SNAPSHOT_GENERATIONS_H
@@ -0,0 +1,357 @@
+#include "snapshot_manifest.h"
+#include "content_hash.h"
+#include "copy_engine.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+// 二进制清单中的一条记录 (80 字节; 版本 1 的记录只有前 64 字节)
+struct ManifestRecord {
+    uint32_t pathOffset;     // 在字符串表中的偏移
+    uint32_t pathLength;
+    uint32_t linkOffset;     // 符号链接目标 (非链接时长度为 0)
+    uint32_t linkLength;
+    uint8_t type;            // EntryType
+    uint8_t flags;           // RECORD_HAS_HASH | RECORD_HAS_ICON
+    uint16_t reserved;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint64_t size;
+    int64_t mtimeNs;
+    uint64_t contentHash;
+    int32_t iconX;
+    int32_t iconY;
+    uint64_t device;         // 冰冻时的设备号和 inode (版本 2 起)
+    uint64_t inode;
+};
+static_assert(sizeof(ManifestRecord) == 80, "ManifestRecord 必须为 80 字节");
+
+namespace {
+
+const char* CONTENT_MANIFEST_HEADER = "# desktop-snapshot content manifest v1";
+
+// 条目路径必须是目标根目录下的相对路径: 非空，不以 '/' 开头，各级名称非空且不是 "." 或 ".."，不含 NUL。
+// 清单位于用户可写的目录中，而开机恢复以 root 身份按清单创建和删除文件，其他路径一律视为损坏
+bool isSafeRelPath(std::string_view relPath) {
+    if (relPath.empty()) return false;
+    for (size_t start = 0;;) {
+        size_t slash = relPath.find('/', start);
+        std::string_view name = relPath.substr(start, slash == std::string_view::npos ? slash : slash - start);
+        if (name.empty() || name == "." || name == ".." || name.find('\0') != std::string_view::npos) return false;
+        if (slash == std::string_view::npos) return true;
+        start = slash + 1;
+    }
+}
+
+const char BINARY_MANIFEST_MAGIC[8] = {'D', 'S', 'N', 'A', 'P', 'M', 'F', '\0'};
+const uint8_t RECORD_HAS_HASH = 1;
+const uint8_t RECORD_HAS_ICON = 2;
+const uint32_t V1_RECORD_SIZE = 64;
+
+// 二进制清单的文件头 (64 字节)
+struct ManifestHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t entryCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t bodyHash;       // 文件头之后全部内容的 XXH3-64
+    uint8_t reserved[16];
+};
+static_assert(sizeof(ManifestHeader) == 64, "ManifestHeader 必须为 64 字节");
+
+// 解析 "x,y"
+bool parsePosition(const std::string& value, int32_t& x, int32_t& y) {
+    char* end = nullptr;
+    long px = std::strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != ',') return false;
+    const char* second = end + 1;
+    long py = std::strtol(second, &end, 10);
+    if (end == second || *end != '\0') return false;
+    x = (int32_t)px;
+    y = (int32_t)py;
+    return true;
+}
+
+std::string unescapeField(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '\\' && i + 1 < value.size()) {
+            char next = value[++i];
+            out += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            out += value[i];
+        }
+    }
+    return out;
+}
+
+bool charToType(const std::string& field, EntryType& type) {
+    if (field == "f") type = EntryType::Regular;
+    else if (field == "d") type = EntryType::Directory;
+    else if (field == "l") type = EntryType::Symlink;
+    else return false;
+    return true;
+}
+
+std::vector<std::string> splitTabs(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t pos = line.find('\t', start);
+        fields.push_back(line.substr(start, pos == std::string::npos ? std::string::npos : pos - start));
+        if (pos == std::string::npos) break;
+        start = pos + 1;
+    }
+    return fields;
+}
+
+} // namespace
+
+bool readContentManifest(const fs::path& path, std::vector<TreeEntry>& entries) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    std::string line;
+    if (!std::getline(in, line) || line != CONTENT_MANIFEST_HEADER) {
+        std::cerr << "  -> 错误: 无法识别的清单格式 " << path.string() << std::endl;
+        return false;
+    }
+
+    entries.clear();
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        std::vector<std::string> f = splitTabs(line);
+        TreeEntry e;
+        if (f.size() < 8 || !charToType(f[0], e.type)) {
+            std::cerr << "  -> 错误: 清单中存在损坏的行 " << path.string() << std::endl;
+            return false;
+        }
+        e.mode = (mode_t)std::strtoul(f[1].c_str(), nullptr, 8);
+        e.uid = (uid_t)std::strtoul(f[2].c_str(), nullptr, 10);
+        e.gid = (gid_t)std::strtoul(f[3].c_str(), nullptr, 10);
+        e.size = std::strtoull(f[4].c_str(), nullptr, 10);
+        e.mtimeNs = std::strtoll(f[5].c_str(), nullptr, 10);
+        if (f[6] != "-") {
+            e.hasContentHash = true;
+            e.contentHash = std::strtoull(f[6].c_str(), nullptr, 16);
+        }
+        e.relPath = unescapeField(f[7]);
+        if (!isSafeRelPath(e.relPath)) {
+            std::cerr << "  -> 错误: 清单中存在非法的路径 " << path.string() << std::endl;
+            return false;
+        }
+        if (e.type == EntryType::Symlink && f.size() > 8) e.linkTarget = unescapeField(f[8]);
+        entries.push_back(std::move(e));
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const TreeEntry& a, const TreeEntry& b) { return a.relPath < b.relPath; });
+    for (size_t i = 1; i < entries.size(); ++i) {
+        if (entries[i].relPath == entries[i - 1].relPath) {
+            std::cerr << "  -> 错误: 清单中存在重复的路径 " << path.string() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readIconManifest(const fs::path& path, std::unordered_map<std::string, std::string>& positions) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t delimiterPos = line.find('|');
+        if (delimiterPos == std::string::npos || delimiterPos + 1 == line.size()) continue;
+        positions[line.substr(0, delimiterPos)] = line.substr(delimiterPos + 1);
+    }
+    return true;
+}
+
+bool writeBinaryManifest(const fs::path& path, const std::vector<TreeEntry>& entries,
+                         const std::unordered_map<std::string, std::string>& iconPositions) {
+    std::vector<const TreeEntry*> sorted;
+    sorted.reserve(entries.size());
+    for (const auto& e : entries) {
+        if (e.type != EntryType::Other) sorted.push_back(&e);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const TreeEntry* a, const TreeEntry* b) { return a->relPath < b->relPath; });
+
+    std::vector<ManifestRecord> records(sorted.size());
+    std::string strings;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const TreeEntry& e = *sorted[i];
+        ManifestRecord& r = records[i];
+        std::memset(&r, 0, sizeof(r));
+        r.pathOffset = (uint32_t)strings.size();
+        r.pathLength = (uint32_t)e.relPath.size();
+        strings += e.relPath;
+        if (e.type == EntryType::Symlink) {
+            r.linkOffset = (uint32_t)strings.size();
+            r.linkLength = (uint32_t)e.linkTarget.size();
+            strings += e.linkTarget;
+        }
+        r.type = (uint8_t)e.type;
+        r.mode = e.mode;
+        r.uid = e.uid;
+        r.gid = e.gid;
+        r.size = e.size;
+        r.mtimeNs = e.mtimeNs;
+        r.device = e.device;
+        r.inode = e.inode;
+        if (e.hasContentHash) {
+            r.flags |= RECORD_HAS_HASH;
+            r.contentHash = e.contentHash;
+        }
+        auto icon = iconPositions.find(e.relPath);
+        if (icon != iconPositions.end() && parsePosition(icon->second, r.iconX, r.iconY)) r.flags |= RECORD_HAS_ICON;
+    }
+    if (strings.size() > UINT32_MAX) {
+        std::cerr << "  -> 错误: 清单路径总长度超出格式限制" << std::endl;
+        return false;
+    }
+
+    // 记录与字符串表连续存放，一起计算校验哈希
+    std::string body(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(ManifestRecord));
+    body += strings;
+
+    ManifestHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BINARY_MANIFEST_MAGIC, sizeof(header.magic));
+    header.version = BINARY_MANIFEST_VERSION;
+    header.recordSize = sizeof(ManifestRecord);
+    header.entryCount = records.size();
+    header.stringsOffset = sizeof(ManifestHeader) + records.size() * sizeof(ManifestRecord);
+    header.stringsSize = strings.size();
+    header.bodyHash = xxh3_64(body.data(), body.size());
+
+    body.insert(0, reinterpret_cast<const char*>(&header), sizeof(header));
+    return writeFileAtomically(path, body);
+}
+
+MappedManifest::~MappedManifest() {
+    close();
+}
+
+void MappedManifest::close() {
+    if (data_) munmap(data_, length_);
+    data_ = nullptr;
+    length_ = 0;
+    count_ = 0;
+    records_ = nullptr;
+    recordSize_ = 0;
+    strings_ = nullptr;
+}
+
+bool MappedManifest::open(const fs::path& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ManifestHeader)) {
+        ::close(fd);
+        return false;
+    }
+    size_t length = (size_t)st.st_size;
+    void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+
+    // 校验文件头、各段范围和内容哈希，任何不一致都视为损坏
+    const ManifestHeader* header = static_cast<const ManifestHeader*>(data);
+    const char* base = static_cast<const char*>(data);
+    uint32_t recordSize = 0;
+    if (std::memcmp(header->magic, BINARY_MANIFEST_MAGIC, sizeof(header->magic)) == 0) {
+        if (header->version == BINARY_MANIFEST_VERSION) recordSize = sizeof(ManifestRecord);
+        if (header->version == 1) recordSize = V1_RECORD_SIZE;
+    }
+    bool valid = recordSize != 0 && header->recordSize == recordSize &&
+                 header->entryCount <= (length - sizeof(ManifestHeader)) / recordSize &&
+                 header->stringsOffset == sizeof(ManifestHeader) + header->entryCount * recordSize &&
+                 header->stringsOffset + header->stringsSize == length &&
+                 xxh3_64(base + sizeof(ManifestHeader), length - sizeof(ManifestHeader)) == header->bodyHash;
+    // 路径必须安全且严格递增 (lowerBound 的二分查找和同步都依赖这一顺序)
+    const char* records = base + sizeof(ManifestHeader);
+    std::string_view previous;
+    for (uint64_t i = 0; valid && i < header->entryCount; ++i) {
+        const ManifestRecord& r = *reinterpret_cast<const ManifestRecord*>(records + i * recordSize);
+        valid = (uint64_t)r.pathOffset + r.pathLength <= header->stringsSize &&
+                (uint64_t)r.linkOffset + r.linkLength <= header->stringsSize &&
+                r.type <= (uint8_t)EntryType::Symlink;
+        if (!valid) break;
+        std::string_view relPath(base + header->stringsOffset + r.pathOffset, r.pathLength);
+        valid = isSafeRelPath(relPath) && (i == 0 || previous < relPath);
+        previous = relPath;
+    }
+    if (!valid) {
+        munmap(data, length);
+        std::cerr << "  -> 错误: 清单已损坏或版本不受支持 " << path.string() << std::endl;
+        return false;
+    }
+
+    data_ = data;
+    length_ = length;
+    count_ = (size_t)header->entryCount;
+    records_ = records;
+    recordSize_ = recordSize;
+    strings_ = base + header->stringsOffset;
+    return true;
+}
+
+const ManifestRecord& MappedManifest::record(size_t i) const {
+    return *reinterpret_cast<const ManifestRecord*>(records_ + i * recordSize_);
+}
+
+std::string_view MappedManifest::relPath(size_t i) const {
+    const ManifestRecord& r = record(i);
+    return std::string_view(strings_ + r.pathOffset, r.pathLength);
+}
+
+TreeEntry MappedManifest::entry(size_t i) const {
+    const ManifestRecord& r = record(i);
+    TreeEntry e;
+    e.relPath.assign(strings_ + r.pathOffset, r.pathLength);
+    e.type = (EntryType)r.type;
+    e.mode = r.mode;
+    e.uid = r.uid;
+    e.gid = r.gid;
+    e.size = r.size;
+    e.mtimeNs = r.mtimeNs;
+    if (r.linkLength > 0) e.linkTarget.assign(strings_ + r.linkOffset, r.linkLength);
+    e.hasContentHash = (r.flags & RECORD_HAS_HASH) != 0;
+    e.contentHash = r.contentHash;
+    if (recordSize_ >= sizeof(ManifestRecord)) {
+        e.device = r.device;
+        e.inode = r.inode;
+    }
+    return e;
+}
+
+bool MappedManifest::iconPosition(size_t i, std::string& position) const {
+    const ManifestRecord& r = record(i);
+    if (!(r.flags & RECORD_HAS_ICON)) return false;
+    position = std::to_string(r.iconX) + "," + std::to_string(r.iconY);
+    return true;
+}
+
+size_t MappedManifest::lowerBound(std::string_view key) const {
+    size_t low = 0;
+    size_t high = count_;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (relPath(mid) < key) low = mid + 1; else high = mid;
+    }
+    return low;
+}
@@ -0,0 +1,99 @@
+#ifndef SNAPSHOT_MANIFEST_H
+#define SNAPSHOT_MANIFEST_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include "tree_sync.h"
+
+/**
+ * 快照清单。当前版本为二进制清单 (manifest.bin)，每个目标一份，冰冻时写入，恢复时只读映射:
+ *
+ *   [文件头 64 字节][条目记录 80 字节 x N (按 relPath 排序)][字符串表]
+ *
+ * 条目记录包含路径、类型、权限、uid/gid、大小、mtime、内容哈希、可选的图标位置以及冰冻时的
+ * 设备号和 inode (恢复时据此找回被移动的文件)，路径和链接目标存放在字符串表中。文件头中的 bodyHash 是记录与字符串表的 XXH3-64，
+ * 打开时校验。整数均为小端序。
+ *
+ * 版本 1 的二进制清单 (64 字节的记录，没有设备号和 inode) 仍可读取。旧版本的文本清单也仍可读取:
+ *   content.manifest  每行一个条目，字段以 '\t' 分隔:
+ *                     类型(f/d/l) 权限(八进制) uid gid 大小 mtime(纳秒) 哈希(或 '-') 相对路径 [链接目标]
+ *   snapshot.manifest 每行 "桌面文件名|x,y"
+ */
+
+// 二进制清单的格式版本
+const uint32_t BINARY_MANIFEST_VERSION = 2;
+
+/**
+ * @brief 写入二进制清单 (先写临时文件再重命名，保证原子性)。
+ * @param entries 条目 (无需排序，类型为 Other 的条目被忽略)。
+ * @param iconPositions relPath -> "x,y"，记录到对应条目上。
+ * @return true 表示成功。
+ */
+bool writeBinaryManifest(const std::filesystem::path& path, const std::vector<TreeEntry>& entries,
+                         const std::unordered_map<std::string, std::string>& iconPositions);
+
+struct ManifestRecord;
+
+/**
+ * 只读映射的二进制清单。打开后可按下标或路径直接访问条目，不需要解析整个文件。
+ */
+class MappedManifest {
+public:
+    MappedManifest() = default;
+    ~MappedManifest();
+    MappedManifest(const MappedManifest&) = delete;
+    MappedManifest& operator=(const MappedManifest&) = delete;
+
+    /**
+     * @brief 映射并校验清单文件。
+     * @return true 表示成功, false 表示文件不存在、版本不支持或内容损坏。
+     */
+    bool open(const std::filesystem::path& path);
+
+    bool isOpen() const { return data_ != nullptr; }
+    size_t size() const { return count_; }
+
+    // 第 i 个条目的相对路径 (指向映射内存，清单关闭前有效)
+    std::string_view relPath(size_t i) const;
+
+    // 第 i 个条目的完整元数据 (sourcePath 为空，由调用方指向 blob)
+    TreeEntry entry(size_t i) const;
+
+    // 第 i 个条目的图标位置 ("x,y")，没有记录时返回 false
+    bool iconPosition(size_t i, std::string& position) const;
+
+    // 第一个 relPath >= key 的条目下标
+    size_t lowerBound(std::string_view key) const;
+
+private:
+    void close();
+    // 第 i 条记录 (版本 1 的记录较短，不能访问其中的 device 和 inode)
+    const ManifestRecord& record(size_t i) const;
+
+    void* data_ = nullptr;
+    size_t length_ = 0;
+    size_t count_ = 0;
+    const char* records_ = nullptr;
+    size_t recordSize_ = 0;
+    const char* strings_ = nullptr;
+};
+
+/**
+ * @brief 读取文本格式的内容清单 (旧版 content.manifest)。
+ *        返回的条目按 relPath 排序，sourcePath 为空 (由调用方指向 blob)。
+ * @return true 表示成功, false 表示文件不存在或格式错误。
+ */
+bool readContentManifest(const std::filesystem::path& path, std::vector<TreeEntry>& entries);
+
+/**
+ * @brief 读取文本格式的图标清单 (旧版 snapshot.manifest)。
+ * @param positions 输出: 桌面文件名 -> "x,y" (位置为空的行不出现在结果中)。
+ * @return true 表示文件可以打开。
+ */
+bool readIconManifest(const std::filesystem::path& path, std::unordered_map<std::string, std::string>& positions);
+
+#endif // SNAPSHOT_MANIFEST_H
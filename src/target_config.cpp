@@ -0,0 +1,189 @@
+#include "target_config.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 配置文件的上限，防止读入异常大的文件
+const off_t MAX_CONFIG_SIZE = 1 << 20;
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+bool hasParentReference(const std::string& path) {
+    size_t begin = 0;
+    while (begin <= path.size()) {
+        size_t slash = path.find('/', begin);
+        if (slash == std::string::npos) slash = path.size();
+        if (path.compare(begin, slash - begin, "..") == 0 && slash - begin == 2) return true;
+        begin = slash + 1;
+    }
+    return false;
+}
+
+// 规范化文件夹路径 (去掉重复和结尾的 '/')，不合法时返回空字符串
+std::string normalizeFolder(const std::string& value, bool absolute) {
+    if (value.empty() || (value[0] == '/') != absolute || hasParentReference(value)) return "";
+    std::string result;
+    for (char c : value) {
+        if (c == '/' && !result.empty() && result.back() == '/') continue;
+        result += c;
+    }
+    while (result.size() > 1 && result.back() == '/') result.pop_back();
+    if (result == "/" || result == ".") return "";
+    return result;
+}
+
+bool isNested(const std::string& a, const std::string& b) {
+    const std::string& shorter = a.size() <= b.size() ? a : b;
+    const std::string& longer = a.size() <= b.size() ? b : a;
+    return longer.compare(0, shorter.size(), shorter) == 0 &&
+           (longer.size() == shorter.size() || longer[shorter.size()] == '/');
+}
+
+// 读取配置文件，文件必须为 owner 所有 (SUID 运行时防止借配置文件读取其他文件)
+bool readConfigFile(const fs::path& file, uid_t owner, std::string& text) {
+    int fd = open(file.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT && errno != ENOTDIR) {
+            std::cerr << "  -> 警告: 无法读取配置文件 " << file.string() << ": " << strerror(errno) << std::endl;
+        }
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > MAX_CONFIG_SIZE ||
+        st.st_uid != owner) {
+        std::cerr << "  -> 警告: 已忽略配置文件 " << file.string() << " (不是普通文件、拥有者不符或过大)" << std::endl;
+        close(fd);
+        return false;
+    }
+    char buffer[8192];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) text.append(buffer, (size_t)n);
+    close(fd);
+    return n == 0;
+}
+
+/**
+ * @brief 把一个配置文件应用到 config 上。
+ * @param system 是否为系统配置 (只有系统配置可以设置系统目录)。
+ */
+void applyConfig(const std::string& text, const fs::path& file, bool system, const std::vector<std::string>& targets,
+                 TargetConfig& config) {
+    std::string section;
+    bool homeReplaced = false, launcherReplaced = false, systemReplaced = false;
+    size_t lineNumber = 0;
+    size_t begin = 0;
+    auto warn = [&](const char* reason) {
+        std::cerr << "  -> 警告: " << file.string() << " 第 " << lineNumber << " 行" << reason << "，已忽略。"
+                  << std::endl;
+    };
+    // 每个目标只替换一次列表，后续的同名键追加
+    auto addFolder = [&](std::vector<std::string>& list, bool& replaced, const std::string& value, bool absolute) {
+        std::string folder = normalizeFolder(value, absolute);
+        if (folder.empty()) return warn(absolute ? ": 需要绝对路径" : ": 需要 HOME 下的相对路径");
+        if (!replaced) {
+            list.clear();
+            replaced = true;
+        }
+        for (const auto& existing : list) {
+            if (isNested(existing, folder)) return warn(": 目录与已配置的目录重叠");
+        }
+        list.push_back(folder);
+    };
+    auto filtersFor = [&](const std::string& name) {
+        std::vector<PathFilter*> result;
+        for (const auto& target : targets) {
+            if (name == "global" || name == target) result.push_back(&config.filters[target]);
+        }
+        return result;
+    };
+
+    while (begin < text.size()) {
+        size_t end = text.find('\n', begin);
+        if (end == std::string::npos) end = text.size();
+        std::string line = trim(text.substr(begin, end - begin));
+        begin = end + 1;
+        lineNumber++;
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+        if (line.front() == '[') {
+            if (line.back() != ']') {
+                warn(": 节名格式错误");
+                section = "?";
+                continue;
+            }
+            section = trim(line.substr(1, line.size() - 2));
+            if (section != "global" && std::find(targets.begin(), targets.end(), section) == targets.end()) {
+                warn(": 未知的节");
+                section = "?";
+            }
+            continue;
+        }
+        if (section == "?") continue;
+        size_t equals = line.find('=');
+        if (equals == std::string::npos || section.empty()) {
+            warn(": 需要在节中使用 '键 = 值' 格式");
+            continue;
+        }
+        std::string key = trim(line.substr(0, equals));
+        std::string value = trim(line.substr(equals + 1));
+
+        if (key == "include" || key == "exclude") {
+            PathFilter probe;
+            if (!probe.addRule(value, key == "include")) {
+                warn(": 模式不合法");
+                continue;
+            }
+            for (auto* filter : filtersFor(section)) filter->addRule(value, key == "include");
+        } else if (key == "max_file_size") {
+            uint64_t bytes = 0;
+            if (!parseByteSize(value, bytes)) {
+                warn(": 大小格式不合法");
+                continue;
+            }
+            for (auto* filter : filtersFor(section)) filter->setMaxFileSize(bytes);
+        } else if (key == "folder" && section == "home_folders") {
+            addFolder(config.homeFolders, homeReplaced, value, false);
+        } else if (key == "launcher" && section == "desktop") {
+            addFolder(config.launcherFolders, launcherReplaced, value, false);
+        } else if (key == "system" && section == "desktop") {
+            if (!system) {
+                warn(": 系统目录只能在系统配置中设置");
+                continue;
+            }
+            addFolder(config.systemFolders, systemReplaced, value, true);
+        } else {
+            warn(": 未知的键");
+        }
+    }
+}
+
+} // namespace
+
+const PathFilter* TargetConfig::filterFor(const std::string& target) const {
+    auto it = filters.find(target);
+    return it == filters.end() || it->second.empty() ? nullptr : &it->second;
+}
+
+TargetConfig loadTargetConfig(const TargetConfig& defaults, const std::vector<std::string>& targets,
+                              const fs::path& systemFile, const fs::path& userFile, uid_t userUid) {
+    TargetConfig config = defaults;
+    std::string text;
+    if (readConfigFile(systemFile, 0, text)) applyConfig(text, systemFile, true, targets, config);
+    text.clear();
+    if (!userFile.empty() && readConfigFile(userFile, userUid, text)) {
+        applyConfig(text, userFile, false, targets, config);
+    }
+    return config;
+}
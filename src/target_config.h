@@ -0,0 +1,54 @@
+#ifndef TARGET_CONFIG_H
+#define TARGET_CONFIG_H
+
+#include "path_filter.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <filesystem>
+#include <sys/types.h>
+
+/**
+ * 冰冻目标的配置: 每个目标包含哪些目录，以及目录中哪些条目不受快照管理。
+ *
+ * 配置文件为 INI 格式，'#' 或 ';' 开头的行是注释，可以有以下几节:
+ *
+ *   [global]                   # 对所有目标生效的规则
+ *   exclude = .cache
+ *   exclude = *.tmp
+ *   max_file_size = 512M       # 超过此大小的普通文件不冰冻
+ *
+ *   [home_folders]
+ *   folder = Documents         # 出现 folder 时替换默认的文件夹列表 (HOME 下的相对路径)
+ *   folder = Projects
+ *   exclude = node_modules/
+ *   include = important.tmp    # 重新包含前面规则排除的条目
+ *
+ *   [desktop]
+ *   launcher = .config/dde-launcher   # 替换默认的启动器配置目录列表 (HOME 下的相对路径)
+ *   system = /usr/share/applications  # 替换默认的系统目录列表 (绝对路径，只能在系统配置中设置)
+ *
+ * 规则的写法见 path_filter.h，模式相对于目标中的每个目录匹配。各文件的规则按出现顺序追加
+ * ([global] 中的规则追加到所有目标)，后面的规则优先。被排除的条目不冰冻，恢复时也不删除、不修改。
+ */
+struct TargetConfig {
+    std::vector<std::string> homeFolders;       // home_folders 目标的用户文件夹 (HOME 下的相对路径)
+    std::vector<std::string> launcherFolders;   // desktop 目标的启动器和任务栏配置目录 (HOME 下的相对路径)
+    std::vector<std::string> systemFolders;     // desktop 目标的系统目录 (绝对路径)
+    std::map<std::string, PathFilter> filters;  // 目标名 -> 已编译的规则
+
+    // 目标的规则，没有任何规则时返回 nullptr
+    const PathFilter* filterFor(const std::string& target) const;
+};
+
+/**
+ * @brief 以 defaults 为基础，依次应用系统配置 systemFile 和用户配置 userFile (不存在的文件跳过)。
+ *        系统配置必须属于 root，用户配置必须属于 userUid (都不跟随符号链接)，且用户配置不能设置系统目录。
+ *        无法解析的行打印警告 (只给出行号) 后忽略。
+ * @param targets 可以设置规则的目标名。
+ */
+TargetConfig loadTargetConfig(const TargetConfig& defaults, const std::vector<std::string>& targets,
+                              const std::filesystem::path& systemFile, const std::filesystem::path& userFile,
+                              uid_t userUid);
+
+#endif // TARGET_CONFIG_H
@@ -0,0 +1,220 @@
+#include "thread_pool.h"
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::mutex g_poolMutex;
+size_t g_requestedWorkers = 0;   // 0 表示使用 CPU 核心数
+
+} // namespace
+
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(size_t workers) {
+        for (size_t i = 0; i < workers; ++i) queues_.emplace_back(new Queue());
+        for (size_t i = 0; i < workers; ++i) threads_.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    size_t size() const { return threads_.size(); }
+
+    // 当前线程若是本线程池的工作线程，返回其序号，否则返回 -1
+    int currentWorker() const { return t_pool == this ? t_index : -1; }
+
+    void submit(TaskGroup* group, std::function<void()> fn) {
+        int self = currentWorker();
+        size_t index = self >= 0 ? (size_t)self : nextQueue_++ % queues_.size();
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(Task{group, std::move(fn)});
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            queued_++;
+        }
+        wake_.notify_one();
+    }
+
+    // 取出并执行一个任务 (自己的队列优先，其次窃取)，没有可执行的任务时返回 false
+    bool runOne(size_t index) {
+        Task task;
+        if (!popOwn(index, task) && !steal(index, task)) return false;
+        execute(task);
+        return true;
+    }
+
+private:
+    struct Task {
+        TaskGroup* group = nullptr;
+        std::function<void()> fn;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static thread_local const WorkStealingPool* t_pool;
+    static thread_local int t_index;
+
+    bool popOwn(size_t index, Task& task) {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        auto& tasks = queues_[index]->tasks;
+        if (tasks.empty()) return false;
+        task = std::move(tasks.back());
+        tasks.pop_back();
+        queued_--;
+        return true;
+    }
+
+    bool steal(size_t index, Task& task) {
+        for (size_t offset = 1; offset < queues_.size(); ++offset) {
+            Queue& victim = *queues_[(index + offset) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_--;
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Task& task) {
+        try {
+            task.fn();
+        } catch (const std::exception& e) {
+            std::cerr << "  -> 警告: 并行任务失败: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "  -> 警告: 并行任务失败 (未知异常)" << std::endl;
+        }
+        task.group->taskFinished();
+    }
+
+    void workerLoop(size_t index) {
+        t_pool = this;
+        t_index = (int)index;
+        while (true) {
+            if (runOne(index)) continue;
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+            if (stop_ && queued_ == 0) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> nextQueue_{0};
+    bool stop_ = false;
+};
+
+thread_local const WorkStealingPool* WorkStealingPool::t_pool = nullptr;
+thread_local int WorkStealingPool::t_index = -1;
+
+namespace {
+
+std::shared_ptr<WorkStealingPool> g_pool;
+
+// 取得共享线程池; 线程数变化时重建 (仍在使用旧线程池的任务组持有其引用)
+std::shared_ptr<WorkStealingPool> sharedPool() {
+    size_t workers = getWorkerCount();
+    if (workers <= 1) return nullptr;
+    std::lock_guard<std::mutex> lock(g_poolMutex);
+    if (!g_pool || g_pool->size() != workers) {
+        g_pool = std::make_shared<WorkStealingPool>(workers);
+    }
+    return g_pool;
+}
+
+} // namespace
+
+void setWorkerCount(size_t count) {
+    std::lock_guard<std::mutex> lock(g_poolMutex);
+    g_requestedWorkers = count;
+}
+
+void restartWorkers() {
+    std::shared_ptr<WorkStealingPool> old;
+    {
+        std::lock_guard<std::mutex> lock(g_poolMutex);
+        old.swap(g_pool);
+    }
+    // 旧线程池在锁外析构 (等待其线程退出)
+}
+
+size_t getWorkerCount() {
+    size_t requested;
+    {
+        std::lock_guard<std::mutex> lock(g_poolMutex);
+        requested = g_requestedWorkers;
+    }
+    if (requested > 0) return requested;
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+}
+
+TaskGroup::TaskGroup() : pool_(sharedPool()) {}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    if (!pool_) {
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "  -> 警告: 任务失败: " << e.what() << std::endl;
+        }
+        return;
+    }
+    pending_++;
+    pool_->submit(this, std::move(task));
+}
+
+void TaskGroup::wait() {
+    if (!pool_) return;
+    int self = pool_->currentWorker();
+    if (self >= 0) {
+        // 在工作线程中等待: 边等边执行任务，避免所有工作线程都阻塞导致死锁
+        while (pending_ > 0) {
+            if (!pool_->runOne((size_t)self)) std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);   // 等待最后一个任务退出 taskFinished
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void TaskGroup::taskFinished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) done_.notify_all();
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) return;
+    TaskGroup group;
+    size_t workers = getWorkerCount();
+    size_t chunk = workers <= 1 ? count : std::max<size_t>(1, count / (workers * 8));
+    for (size_t begin = 0; begin < count; begin += chunk) {
+        size_t end = std::min(count, begin + chunk);
+        group.run([&fn, begin, end] {
+            for (size_t i = begin; i < end; ++i) fn(i);
+        });
+    }
+    group.wait();
+}
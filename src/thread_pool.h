@@ -0,0 +1,68 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * 工作窃取线程池。每个工作线程有自己的双端队列: 自己从尾部取 (LIFO，利于缓存)，
+ * 空闲时从其他线程的头部窃取 (FIFO，优先拿到较大的子树)。
+ * 线程池在进程内共享，由 TaskGroup 提交任务并等待完成。
+ */
+
+class WorkStealingPool;
+
+/**
+ * @brief 设置并行复制使用的工作线程数。
+ * @param count 0 表示使用 CPU 核心数; 1 表示完全串行执行。
+ */
+void setWorkerCount(size_t count);
+
+// 返回当前生效的工作线程数 (已将 0 解析为核心数)
+size_t getWorkerCount();
+
+/**
+ * @brief 丢弃当前的工作线程，下次提交任务时重新创建。
+ *        新线程从调用线程派生，继承其调度优先级 (nice 和 I/O 优先级)，
+ *        用于切换到后台低优先级执行。调用时不应有正在执行的任务组。
+ */
+void restartWorkers();
+
+/**
+ * @brief 一组可以派生子任务的并行任务。
+ *        wait() 返回时，组内所有任务 (包括任务中再提交的任务) 均已完成。
+ *        工作线程数为 1 时任务在调用线程上立即执行，行为与串行代码完全相同。
+ */
+class TaskGroup {
+public:
+    TaskGroup();
+    ~TaskGroup();
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // 提交一个任务 (可在组内其他任务中调用)
+    void run(std::function<void()> task);
+
+    // 等待组内所有任务完成。若在工作线程中调用，等待期间会帮助执行其他任务
+    void wait();
+
+private:
+    friend class WorkStealingPool;
+    void taskFinished();
+
+    std::shared_ptr<WorkStealingPool> pool_;   // 为空表示串行执行
+    std::atomic<size_t> pending_{0};
+    std::mutex mutex_;
+    std::condition_variable done_;
+};
+
+/**
+ * @brief 并行执行 fn(0) ... fn(count - 1)，全部完成后返回。
+ */
+void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+#endif // THREAD_POOL_H
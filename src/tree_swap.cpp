@@ -0,0 +1,219 @@
+#include "tree_swap.h"
+#include "restore_scheduler.h"
+#include <iostream>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+
+namespace fs = std::filesystem;
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+namespace {
+
+const char* STAGING_SUFFIX = ".snapshot-staging";
+const char* OLD_TREE_INFIX = ".snapshot-old.";
+// 暂存前要求文件系统在新树之外至少还剩的空间
+const uint64_t SPACE_RESERVE = 64ULL << 20;
+
+/**
+ * 后台回收线程: 按提交顺序删除换下来的旧树。线程在第一次提交时以低优先级启动，
+ * 进程退出时析构函数等待队列清空。
+ */
+class TreeReaper {
+public:
+    ~TreeReaper() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+            stop_ = true;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    void submit(const fs::path& dir) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(dir);
+            if (!thread_.joinable()) thread_ = std::thread([this] { run(); });
+        }
+        wake_.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    }
+
+private:
+    void run() {
+        applyBackgroundPriority();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) break;
+            fs::path dir = queue_.front();
+            queue_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            std::error_code ec;
+            fs::remove_all(dir, ec);
+            if (ec) std::cerr << "  -> 警告: 无法删除旧目录 '" << dir.string() << "': " << ec.message() << std::endl;
+
+            lock.lock();
+            busy_ = false;
+            if (queue_.empty()) idle_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::deque<fs::path> queue_;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+TreeReaper& reaper() {
+    static TreeReaper instance;
+    return instance;
+}
+
+fs::path stagingPathFor(const fs::path& liveDir) {
+    return liveDir.parent_path() / ("." + liveDir.filename().string() + STAGING_SUFFIX);
+}
+
+// 旧树在回收前使用的唯一名称
+fs::path oldTreePathFor(const fs::path& liveDir) {
+    static std::atomic<unsigned> counter{0};
+    return liveDir.parent_path() / ("." + liveDir.filename().string() + OLD_TREE_INFIX +
+                                    std::to_string(getpid()) + "." + std::to_string(counter++));
+}
+
+// 改名后交给后台回收; 改名失败时直接回收原路径
+void retireTree(const fs::path& dir, const fs::path& liveDir) {
+    fs::path oldPath = oldTreePathFor(liveDir);
+    if (rename(dir.c_str(), oldPath.c_str()) == 0) {
+        reaper().submit(oldPath);
+    } else {
+        reaper().submit(dir);
+    }
+}
+
+// 回收以前中断的恢复留下的暂存目录和旧树
+void reapLeftovers(const fs::path& liveDir) {
+    std::string stagingName = stagingPathFor(liveDir).filename().string();
+    std::string oldPrefix = "." + liveDir.filename().string() + OLD_TREE_INFIX;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(liveDir.parent_path(), ec)) {
+        std::string name = entry.path().filename().string();
+        if (name == stagingName) {
+            retireTree(entry.path(), liveDir);
+        } else if (name.compare(0, oldPrefix.size(), oldPrefix) == 0) {
+            reaper().submit(entry.path());
+        }
+    }
+}
+
+} // namespace
+
+bool createStagingDir(const fs::path& liveDir, fs::path& stagingDir) {
+    reapLeftovers(liveDir);
+    stagingDir = stagingPathFor(liveDir);
+    if (mkdir(stagingDir.c_str(), 0700) != 0) {
+        std::cerr << "  -> 警告: 无法创建暂存目录 '" << stagingDir.string() << "': " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool prepareStagingDir(const fs::path& liveDir, uint64_t requiredBytes, fs::path& stagingDir) {
+    fs::path parent = liveDir.parent_path();
+    struct stat liveStat, parentStat;
+    if (parent.empty() || lstat(liveDir.c_str(), &liveStat) != 0 || !S_ISDIR(liveStat.st_mode) ||
+        stat(parent.c_str(), &parentStat) != 0) {
+        return false;
+    }
+    // 挂载点无法与同级目录交换
+    if (liveStat.st_dev != parentStat.st_dev) return false;
+
+    struct statvfs fsStat;
+    if (statvfs(parent.c_str(), &fsStat) == 0 &&
+        (uint64_t)fsStat.f_bavail * fsStat.f_frsize < requiredBytes + SPACE_RESERVE) {
+        std::cerr << "  -> 警告: '" << parent.string() << "' 所在文件系统空间不足，改为原地恢复。" << std::endl;
+        return false;
+    }
+
+    if (!createStagingDir(liveDir, stagingDir)) {
+        std::cerr << "  -> 警告: 改为原地恢复。" << std::endl;
+        return false;
+    }
+    // 交换后暂存目录成为目标目录本身，沿用原目录的拥有者和权限
+    if ((liveStat.st_uid != getuid() || liveStat.st_gid != getgid()) &&
+        chown(stagingDir.c_str(), liveStat.st_uid, liveStat.st_gid) != 0) {
+        std::cerr << "  -> 警告: 无法设置暂存目录的拥有者，改为原地恢复。" << std::endl;
+        rmdir(stagingDir.c_str());
+        return false;
+    }
+    chmod(stagingDir.c_str(), liveStat.st_mode & 07777);
+    return true;
+}
+
+bool swapInStagedTree(const fs::path& liveDir, const fs::path& stagingDir) {
+    struct stat liveStat;
+    if (lstat(liveDir.c_str(), &liveStat) != 0 && errno == ENOENT) {
+        if (rename(stagingDir.c_str(), liveDir.c_str()) == 0) return true;
+        std::cerr << "  -> 警告: 无法发布 '" << liveDir.string() << "': " << std::strerror(errno) << std::endl;
+        discardStagedTree(liveDir, stagingDir);
+        return false;
+    }
+    if (syscall(SYS_renameat2, AT_FDCWD, stagingDir.c_str(), AT_FDCWD, liveDir.c_str(), RENAME_EXCHANGE) == 0) {
+        // 交换后暂存路径上是旧树
+        retireTree(stagingDir, liveDir);
+        return true;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        std::cerr << "  -> 警告: 无法交换 '" << liveDir.string() << "': " << std::strerror(errno) << std::endl;
+        discardStagedTree(liveDir, stagingDir);
+        return false;
+    }
+
+    // 内核或文件系统不支持 RENAME_EXCHANGE: 先移走旧树，再把新树改名过去
+    fs::path oldPath = oldTreePathFor(liveDir);
+    if (rename(liveDir.c_str(), oldPath.c_str()) != 0) {
+        std::cerr << "  -> 警告: 无法移走 '" << liveDir.string() << "': " << std::strerror(errno) << std::endl;
+        discardStagedTree(liveDir, stagingDir);
+        return false;
+    }
+    if (rename(stagingDir.c_str(), liveDir.c_str()) != 0) {
+        std::cerr << "  -> 警告: 无法替换 '" << liveDir.string() << "': " << std::strerror(errno) << std::endl;
+        rename(oldPath.c_str(), liveDir.c_str());
+        discardStagedTree(liveDir, stagingDir);
+        return false;
+    }
+    reaper().submit(oldPath);
+    return true;
+}
+
+void discardStagedTree(const fs::path& liveDir, const fs::path& stagingDir) {
+    retireTree(stagingDir, liveDir);
+}
+
+void waitForReaper() {
+    reaper().wait();
+}
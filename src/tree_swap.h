@@ -0,0 +1,49 @@
+#ifndef TREE_SWAP_H
+#define TREE_SWAP_H
+
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * 原子替换目录树。新树先在与目标同级的暂存目录 (.<名称>.snapshot-staging) 中完整建好，
+ * 再用 renameat2(RENAME_EXCHANGE) 与目标目录一次交换，目标路径在任何时刻都指向一棵完整的树。
+ * 换下来的旧树改名为 .<名称>.snapshot-old.<pid>.<序号> 后交给后台回收线程删除，不占用恢复的关键路径;
+ * 进程中途退出留下的暂存目录和旧树会在下次准备同一目标时一并回收。
+ */
+
+/**
+ * @brief 为 liveDir 准备一个空的暂存目录，并复制 liveDir 的权限和拥有者。
+ * @param liveDir 要替换的目录 (必须是真实目录，不是挂载点或符号链接)。
+ * @param requiredBytes 新树大约需要的空间，文件系统剩余空间不足时放弃暂存。
+ * @param stagingDir 输出: 暂存目录的路径。
+ * @return true 表示可以原子替换; false 表示调用方应退回原地恢复。
+ */
+bool prepareStagingDir(const std::filesystem::path& liveDir, uint64_t requiredBytes,
+                       std::filesystem::path& stagingDir);
+
+/**
+ * @brief 为 liveDir 创建一个空的暂存目录 (权限 0700)，liveDir 可以尚不存在。
+ *        先回收以前中断留下的暂存目录和旧树。
+ * @return true 表示成功。
+ */
+bool createStagingDir(const std::filesystem::path& liveDir, std::filesystem::path& stagingDir);
+
+/**
+ * @brief 将暂存目录与 liveDir 交换，并把换下来的旧树交给后台回收。
+ *        liveDir 不存在时直接改名发布; 文件系统不支持 RENAME_EXCHANGE 时退回两次 rename
+ *        (目标路径会短暂不存在，但不会出现半成品)。
+ * @return true 表示成功; 失败时 liveDir 保持原样，暂存目录被回收。
+ */
+bool swapInStagedTree(const std::filesystem::path& liveDir, const std::filesystem::path& stagingDir);
+
+/**
+ * @brief 放弃 liveDir 的暂存目录 (例如构建失败)，交给后台回收。
+ */
+void discardStagedTree(const std::filesystem::path& liveDir, const std::filesystem::path& stagingDir);
+
+/**
+ * @brief 等待后台回收线程删除完所有已提交的目录树。进程退出时也会自动等待。
+ */
+void waitForReaper();
+
+#endif // TREE_SWAP_H
@@ -0,0 +1,769 @@
+#include "tree_sync.h"
+#include "content_hash.h"
+#include "copy_engine.h"
+#include "thread_pool.h"
+#include "uring_copy.h"
+#include "async_operation.h"
+#include "path_filter.h"
+#include "block_table.h"
+#include <iostream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 跟随符号链接时的最大递归深度，防止链接成环
+const int MAX_SCAN_DEPTH = 64;
+
+int64_t toNanoseconds(const struct timespec& ts) {
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+EntryType typeFromMode(mode_t mode) {
+    if (S_ISREG(mode)) return EntryType::Regular;
+    if (S_ISDIR(mode)) return EntryType::Directory;
+    if (S_ISLNK(mode)) return EntryType::Symlink;
+    return EntryType::Other;
+}
+
+void fillFromStat(TreeEntry& entry, const struct stat& st) {
+    entry.type = typeFromMode(st.st_mode);
+    entry.mode = st.st_mode & 07777;
+    entry.uid = st.st_uid;
+    entry.gid = st.st_gid;
+    entry.size = entry.type == EntryType::Regular ? (uint64_t)st.st_size : 0;
+    entry.mtimeNs = toNanoseconds(st.st_mtim);
+    entry.device = (uint64_t)st.st_dev;
+    entry.inode = (uint64_t)st.st_ino;
+}
+
+// 列出单个目录的条目，子目录交给 onSubdirectory 继续处理 (可能在其他线程上)
+// 被 filter 排除的条目直接跳过，被排除的目录因此不会再被枚举
+void scanDirectory(const fs::path& dir, const std::string& relPrefix, bool dereference, int depth,
+                   const PathFilter* filter, std::vector<TreeEntry>& out,
+                   const std::function<void(const fs::path&, const std::string&, int)>& onSubdirectory) {
+    if (depth > MAX_SCAN_DEPTH) {
+        std::cerr << "  -> 警告: 目录层级过深，已跳过 " << dir.string() << std::endl;
+        return;
+    }
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(dir, ec)) {
+        const fs::path& path = item.path();
+        TreeEntry entry;
+        entry.relPath = relPrefix.empty() ? path.filename().string()
+                                          : relPrefix + "/" + path.filename().string();
+        entry.sourcePath = path;
+
+        struct stat st;
+        bool ok = dereference ? (stat(path.c_str(), &st) == 0) : false;
+        if (!ok && lstat(path.c_str(), &st) != 0) continue;
+        fillFromStat(entry, st);
+        if (filter && filter->excludes(entry.relPath, entry.type == EntryType::Directory, entry.size)) continue;
+
+        if (entry.type == EntryType::Symlink) {
+            std::error_code linkEc;
+            entry.linkTarget = fs::read_symlink(path, linkEc).string();
+        }
+        if (entry.type == EntryType::Directory) {
+            onSubdirectory(path, entry.relPath, depth + 1);
+        }
+        out.push_back(std::move(entry));
+    }
+    if (ec) {
+        std::cerr << "  -> 警告: 无法读取目录 " << dir.string() << ": " << ec.message() << std::endl;
+    }
+}
+
+bool isInside(const std::string& path, const std::string& dir) {
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+}
+
+// 按 relPath 字典序遍历时，path 是否已排在 dir 的整个子树之后。
+// '.' '-' ' ' 等字符排在 '/' 之前，"a.zip" 位于 "a" 和 "a/b" 之间，不能因为遇到它就认为 "a" 的子树已结束
+bool pastSubtree(const std::string& path, const std::string& dir) {
+    int c = path.compare(0, dir.size(), dir);
+    if (c != 0) return c > 0;
+    return path.size() > dir.size() && path[dir.size()] > '/';
+}
+
+void applyOwnership(const fs::path& path, const SyncOptions& options) {
+    if (options.ownerUid != (uid_t)-1) {
+        lchown(path.c_str(), options.ownerUid, options.ownerGid);
+    }
+}
+
+void fillMtime(struct timespec times[2], int64_t mtimeNs) {
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = mtimeNs / 1000000000LL;
+    times[1].tv_nsec = mtimeNs % 1000000000LL;
+}
+
+/**
+ * 目标中一个条目的位置: 父目录 fd + 文件名。所有创建和属性修改都相对于父目录 fd 完成，
+ * 不再逐个从 '/' 解析完整路径; path 只用于提示信息、内容哈希和少数整树删除。
+ */
+struct DestRef {
+    int dirFd;
+    std::string name;
+    fs::path path;
+};
+
+[[noreturn]] void throwErrno(const char* what, const fs::path& path) {
+    throw fs::filesystem_error(what, path, std::error_code(errno, std::generic_category()));
+}
+
+void applyOwnershipAt(const DestRef& dest, const SyncOptions& options) {
+    if (options.ownerUid != (uid_t)-1) {
+        fchownat(dest.dirFd, dest.name.c_str(), options.ownerUid, options.ownerGid, AT_SYMLINK_NOFOLLOW);
+    }
+}
+
+void applyMtimeAt(const DestRef& dest, int64_t mtimeNs) {
+    struct timespec times[2];
+    fillMtime(times, mtimeNs);
+    utimensat(dest.dirFd, dest.name.c_str(), times, AT_SYMLINK_NOFOLLOW);
+}
+
+/**
+ * 沿目标树向下打开目录的游标。保存从根到当前目录的一串目录 fd，
+ * 按 relPath 排序依次访问时，每个目录只需 openat 一次 (O_NOFOLLOW，不会被符号链接引出目标树)。
+ */
+class DirCursor {
+public:
+    explicit DirCursor(const fs::path& root) {
+        stack_.emplace_back("", ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    }
+    ~DirCursor() {
+        for (auto& level : stack_) if (level.second >= 0) close(level.second);
+    }
+    DirCursor(const DirCursor&) = delete;
+    DirCursor& operator=(const DirCursor&) = delete;
+
+    // 返回 relDir (相对根目录，"" 表示根) 的 fd，失败时返回 -1。fd 归游标所有
+    int open(const std::string& relDir) {
+        while (stack_.size() > 1 && relDir != stack_.back().first && !isInside(relDir, stack_.back().first)) {
+            close(stack_.back().second);
+            stack_.pop_back();
+        }
+        while (stack_.back().second >= 0 && stack_.back().first != relDir) {
+            const std::string& top = stack_.back().first;
+            size_t start = top.empty() ? 0 : top.size() + 1;
+            size_t slash = relDir.find('/', start);
+            std::string component = relDir.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+            int fd = openat(stack_.back().second, component.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd < 0) return -1;
+            stack_.emplace_back(top.empty() ? component : top + "/" + component, fd);
+        }
+        return stack_.back().second;
+    }
+
+    // 打开 relPath 的父目录，并给出 relPath 在目标中的位置
+    bool locate(const std::string& relPath, const fs::path& destRoot, DestRef& dest) {
+        size_t slash = relPath.rfind('/');
+        dest.dirFd = open(slash == std::string::npos ? "" : relPath.substr(0, slash));
+        dest.name = slash == std::string::npos ? relPath : relPath.substr(slash + 1);
+        dest.path = destRoot / relPath;
+        return dest.dirFd >= 0;
+    }
+
+private:
+    std::vector<std::pair<std::string, int>> stack_;
+};
+
+// 只比较与内容无关的元数据 (权限和所有者)
+bool metadataMatches(const TreeEntry& source, const TreeEntry& dest, const SyncOptions& options) {
+    if (source.type != EntryType::Symlink && source.mode != dest.mode) return false;
+    if (options.ownerUid != (uid_t)-1 && (dest.uid != options.ownerUid || dest.gid != options.ownerGid)) return false;
+    return true;
+}
+
+// 比较内容是否一致。开启 compareContent 时以内容哈希做最终判断
+bool contentMatches(const TreeEntry& source, const TreeEntry& dest, const fs::path& destPath,
+                    const SyncOptions& options, bool& mtimeOnly) {
+    mtimeOnly = false;
+    if (source.type != dest.type) return false;
+    if (source.type == EntryType::Symlink) return source.linkTarget == dest.linkTarget;
+    if (source.type != EntryType::Regular) return true;
+    if (source.size != dest.size) return false;
+
+    bool sameMtime = source.mtimeNs == dest.mtimeNs;
+    if (!options.compareContent) return sameMtime;
+
+    // 快照清单中已记录哈希时直接使用，不必再读取快照内容
+    uint64_t sourceHash = source.contentHash;
+    uint64_t destHash = 0;
+    if (!source.hasContentHash && !hashFile(source.sourcePath, sourceHash, options.dereference)) return false;
+    if (!hashFile(destPath, destHash)) return false;
+    if (sourceHash != destHash) return false;
+    // 内容一致但时间戳不同：只需修正 mtime，无需重新复制
+    mtimeOnly = !sameMtime;
+    return true;
+}
+
+/**
+ * @brief 硬链接模式下能否直接链接到来源对象: 链接与存储中的对象共享 inode，不能再通过它改权限或拥有者，
+ *        因此只有只读且权限和拥有者都已与对象一致的条目才链接，其余退回复制。
+ */
+bool canHardlink(const TreeEntry& entry, const SyncOptions& options) {
+    if (!options.hardlinkSources || options.contentSource || (entry.mode & 0222) != 0) return false;
+    struct stat st;
+    if (stat(entry.sourcePath.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    if ((st.st_mode & 07777) != (entry.mode & 07777)) return false;
+    return options.ownerUid == (uid_t)-1 || (st.st_uid == options.ownerUid && st.st_gid == options.ownerGid);
+}
+
+/**
+ * @brief 在父目录 fd 下创建普通文件: 复制内容后直接在新文件的 fd 上设置拥有者、权限和 mtime。
+ */
+void materializeFile(const TreeEntry& entry, const DestRef& dest, const SyncOptions& options) {
+    const char* name = dest.name.c_str();
+    // 先删除旧文件再复制，避免改写与其他路径共享 inode 的硬链接
+    if (unlinkat(dest.dirFd, name, 0) != 0 && errno != ENOENT) throwErrno("unlinkat", dest.path);
+
+    if (canHardlink(entry, options) && linkat(AT_FDCWD, entry.sourcePath.c_str(), dest.dirFd, name, 0) == 0) {
+        applyMtimeAt(dest, entry.mtimeNs);
+        return;
+    }
+
+    int in = -1;
+    if (!options.contentSource) {
+        in = open(entry.sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) throwErrno("open source", entry.sourcePath);
+    }
+    int out = openat(dest.dirFd, name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (out < 0) {
+        int err = errno;
+        if (in >= 0) close(in);
+        errno = err;
+        throwErrno("open dest", dest.path);
+    }
+
+    std::string error;
+    bool ok;
+    if (options.contentSource) {
+        ok = options.contentSource(entry, out, error);
+    } else {
+        ok = copyFdContents(in, out, nullptr, &error);
+        close(in);
+    }
+    if (ok) {
+        // 先改拥有者再设置权限 (fchown 会清除 setuid/setgid 位)
+        if (options.ownerUid != (uid_t)-1) fchown(out, options.ownerUid, options.ownerGid);
+        fchmod(out, entry.mode);
+        struct timespec times[2];
+        fillMtime(times, entry.mtimeNs);
+        futimens(out, times);
+    }
+    if (close(out) != 0 && ok) {
+        ok = false;
+        error = std::string("close: ") + strerror(errno);
+    }
+    if (!ok) {
+        throw fs::filesystem_error(error, entry.sourcePath, dest.path, std::make_error_code(std::errc::io_error));
+    }
+}
+
+bool materializeEntry(const TreeEntry& entry, const DestRef& dest, const SyncOptions& options,
+                      SyncStats& stats) {
+    switch (entry.type) {
+        case EntryType::Directory:
+            if (mkdirat(dest.dirFd, dest.name.c_str(), 0777) != 0 && errno != EEXIST) throwErrno("mkdirat", dest.path);
+            applyOwnershipAt(dest, options);
+            return true;
+        case EntryType::Symlink:
+            if (symlinkat(entry.linkTarget.c_str(), dest.dirFd, dest.name.c_str()) != 0) throwErrno("symlinkat", dest.path);
+            applyOwnershipAt(dest, options);
+            return true;
+        case EntryType::Regular:
+            materializeFile(entry, dest, options);
+            stats.filesCopied++;
+            stats.bytesCopied += entry.size;
+            return true;
+        default:
+            return false;   // 特殊文件 (socket / pipe) 不复制
+    }
+}
+
+void mergeStats(SyncStats& into, const SyncStats& from) {
+    into.filesCopied += from.filesCopied;
+    into.bytesCopied += from.bytesCopied;
+    into.entriesRemoved += from.entriesRemoved;
+    into.entriesUnchanged += from.entriesUnchanged;
+    into.metadataFixed += from.metadataFixed;
+    into.bytesSkipped += from.bytesSkipped;
+    into.entriesFailed += from.entriesFailed;
+    into.filesPatched += from.filesPatched;
+}
+
+// relPath 的各级父目录 (不含根目录本身)
+std::vector<std::string> parentPaths(const std::string& relPath) {
+    std::vector<std::string> parents;
+    for (size_t slash = relPath.find('/'); slash != std::string::npos; slash = relPath.find('/', slash + 1)) {
+        parents.push_back(relPath.substr(0, slash));
+    }
+    return parents;
+}
+
+// 扫描 dir 下的目录树，条目的 relPath 以 relPrefix 为前缀 (filter 按带前缀的完整路径判断)
+std::vector<TreeEntry> scanSubtree(const fs::path& dir, const std::string& relPrefix, bool dereference,
+                                   const PathFilter* filter) {
+    // 每个目录是一个任务，目录中发现的子目录作为新任务提交给线程池
+    std::vector<TreeEntry> entries;
+    std::mutex entriesMutex;
+    TaskGroup group;
+    std::function<void(const fs::path&, const std::string&, int)> scanTask;
+    scanTask = [&](const fs::path& dir, const std::string& relPrefix, int depth) {
+        group.run([&, dir, relPrefix, depth] {
+            std::vector<TreeEntry> local;
+            scanDirectory(dir, relPrefix, dereference, depth, filter, local, scanTask);
+            std::lock_guard<std::mutex> lock(entriesMutex);
+            std::move(local.begin(), local.end(), std::back_inserter(entries));
+        });
+    };
+    scanTask(dir, relPrefix, 0);
+    group.wait();
+
+    std::sort(entries.begin(), entries.end(),
+              [](const TreeEntry& a, const TreeEntry& b) { return a.relPath < b.relPath; });
+    return entries;
+}
+
+// 只扫描目标中同步范围内的条目: 父目录只取其本身，子树根目录连同其下的全部条目
+// (位于被 filter 排除的子树中的路径不扫描)
+std::vector<TreeEntry> scanScope(const fs::path& destRoot, const SyncScope& scope, const PathFilter* filter) {
+    std::vector<TreeEntry> entries;
+    auto statEntry = [&](const std::string& relPath) {
+        fs::path path = destRoot / relPath;
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) return false;
+        TreeEntry entry;
+        entry.relPath = relPath;
+        entry.sourcePath = path;
+        fillFromStat(entry, st);
+        if (filter && filter->excludesPath(relPath, entry.type == EntryType::Directory, entry.size)) return false;
+        if (entry.type == EntryType::Symlink) {
+            std::error_code linkEc;
+            entry.linkTarget = fs::read_symlink(path, linkEc).string();
+        }
+        bool directory = entry.type == EntryType::Directory;
+        entries.push_back(std::move(entry));
+        return directory;
+    };
+    for (const auto& parent : scope.parents) statEntry(parent);
+    for (const auto& root : scope.roots) {
+        if (!statEntry(root)) continue;
+        for (auto& entry : scanSubtree(destRoot / root, root, false, filter)) entries.push_back(std::move(entry));
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const TreeEntry& a, const TreeEntry& b) { return a.relPath < b.relPath; });
+    return entries;
+}
+
+/**
+ * @brief 对比单个条目与目标中现有的同名条目: 一致时只修正元数据，类型不同时删除旧条目。
+ * @param existing 目标中现有的同名条目 (不存在时为 nullptr)。
+ * @return true 表示条目需要 (重新) 物化。
+ */
+bool reconcileEntry(const TreeEntry& entry, const TreeEntry* existing, const DestRef& dest,
+                    const SyncOptions& options, SyncStats& s) {
+    if (!existing) return true;
+
+    bool mtimeOnly = false;
+    if (contentMatches(entry, *existing, dest.path, options, mtimeOnly)) {
+        if (!mtimeOnly && metadataMatches(entry, *existing, options)) {
+            s.entriesUnchanged++;
+            s.bytesSkipped += entry.size;
+        } else {
+            // 权限或拥有者不同且与其他路径共享 inode (如硬链接到存储中的对象)：重新物化，不改共享的 inode
+            struct stat st;
+            if (!metadataMatches(entry, *existing, options) && entry.type == EntryType::Regular &&
+                fstatat(dest.dirFd, dest.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_nlink > 1) {
+                return true;
+            }
+            applyOwnershipAt(dest, options);
+            if (entry.type != EntryType::Symlink) fchmodat(dest.dirFd, dest.name.c_str(), entry.mode, 0);
+            if (mtimeOnly) applyMtimeAt(dest, entry.mtimeNs);
+            s.metadataFixed++;
+            s.bytesSkipped += entry.size;
+        }
+        return false;
+    }
+    // 类型不同 (如文件变成了目录)：先整体删除旧条目
+    if (existing->type != entry.type) {
+        fs::remove_all(dest.path);
+        s.entriesRemoved++;
+    } else if (entry.type == EntryType::Symlink) {
+        if (unlinkat(dest.dirFd, dest.name.c_str(), 0) != 0 && errno != ENOENT) throwErrno("unlinkat", dest.path);
+    }
+    return true;
+}
+
+/**
+ * @brief 将单个条目同步到 dest。
+ * @return true 表示新建了目录 (需要在最后设置其权限)。
+ */
+bool syncOneEntry(const TreeEntry& entry, const TreeEntry* existing, const DestRef& dest,
+                  const SyncOptions& options, SyncStats& s) {
+    if (!reconcileEntry(entry, existing, dest, options, s)) return false;
+    materializeEntry(entry, dest, options, s);
+    return entry.type == EntryType::Directory;
+}
+
+/**
+ * @brief 按块原地更新目标中已有的大文件 (见 SyncOptions::deltaMinSize)，只改写与快照内容不同的块。
+ * @return true 表示已更新; false 表示不适用或中途失败，调用方改为整体替换。
+ */
+bool patchFile(const TreeEntry& entry, const TreeEntry& existing, const DestRef& dest, const SyncOptions& options,
+               SyncStats& s) {
+    if (options.deltaMinSize == 0 || entry.size < options.deltaMinSize || existing.type != EntryType::Regular ||
+        options.contentSource || options.hardlinkSources) {
+        return false;
+    }
+    int out = openat(dest.dirFd, dest.name.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+    if (out < 0) return false;
+    // 与其他路径共享 inode 的文件 (例如硬链接到存储中的对象) 不能原地改写
+    struct stat st;
+    if (fstat(out, &st) != 0 || !S_ISREG(st.st_mode) || st.st_nlink != 1) {
+        close(out);
+        return false;
+    }
+    int in = open(entry.sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        close(out);
+        return false;
+    }
+    BlockTable table;
+    bool hasTable = options.blockTable && options.blockTable(entry, table);
+    BlockDeltaStats delta;
+    std::string error;
+    bool ok = applyBlockDelta(in, entry.size, out, hasTable ? &table : nullptr, delta, error);
+    close(in);
+    if (ok) {
+        if (options.ownerUid != (uid_t)-1) fchown(out, options.ownerUid, options.ownerGid);
+        fchmod(out, entry.mode);
+        struct timespec times[2];
+        fillMtime(times, entry.mtimeNs);
+        futimens(out, times);
+    }
+    if (close(out) != 0) ok = false;
+    if (!ok) {
+        std::cerr << "  -> 警告: 按块更新 '" << dest.path.string() << "' 失败 (" << error << ")，改为完整复制"
+                  << std::endl;
+        return false;
+    }
+    s.filesPatched++;
+    s.bytesCopied += delta.bytesWritten;
+    s.bytesSkipped += delta.bytesSkipped;
+    recordCopiedFile(CopyStrategy::Delta, delta.bytesWritten);
+    return true;
+}
+
+// 是否交给 io_uring 批量复制 (硬链接模式、打包容器来源和大文件走普通路径)
+bool useBatchedCopy(const TreeEntry& entry, const SyncOptions& options) {
+    return !options.hardlinkSources && !options.contentSource && entry.size <= uringSmallFileLimit() &&
+           uringCopyAvailable();
+}
+
+// 需要同步的普通文件
+struct FileJob {
+    const TreeEntry* entry;
+    const TreeEntry* existing;
+};
+
+// 同一父目录下的一组普通文件，作为一个并行任务处理 (整个任务只打开一次父目录)
+struct FileChunk {
+    std::string parent;
+    std::vector<FileJob> jobs;
+};
+
+/**
+ * @brief 同步一组同目录的普通文件。需要复制的小文件先收集起来以 io_uring 批量复制，
+ *        批量路径失败的文件逐个退回普通复制。
+ */
+void syncFileChunk(const FileChunk& chunk, const fs::path& destRoot, const SyncOptions& options, SyncStats& s) {
+    DirCursor cursor(destRoot);
+    int dirFd = cursor.open(chunk.parent);
+    if (dirFd < 0) {
+        std::cerr << "  -> 警告: 无法打开目录 '" << (destRoot / chunk.parent).string() << "'，跳过其中 "
+                  << chunk.jobs.size() << " 个文件" << std::endl;
+        s.entriesFailed += chunk.jobs.size();
+        return;
+    }
+
+    std::vector<UringCopyJob> batched;
+    std::vector<const TreeEntry*> batchedEntries;
+    for (const auto& job : chunk.jobs) {
+        // 取消后剩余的文件保持原样 (已收集的批量复制也一并放弃)
+        if (operationCancelled()) return;
+        DestRef dest;
+        cursor.locate(job.entry->relPath, destRoot, dest);
+        bool batchedJob = false;   // 批量复制的文件在复制完成后才计入进度
+        try {
+            if (reconcileEntry(*job.entry, job.existing, dest, options, s)) {
+                if (job.existing && patchFile(*job.entry, *job.existing, dest, options, s)) {
+                    // 已按块更新
+                } else if (useBatchedCopy(*job.entry, options)) {
+                    UringCopyJob copy;
+                    copy.source = job.entry->sourcePath;
+                    copy.destDirFd = dirFd;
+                    copy.dest = dest.name;
+                    copy.mode = job.entry->mode;
+                    copy.ownerUid = options.ownerUid;
+                    copy.ownerGid = options.ownerGid;
+                    copy.mtimeNs = job.entry->mtimeNs;
+                    copy.removeExisting = job.existing != nullptr;
+                    batched.push_back(std::move(copy));
+                    batchedEntries.push_back(job.entry);
+                    batchedJob = true;
+                } else {
+                    materializeEntry(*job.entry, dest, options, s);
+                }
+            }
+        } catch (const fs::filesystem_error& e) {
+            std::cerr << "  -> 警告: 恢复 '" << dest.path.string() << "' 失败: " << e.what() << std::endl;
+            s.entriesFailed++;
+        }
+        if (!batchedJob) progressAddDone(1, job.entry->size);
+    }
+    if (batched.empty()) return;
+
+    uringCopyBatch(batched);
+    for (size_t i = 0; i < batched.size(); ++i) {
+        if (batched[i].done) {
+            s.filesCopied++;
+            s.bytesCopied += batchedEntries[i]->size;
+        } else {
+            DestRef dest{dirFd, batched[i].dest.string(), destRoot / batchedEntries[i]->relPath};
+            try {
+                materializeEntry(*batchedEntries[i], dest, options, s);
+            } catch (const fs::filesystem_error& e) {
+                std::cerr << "  -> 警告: 恢复 '" << dest.path.string() << "' 失败: " << e.what() << std::endl;
+                s.entriesFailed++;
+            }
+        }
+        progressAddDone(1, batchedEntries[i]->size);
+    }
+}
+
+} // namespace
+
+SyncScope::SyncScope(const std::vector<std::string>& paths) : roots(paths.begin(), paths.end()) {
+    for (const auto& path : paths) {
+        for (auto& parent : parentPaths(path)) parents.insert(std::move(parent));
+    }
+}
+
+bool SyncScope::contains(const std::string& relPath) const {
+    if (roots.count(relPath) || parents.count(relPath)) return true;
+    for (const auto& parent : parentPaths(relPath)) {
+        if (roots.count(parent)) return true;
+    }
+    return false;
+}
+
+std::vector<TreeEntry> scanTree(const fs::path& root, bool dereference, const PathFilter* filter) {
+    return scanSubtree(root, "", dereference, filter);
+}
+
+std::vector<TreeEntry> selectSyncEntries(const std::vector<TreeEntry>& entries, const SyncOptions& options) {
+    if (!options.scoped && !options.filter) return entries;
+    std::unique_ptr<SyncScope> scope;
+    if (options.scoped) scope = std::make_unique<SyncScope>(options.scopePaths);
+    std::vector<TreeEntry> selected;
+    std::string excludedDir;
+    for (const auto& e : entries) {
+        if (scope && !scope->contains(e.relPath)) continue;
+        if (options.filter) {
+            // entries 有序，父目录在前且被排除目录的子项紧随其后，因此只需判断条目本身
+            if (!excludedDir.empty() && isInside(e.relPath, excludedDir)) continue;
+            bool directory = e.type == EntryType::Directory;
+            if (options.filter->excludes(e.relPath, directory, e.size)) {
+                if (directory) excludedDir = e.relPath;
+                continue;
+            }
+        }
+        selected.push_back(e);
+    }
+    return selected;
+}
+
+std::vector<TreeEntry> scanDestination(const fs::path& destRoot, const SyncOptions& options) {
+    if (options.scoped) return scanScope(destRoot, SyncScope(options.scopePaths), options.filter);
+    return scanTree(destRoot, false, options.filter);
+}
+
+bool syncTree(const fs::path& sourceRoot, const fs::path& destRoot,
+              const SyncOptions& options, SyncStats* stats) {
+    std::error_code ec;
+    if (!fs::is_directory(sourceRoot, ec)) {
+        std::cerr << "  -> 错误: 同步源目录不存在 " << sourceRoot.string() << std::endl;
+        return false;
+    }
+    return syncEntries(scanTree(sourceRoot, options.dereference), destRoot, options, stats);
+}
+
+bool syncEntries(const std::vector<TreeEntry>& entries, const fs::path& destRoot,
+                 const SyncOptions& options, SyncStats* stats) {
+    SyncStats localStats;
+    SyncStats& s = stats ? *stats : localStats;
+
+    try {
+        // 1. 确保目标根目录存在
+        if (!fs::exists(destRoot)) {
+            fs::create_directories(destRoot);
+            applyOwnership(destRoot, options);
+        }
+
+        // 2. 扫描目标现状 (限定范围时只扫描范围内的子树，源条目也只取范围内的部分;
+        //    被排除的子树在两边都不出现，因此既不会被物化也不会被当作多余条目删除)
+        std::vector<TreeEntry> scopedEntries;
+        const std::vector<TreeEntry>* source = &entries;
+        if (options.scoped || options.filter) {
+            scopedEntries = selectSyncEntries(entries, options);
+            source = &scopedEntries;
+        }
+        std::vector<TreeEntry> scanned;
+        if (!options.destEntries) scanned = scanDestination(destRoot, options);
+        const std::vector<TreeEntry>& current = options.destEntries ? *options.destEntries : scanned;
+        std::unordered_map<std::string, const TreeEntry*> currentByPath;
+        currentByPath.reserve(current.size());
+        for (const auto& e : current) currentByPath.emplace(e.relPath, &e);
+
+        std::unordered_map<std::string, const TreeEntry*> wanted;
+        wanted.reserve(source->size());
+        for (const auto& e : *source) {
+            if (e.type != EntryType::Other) wanted.emplace(e.relPath, &e);
+        }
+
+        // 3. 删除多余条目 (只删除最顶层的多余目录，其子项随之删除)
+        //    有排除规则时多余目录中可能含有被排除的条目，改为由深到浅逐个删除，仍不为空的目录保留
+        //    removing 是已删除条目中子树尚未遍历完的祖先栈，栈顶的子树总是排在下面各层之前，
+        //    因此弹出已经过去的子树后只需检查栈顶，父子不会同时交给线程池删除
+        if (options.deleteExtra) {
+            std::vector<std::string> extras;
+            std::vector<const std::string*> removing;
+            for (const auto& e : current) {
+                if (!options.filter) {
+                    while (!removing.empty() && pastSubtree(e.relPath, *removing.back())) removing.pop_back();
+                    if (!removing.empty() && isInside(e.relPath, *removing.back())) continue;
+                }
+                if (wanted.count(e.relPath)) continue;
+                extras.push_back(e.relPath);
+                if (!options.filter && e.type == EntryType::Directory) removing.push_back(&e.relPath);
+            }
+            std::atomic<uint64_t> removed{0};
+            std::atomic<uint64_t> failed{0};
+            if (options.filter) {
+                for (auto it = extras.rbegin(); it != extras.rend(); ++it) {
+                    fs::path path = destRoot / *it;
+                    if (::remove(path.c_str()) == 0) {
+                        removed++;
+                    } else if (errno != ENOTEMPTY && errno != EEXIST && errno != ENOENT) {
+                        std::cerr << "  -> 警告: 删除 '" << path.string() << "' 失败" << std::endl;
+                        failed++;
+                    }
+                }
+                extras.clear();
+            }
+            parallelFor(extras.size(), [&](size_t i) {
+                std::error_code rmEc;
+                fs::remove_all(destRoot / extras[i], rmEc);
+                if (rmEc) {
+                    std::cerr << "  -> 警告: 删除 '" << (destRoot / extras[i]).string() << "' 失败" << std::endl;
+                    failed++;
+                    return;
+                }
+                removed++;
+            });
+            s.entriesRemoved += removed;
+            s.entriesFailed += failed;
+        }
+
+        // 4. 按顺序 (父目录在前) 处理目录和符号链接，普通文件按所在目录分组，留给线程池并行处理
+        //    目录总是在其子项之前创建完毕
+        const size_t CHUNK_FILES = 256;
+        std::map<std::string, std::vector<FileJob>> filesByParent;
+        std::vector<std::pair<const TreeEntry*, bool>> directories;   // 同步成功的目录及其是否为新建
+        std::string brokenDir;
+        DirCursor cursor(destRoot);
+        for (const auto& entry : *source) {
+            if (entry.type == EntryType::Other) continue;
+            if (!brokenDir.empty() && isInside(entry.relPath, brokenDir)) {
+                s.entriesFailed++;
+                continue;
+            }
+
+            auto it = currentByPath.find(entry.relPath);
+            const TreeEntry* existing = it == currentByPath.end() ? nullptr : it->second;
+            if (entry.type == EntryType::Regular && (!existing || existing->type == EntryType::Regular)) {
+                size_t slash = entry.relPath.rfind('/');
+                filesByParent[slash == std::string::npos ? "" : entry.relPath.substr(0, slash)].push_back({&entry, existing});
+                continue;
+            }
+
+            DestRef dest;
+            try {
+                if (!cursor.locate(entry.relPath, destRoot, dest)) {
+                    throw fs::filesystem_error("open parent directory", dest.path,
+                                               std::error_code(errno, std::generic_category()));
+                }
+                bool created = syncOneEntry(entry, existing, dest, options, s);
+                if (entry.type == EntryType::Directory) directories.emplace_back(&entry, created);
+            } catch (const fs::filesystem_error& e) {
+                std::cerr << "  -> 警告: 恢复 '" << dest.path.string() << "' 失败: " << e.what() << std::endl;
+                s.entriesFailed++;
+                if (entry.type == EntryType::Directory) brokenDir = entry.relPath;
+            }
+        }
+
+        std::vector<FileChunk> chunks;
+        for (auto& group : filesByParent) {
+            for (size_t begin = 0; begin < group.second.size(); begin += CHUNK_FILES) {
+                size_t end = std::min(group.second.size(), begin + CHUNK_FILES);
+                chunks.push_back({group.first, std::vector<FileJob>(group.second.begin() + begin,
+                                                                   group.second.begin() + end)});
+            }
+        }
+        std::mutex statsMutex;
+        parallelFor(chunks.size(), [&](size_t i) {
+            SyncStats local;
+            syncFileChunk(chunks[i], destRoot, options, local);
+            std::lock_guard<std::mutex> lock(statsMutex);
+            mergeStats(s, local);
+        });
+
+        // 5. 最后由深到浅设置新建目录的权限，避免只读目录阻止子项的创建；
+        //    同时恢复目录的 mtime (子项的创建和删除都会改变它，因此放在所有子项处理完之后)
+        for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+            const TreeEntry& entry = *it->first;
+            DestRef dest;
+            if (!cursor.locate(entry.relPath, destRoot, dest)) continue;
+            if (it->second) fchmodat(dest.dirFd, dest.name.c_str(), entry.mode, 0);
+            struct stat st;
+            if (fstatat(dest.dirFd, dest.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) &&
+                toNanoseconds(st.st_mtim) != entry.mtimeNs) {
+                applyMtimeAt(dest, entry.mtimeNs);
+            }
+        }
+        return !operationCancelled();
+    } catch (const std::exception& e) {
+        std::cerr << "  -> 错误: 增量同步失败 " << destRoot.string() << ": " << e.what() << std::endl;
+        return false;
+    }
+}
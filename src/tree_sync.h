@@ -0,0 +1,132 @@
+#ifndef TREE_SYNC_H
+#define TREE_SYNC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <unordered_set>
+#include <sys/types.h>
+
+class PathFilter;
+struct BlockTable;
+
+// 目录树中单个条目的类型
+enum class EntryType : uint8_t {
+    Regular = 0,
+    Directory = 1,
+    Symlink = 2,
+    Other = 3      // socket / fifo / 设备文件等，不参与复制
+};
+
+/**
+ * @brief 目录树中一个条目的元数据快照。
+ *        relPath 使用 '/' 分隔，相对于扫描根目录；sourcePath 指向内容的物理来源
+ *        (实时文件、旧版镜像快照中的文件或 blob 存储中的对象)。
+ */
+struct TreeEntry {
+    std::string relPath;
+    EntryType type = EntryType::Other;
+    mode_t mode = 0;
+    uid_t uid = 0;
+    gid_t gid = 0;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    std::string linkTarget;
+    std::filesystem::path sourcePath;
+    bool hasContentHash = false;   // contentHash 是否有效 (仅普通文件)
+    uint64_t contentHash = 0;      // 内容的 XXH3-64 哈希
+    uint64_t device = 0;           // 扫描时所在的设备和 inode (0 表示未知，例如旧版清单)
+    uint64_t inode = 0;
+};
+
+// 增量同步的选项
+struct SyncOptions {
+    bool compareContent = false;   // 大小和 mtime 一致时，是否再比较内容哈希
+    bool deleteExtra = true;       // 是否删除目标中多出来的条目
+    bool dereference = false;      // 扫描源目录时是否跟随符号链接
+    uid_t ownerUid = (uid_t)-1;    // 目标文件的拥有者 (-1 表示不修改)
+    gid_t ownerGid = (gid_t)-1;
+    bool hardlinkSources = false;  // 以硬链接方式物化只读且权限、拥有者与来源一致的普通文件 (其余或跨文件系统时复制)
+    // 普通文件内容的来源 (例如打包容器)。设置后不再读取 sourcePath，也不使用硬链接和批量复制路径;
+    // 向已打开的空文件 outFd 写入 entry 的全部内容，失败时返回 false 并在 error 中给出原因
+    std::function<bool(const TreeEntry& entry, int outFd, std::string& error)> contentSource;
+    // 只同步 scopePaths 中的子树 (相对目标根目录、互不嵌套，例如变更日志记录的路径) 及其各级父目录本身，
+    // 其余条目既不扫描也不修改
+    bool scoped = false;
+    std::vector<std::string> scopePaths;
+    // 不小于 deltaMinSize 的普通文件在目标中已有内容不同的同名文件时按块原地更新，只改写不同的块
+    // (0 表示不使用; 不适用于 contentSource 和硬链接方式，与其他路径共享 inode 的目标文件也总是整体替换)
+    uint64_t deltaMinSize = 0;
+    // 取得 entry 内容的块校验表 (冰冻时记录)，没有时返回 false，此时直接逐块比较两边的内容
+    std::function<bool(const TreeEntry& entry, BlockTable& table)> blockTable;
+    // 不受管理的条目 (例如配置中排除的子树): 源条目中被排除的部分不物化，目标中的也不扫描、不删除、不修改
+    const PathFilter* filter = nullptr;
+    // 调用方预先扫描的目标现状 (scanDestination 的结果，之后目标不能再有变化)，设置后不再重新扫描
+    const std::vector<TreeEntry>* destEntries = nullptr;
+};
+
+// 一次同步的统计信息
+struct SyncStats {
+    uint64_t filesCopied = 0;
+    uint64_t bytesCopied = 0;
+    uint64_t entriesRemoved = 0;
+    uint64_t entriesUnchanged = 0;
+    uint64_t metadataFixed = 0;
+    uint64_t bytesSkipped = 0;    // 因内容未变而免于复制的字节数
+    uint64_t entriesFailed = 0;   // 复制、创建或删除失败 (只打印了警告) 的条目数
+    uint64_t filesPatched = 0;    // 按块原地更新的大文件数 (写入的字节计入 bytesCopied，未变的块计入 bytesSkipped)
+    uint64_t filesMoved = 0;      // 从目标中其他位置移回原处的文件数 (见 relocation.h)
+    uint64_t bytesMoved = 0;
+};
+
+/**
+ * 限定范围同步的范围: scopePaths 中的子树，以及它们的各级父目录 (只包含目录本身)。
+ */
+struct SyncScope {
+    explicit SyncScope(const std::vector<std::string>& paths);
+    // relPath 是否在范围内
+    bool contains(const std::string& relPath) const;
+
+    std::unordered_set<std::string> roots;
+    std::unordered_set<std::string> parents;
+};
+
+/**
+ * @brief 扫描一个目录树，返回按 relPath 排序的条目列表 (父目录总在子条目之前)。
+ * @param root 扫描根目录 (根目录本身不包含在结果中)。
+ * @param dereference 为 true 时跟随符号链接 (断开的链接仍作为链接记录)。
+ * @param filter 不为空时跳过被排除的条目，被排除的目录不再向下枚举。
+ */
+std::vector<TreeEntry> scanTree(const std::filesystem::path& root, bool dereference,
+                                const PathFilter* filter = nullptr);
+
+/**
+ * @brief 按 options 的同步范围和排除规则筛选源条目 (entries 必须按 relPath 排序)，
+ *        结果即 syncEntries 实际要物化的条目。
+ */
+std::vector<TreeEntry> selectSyncEntries(const std::vector<TreeEntry>& entries, const SyncOptions& options);
+
+/**
+ * @brief 按 options 的同步范围和排除规则扫描目标现状 (与 syncEntries 内部的扫描相同)。
+ */
+std::vector<TreeEntry> scanDestination(const std::filesystem::path& destRoot, const SyncOptions& options);
+
+/**
+ * @brief 将 destRoot 增量同步为与 sourceRoot 一致。
+ *        只复制缺失或发生变化的条目 (比较类型、大小、mtime、权限和链接目标，可选内容哈希)，
+ *        只删除多出来的条目，未变化的条目不会被触碰。
+ * @return true 表示成功 (单个条目的失败只打印警告), false 表示源目录无法读取或当前异步操作已被取消。
+ */
+bool syncTree(const std::filesystem::path& sourceRoot, const std::filesystem::path& destRoot,
+              const SyncOptions& options, SyncStats* stats = nullptr);
+
+/**
+ * @brief 与 syncTree 相同，但源条目由调用方直接给出 (例如来自快照清单)。
+ *        entries 必须按 relPath 排序。设置了 options.scoped 时只扫描和同步其中的子树。
+ */
+bool syncEntries(const std::vector<TreeEntry>& entries, const std::filesystem::path& destRoot,
+                 const SyncOptions& options, SyncStats* stats = nullptr);
+
+#endif // TREE_SYNC_H
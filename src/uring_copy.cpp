@@ -0,0 +1,387 @@
+#include "uring_copy.h"
+#include "copy_engine.h"
+
+namespace {
+
+const uint64_t SMALL_FILE_LIMIT = 256 * 1024;   // 批量路径一次读入整个文件，只处理小文件
+
+} // namespace
+
+uint64_t uringSmallFileLimit() {
+    return SMALL_FILE_LIMIT;
+}
+
+#ifndef SNAPSHOT_HAVE_IO_URING
+
+bool uringCopyAvailable() {
+    return false;
+}
+
+void uringCopyBatch(std::vector<UringCopyJob>& jobs) {
+    for (auto& job : jobs) job.done = false;
+}
+
+#else
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace {
+
+const unsigned RING_ENTRIES = 256;   // 队列深度上限
+const size_t WINDOW = 64;            // 每轮同时处理的文件数 (第一阶段每个文件最多 4 个请求)
+
+// 请求的 user_data: 高位为文件序号，低 3 位为操作类型
+enum Op : uint64_t { OpUnlink = 0, OpOpenDest = 1, OpOpenSource = 2, OpStatx = 3, OpRead = 4, OpWrite = 5,
+                     OpCloseSource = 6, OpCloseDest = 7 };
+
+int sysSetup(unsigned entries, io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+int sysRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+/**
+ * 最小化的 io_uring 封装 (不依赖 liburing): 映射提交/完成队列，提供取 SQE、提交并等待、遍历 CQE。
+ */
+class Ring {
+public:
+    ~Ring() {
+        if (sqes_) munmap(sqes_, sqesSize_);
+        if (cqPtr_ && cqPtr_ != sqPtr_) munmap(cqPtr_, cqSize_);
+        if (sqPtr_) munmap(sqPtr_, sqSize_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool init(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd_ = sysSetup(entries, &params);
+        if (fd_ < 0) return false;
+
+        sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+
+        sqPtr_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sqPtr_ == MAP_FAILED) { sqPtr_ = nullptr; return false; }
+        if (singleMmap) {
+            cqPtr_ = sqPtr_;
+        } else {
+            cqPtr_ = mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cqPtr_ == MAP_FAILED) { cqPtr_ = nullptr; return false; }
+        }
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = (io_uring_sqe*)sqes;
+
+        char* sq = (char*)sqPtr_;
+        sqHead_ = (unsigned*)(sq + params.sq_off.head);
+        sqTail_ = (unsigned*)(sq + params.sq_off.tail);
+        sqMask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray_ = (unsigned*)(sq + params.sq_off.array);
+        sqEntries_ = params.sq_entries;
+        char* cq = (char*)cqPtr_;
+        cqHead_ = (unsigned*)(cq + params.cq_off.head);
+        cqTail_ = (unsigned*)(cq + params.cq_off.tail);
+        cqMask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // 检查本阶段要用到的操作码是否都被内核支持
+    bool supports(const std::vector<int>& opcodes) {
+        size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::unique_ptr<char[]> buffer(new char[size]());
+        io_uring_probe* probe = (io_uring_probe*)buffer.get();
+        if (sysRegister(fd_, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+        for (int op : opcodes) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    unsigned capacity() const { return sqEntries_; }
+
+    io_uring_sqe* nextSqe(uint8_t opcode, uint64_t userData) {
+        unsigned tail = *sqTail_;
+        unsigned index = tail & sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->user_data = userData;
+        sqArray_[index] = index;
+        *sqTail_ = tail + 1;   // 提交前统一以 release 语义发布
+        pending_++;
+        return sqe;
+    }
+
+    /**
+     * @brief 提交所有已准备的请求并等待它们全部完成，对每个完成事件调用 onComplete(user_data, res)。
+     * @return false 表示 io_uring_enter 本身失败。
+     */
+    template <typename Fn>
+    bool submitAndDrain(Fn onComplete) {
+        unsigned toSubmit = pending_;
+        __atomic_store_n(sqTail_, *sqTail_, __ATOMIC_RELEASE);
+        unsigned completed = 0;
+        while (completed < pending_) {
+            int ret = sysEnter(fd_, toSubmit, 1, IORING_ENTER_GETEVENTS);
+            if (ret < 0 && errno == EINTR) continue;
+            if (ret < 0) return false;
+            toSubmit -= std::min<unsigned>(toSubmit, (unsigned)ret);
+
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head, ++completed) {
+                const io_uring_cqe& cqe = cqes_[head & cqMask_];
+                onComplete(cqe.user_data, cqe.res);
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        }
+        pending_ = 0;
+        return true;
+    }
+
+private:
+    int fd_ = -1;
+    void* sqPtr_ = nullptr;
+    void* cqPtr_ = nullptr;
+    size_t sqSize_ = 0;
+    size_t cqSize_ = 0;
+    size_t sqesSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned pending_ = 0;
+};
+
+const std::vector<int> REQUIRED_OPS = {IORING_OP_UNLINKAT, IORING_OP_OPENAT, IORING_OP_STATX,
+                                       IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE};
+
+std::once_flag g_probeOnce;
+bool g_available = false;
+
+thread_local std::unique_ptr<Ring> t_ring;
+thread_local bool t_ringFailed = false;
+
+// 取得当前线程的 ring (首次使用时创建)，创建失败时返回 nullptr
+Ring* threadRing() {
+    if (t_ring) return t_ring.get();
+    if (t_ringFailed) return nullptr;
+    std::unique_ptr<Ring> ring(new Ring());
+    if (!ring->init(RING_ENTRIES) || ring->capacity() < WINDOW * 4) {
+        t_ringFailed = true;
+        return nullptr;
+    }
+    t_ring = std::move(ring);
+    return t_ring.get();
+}
+
+uint64_t tag(size_t index, Op op) {
+    return ((uint64_t)index << 3) | op;
+}
+
+// 一个文件在批量流水线中的状态
+struct Slot {
+    int sourceFd = -1;
+    int destFd = -1;
+    struct statx stx;
+    std::unique_ptr<char[]> buffer;
+    uint64_t size = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief 处理一轮 (不超过 WINDOW 个) 文件:
+ *        阶段 1 unlinkat(旧文件) -> openat(目标), openat(源), statx(源)
+ *        阶段 2 read    阶段 3 write    之后在目标 fd 上设置权限/拥有者/mtime
+ *        阶段 4 close 所有 fd
+ * @return false 表示 ring 本身出错 (本轮所有文件均交给调用方退回)。
+ */
+bool runWindow(Ring& ring, UringCopyJob* jobs, size_t count) {
+    std::vector<Slot> slots(count);
+    bool ringOk = true;
+
+    // 阶段 1
+    for (size_t i = 0; i < count; ++i) {
+        const UringCopyJob& job = jobs[i];
+        if (job.removeExisting) {
+            // IOSQE_IO_HARDLINK: 删除失败 (例如文件已不存在) 也继续执行后面的 openat
+            io_uring_sqe* sqe = ring.nextSqe(IORING_OP_UNLINKAT, tag(i, OpUnlink));
+            sqe->fd = job.destDirFd;
+            sqe->addr = (uint64_t)(uintptr_t)job.dest.c_str();
+            sqe->flags = IOSQE_IO_HARDLINK;
+        }
+        io_uring_sqe* openDest = ring.nextSqe(IORING_OP_OPENAT, tag(i, OpOpenDest));
+        openDest->fd = job.destDirFd;
+        openDest->addr = (uint64_t)(uintptr_t)job.dest.c_str();
+        openDest->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        openDest->len = 0600;
+
+        io_uring_sqe* openSource = ring.nextSqe(IORING_OP_OPENAT, tag(i, OpOpenSource));
+        openSource->fd = AT_FDCWD;
+        openSource->addr = (uint64_t)(uintptr_t)job.source.c_str();
+        openSource->open_flags = O_RDONLY | O_CLOEXEC;
+
+        io_uring_sqe* stat = ring.nextSqe(IORING_OP_STATX, tag(i, OpStatx));
+        stat->fd = AT_FDCWD;
+        stat->addr = (uint64_t)(uintptr_t)job.source.c_str();
+        stat->len = STATX_SIZE;
+        stat->off = (uint64_t)(uintptr_t)&slots[i].stx;
+    }
+    ringOk = ring.submitAndDrain([&](uint64_t data, int res) {
+        Slot& slot = slots[data >> 3];
+        switch (data & 7) {
+            case OpUnlink:
+                if (res < 0 && res != -ENOENT) slot.failed = true;
+                break;
+            case OpOpenDest:
+                if (res >= 0) slot.destFd = res; else slot.failed = true;
+                break;
+            case OpOpenSource:
+                if (res >= 0) slot.sourceFd = res; else slot.failed = true;
+                break;
+            case OpStatx:
+                if (res < 0) slot.failed = true;
+                break;
+        }
+    });
+
+    // 阶段 2: 读入整个源文件 (读到的长度与 statx 不符说明文件在变化，交给普通路径)
+    if (ringOk) {
+        for (size_t i = 0; i < count; ++i) {
+            Slot& slot = slots[i];
+            if (slot.failed) continue;
+            slot.size = slot.stx.stx_size;
+            if (slot.size > SMALL_FILE_LIMIT) { slot.failed = true; continue; }
+            if (slot.size == 0) continue;
+            slot.buffer.reset(new char[slot.size]);
+            io_uring_sqe* sqe = ring.nextSqe(IORING_OP_READ, tag(i, OpRead));
+            sqe->fd = slot.sourceFd;
+            sqe->addr = (uint64_t)(uintptr_t)slot.buffer.get();
+            sqe->len = (unsigned)slot.size;
+            sqe->off = 0;
+        }
+        ringOk = ring.submitAndDrain([&](uint64_t data, int res) {
+            Slot& slot = slots[data >> 3];
+            if (res < 0 || (uint64_t)res != slot.size) slot.failed = true;
+        });
+    }
+
+    // 阶段 3: 写入目标
+    if (ringOk) {
+        for (size_t i = 0; i < count; ++i) {
+            Slot& slot = slots[i];
+            if (slot.failed || slot.size == 0) continue;
+            io_uring_sqe* sqe = ring.nextSqe(IORING_OP_WRITE, tag(i, OpWrite));
+            sqe->fd = slot.destFd;
+            sqe->addr = (uint64_t)(uintptr_t)slot.buffer.get();
+            sqe->len = (unsigned)slot.size;
+            sqe->off = 0;
+        }
+        ringOk = ring.submitAndDrain([&](uint64_t data, int res) {
+            Slot& slot = slots[data >> 3];
+            if (res < 0 || (uint64_t)res != slot.size) slot.failed = true;
+        });
+    }
+
+    // 元数据: io_uring 没有 fchmod/fchown 操作码，直接在已打开的 fd 上设置 (无需再次解析路径)
+    for (size_t i = 0; i < count && ringOk; ++i) {
+        Slot& slot = slots[i];
+        if (slot.failed) continue;
+        const UringCopyJob& job = jobs[i];
+        // 先改拥有者再设置权限 (fchown 会清除 setuid/setgid 位)
+        if (job.ownerUid != (uid_t)-1 && fchown(slot.destFd, job.ownerUid, job.ownerGid) != 0) slot.failed = true;
+        if (fchmod(slot.destFd, job.mode) != 0) slot.failed = true;
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = job.mtimeNs / 1000000000LL;
+        times[1].tv_nsec = job.mtimeNs % 1000000000LL;
+        if (futimens(slot.destFd, times) != 0) slot.failed = true;
+    }
+
+    // 阶段 4: 关闭所有打开的 fd (ring 出错时同步关闭)
+    size_t closes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Slot& slot = slots[i];
+        if (!ringOk) {
+            if (slot.sourceFd >= 0) close(slot.sourceFd);
+            if (slot.destFd >= 0) close(slot.destFd);
+            continue;
+        }
+        if (slot.sourceFd >= 0) {
+            ring.nextSqe(IORING_OP_CLOSE, tag(i, OpCloseSource))->fd = slot.sourceFd;
+            closes++;
+        }
+        if (slot.destFd >= 0) {
+            ring.nextSqe(IORING_OP_CLOSE, tag(i, OpCloseDest))->fd = slot.destFd;
+            closes++;
+        }
+    }
+    if (ringOk && closes > 0) {
+        ringOk = ring.submitAndDrain([&](uint64_t data, int res) {
+            // 目标文件 close 失败可能意味着延迟写入出错 (如网络文件系统)
+            if ((data & 7) == OpCloseDest && res < 0) slots[data >> 3].failed = true;
+        });
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        jobs[i].done = ringOk && !slots[i].failed;
+        jobs[i].bytes = jobs[i].done ? slots[i].size : 0;
+        if (jobs[i].done) recordCopiedFile(CopyStrategy::IoUring, slots[i].size);
+    }
+    return ringOk;
+}
+
+} // namespace
+
+bool uringCopyAvailable() {
+    std::call_once(g_probeOnce, [] {
+        Ring probe;
+        g_available = probe.init(8) && probe.supports(REQUIRED_OPS);
+    });
+    return g_available;
+}
+
+void uringCopyBatch(std::vector<UringCopyJob>& jobs) {
+    Ring* ring = uringCopyAvailable() ? threadRing() : nullptr;
+    for (size_t begin = 0; begin < jobs.size(); begin += WINDOW) {
+        size_t count = std::min(WINDOW, jobs.size() - begin);
+        if (ring && runWindow(*ring, &jobs[begin], count)) continue;
+        for (size_t i = begin; i < begin + count; ++i) jobs[i].done = false;
+        if (ring) {
+            // ring 状态已不可信: 本线程之后都走普通路径
+            t_ring.reset();
+            t_ringFailed = true;
+            ring = nullptr;
+        }
+    }
+}
+
+#endif // SNAPSHOT_HAVE_IO_URING
@@ -0,0 +1,51 @@
+#ifndef URING_COPY_H
+#define URING_COPY_H
+
+#include <cstdint>
+#include <vector>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/types.h>
+
+/**
+ * 基于 io_uring 的小文件批量复制后端 (编译时由 CMake 选项 DESKSNAPSHOT_WITH_IO_URING 开启)。
+ * 一批文件的 unlinkat/openat/statx、read、write、close 分阶段批量提交，
+ * 每个阶段只需一次 io_uring_enter，免去逐个文件的系统调用往返。
+ * 内核不支持 io_uring (或未编译此后端) 时 uringCopyAvailable() 返回 false，
+ * 调用方应退回 copy_engine 的逐文件复制路径。
+ */
+
+// 一个待复制的小文件
+struct UringCopyJob {
+    std::filesystem::path source;
+    int destDirFd = AT_FDCWD;     // dest 为相对路径时所基于的目录 fd
+    std::filesystem::path dest;
+    mode_t mode = 0644;
+    uid_t ownerUid = (uid_t)-1;   // -1 表示不修改拥有者
+    gid_t ownerGid = (gid_t)-1;
+    int64_t mtimeNs = 0;
+    bool removeExisting = false;  // 先删除目标处的旧文件 (避免改写共享 inode 的硬链接)
+
+    // 输出
+    bool done = false;            // false 表示需要由调用方退回普通路径重新复制
+    uint64_t bytes = 0;
+};
+
+/**
+ * @brief 当前进程能否使用 io_uring 后端 (编译开关 + 运行时探测所需操作码，只探测一次)。
+ */
+bool uringCopyAvailable();
+
+/**
+ * @brief 适合走批量路径的文件大小上限，更大的文件交给 copy_file_range 等内核复制路径。
+ */
+uint64_t uringSmallFileLimit();
+
+/**
+ * @brief 在当前线程的 io_uring 上复制一批小文件 (可在多个线程上并行调用，每个线程使用自己的 ring)。
+ *        每批最多同时处理固定数量的文件，队列深度有上限。
+ *        成功的条目 done 为 true，且权限、拥有者和 mtime 均已设置; 失败的条目由调用方退回普通路径。
+ */
+void uringCopyBatch(std::vector<UringCopyJob>& jobs);
+
+#endif // URING_COPY_H
@@ -0,0 +1,134 @@
+// XXH3-64 的回归测试: 一次计算、流式计算 (随机切分) 和 hashFile 都必须与官方 xxhash 的结果一致。
+// ctest 以 DESKSNAPSHOT_XXH3=scalar / sse2 和默认 (按 CPU 选择) 分别运行，覆盖每种长输入实现
+#include "../src/content_hash.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 官方 xxhash 对下面生成的数据前 len 字节计算的 XXH3_64bits() (seed = 0)。
+// 覆盖短输入的各个分支、129..240 字节的中等输入，以及 1024 字节块和条带的边界
+struct Vector {
+    size_t len;
+    uint64_t hash;
+};
+const Vector VECTORS[] = {
+    {0, 0x2d06800538d394c2ULL},
+    {1, 0xc44bdff4074eecdbULL},
+    {3, 0x54247382a8d6b94dULL},
+    {4, 0xe5dc74bc51848a51ULL},
+    {8, 0x24ccc9acaa9f65e4ULL},
+    {9, 0x14d5001c15dd3f2bULL},
+    {16, 0x981b17d36c7498c9ULL},
+    {17, 0x796f5acd3a60f862ULL},
+    {128, 0xfcff24126754d861ULL},
+    {129, 0x98f1b0a679a2ca29ULL},
+    {240, 0x81c3c2b67f568ccfULL},
+    {241, 0xc5a639ecd2030e5eULL},
+    {1024, 0xdd85c9b5c1109c5cULL},
+    {1025, 0xd870c0fa13211c6aULL},
+    {2048, 0xdd59e2c3a5f038e0ULL},
+    {4096, 0xe91206429d1f48f9ULL},
+    {65543, 0x30f4f3c32b87aab2ULL},
+    {1048589, 0x4fe0dbdfc8fde8a3ULL},
+};
+const size_t DATA_SIZE = 1048589;
+
+int g_failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAIL: " << what << std::endl;
+        g_failures++;
+    }
+}
+
+// 与 xxhash 自带的 sanity 测试相同的数据生成方式
+std::vector<uint8_t> makeData(size_t size) {
+    std::vector<uint8_t> data(size);
+    uint64_t generator = 2654435761ULL;
+    for (auto& byte : data) {
+        byte = (uint8_t)(generator >> 56);
+        generator *= 11400714785074694797ULL;
+    }
+    return data;
+}
+
+// 固定种子的伪随机数 (切分点可重现)
+uint64_t nextRandom(uint64_t& state) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return state >> 33;
+}
+
+} // namespace
+
+int main() {
+    // 强制的实现必须生效，否则这一轮测试并没有覆盖它
+    const char* forced = std::getenv("DESKSNAPSHOT_XXH3");
+    std::vector<uint8_t> data = makeData(DATA_SIZE);
+    xxh3_64(data.data(), 1024);
+    std::string implementation = xxh3Implementation();
+    if (forced && *forced) check(implementation == forced, "实现为 " + implementation + "，期望 " + forced);
+
+    uint64_t state = 42;
+    for (const auto& v : VECTORS) {
+        std::string tag = implementation + " len " + std::to_string(v.len) + ": ";
+        check(xxh3_64(data.data(), v.len) == v.hash, tag + "xxh3_64 与参考值不一致");
+
+        // 逐字节、整块，以及若干组随机切分
+        Xxh3Stream whole;
+        whole.update(data.data(), v.len);
+        check(whole.digest() == v.hash, tag + "Xxh3Stream (一次写入) 与参考值不一致");
+        if (v.len <= 4096) {
+            Xxh3Stream bytes;
+            for (size_t i = 0; i < v.len; ++i) bytes.update(data.data() + i, 1);
+            check(bytes.digest() == v.hash, tag + "Xxh3Stream (逐字节) 与参考值不一致");
+        }
+        for (int round = 0; round < 8; ++round) {
+            Xxh3Stream stream;
+            size_t maxChunk = (round % 2 == 0) ? 300 : 70000;
+            for (size_t offset = 0; offset < v.len;) {
+                size_t chunk = std::min(v.len - offset, (size_t)(nextRandom(state) % maxChunk));
+                stream.update(data.data() + offset, chunk);
+                offset += chunk;
+            }
+            check(stream.digest() == v.hash, tag + "Xxh3Stream (随机切分第 " + std::to_string(round) + " 组) 与参考值不一致");
+        }
+    }
+
+    // hashFile 通过内存映射读取文件
+    fs::path path = fs::temp_directory_path() / ("content_hash_test." + std::to_string(getpid()));
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(data.data()), (std::streamsize)data.size());
+    }
+    const uint64_t expected = VECTORS[sizeof(VECTORS) / sizeof(VECTORS[0]) - 1].hash;
+    uint64_t fileHash = 0;
+    check(hashFile(path, fileHash) && fileHash == expected, implementation + " hashFile 与参考值不一致");
+    fileHash = 0;
+    check(hashStoreObject(path, fileHash) && fileHash == expected, implementation + " hashStoreObject 与参考值不一致");
+
+    // 实时文件: 默认不跟随符号链接，FIFO 等非普通文件直接失败 (不会阻塞)
+    fs::path link = path.string() + ".link";
+    fs::path fifo = path.string() + ".fifo";
+    fs::create_symlink(path, link);
+    check(!hashFile(link, fileHash), "hashFile 跟随了符号链接");
+    check(hashFile(link, fileHash, true) && fileHash == expected, "hashFile (followSymlinks) 与参考值不一致");
+    check(mkfifo(fifo.c_str(), 0600) == 0 && !hashFile(fifo, fileHash, true), "hashFile 接受了 FIFO");
+    fs::remove(link);
+    fs::remove(fifo);
+    fs::remove(path);
+
+    if (g_failures > 0) return 1;
+    std::cout << "content_hash_test (" << implementation << "): OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,96 @@
+// tree_sync 的回归测试:
+// 1. 删除多余条目时父目录和子目录不能同时交给线程池删除
+//    ('.' '-' ' ' 排在 '/' 之前，"Proj.zip" 位于 "Proj" 和 "Proj/sub" 之间)
+// 2. 子项的增删完成后，目录的 mtime 仍与源一致
+#include "../src/tree_sync.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <chrono>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int g_failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAIL: " << what << std::endl;
+        g_failures++;
+    }
+}
+
+void writeFile(const fs::path& path, const std::string& content) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << content;
+}
+
+// 目标中与源无关的多余条目: 同名前缀的目录、文件和深层子目录
+void makeExtras(const fs::path& dest) {
+    for (const char* name : {"Proj", "Proj-2", "Proj 3", "Proj.d"}) {
+        for (int i = 0; i < 16; ++i) {
+            std::string sub = std::to_string(i);
+            writeFile(dest / name / ("sub" + sub) / "deep" / "f.txt", sub);
+            writeFile(dest / name / ("f" + sub), sub);
+        }
+    }
+    writeFile(dest / "Proj.zip", "zip");
+    writeFile(dest / "Proj.d.txt", "txt");
+}
+
+} // namespace
+
+int main() {
+    fs::path root = fs::temp_directory_path() / ("tree_sync_test." + std::to_string(getpid()));
+    fs::path source = root / "source";
+    fs::path dest = root / "dest";
+    writeFile(source / "keep" / "a.txt", "a");
+    writeFile(source / "Proj.keep", "k");
+
+    for (int round = 0; round < 20; ++round) {
+        fs::remove_all(dest);
+        makeExtras(dest);
+        writeFile(dest / "keep" / "stale.txt", "stale");
+
+        SyncOptions options;
+        SyncStats stats;
+        bool ok = syncTree(source, dest, options, &stats);
+        std::string tag = "round " + std::to_string(round) + ": ";
+        check(ok, tag + "syncTree 失败");
+        check(stats.entriesFailed == 0, tag + "entriesFailed = " + std::to_string(stats.entriesFailed));
+        // Proj, Proj 3, Proj-2, Proj.d, Proj.d.txt, Proj.zip, keep/stale.txt
+        check(stats.entriesRemoved == 7, tag + "entriesRemoved = " + std::to_string(stats.entriesRemoved));
+
+        std::vector<std::string> left;
+        for (const auto& e : fs::recursive_directory_iterator(dest)) {
+            left.push_back(fs::relative(e.path(), dest).string());
+        }
+        check(left.size() == 3 && fs::exists(dest / "keep" / "a.txt") && fs::exists(dest / "Proj.keep"),
+              tag + "目标与源不一致 (" + std::to_string(left.size()) + " 个条目)");
+        if (g_failures > 0) break;
+    }
+
+    // 目录 mtime: 源目录设为固定的旧时间，目标中同时有子项被删除和新建
+    fs::remove_all(dest);
+    writeFile(dest / "keep" / "stale.txt", "stale");
+    auto old = fs::file_time_type::clock::now() - std::chrono::hours(24 * 30);
+    fs::last_write_time(source / "keep", old);
+    {
+        SyncOptions options;
+        bool ok = syncTree(source, dest, options, nullptr);
+        check(ok, "mtime: syncTree 失败");
+        check(fs::last_write_time(dest / "keep") == old, "mtime: 已存在目录的 mtime 未恢复");
+        fs::remove_all(dest);
+        ok = syncTree(source, dest, options, nullptr);
+        check(ok && fs::last_write_time(dest / "keep") == old, "mtime: 新建目录的 mtime 未恢复");
+    }
+
+    fs::remove_all(root);
+    if (g_failures > 0) return 1;
+    std::cout << "tree_sync_test: OK" << std::endl;
+    return 0;
+}